@@ -0,0 +1,71 @@
+dnl Check for PCRE2 Libraries
+dnl CHECK_PCRE2(ACTION-IF-FOUND [, ACTION-IF-NOT-FOUND])
+dnl Sets:
+dnl  PCRE2_CFLAGS
+dnl  PCRE2_LDADD
+
+PCRE2_CONFIG=""
+PCRE2_VERSION=""
+PCRE2_CFLAGS=""
+PCRE2_LDADD=""
+
+AC_DEFUN([CHECK_PCRE2],
+[dnl
+
+AC_ARG_WITH(
+    pcre2,
+    [AC_HELP_STRING([--with-pcre2=PATH],[Path to pcre2 prefix or config script])],
+    [test_paths="${with_pcre2}"],
+    [test_paths="/usr/local/pcre2 /usr/local /usr /opt/local"])
+
+AC_MSG_CHECKING([for libpcre2 config script])
+
+for x in ${test_paths}; do
+    dnl # Determine if the script was specified and use it directly
+    if test ! -d "$x" -a -e "$x"; then
+        PCRE2_CONFIG=$x
+        pcre2_path="no"
+        break
+    fi
+
+    dnl # Try known config script names/locations
+    PCRE2_CONFIG=pcre2-config
+    if test -e "${x}/bin/${PCRE2_CONFIG}"; then
+        pcre2_path="${x}/bin"
+        break
+    elif test -e "${x}/${PCRE2_CONFIG}"; then
+        pcre2_path="${x}"
+        break
+    else
+        pcre2_path=""
+    fi
+done
+
+if test "${with_pcre2}" != "no" -a -n "${pcre2_path}"; then
+    if test "${pcre2_path}" != "no"; then
+        PCRE2_CONFIG="${pcre2_path}/${PCRE2_CONFIG}"
+    fi
+    AC_MSG_RESULT([${PCRE2_CONFIG}])
+    PCRE2_VERSION="`${PCRE2_CONFIG} --version`"
+    if test "$verbose_output" -eq 1; then AC_MSG_NOTICE(pcre2 VERSION: $PCRE2_VERSION); fi
+    PCRE2_CFLAGS="`${PCRE2_CONFIG} --cflags`"
+    if test "$verbose_output" -eq 1; then AC_MSG_NOTICE(pcre2 CFLAGS: $PCRE2_CFLAGS); fi
+    PCRE2_LDADD="`${PCRE2_CONFIG} --libs8`"
+    if test "$verbose_output" -eq 1; then AC_MSG_NOTICE(pcre2 LDADD: $PCRE2_LDADD); fi
+else
+    AC_MSG_RESULT([no])
+fi
+
+AC_SUBST(PCRE2_CONFIG)
+AC_SUBST(PCRE2_VERSION)
+AC_SUBST(PCRE2_CFLAGS)
+AC_SUBST(PCRE2_LDADD)
+
+if test -z "${PCRE2_VERSION}"; then
+    AC_MSG_NOTICE([*** pcre2 library not found.])
+    ifelse([$2], , AC_MSG_ERROR([pcre2 library is required]), $2)
+else
+    AC_MSG_NOTICE([using pcre2 v${PCRE2_VERSION}])
+    ifelse([$1], , , $1)
+fi
+])
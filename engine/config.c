@@ -35,6 +35,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
 
 
 #include <ironbee/engine.h>
@@ -155,6 +157,8 @@ ib_status_t ib_cfgparser_parse(ib_cfgparser_t *cp,
     uint8_t buf[8192];
     uint8_t *buf_end = buf + sizeof(buf);
     uint8_t *buf_mark = buf;
+    const char *prev_file = cp->cur_file;
+    unsigned int prev_lineno = cp->cur_lineno;
     ssize_t nbytes;
     ib_status_t rc = IB_OK;
 
@@ -165,6 +169,11 @@ ib_status_t ib_cfgparser_parse(ib_cfgparser_t *cp,
         IB_FTRACE_RET_STATUS(IB_EINVAL);
     }
 
+    /* Track the location so that directives can refer to it. */
+    cp->cur_file = (const char *)ib_mpool_memdup(cp->mp, file,
+                                                 strlen(file) + 1);
+    cp->cur_lineno = 0;
+
 #define bufremain (sizeof(buf) - (buf_mark - buf) + 1)
 
     while ((nbytes = read(fd, buf_mark, bufremain))) {
@@ -200,12 +209,24 @@ ib_status_t ib_cfgparser_parse(ib_cfgparser_t *cp,
             /* Process a line of input. */
             if (*chunk_end == '\n') {
                 size_t chunk_len = (chunk_end - chunk_start) + 1;
+                uint8_t *nl;
+
+                /* A chunk may start with blank lines, so any directive
+                 * is on the last line of it.
+                 */
+                for (nl = chunk_start; nl <= chunk_end; nl++) {
+                    if (*nl == '\n') {
+                        cp->cur_lineno++;
+                    }
+                }
 
                 /// @todo Make the parser type configurable
                 ib_log_debug(cp->ib, 9, "Parsing %d byte chunk", (int)chunk_len);
                 rc = ib_cfgparser_ragel_parse_chunk(cp, chunk_start, chunk_len);
                 if (rc != IB_OK) {
-                    ib_log_error(cp->ib, 1, "Error parsing config file: %d", rc);
+                    ib_log_error(cp->ib, 1, "Error parsing config file "
+                                 "\"%s\" at line %u: %d",
+                                 file, cp->cur_lineno, rc);
                     IB_FTRACE_RET_STATUS(rc);
                 }
 
@@ -228,6 +249,11 @@ ib_status_t ib_cfgparser_parse(ib_cfgparser_t *cp,
     ib_log_debug(cp->ib, 9, "Done reading config \"%s\" via fd=%d errno=%d", file, fd, errno);
 
     cfgp_dump(cp);
+
+    /* Restore the location of any including file. */
+    cp->cur_file = prev_file;
+    cp->cur_lineno = prev_lineno;
+
     IB_FTRACE_RET_STATUS(rc);
 }
 
@@ -578,6 +604,8 @@ ib_status_t ib_site_create(ib_site_t **psite,
 {
     IB_FTRACE_INIT(ib_site_create);
     ib_mpool_t *pool = ib->config_mp;
+    char *stat_name;
+    size_t nlen = strlen(name);
     ib_status_t rc;
 
     /* Create the main structure in the config memory pool */
@@ -590,6 +618,16 @@ ib_status_t ib_site_create(ib_site_t **psite,
     (*psite)->mp = pool;
     (*psite)->name = (const char *)ib_mpool_memdup(pool, name, strlen(name)+1);
 
+    /* Count context selections for the site. */
+    stat_name = (char *)ib_mpool_alloc(pool, nlen + sizeof("site..selected"));
+    if (stat_name == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    sprintf(stat_name, "site.%s.selected", name);
+    rc = ib_stat_register(ib, stat_name, &(*psite)->stat_selected);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
 
     /* Remaining fields are NULL via calloc. */
 
@@ -714,3 +752,227 @@ ib_status_t ib_site_loc_create_default(ib_site_t *site,
     IB_FTRACE_RET_STATUS(IB_OK);
 }
 
+
+/* -- Configuration Jobs -- */
+
+/** Maximum number of threads running configuration jobs. */
+#define CFGJOB_THREADS_MAX 64
+
+typedef struct cfgjob_t cfgjob_t;
+typedef struct cfgjob_worker_t cfgjob_worker_t;
+
+/**
+ * @internal
+ * Configuration job.
+ */
+struct cfgjob_t {
+    ib_cfgjob_fn_t            fn;       /**< Job function */
+    void                     *data;     /**< Job data */
+    const char               *file;     /**< Config file (or NULL) */
+    unsigned int              lineno;   /**< Config line number */
+    ib_status_t               rc;       /**< Job status */
+    const char               *err;      /**< Job error message (or NULL) */
+};
+
+/**
+ * @internal
+ * Configuration job worker.
+ */
+struct cfgjob_worker_t {
+    cfgjob_t                **jobs;     /**< All jobs */
+    size_t                    njobs;    /**< Number of jobs */
+    size_t                   *next;     /**< Next job to run (shared) */
+    ib_mpool_t               *mp;       /**< Worker memory pool */
+    pthread_t                 thread;   /**< Worker thread */
+};
+
+/**
+ * @internal
+ * Run jobs until none are left.
+ *
+ * @param data Worker
+ *
+ * @returns NULL
+ */
+static void *cfgjob_worker(void *data)
+{
+    cfgjob_worker_t *w = (cfgjob_worker_t *)data;
+    size_t i;
+
+    while ((i = __sync_fetch_and_add(w->next, 1)) < w->njobs) {
+        cfgjob_t *job = w->jobs[i];
+
+        job->rc = job->fn(job->data, w->mp, &job->err);
+    }
+
+    return NULL;
+}
+
+/**
+ * @internal
+ * Log the error of a failed job at the location it was added at.
+ *
+ * @param ib Engine
+ * @param job Job
+ */
+static void cfgjob_log(ib_engine_t *ib,
+                       const cfgjob_t *job)
+{
+    const char *err = job->err ? job->err : "Configuration job failed";
+
+    if (job->file != NULL) {
+        ib_log_error(ib, 1, "%s:%u: %s: %d",
+                     job->file, job->lineno, err, job->rc);
+    }
+    else {
+        ib_log_error(ib, 1, "%s: %d", err, job->rc);
+    }
+}
+
+ib_status_t ib_cfgjob_add(ib_engine_t *ib,
+                          const char *file,
+                          unsigned int lineno,
+                          ib_cfgjob_fn_t fn,
+                          void *data)
+{
+    IB_FTRACE_INIT(ib_cfgjob_add);
+    cfgjob_t *job;
+    ib_status_t rc;
+
+    /* Once configuration is finished, jobs are run right away. */
+    if (ib->cfgjobs == NULL) {
+        cfgjob_t now;
+
+        now.file = file;
+        now.lineno = lineno;
+        now.err = NULL;
+        now.rc = fn(data, ib_engine_pool_config_get(ib), &now.err);
+        if (now.rc != IB_OK) {
+            cfgjob_log(ib, &now);
+        }
+        IB_FTRACE_RET_STATUS(now.rc);
+    }
+
+    job = (cfgjob_t *)ib_mpool_calloc(ib->temp_mp, 1, sizeof(*job));
+    if (job == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    job->fn = fn;
+    job->data = data;
+    job->lineno = lineno;
+
+    /* The parser (and so its copy of the file name) may be gone
+     * by the time the job is run.
+     */
+    if (file != NULL) {
+        job->file = (const char *)ib_mpool_memdup(ib->temp_mp, file,
+                                                  strlen(file) + 1);
+        if (job->file == NULL) {
+            IB_FTRACE_RET_STATUS(IB_EALLOC);
+        }
+    }
+
+    rc = ib_list_push(ib->cfgjobs, job);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+ib_status_t ib_cfgjob_run(ib_engine_t *ib)
+{
+    IB_FTRACE_INIT(ib_cfgjob_run);
+    cfgjob_worker_t *workers;
+    cfgjob_t **jobs;
+    ib_list_node_t *node;
+    uint64_t start = ib_stats_clock();
+    size_t njobs;
+    size_t nthreads;
+    size_t started;
+    size_t failed = 0;
+    size_t next = 0;
+    size_t i = 0;
+    long ncpu;
+    ib_status_t rc;
+    ib_status_t jobrc = IB_OK;
+
+    if (ib->cfgjobs == NULL) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+    njobs = ib_list_elements(ib->cfgjobs);
+    if (njobs == 0) {
+        ib->cfgjobs = NULL;
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    jobs = (cfgjob_t **)ib_mpool_alloc(ib->temp_mp, njobs * sizeof(*jobs));
+    if (jobs == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    IB_LIST_LOOP(ib->cfgjobs, node) {
+        jobs[i++] = (cfgjob_t *)ib_list_node_data(node);
+    }
+
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = (ncpu > 0) ? (size_t)ncpu : 1;
+    if (nthreads > CFGJOB_THREADS_MAX) {
+        nthreads = CFGJOB_THREADS_MAX;
+    }
+    if (nthreads > njobs) {
+        nthreads = njobs;
+    }
+
+    workers = (cfgjob_worker_t *)ib_mpool_calloc(ib->temp_mp, nthreads,
+                                                 sizeof(*workers));
+    if (workers == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    /* Each worker allocates from its own pool, created here as pools
+     * are not created thread safely.
+     */
+    for (i = 0; i < nthreads; i++) {
+        workers[i].jobs = jobs;
+        workers[i].njobs = njobs;
+        workers[i].next = &next;
+        rc = ib_mpool_create(&workers[i].mp, ib_engine_pool_config_get(ib));
+        if (rc != IB_OK) {
+            if (i == 0) {
+                IB_FTRACE_RET_STATUS(rc);
+            }
+            nthreads = i;
+            break;
+        }
+    }
+
+    /* This thread is the first worker, so jobs run even if no threads
+     * can be started.
+     */
+    for (started = 1; started < nthreads; started++) {
+        if (pthread_create(&workers[started].thread, NULL,
+                           cfgjob_worker, &workers[started]) != 0)
+        {
+            break;
+        }
+    }
+    cfgjob_worker(&workers[0]);
+    for (i = 1; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    for (i = 0; i < njobs; i++) {
+        if (jobs[i]->rc != IB_OK) {
+            cfgjob_log(ib, jobs[i]);
+            if (failed++ == 0) {
+                jobrc = jobs[i]->rc;
+            }
+        }
+    }
+
+    ib_log_debug(ib, 4, "Ran %zu configuration jobs (%zu failed) on %zu "
+                 "threads in %" PRIu64 "us",
+                 njobs, failed, started,
+                 (ib_stats_clock() - start) / 1000);
+
+    /* Jobs added from now on are run right away. */
+    ib->cfgjobs = NULL;
+
+    IB_FTRACE_RET_STATUS(jobrc);
+}
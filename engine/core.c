@@ -951,6 +951,8 @@ static ib_status_t audit_api_write_log(ib_provider_inst_t *lpi)
         }
     }
 
+    ib_stat_inc(lpi->pr->ib, IB_STAT_AUDITLOGS);
+
     IB_FTRACE_RET_STATUS(IB_OK);
 }
 
@@ -2737,37 +2739,253 @@ static ib_status_t matcher_api_match_compiled(ib_provider_t *mpr,
  *
  * @param mpi Matcher provider instance
  * @param patt Pattern
+ * @param id Pattern ID
+ * @param errptr Address which any error is written (if non-NULL)
+ * @param erroffset Offset in pattern where the error occurred (if non-NULL)
  *
  * @returns Status code
  */
 static ib_status_t matcher_api_add_pattern(ib_provider_inst_t *mpi,
-                                           const char *patt)
+                                           const char *patt,
+                                           ib_num_t id,
+                                           const char **errptr,
+                                           int *erroffset)
 {
     IB_FTRACE_INIT(matcher_api_add_pattern);
-    IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+    IB_PROVIDER_IFACE_TYPE(matcher) *iface = mpi?(IB_PROVIDER_IFACE_TYPE(matcher) *)mpi->pr->iface:NULL;
+    ib_status_t rc;
+
+    if (iface == NULL) {
+        /// @todo Probably should not need this check
+        ib_util_log_error(0, "Failed to fetch matcher interface");
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+
+    if (iface->add == NULL) {
+        IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+    }
+
+    rc = iface->add(mpi, patt, id, errptr, erroffset);
+    IB_FTRACE_RET_STATUS(rc);
 }
 
 /**
  * @internal
  * Match all the provider instance patterns on a data field.
  *
- * @warning Not yet implemented
- *
  * @param mpi Matcher provider instance
  * @param flags Flags
  * @param data Data buffer
  * @param dlen Data buffer length
+ * @param fn Callback function called for each match (or NULL)
+ * @param cbdata Callback data
  *
  * @returns Status code
  */
 static ib_status_t matcher_api_match(ib_provider_inst_t *mpi,
                                      ib_flags_t flags,
                                      const uint8_t *data,
-                                     size_t dlen)
-                                     
+                                     size_t dlen,
+                                     ib_matcher_callback_fn_t fn,
+                                     void *cbdata)
 {
     IB_FTRACE_INIT(matcher_api_match);
-    IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+    IB_PROVIDER_IFACE_TYPE(matcher) *iface = mpi?(IB_PROVIDER_IFACE_TYPE(matcher) *)mpi->pr->iface:NULL;
+    ib_status_t rc;
+
+    if (iface == NULL) {
+        /// @todo Probably should not need this check
+        ib_util_log_error(0, "Failed to fetch matcher interface");
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+
+    if (iface->match == NULL) {
+        IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+    }
+
+    rc = iface->match(mpi, flags, data, dlen, fn, cbdata);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+/**
+ * @internal
+ * Create the state used to match instance patterns across a stream.
+ *
+ * @param mpi Matcher provider instance
+ * @param pool Memory pool the state is allocated from
+ * @param pstate Address which the state is written
+ *
+ * @returns Status code
+ */
+static ib_status_t matcher_api_stream_create(ib_provider_inst_t *mpi,
+                                             ib_mpool_t *pool,
+                                             void *pstate)
+{
+    IB_FTRACE_INIT(matcher_api_stream_create);
+    IB_PROVIDER_IFACE_TYPE(matcher) *iface = mpi?(IB_PROVIDER_IFACE_TYPE(matcher) *)mpi->pr->iface:NULL;
+    ib_status_t rc;
+
+    if (iface == NULL) {
+        /// @todo Probably should not need this check
+        ib_util_log_error(0, "Failed to fetch matcher interface");
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+
+    if (iface->stream_create == NULL) {
+        IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+    }
+
+    rc = iface->stream_create(mpi, pool, pstate);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+/**
+ * @internal
+ * Match all the provider instance patterns on the next chunk of a stream.
+ *
+ * @param mpi Matcher provider instance
+ * @param state Stream state
+ * @param flags Flags
+ * @param data Data buffer
+ * @param dlen Data buffer length
+ * @param fn Callback function called for each match (or NULL)
+ * @param cbdata Callback data
+ *
+ * @returns Status code
+ */
+static ib_status_t matcher_api_stream_feed(ib_provider_inst_t *mpi,
+                                           void *state,
+                                           ib_flags_t flags,
+                                           const uint8_t *data,
+                                           size_t dlen,
+                                           ib_matcher_callback_fn_t fn,
+                                           void *cbdata)
+{
+    IB_FTRACE_INIT(matcher_api_stream_feed);
+    IB_PROVIDER_IFACE_TYPE(matcher) *iface = mpi?(IB_PROVIDER_IFACE_TYPE(matcher) *)mpi->pr->iface:NULL;
+    ib_status_t rc;
+
+    if (iface == NULL) {
+        /// @todo Probably should not need this check
+        ib_util_log_error(0, "Failed to fetch matcher interface");
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+
+    if (iface->stream_feed == NULL) {
+        IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+    }
+
+    rc = iface->stream_feed(mpi, state, flags, data, dlen, fn, cbdata);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+/**
+ * @internal
+ * Finish matching a stream, reporting any matches that needed the
+ * end of the stream.
+ *
+ * @param mpi Matcher provider instance
+ * @param state Stream state
+ * @param fn Callback function called for each match (or NULL)
+ * @param cbdata Callback data
+ *
+ * @returns Status code
+ */
+static ib_status_t matcher_api_stream_finish(ib_provider_inst_t *mpi,
+                                             void *state,
+                                             ib_matcher_callback_fn_t fn,
+                                             void *cbdata)
+{
+    IB_FTRACE_INIT(matcher_api_stream_finish);
+    IB_PROVIDER_IFACE_TYPE(matcher) *iface = mpi?(IB_PROVIDER_IFACE_TYPE(matcher) *)mpi->pr->iface:NULL;
+    ib_status_t rc;
+
+    if (iface == NULL) {
+        /// @todo Probably should not need this check
+        ib_util_log_error(0, "Failed to fetch matcher interface");
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+
+    if (iface->stream_finish == NULL) {
+        IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+    }
+
+    rc = iface->stream_finish(mpi, state, fn, cbdata);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+/**
+ * @internal
+ * Serialize a compiled pattern so that it can be loaded without
+ * compiling it again.
+ *
+ * @param mpr Matcher provider
+ * @param cpatt Compiled pattern
+ * @param pool Memory pool the buffer is allocated from
+ * @param pbuf Address which the buffer is written
+ * @param plen Address which the buffer length is written
+ *
+ * @returns Status code
+ */
+static ib_status_t matcher_api_serialize_pattern(ib_provider_t *mpr,
+                                                 void *cpatt,
+                                                 ib_mpool_t *pool,
+                                                 const uint8_t **pbuf,
+                                                 size_t *plen)
+{
+    IB_FTRACE_INIT(matcher_api_serialize_pattern);
+    IB_PROVIDER_IFACE_TYPE(matcher) *iface = mpr?(IB_PROVIDER_IFACE_TYPE(matcher) *)mpr->iface:NULL;
+    ib_status_t rc;
+
+    if (iface == NULL) {
+        /// @todo Probably should not need this check
+        ib_util_log_error(0, "Failed to fetch matcher interface");
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+
+    if (iface->serialize == NULL) {
+        IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+    }
+
+    rc = iface->serialize(mpr, cpatt, pool, pbuf, plen);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+/**
+ * @internal
+ * Load a compiled pattern from a buffer written by
+ * matcher_api_serialize_pattern().
+ *
+ * @param mpr Matcher provider
+ * @param pool Memory pool
+ * @param pcpatt Address which compiled pattern is written
+ * @param buf Buffer
+ * @param len Buffer length
+ *
+ * @returns Status code
+ */
+static ib_status_t matcher_api_deserialize_pattern(ib_provider_t *mpr,
+                                                   ib_mpool_t *pool,
+                                                   void *pcpatt,
+                                                   const uint8_t *buf,
+                                                   size_t len)
+{
+    IB_FTRACE_INIT(matcher_api_deserialize_pattern);
+    IB_PROVIDER_IFACE_TYPE(matcher) *iface = mpr?(IB_PROVIDER_IFACE_TYPE(matcher) *)mpr->iface:NULL;
+    ib_status_t rc;
+
+    if (iface == NULL) {
+        /// @todo Probably should not need this check
+        ib_util_log_error(0, "Failed to fetch matcher interface");
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+
+    if (iface->deserialize == NULL) {
+        IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+    }
+
+    rc = iface->deserialize(mpr, pool, pcpatt, buf, len);
+    IB_FTRACE_RET_STATUS(rc);
 }
 
 /**
@@ -2779,6 +2997,11 @@ static IB_PROVIDER_API_TYPE(matcher) matcher_api = {
     matcher_api_match_compiled,
     matcher_api_add_pattern,
     matcher_api_match,
+    matcher_api_stream_create,
+    matcher_api_stream_feed,
+    matcher_api_stream_finish,
+    matcher_api_serialize_pattern,
+    matcher_api_deserialize_pattern,
 };
 
 /**
@@ -2907,6 +3130,66 @@ static ib_status_t filter_ctl_config(ib_engine_t *ib,
 
 /* -- Transformations -- */
 
+/**
+ * @internal
+ * Check for whitespace (as isspace() in the "C" locale, which does
+ * not depend on the process locale).
+ */
+#define CORE_ISSPACE(c) \
+    (((c) == ' ') || (((c) >= '\t') && ((c) <= '\r')))
+
+/**
+ * @internal
+ * ASCII lowercase byte map (built on first use).
+ */
+static uint8_t core_lowercase_map[256];
+
+/**
+ * @internal
+ * Fusable stages for the lowercase transformation.
+ */
+static const ib_tfn_fuse_t core_fuse_lowercase[] = {
+    { IB_TFN_FUSE_MAP, core_lowercase_map, NULL, NULL },
+    { IB_TFN_FUSE_END, NULL, NULL, NULL }
+};
+
+/**
+ * @internal
+ * Fusable stages for the compressWhitespace transformation.
+ */
+static const ib_tfn_fuse_t core_fuse_compress_ws[] = {
+    { IB_TFN_FUSE_COMPRESS_WS, NULL, NULL, NULL },
+    { IB_TFN_FUSE_END, NULL, NULL, NULL }
+};
+
+/**
+ * @internal
+ * Fusable stages for the trimLeft transformation.
+ */
+static const ib_tfn_fuse_t core_fuse_trimleft[] = {
+    { IB_TFN_FUSE_TRIM_LEFT, NULL, NULL, NULL },
+    { IB_TFN_FUSE_END, NULL, NULL, NULL }
+};
+
+/**
+ * @internal
+ * Fusable stages for the trimRight transformation.
+ */
+static const ib_tfn_fuse_t core_fuse_trimright[] = {
+    { IB_TFN_FUSE_TRIM_RIGHT, NULL, NULL, NULL },
+    { IB_TFN_FUSE_END, NULL, NULL, NULL }
+};
+
+/**
+ * @internal
+ * Fusable stages for the trim transformation.
+ */
+static const ib_tfn_fuse_t core_fuse_trim[] = {
+    { IB_TFN_FUSE_TRIM_LEFT, NULL, NULL, NULL },
+    { IB_TFN_FUSE_TRIM_RIGHT, NULL, NULL, NULL },
+    { IB_TFN_FUSE_END, NULL, NULL, NULL }
+};
+
 /**
  * @internal
  * Simple ASCII lowercase function.
@@ -2921,9 +3204,6 @@ static ib_status_t core_tfn_lowercase(void *fndata,
                                       size_t *dlen_out,
                                       ib_flags_t *pflags)
 {
-    size_t i = 0;
-    int modified = 0;
-
     /* This is an in-place transformation which does not change
      * the data length.
      */
@@ -2931,18 +3211,8 @@ static ib_status_t core_tfn_lowercase(void *fndata,
     *dlen_out = dlen_in;
     (*pflags) |= IB_TFN_FINPLACE;
 
-    while(i < dlen_in) {
-        int c = data_in[i];
-        (*data_out)[i] = tolower(c);
-        if (c != (*data_out)[i]) {
-            modified++;
-        }
-        i++;
-    }
-
-    if (modified != 0) {
+    if (ib_strops_lower(data_in, dlen_in)) {
         (*pflags) |= IB_TFN_FMODIFIED;
-        (*data_out)[*dlen_out] = '\0';
     }
 
     return IB_OK;
@@ -2951,6 +3221,9 @@ static ib_status_t core_tfn_lowercase(void *fndata,
 /**
  * @internal
  * Simple ASCII trimLeft function.
+ *
+ * The result aliases the input, so this is not in-place if data
+ * is trimmed.
  */
 static ib_status_t core_tfn_trimleft(void *fndata,
                                      ib_mpool_t *pool,
@@ -2960,24 +3233,17 @@ static ib_status_t core_tfn_trimleft(void *fndata,
                                      size_t *dlen_out,
                                      ib_flags_t *pflags)
 {
-    size_t i = 0;
+    size_t i = ib_strops_wsleft(data_in, dlen_in);
 
-    /* This is an in-place transformation which may change
-     * the data length.
-     */
-    (*pflags) |= IB_TFN_FINPLACE;
+    *data_out = data_in + i;
+    *dlen_out = dlen_in - i;
 
-    while(i < dlen_in) {
-        if (isspace(data_in[i]) == 0) {
-            *data_out = data_in + i;
-            *dlen_out = dlen_in - i;
-            (*pflags) |= IB_TFN_FMODIFIED;
-            return IB_OK;
-        }
-        i++;
+    if (i == 0) {
+        (*pflags) |= IB_TFN_FINPLACE;
+    }
+    else {
+        (*pflags) |= IB_TFN_FMODIFIED;
     }
-    *dlen_out = 0;
-    *data_out = data_in;
 
     return IB_OK;
 }
@@ -2985,6 +3251,9 @@ static ib_status_t core_tfn_trimleft(void *fndata,
 /**
  * @internal
  * Simple ASCII trimRight function.
+ *
+ * The result aliases the input, so this is not in-place if data
+ * is trimmed.
  */
 static ib_status_t core_tfn_trimright(void *fndata,
                                       ib_mpool_t *pool,
@@ -2994,24 +3263,19 @@ static ib_status_t core_tfn_trimright(void *fndata,
                                       size_t *dlen_out,
                                       ib_flags_t *pflags)
 {
-    size_t i = dlen_in - 1;
+    size_t i = ib_strops_wsright(data_in, dlen_in);
 
-    /* This is an in-place transformation which may change
-     * the data length.
-     */
     *data_out = data_in;
-    (*pflags) |= IB_TFN_FINPLACE;
+    *dlen_out = i;
 
-    while(i > 0) {
-        if (isspace(data_in[i]) == 0) {
-            (*pflags) |= IB_TFN_FMODIFIED;
-            (*data_out)[*dlen_out] = '\0';
-            *dlen_out = i + 1;
-            return IB_OK;
-        }
-        i--;
+    if (i == dlen_in) {
+        (*pflags) |= IB_TFN_FINPLACE;
+    }
+    else {
+        /* Trimmed bytes are within the buffer, so terminate. */
+        (*pflags) |= IB_TFN_FMODIFIED;
+        data_in[i] = '\0';
     }
-    *dlen_out = 0;
 
     return IB_OK;
 }
@@ -3028,57 +3292,1023 @@ static ib_status_t core_tfn_trim(void *fndata,
                                  size_t *dlen_out,
                                  ib_flags_t *pflags)
 {
+    ib_flags_t lflags = IB_TFN_FNONE;
+    ib_flags_t rflags = IB_TFN_FNONE;
     ib_status_t rc;
 
     /* Just call the other trim functions. */
     rc = core_tfn_trimleft(fndata, pool, data_in, dlen_in, data_out, dlen_out,
-                           pflags);
-    if (IB_OK != IB_OK) {
+                           &lflags);
+    if (rc != IB_OK) {
         return rc;
     }
-    rc = core_tfn_trimleft(fndata, pool, *data_out, *dlen_out, data_out, dlen_out,
-                           pflags);
-    return rc;
-}
+    rc = core_tfn_trimright(fndata, pool, *data_out, *dlen_out,
+                            data_out, dlen_out, &rflags);
 
+    /* Only in-place if neither side was trimmed. */
+    (*pflags) |= (lflags | rflags) & IB_TFN_FMODIFIED;
+    if (!IB_TFN_CHECK_FMODIFIED(*pflags)) {
+        (*pflags) |= IB_TFN_FINPLACE;
+    }
 
-/* -- Directive Handlers -- */
+    return rc;
+}
 
 /**
  * @internal
- * Make an absolute filename out of a base directory and relative filename.
- *
- * @todo Needs to not assume the trailing slash will be there.
- * 
- * @param ib Engine
- * @param basedir Base directory
- * @param file Relative filename
- * @param pabsfile Address which absolute path is written
+ * Simple ASCII compressWhitespace function.
  *
- * @returns Status code
+ * Each run of whitespace is replaced with a single space.
  */
-static ib_status_t core_abs_module_path(ib_engine_t *ib,
-                                        const char *basedir,
-                                        const char *file,
-                                        char **pabsfile)
+static ib_status_t core_tfn_compress_ws(void *fndata,
+                                        ib_mpool_t *pool,
+                                        uint8_t *data_in,
+                                        size_t dlen_in,
+                                        uint8_t **data_out,
+                                        size_t *dlen_out,
+                                        ib_flags_t *pflags)
 {
-    IB_FTRACE_INIT(core_abs_module_path);
-    ib_mpool_t *pool = ib_engine_pool_config_get(ib);
-    
-    *pabsfile = (char *)ib_mpool_alloc(pool, strlen(basedir) + 1 + strlen(file) + 1);
-    if (*pabsfile == NULL) {
-        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    size_t i;
+    size_t o = 0;
+    int ws = 0;
+    int modified = 0;
+
+    /* This is an in-place transformation which may shorten
+     * the data.
+     */
+    for (i = 0; i < dlen_in; i++) {
+        uint8_t c = data_in[i];
+
+        if (CORE_ISSPACE(c)) {
+            if (ws) {
+                modified = 1;
+                continue;
+            }
+            ws = 1;
+            if (c != ' ') {
+                modified = 1;
+                c = ' ';
+            }
+        }
+        else {
+            ws = 0;
+        }
+        data_in[o++] = c;
     }
 
-    strcpy(*pabsfile, basedir);
-    strcat(*pabsfile, file);
+    *data_out = data_in;
+    *dlen_out = o;
 
-    IB_FTRACE_RET_STATUS(IB_OK);
+    if (!modified) {
+        (*pflags) |= IB_TFN_FINPLACE;
+    }
+    else {
+        /* Shortened data is not updated in-place, so the
+         * field value is updated with the new length.
+         */
+        (*pflags) |= IB_TFN_FMODIFIED;
+        if (o < dlen_in) {
+            data_in[o] = '\0';
+        }
+    }
+
+    return IB_OK;
 }
 
 /**
  * @internal
- * Handle the start of a Site block.
+ * Decoder used by the decoding transformations.
+ */
+typedef struct {
+    int (*decode)(uint8_t *data, size_t dlen, size_t *pdlen);
+    int (*decode_ex)(uint8_t *data, size_t dlen, size_t *pdlen,
+                     size_t *pconsumed);
+} core_decoder_t;
+
+/**
+ * @internal
+ * Path decoder (windows separators not converted).
+ */
+static int core_decode_path(uint8_t *data, size_t dlen, size_t *pdlen)
+{
+    return ib_decode_path(data, dlen, pdlen, 0);
+}
+
+/**
+ * @internal
+ * Path decoder (windows separators converted).
+ */
+static int core_decode_path_win(uint8_t *data, size_t dlen, size_t *pdlen)
+{
+    return ib_decode_path(data, dlen, pdlen, 1);
+}
+
+static const core_decoder_t core_decoder_url =
+    { ib_decode_url, ib_decode_url_ex };
+static const core_decoder_t core_decoder_hex =
+    { ib_decode_hex, ib_decode_hex_ex };
+static const core_decoder_t core_decoder_base64 =
+    { ib_decode_base64, NULL };
+static const core_decoder_t core_decoder_html =
+    { ib_decode_html_entity, ib_decode_html_entity_ex };
+static const core_decoder_t core_decoder_js =
+    { ib_decode_js, ib_decode_js_ex };
+static const core_decoder_t core_decoder_css =
+    { ib_decode_css, ib_decode_css_ex };
+static const core_decoder_t core_decoder_path =
+    { core_decode_path, NULL };
+static const core_decoder_t core_decoder_path_win =
+    { core_decode_path_win, NULL };
+
+/**
+ * @internal
+ * Decoding transformation.
+ *
+ * The decoder is passed as the fndata. Decoded data is never longer
+ * than the input, so this decodes in-place, but is flagged as not
+ * in-place if the length changed so that the field is updated.
+ */
+static ib_status_t core_tfn_decode(void *fndata,
+                                   ib_mpool_t *pool,
+                                   uint8_t *data_in,
+                                   size_t dlen_in,
+                                   uint8_t **data_out,
+                                   size_t *dlen_out,
+                                   ib_flags_t *pflags)
+{
+    const core_decoder_t *dec = (const core_decoder_t *)fndata;
+
+    *data_out = data_in;
+
+    if (!dec->decode(data_in, dlen_in, dlen_out)) {
+        (*pflags) |= IB_TFN_FINPLACE;
+        return IB_OK;
+    }
+
+    (*pflags) |= IB_TFN_FMODIFIED;
+    if (*dlen_out == dlen_in) {
+        (*pflags) |= IB_TFN_FINPLACE;
+    }
+    else {
+        data_in[*dlen_out] = '\0';
+    }
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Streaming decoding transformation update.
+ *
+ * Escapes which may continue in the next chunk are left unconsumed.
+ */
+static ib_status_t core_stream_decode_update(void *fndata,
+                                             void *state,
+                                             uint8_t *data,
+                                             size_t dlen,
+                                             size_t *pdlen,
+                                             size_t *pconsumed)
+{
+    const core_decoder_t *dec = (const core_decoder_t *)fndata;
+
+    dec->decode_ex(data, dlen, pdlen, pconsumed);
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Streaming decoding transformation finish.
+ */
+static ib_status_t core_stream_decode_finish(void *fndata,
+                                             void *state,
+                                             uint8_t *data,
+                                             size_t dlen,
+                                             size_t *pdlen)
+{
+    const core_decoder_t *dec = (const core_decoder_t *)fndata;
+
+    dec->decode(data, dlen, pdlen);
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Streaming functions for decoders supporting chunked decoding.
+ */
+static const ib_tfn_stream_fns_t core_stream_decode = {
+    0,
+    NULL,
+    core_stream_decode_update,
+    core_stream_decode_finish
+};
+
+/**
+ * @internal
+ * Streaming base64 decode update.
+ *
+ * All data is consumed, with the decoder state carried instead.
+ */
+static ib_status_t core_stream_base64_update(void *fndata,
+                                             void *state,
+                                             uint8_t *data,
+                                             size_t dlen,
+                                             size_t *pdlen,
+                                             size_t *pconsumed)
+{
+    ib_decode_base64_ex(data, dlen, pdlen,
+                        (ib_decode_base64_state_t *)state);
+    *pconsumed = dlen;
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Streaming base64 decode finish.
+ */
+static ib_status_t core_stream_base64_finish(void *fndata,
+                                             void *state,
+                                             uint8_t *data,
+                                             size_t dlen,
+                                             size_t *pdlen)
+{
+    ib_decode_base64_ex(data, dlen, pdlen,
+                        (ib_decode_base64_state_t *)state);
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Streaming functions for base64 decoding.
+ */
+static const ib_tfn_stream_fns_t core_stream_base64 = {
+    sizeof(ib_decode_base64_state_t),
+    NULL,
+    core_stream_base64_update,
+    core_stream_base64_finish
+};
+
+/**
+ * @internal
+ * URL decoder states (for fusing).
+ */
+enum {
+    CORE_URL_NORMAL,                      /**< Not in an escape */
+    CORE_URL_PCT,                         /**< After a '%' */
+    CORE_URL_HEX,                         /**< In a %XX escape */
+    CORE_URL_UNI                          /**< In a %uXXXX escape */
+};
+
+/**
+ * @internal
+ * Fusable URL decoder flush function.
+ */
+static size_t core_fuse_url_flush(ib_tfn_fuse_dstate_t *ds,
+                                  uint8_t *out)
+{
+    size_t n = ds->blen;
+
+    /* An incomplete escape is left as-is. */
+    memcpy(out, ds->buf, n);
+    ds->blen = 0;
+    ds->state = CORE_URL_NORMAL;
+
+    return n;
+}
+
+/**
+ * @internal
+ * Fusable URL decoder step function.
+ *
+ * This decodes the same as ib_decode_url(), but a byte at a time.
+ */
+static size_t core_fuse_url_decode(ib_tfn_fuse_dstate_t *ds,
+                                   uint8_t c,
+                                   uint8_t *out)
+{
+    size_t n = 0;
+    uint32_t val;
+    size_t i;
+
+    for (;;) {
+        switch (ds->state) {
+            case CORE_URL_NORMAL:
+                if (c == '%') {
+                    ds->buf[ds->blen++] = c;
+                    ds->state = CORE_URL_PCT;
+                }
+                else {
+                    out[n++] = (c == '+') ? ' ' : c;
+                }
+                return n;
+
+            case CORE_URL_PCT:
+                if ((c | 0x20) == 'u') {
+                    ds->buf[ds->blen++] = c;
+                    ds->state = CORE_URL_UNI;
+                    return n;
+                }
+                if (ib_decode_hexval(c) >= 0) {
+                    ds->buf[ds->blen++] = c;
+                    ds->state = CORE_URL_HEX;
+                    return n;
+                }
+                break;
+
+            case CORE_URL_HEX:
+                if (ib_decode_hexval(c) >= 0) {
+                    out[n++] = (uint8_t)((ib_decode_hexval(ds->buf[1]) << 4)
+                                         | ib_decode_hexval(c));
+                    ds->blen = 0;
+                    ds->state = CORE_URL_NORMAL;
+                    return n;
+                }
+                break;
+
+            case CORE_URL_UNI:
+                if (ib_decode_hexval(c) >= 0) {
+                    ds->buf[ds->blen++] = c;
+                    if (ds->blen == 6) {
+                        for (val = 0, i = 2; i < 6; i++) {
+                            val = (val << 4)
+                                | (uint32_t)ib_decode_hexval(ds->buf[i]);
+                        }
+                        out[n++] = ib_decode_ucs2(val);
+                        ds->blen = 0;
+                        ds->state = CORE_URL_NORMAL;
+                    }
+                    return n;
+                }
+                break;
+        }
+
+        /* Invalid escape, so write it as-is and then reprocess
+         * the byte as a normal byte.
+         */
+        n += core_fuse_url_flush(ds, out + n);
+    }
+}
+
+/**
+ * @internal
+ * Fusable stages for the urlDecode transformation.
+ */
+static const ib_tfn_fuse_t core_fuse_url[] = {
+    { IB_TFN_FUSE_DECODE, NULL, core_fuse_url_decode, core_fuse_url_flush },
+    { IB_TFN_FUSE_END, NULL, NULL, NULL }
+};
+
+/**
+ * @internal
+ * Define a core transformation, making it fusable and/or streaming.
+ *
+ * @param ib Engine
+ * @param name Name
+ * @param transform Transformation function
+ * @param fndata Transformation function data
+ * @param fuse Fusable stages (END terminated) or NULL if not fusable
+ * @param stream Streaming functions or NULL
+ *
+ * @returns Status code
+ */
+static ib_status_t core_tfn_define(ib_engine_t *ib,
+                                   const char *name,
+                                   ib_tfn_fn_t transform,
+                                   void *fndata,
+                                   const ib_tfn_fuse_t *fuse,
+                                   const ib_tfn_stream_fns_t *stream)
+{
+    ib_tfn_t *tfn;
+    ib_status_t rc;
+
+    rc = ib_tfn_create(ib, name, transform, fndata, &tfn);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    if (fuse != NULL) {
+        rc = ib_tfn_fuse_set(tfn, fuse);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+
+    if (stream != NULL) {
+        rc = ib_tfn_stream_set(tfn, stream);
+    }
+
+    return rc;
+}
+
+
+/* -- Operators -- */
+
+/**
+ * @internal
+ * Get the data of a string field tested by an operator.
+ *
+ * @param f Field
+ * @param pdata Address which the data is written
+ * @param pdlen Address which the data length is written
+ *
+ * @returns Status code (IB_EINVAL if not a string field)
+ */
+static ib_status_t core_op_field_data(ib_field_t *f,
+                                      const uint8_t **pdata,
+                                      size_t *pdlen)
+{
+    switch (f->type) {
+        case IB_FTYPE_BYTESTR:
+            *pdata = ib_bytestr_ptr(ib_field_value_bytestr(f));
+            *pdlen = ib_bytestr_length(ib_field_value_bytestr(f));
+            return IB_OK;
+        case IB_FTYPE_NULSTR:
+            *pdata = (const uint8_t *)ib_field_value_nulstr(f);
+            *pdlen = strlen((const char *)*pdata);
+            return IB_OK;
+        default:
+            return IB_EINVAL;
+    }
+}
+
+/**
+ * @internal
+ * String operator data.
+ */
+typedef struct {
+    const char         *str;      /**< String parameter */
+    size_t              len;      /**< String length */
+} core_op_str_t;
+
+/**
+ * @internal
+ * Create a string operator instance (streq, beginsWith, etc.).
+ */
+static ib_status_t core_op_str_create(ib_engine_t *ib,
+                                      ib_mpool_t *pool,
+                                      const char *params,
+                                      void **pdata)
+{
+    core_op_str_t *d;
+
+    d = (core_op_str_t *)ib_mpool_alloc(pool, sizeof(*d));
+    if (d == NULL) {
+        return IB_EALLOC;
+    }
+    d->str = params;
+    d->len = strlen(params);
+
+    *pdata = d;
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Execute the "streq" operator (field equals the string).
+ */
+static ib_status_t core_op_streq_execute(void *data,
+                                         ib_mpool_t *pool,
+                                         ib_field_t *f)
+{
+    const core_op_str_t *d = (const core_op_str_t *)data;
+    const uint8_t *fdata;
+    size_t flen;
+    ib_status_t rc;
+
+    rc = core_op_field_data(f, &fdata, &flen);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return ((flen == d->len) && (memcmp(fdata, d->str, flen) == 0))
+        ? IB_OK : IB_ENOENT;
+}
+
+/**
+ * @internal
+ * Execute the "streqNoCase" operator (field equals the string,
+ * ignoring ASCII case).
+ */
+static ib_status_t core_op_streq_nocase_execute(void *data,
+                                                ib_mpool_t *pool,
+                                                ib_field_t *f)
+{
+    const core_op_str_t *d = (const core_op_str_t *)data;
+    const uint8_t *fdata;
+    size_t flen;
+    ib_status_t rc;
+
+    rc = core_op_field_data(f, &fdata, &flen);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return ((flen == d->len)
+            && ib_strops_caseeq(fdata, (const uint8_t *)d->str, flen))
+        ? IB_OK : IB_ENOENT;
+}
+
+/**
+ * @internal
+ * Execute the "beginsWith" operator (field starts with the string).
+ */
+static ib_status_t core_op_begins_execute(void *data,
+                                          ib_mpool_t *pool,
+                                          ib_field_t *f)
+{
+    const core_op_str_t *d = (const core_op_str_t *)data;
+    const uint8_t *fdata;
+    size_t flen;
+    ib_status_t rc;
+
+    rc = core_op_field_data(f, &fdata, &flen);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return ((flen >= d->len) && (memcmp(fdata, d->str, d->len) == 0))
+        ? IB_OK : IB_ENOENT;
+}
+
+/**
+ * @internal
+ * Execute the "endsWith" operator (field ends with the string).
+ */
+static ib_status_t core_op_ends_execute(void *data,
+                                        ib_mpool_t *pool,
+                                        ib_field_t *f)
+{
+    const core_op_str_t *d = (const core_op_str_t *)data;
+    const uint8_t *fdata;
+    size_t flen;
+    ib_status_t rc;
+
+    rc = core_op_field_data(f, &fdata, &flen);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return ((flen >= d->len)
+            && (memcmp(fdata + flen - d->len, d->str, d->len) == 0))
+        ? IB_OK : IB_ENOENT;
+}
+
+/**
+ * @internal
+ * Execute the "contains" operator (field contains the string).
+ */
+static ib_status_t core_op_contains_execute(void *data,
+                                            ib_mpool_t *pool,
+                                            ib_field_t *f)
+{
+    const core_op_str_t *d = (const core_op_str_t *)data;
+    const uint8_t *fdata;
+    size_t flen;
+    ib_status_t rc;
+
+    rc = core_op_field_data(f, &fdata, &flen);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    if (d->len == 0) {
+        return IB_OK;
+    }
+
+    return (ib_strops_find(fdata, flen, d->str, d->len) < flen)
+        ? IB_OK : IB_ENOENT;
+}
+
+/** Longest string (with sign) converted to a number by an operator. */
+#define CORE_OP_NUM_MAX          24
+
+/**
+ * @internal
+ * Convert a whole string to a number.
+ *
+ * @param str String (NUL terminated)
+ * @param pnum Address which the number is written
+ *
+ * @returns Status code (IB_EINVAL if not a decimal number)
+ */
+static ib_status_t core_op_str_to_num(const char *str,
+                                      ib_num_t *pnum)
+{
+    char *end;
+    long long n;
+
+    errno = 0;
+    n = strtoll(str, &end, 10);
+    if ((end == str) || (*end != '\0') || (errno != 0)) {
+        return IB_EINVAL;
+    }
+
+    *pnum = (ib_num_t)n;
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Get the numeric value of a field tested by an operator.
+ *
+ * String fields are converted, however a string which is not a
+ * number is not equal to, less or greater than any number.
+ *
+ * @param f Field
+ * @param pnum Address which the number is written
+ *
+ * @returns Status code (IB_ENOENT if not a number)
+ */
+static ib_status_t core_op_field_num(ib_field_t *f,
+                                     ib_num_t *pnum)
+{
+    char buf[CORE_OP_NUM_MAX + 1];
+    const uint8_t *fdata;
+    size_t flen;
+    ib_status_t rc;
+
+    switch (f->type) {
+        case IB_FTYPE_NUM:
+            *pnum = *ib_field_value_num(f);
+            return IB_OK;
+        case IB_FTYPE_UNUM:
+            *pnum = (ib_num_t)*ib_field_value_unum(f);
+            return IB_OK;
+        default:
+            break;
+    }
+
+    rc = core_op_field_data(f, &fdata, &flen);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    if (flen > CORE_OP_NUM_MAX) {
+        return IB_ENOENT;
+    }
+    memcpy(buf, fdata, flen);
+    buf[flen] = '\0';
+
+    return (core_op_str_to_num(buf, pnum) == IB_OK) ? IB_OK : IB_ENOENT;
+}
+
+/**
+ * @internal
+ * Create a numeric compare operator instance (eq, lt, etc.).
+ */
+static ib_status_t core_op_num_create(ib_engine_t *ib,
+                                      ib_mpool_t *pool,
+                                      const char *params,
+                                      void **pdata)
+{
+    ib_num_t *d;
+    ib_status_t rc;
+
+    d = (ib_num_t *)ib_mpool_alloc(pool, sizeof(*d));
+    if (d == NULL) {
+        return IB_EALLOC;
+    }
+
+    rc = core_op_str_to_num(params, d);
+    if (rc != IB_OK) {
+        ib_log_error(ib, 1, "Operator parameter is not a number: %s",
+                     params);
+        return rc;
+    }
+
+    *pdata = d;
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Define a numeric compare operator execute function.
+ *
+ * @param name Function name suffix
+ * @param cmp Comparison operator
+ */
+#define CORE_OP_NUM_EXECUTE(name, cmp) \
+    static ib_status_t core_op_##name##_execute(void *data, \
+                                                ib_mpool_t *pool, \
+                                                ib_field_t *f) \
+    { \
+        ib_num_t n; \
+        ib_status_t rc = core_op_field_num(f, &n); \
+        if (rc != IB_OK) { \
+            return rc; \
+        } \
+        return (n cmp *(const ib_num_t *)data) ? IB_OK : IB_ENOENT; \
+    }
+
+CORE_OP_NUM_EXECUTE(eq, ==)
+CORE_OP_NUM_EXECUTE(ne, !=)
+CORE_OP_NUM_EXECUTE(lt, <)
+CORE_OP_NUM_EXECUTE(le, <=)
+CORE_OP_NUM_EXECUTE(gt, >)
+CORE_OP_NUM_EXECUTE(ge, >=)
+
+/** Separators of the words in a list parameter. */
+#define CORE_OP_WORD_SEP         " \t,"
+
+/**
+ * @internal
+ * Network operator data.
+ *
+ * IPv4 and IPv6 networks are kept apart so that an address can never
+ * match a network of the other family; the exception is an IPv4-mapped
+ * IPv6 address (::ffff:a.b.c.d), which is the IPv4 address of a client
+ * of a dual-stack server and so also matches the IPv4 networks.
+ */
+typedef struct {
+    ib_radix_t         *ipv4;     /**< IPv4 networks */
+    ib_radix_t         *ipv6;     /**< IPv6 networks */
+} core_op_ip_t;
+
+/** Longest address (IPv6 with a mask) tested by "ipMatch". */
+#define CORE_OP_IP_MAX           48
+
+/**
+ * @internal
+ * Create an "ipMatch" operator instance from a list of networks
+ * (address or address/bits).
+ */
+static ib_status_t core_op_ip_create(ib_engine_t *ib,
+                                     ib_mpool_t *pool,
+                                     const char *params,
+                                     void **pdata)
+{
+    core_op_ip_t *d;
+    char *copy;
+    char *word;
+    char *state;
+    ib_status_t rc;
+
+    d = (core_op_ip_t *)ib_mpool_alloc(pool, sizeof(*d));
+    copy = (char *)ib_mpool_memdup(pool, params, strlen(params) + 1);
+    if ((d == NULL) || (copy == NULL)) {
+        return IB_EALLOC;
+    }
+    rc = ib_radix_new(&d->ipv4, NULL, NULL, NULL, pool);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_radix_new(&d->ipv6, NULL, NULL, NULL, pool);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    for (word = strtok_r(copy, CORE_OP_WORD_SEP, &state);
+         word != NULL;
+         word = strtok_r(NULL, CORE_OP_WORD_SEP, &state))
+    {
+        ib_radix_prefix_t *prefix;
+
+        if (strlen(word) > CORE_OP_IP_MAX) {
+            rc = IB_EINVAL;
+        }
+        else {
+            rc = ib_radix_ip_to_prefix(word, &prefix, pool);
+        }
+        if (rc != IB_OK) {
+            ib_log_error(ib, 1, "Invalid network for ipMatch: %s", word);
+            return IB_EINVAL;
+        }
+
+        rc = ib_radix_insert_data((strchr(word, ':') != NULL) ? d->ipv6
+                                                              : d->ipv4,
+                                  prefix, d);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+
+    *pdata = d;
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Execute the "ipMatch" operator (field is an address within any
+ * of the networks, with IPv4-mapped IPv6 addresses also tested as IPv4).
+ */
+static ib_status_t core_op_ip_execute(void *data,
+                                      ib_mpool_t *pool,
+                                      ib_field_t *f)
+{
+    const core_op_ip_t *d = (const core_op_ip_t *)data;
+    char buf[CORE_OP_IP_MAX + 1];
+    struct in6_addr a6;
+    ib_radix_prefix_t *prefix;
+    const uint8_t *fdata;
+    size_t flen;
+    void *result;
+    ib_status_t rc;
+
+    rc = core_op_field_data(f, &fdata, &flen);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    if ((flen == 0) || (flen > CORE_OP_IP_MAX)) {
+        return IB_ENOENT;
+    }
+    memcpy(buf, fdata, flen);
+    buf[flen] = '\0';
+
+    /* Not an address. */
+    if (ib_radix_ip_to_prefix(buf, &prefix, pool) != IB_OK) {
+        return IB_ENOENT;
+    }
+
+    if (strchr(buf, ':') == NULL) {
+        rc = ib_radix_match_closest(d->ipv4, prefix, &result);
+        return (rc == IB_OK) ? IB_OK : IB_ENOENT;
+    }
+
+    rc = ib_radix_match_closest(d->ipv6, prefix, &result);
+    if (rc == IB_OK) {
+        return IB_OK;
+    }
+
+    /* An IPv4-mapped address is also tested as the IPv4 address. */
+    if (   (inet_pton(AF_INET6, buf, &a6) != 1)
+        || !IN6_IS_ADDR_V4MAPPED(&a6))
+    {
+        return IB_ENOENT;
+    }
+    rc = ib_radix_prefix_create(&prefix, &a6.s6_addr[12], 32, pool);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_radix_match_closest(d->ipv4, prefix, &result);
+
+    return (rc == IB_OK) ? IB_OK : IB_ENOENT;
+}
+
+/**
+ * @internal
+ * Create an "inSet" operator instance from a list of words.
+ */
+static ib_status_t core_op_set_create(ib_engine_t *ib,
+                                      ib_mpool_t *pool,
+                                      const char *params,
+                                      void **pdata)
+{
+    ib_hash_t *set;
+    char *copy;
+    char *word;
+    char *state;
+    ib_status_t rc;
+
+    copy = (char *)ib_mpool_memdup(pool, params, strlen(params) + 1);
+    if (copy == NULL) {
+        return IB_EALLOC;
+    }
+    rc = ib_hash_create(&set, pool);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    /* The hash does not copy keys, so they are left in the copy. */
+    for (word = strtok_r(copy, CORE_OP_WORD_SEP, &state);
+         word != NULL;
+         word = strtok_r(NULL, CORE_OP_WORD_SEP, &state))
+    {
+        rc = ib_hash_set(set, word, word);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+
+    *pdata = set;
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Execute the "inSet" operator (field equals any of the words).
+ */
+static ib_status_t core_op_set_execute(void *data,
+                                       ib_mpool_t *pool,
+                                       ib_field_t *f)
+{
+    const uint8_t *fdata;
+    size_t flen;
+    void *word;
+    ib_status_t rc;
+
+    rc = core_op_field_data(f, &fdata, &flen);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return ib_hash_get_ex((ib_hash_t *)data, (void *)fdata, flen, &word);
+}
+
+/**
+ * @internal
+ * Create a "pm" operator instance from a list of phrases.
+ */
+static ib_status_t core_op_pm_create(ib_engine_t *ib,
+                                     ib_mpool_t *pool,
+                                     const char *params,
+                                     void **pdata)
+{
+    ib_ac_t *ac;
+    char *copy;
+    char *word;
+    char *state;
+    ib_num_t id = 0;
+    ib_status_t rc;
+
+    copy = (char *)ib_mpool_memdup(pool, params, strlen(params) + 1);
+    if (copy == NULL) {
+        return IB_EALLOC;
+    }
+    rc = ib_ac_create(&ac, pool, IB_AC_FNOCASE);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    for (word = strtok_r(copy, CORE_OP_WORD_SEP, &state);
+         word != NULL;
+         word = strtok_r(NULL, CORE_OP_WORD_SEP, &state))
+    {
+        rc = ib_ac_add_pattern(ac, (const uint8_t *)word, strlen(word), id++);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+
+    rc = ib_ac_build(ac);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    *pdata = ac;
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Execute the "pm" operator (field contains any of the phrases,
+ * ignoring ASCII case).
+ */
+static ib_status_t core_op_pm_execute(void *data,
+                                      ib_mpool_t *pool,
+                                      ib_field_t *f)
+{
+    const uint8_t *fdata;
+    size_t flen;
+    ib_status_t rc;
+
+    rc = core_op_field_data(f, &fdata, &flen);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return ib_ac_match((const ib_ac_t *)data, fdata, flen, NULL, NULL);
+}
+
+
+/* -- Directive Handlers -- */
+
+/**
+ * @internal
+ * Make an absolute filename out of a base directory and relative filename.
+ *
+ * @todo Needs to not assume the trailing slash will be there.
+ * 
+ * @param ib Engine
+ * @param basedir Base directory
+ * @param file Relative filename
+ * @param pabsfile Address which absolute path is written
+ *
+ * @returns Status code
+ */
+static ib_status_t core_abs_module_path(ib_engine_t *ib,
+                                        const char *basedir,
+                                        const char *file,
+                                        char **pabsfile)
+{
+    IB_FTRACE_INIT(core_abs_module_path);
+    ib_mpool_t *pool = ib_engine_pool_config_get(ib);
+    
+    *pabsfile = (char *)ib_mpool_alloc(pool, strlen(basedir) + 1 + strlen(file) + 1);
+    if (*pabsfile == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    strcpy(*pabsfile, basedir);
+    strcat(*pabsfile, file);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Handle the start of a Site block.
  *
  * This function sets up the new site and pushes it onto the parser stack.
  *
@@ -3440,6 +4670,40 @@ static ib_status_t core_dir_param1(ib_cfgparser_t *cp,
         rc = ib_context_set_num(ctx, "buffer_res", 0);
         IB_FTRACE_RET_STATUS(rc);
     }
+    else if (strcasecmp("HookTiming", name) == 0) {
+        ib_log_debug(ib, 7, "%s: %s", name, p1);
+        if (strcasecmp("On", p1) == 0) {
+            ib_hook_stats_enable(ib, 1);
+            IB_FTRACE_RET_STATUS(IB_OK);
+        }
+        else if (strcasecmp("Off", p1) == 0) {
+            ib_hook_stats_enable(ib, 0);
+            IB_FTRACE_RET_STATUS(IB_OK);
+        }
+
+        ib_log_error(ib, 1, "Failed to parse directive: %s \"%s\"", name, p1);
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+    else if (strcasecmp("HookTimingDumpInterval", name) == 0) {
+        long secs = strtol(p1, NULL, 0);
+
+        if (secs < 0) {
+            ib_log_error(ib, 1, "Invalid interval: %s \"%s\"", name, p1);
+            IB_FTRACE_RET_STATUS(IB_EINVAL);
+        }
+        ib_log_debug(ib, 7, "%s: %ld", name, secs);
+        ib_hook_stats_dump_interval(ib, (time_t)secs);
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+    else if (strcasecmp("PatternDatabase", name) == 0) {
+        ib_log_debug(ib, 7, "%s: %s", name, p1);
+        rc = ib_matcher_db_open(ib, p1);
+        if (rc != IB_OK) {
+            ib_log_error(ib, 1, "Failed to open pattern database \"%s\": %d",
+                         p1, rc);
+        }
+        IB_FTRACE_RET_STATUS(rc);
+    }
     else if (strcasecmp("SensorId", name) == 0) {
         ib->sensor_id = htonl(strtol(p1, NULL, 0));
         ib_log_debug(ib, 7, "%s: %08x", name, ib->sensor_id);
@@ -3714,6 +4978,25 @@ static IB_DIRMAP_INIT_STRUCTURE(core_directive_map) = {
         NULL
     ),
 
+    /* Statistics */
+    IB_DIRMAP_INIT_PARAM1(
+        "HookTiming",
+        core_dir_param1,
+        NULL
+    ),
+    IB_DIRMAP_INIT_PARAM1(
+        "HookTimingDumpInterval",
+        core_dir_param1,
+        NULL
+    ),
+
+    /* Matchers */
+    IB_DIRMAP_INIT_PARAM1(
+        "PatternDatabase",
+        core_dir_param1,
+        NULL
+    ),
+
     /* Config */
     IB_DIRMAP_INIT_SBLK1(
         "Site",
@@ -3805,6 +5088,7 @@ static ib_status_t core_init(ib_engine_t *ib,
     ib_provider_inst_t *logevent;
     ib_provider_inst_t *parser;
     ib_filter_t *fbuffer;
+    int i;
     ib_status_t rc;
 
     /* Get the core module config. */
@@ -3816,10 +5100,66 @@ static ib_status_t core_init(ib_engine_t *ib,
     }
 
     /* Define transformations. */
-    ib_tfn_create(ib, "lowercase", core_tfn_lowercase, NULL, NULL);
-    ib_tfn_create(ib, "trimLeft", core_tfn_trimleft, NULL, NULL);
-    ib_tfn_create(ib, "trimRight", core_tfn_trimright, NULL, NULL);
-    ib_tfn_create(ib, "trim", core_tfn_trim, NULL, NULL);
+    for (i = 0; i < 256; i++) {
+        core_lowercase_map[i] =
+            ((i >= 'A') && (i <= 'Z')) ? (uint8_t)(i + ('a' - 'A')) : (uint8_t)i;
+    }
+    core_tfn_define(ib, "lowercase", core_tfn_lowercase, NULL,
+                    core_fuse_lowercase, NULL);
+    core_tfn_define(ib, "trimLeft", core_tfn_trimleft, NULL,
+                    core_fuse_trimleft, NULL);
+    core_tfn_define(ib, "trimRight", core_tfn_trimright, NULL,
+                    core_fuse_trimright, NULL);
+    core_tfn_define(ib, "trim", core_tfn_trim, NULL,
+                    core_fuse_trim, NULL);
+    core_tfn_define(ib, "compressWhitespace", core_tfn_compress_ws, NULL,
+                    core_fuse_compress_ws, NULL);
+    core_tfn_define(ib, "urlDecode", core_tfn_decode,
+                    (void *)&core_decoder_url, core_fuse_url, NULL);
+    core_tfn_define(ib, "hexDecode", core_tfn_decode,
+                    (void *)&core_decoder_hex, NULL, &core_stream_decode);
+    core_tfn_define(ib, "base64Decode", core_tfn_decode,
+                    (void *)&core_decoder_base64, NULL, &core_stream_base64);
+    core_tfn_define(ib, "htmlEntityDecode", core_tfn_decode,
+                    (void *)&core_decoder_html, NULL, &core_stream_decode);
+    core_tfn_define(ib, "jsDecode", core_tfn_decode,
+                    (void *)&core_decoder_js, NULL, &core_stream_decode);
+    core_tfn_define(ib, "cssDecode", core_tfn_decode,
+                    (void *)&core_decoder_css, NULL, &core_stream_decode);
+    core_tfn_define(ib, "normalizePath", core_tfn_decode,
+                    (void *)&core_decoder_path, NULL, NULL);
+    core_tfn_define(ib, "normalizePathWin", core_tfn_decode,
+                    (void *)&core_decoder_path_win, NULL, NULL);
+
+    /* Define operators. */
+    ib_operator_create(ib, "streq", core_op_str_create,
+                       core_op_streq_execute, NULL);
+    ib_operator_create(ib, "streqNoCase", core_op_str_create,
+                       core_op_streq_nocase_execute, NULL);
+    ib_operator_create(ib, "beginsWith", core_op_str_create,
+                       core_op_begins_execute, NULL);
+    ib_operator_create(ib, "endsWith", core_op_str_create,
+                       core_op_ends_execute, NULL);
+    ib_operator_create(ib, "contains", core_op_str_create,
+                       core_op_contains_execute, NULL);
+    ib_operator_create(ib, "eq", core_op_num_create,
+                       core_op_eq_execute, NULL);
+    ib_operator_create(ib, "ne", core_op_num_create,
+                       core_op_ne_execute, NULL);
+    ib_operator_create(ib, "lt", core_op_num_create,
+                       core_op_lt_execute, NULL);
+    ib_operator_create(ib, "le", core_op_num_create,
+                       core_op_le_execute, NULL);
+    ib_operator_create(ib, "gt", core_op_num_create,
+                       core_op_gt_execute, NULL);
+    ib_operator_create(ib, "ge", core_op_num_create,
+                       core_op_ge_execute, NULL);
+    ib_operator_create(ib, "ipMatch", core_op_ip_create,
+                       core_op_ip_execute, NULL);
+    ib_operator_create(ib, "inSet", core_op_set_create,
+                       core_op_set_execute, NULL);
+    ib_operator_create(ib, "pm", core_op_pm_create,
+                       core_op_pm_execute, NULL);
 
     /* Define the logger provider API. */
     rc = ib_provider_define(ib, IB_PROVIDER_TYPE_LOGGER,
@@ -4141,6 +5481,15 @@ static IB_CFGMAP_INIT_STRUCTURE(core_config_map) = {
         MODULE_NAME_STR
     ),
 
+    /* Matcher */
+    IB_CFGMAP_INIT_ENTRY(
+        IB_PROVIDER_TYPE_MATCHER,
+        IB_FTYPE_NULSTR,
+        &core_global_cfg,
+        matcher,
+        "pcre"
+    ),
+
     /* End */
     IB_CFGMAP_INIT_LAST
 };
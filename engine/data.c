@@ -322,3 +322,97 @@ ib_status_t ib_data_tfn_get_ex(ib_provider_inst_t *dpi,
     IB_FTRACE_RET_STATUS(rc);
 }
 
+/**
+ * @internal
+ * Transformation memo key.
+ */
+typedef struct {
+    const ib_field_t   *src;              /**< Source field */
+    size_t              id;               /**< Pipeline ID */
+} ib_tfn_memo_key_t;
+
+ib_status_t ib_tx_data_tfn_get(ib_tx_t *tx,
+                               const char *name,
+                               size_t nlen,
+                               ib_field_t **pf,
+                               const ib_tfn_pipeline_t *pl)
+{
+    IB_FTRACE_INIT(ib_tx_data_tfn_get);
+    ib_field_t *src;
+    ib_status_t rc;
+
+    /* Get the non-tfn field. */
+    rc = ib_data_get_ex(tx->dpi, name, nlen, &src);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    rc = ib_tx_field_tfn_get(tx, src, pf, pl);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+ib_status_t ib_tx_field_tfn_get(ib_tx_t *tx,
+                                ib_field_t *src,
+                                ib_field_t **pf,
+                                const ib_tfn_pipeline_t *pl)
+{
+    IB_FTRACE_INIT(ib_tx_field_tfn_get);
+    ib_engine_t *ib = tx->ib;
+    ib_tfn_memo_key_t key;
+    ib_tfn_memo_key_t *memo_key;
+    ib_flags_t flags;
+    ib_status_t rc;
+
+    /* See if the pipeline was already run on this field. */
+    memset(&key, 0, sizeof(key));
+    key.src = src;
+    key.id = pl->id;
+    if (tx->tfn_memo != NULL) {
+        rc = ib_hash_get_ex(tx->tfn_memo, &key, sizeof(key), pf);
+        if (rc == IB_OK) {
+            IB_FTRACE_RET_STATUS(IB_OK);
+        }
+    }
+    else {
+        rc = ib_hash_create(&tx->tfn_memo, tx->mp);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+    }
+
+    /* Currently this only works for string type fields. */
+    if (   (src->type != IB_FTYPE_NULSTR)
+        && (src->type != IB_FTYPE_BYTESTR))
+    {
+        ib_log_error(ib, 4,
+                     "Cannot transform a non-string based field type=%d",
+                     (int)src->type);
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    /* Copy the field, noting the tfn. */
+    rc = ib_field_copy_ex(pf, tx->mp, src->name, src->nlen, src);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    (*pf)->tfn = (char *)pl->spec;
+
+    ib_log_debug(ib, 7, "TFN: %" IB_BYTESTR_FMT ".t(%s)",
+                 IB_BYTESTRSL_FMT_PARAM(src->name, src->nlen), pl->spec);
+
+    rc = ib_tfn_pipeline_transform_field(pl, *pf, &flags);
+    if (rc != IB_OK) {
+        /// @todo What to do here?  Fail or ignore?
+        ib_log_error(ib, 3, "Transformation failed: %s", pl->spec);
+    }
+
+    /* Memoize the transformed field. */
+    memo_key = (ib_tfn_memo_key_t *)ib_mpool_memdup(tx->mp, &key, sizeof(key));
+    if (memo_key == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    rc = ib_hash_set_ex(tx->tfn_memo, memo_key, sizeof(*memo_key), *pf);
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
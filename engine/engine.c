@@ -42,6 +42,7 @@
 #include <ironbee/plugin.h>
 
 #include "ironbee_private.h"
+#include "ironbee_probes.h"
 
 /* -- Constants -- */
 
@@ -98,6 +99,10 @@ static ib_status_t _ib_context_get(ib_engine_t *ib,
         rc = ctx->fn_ctx(ctx, type, data, ctx->fn_ctx_data);
         if (rc == IB_OK) {
             ib_log_debug(ib, 9, "Selected context %d=%p", (int)i, ctx);
+            if (ctx->fn_ctx == ib_context_siteloc_chooser) {
+                ib_loc_t *loc = (ib_loc_t *)ctx->fn_ctx_data;
+                ib_stat_inc(ib, loc->site->stat_selected);
+            }
             *pctx = ctx;
             break;
         }
@@ -107,6 +112,7 @@ static ib_status_t _ib_context_get(ib_engine_t *ib,
     }
     if (*pctx == NULL) {
         ib_log_debug(ib, 9, "Using engine context");
+        ib_stat_inc(ib, IB_STAT_CTX_MAIN);
         *pctx = ib_context_main(ib);
     }
 
@@ -138,6 +144,12 @@ ib_status_t ib_engine_create(ib_engine_t **pib, void *plugin)
     }
     (*pib)->mp = pool;
 
+    /* Initialize statistics. */
+    rc = ib_stats_init(*pib);
+    if (rc != IB_OK) {
+        goto failed;
+    }
+
     /* Create temporary memory pool */
     rc = ib_mpool_create(&((*pib)->temp_mp), pool);
     if (rc != IB_OK) {
@@ -228,6 +240,34 @@ ib_status_t ib_engine_create(ib_engine_t **pib, void *plugin)
         goto failed;
     }
 
+    /* Create a hash to hold compiled transformation pipelines */
+    rc = ib_hash_create(&((*pib)->tfn_pipelines), (*pib)->mp);
+    if (rc != IB_OK) {
+        goto failed;
+    }
+
+    /* Create a hash to hold operators by name */
+    rc = ib_hash_create(&((*pib)->operators), (*pib)->mp);
+    if (rc != IB_OK) {
+        goto failed;
+    }
+
+    /* Create a hash to share compiled patterns during configuration */
+    rc = ib_hash_create(&((*pib)->matcher_cache), (*pib)->temp_mp);
+    if (rc != IB_OK) {
+        goto failed;
+    }
+    rc = ib_list_create(&((*pib)->matcher_entries), (*pib)->temp_mp);
+    if (rc != IB_OK) {
+        goto failed;
+    }
+
+    /* Create a list of jobs to run when configuration is finished */
+    rc = ib_list_create(&((*pib)->cfgjobs), (*pib)->temp_mp);
+    if (rc != IB_OK) {
+        goto failed;
+    }
+
     /* Initialize the core static module. */
     /// @todo Probably want to do this in a less hard-coded manner.
     rc = ib_module_init(ib_core_module(), *pib);
@@ -251,7 +291,12 @@ failed:
 ib_status_t ib_engine_init(ib_engine_t *ib)
 {
     IB_FTRACE_INIT(ib_init);
+    char buf[64];
     ib_status_t rc = ib_context_init(ib->ectx);
+
+    ib_log_debug(ib, 4, "CPU features: %s",
+                 ib_cpu_features_str(ib_cpu_features(), buf, sizeof(buf)));
+
     IB_FTRACE_RET_STATUS(rc);
 }
 
@@ -317,6 +362,12 @@ void ib_engine_pool_temp_destroy(ib_engine_t *ib)
     IB_FTRACE_INIT(ib_engine_pool_temp_destroy);
     ib_mpool_destroy(ib->temp_mp);
     ib->temp_mp = NULL;
+
+    /* The matcher cache is only used during configuration. */
+    ib->matcher_cache = NULL;
+    ib->matcher_entries = NULL;
+    ib->matcher_db = NULL;
+    ib->cfgjobs = NULL;
     IB_FTRACE_RET_VOID();
 }
 
@@ -328,6 +379,27 @@ void ib_engine_destroy(ib_engine_t *ib)
                ib->plugin->vernum, ib->plugin->abinum,
                ib->plugin->filename, ib->plugin->name, ib);
 
+        if (ib->stats.hook_timing) {
+            ib_hook_stats_dump(ib, 1);
+        }
+
+        /* Finish modules (in reverse load order) while the engine
+         * is still intact.
+         */
+        if (ib->modules != NULL) {
+            size_t i = ib_array_elements(ib->modules);
+
+            while (i-- > 0) {
+                ib_module_t *m;
+
+                if (   (ib_array_get(ib->modules, i, (void *)&m) == IB_OK)
+                    && (m != NULL) && (m->fn_fini != NULL))
+                {
+                    m->fn_fini(ib, m);
+                }
+            }
+        }
+
         ib_mpool_destroy(ib->mp);
     }
     IB_FTRACE_RET_VOID();
@@ -396,6 +468,9 @@ ib_status_t ib_conn_create(ib_engine_t *ib,
         goto failed;
     }
 
+    ib_stat_inc(ib, IB_STAT_CONNS);
+    IB_PROBE1(conn_create, *pconn);
+
     IB_FTRACE_RET_STATUS(IB_OK);
 
 failed:
@@ -588,6 +663,9 @@ ib_status_t ib_tx_create(ib_engine_t *ib,
         ib_log_debug(ib, 9, "Found a pipelined transaction.");
     }
 
+    ib_stat_inc(ib, IB_STAT_TXS);
+    IB_PROBE3(tx_create, *ptx, conn, (*ptx)->id);
+
     IB_FTRACE_RET_STATUS(IB_OK);
 
 failed:
@@ -604,6 +682,8 @@ void ib_tx_destroy(ib_tx_t *tx)
 {
     ib_tx_t *conn_tx = tx->conn->tx;
 
+    IB_PROBE2(tx_destroy, tx, tx->id);
+
     /* Remove transaction from the connection list */
     if (conn_tx == tx) {
         tx->conn->tx = tx->conn->tx->next;
@@ -686,31 +766,39 @@ const char *ib_state_event_name(ib_state_event_type_t event)
 
 /**
  * @internal
- * Notify the engine that an event has occurred.
+ * Run a list of hook callbacks for an event.
  *
- * This is a generic function that handles all types.
+ * If hook timing is enabled, each callback is timed and recorded.
  *
  * @param ib Engine
  * @param event Event
+ * @param hook First hook in the list
  * @param param Parameter (type is event specific)
  *
  * @returns Status code
  */
-static ib_status_t ib_state_notify(ib_engine_t *ib,
-                                   ib_state_event_type_t event,
-                                   void *param)
+static ib_status_t ib_hook_run(ib_engine_t *ib,
+                               ib_state_event_type_t event,
+                               ib_hook_t *hook,
+                               void *param)
 {
-    IB_FTRACE_INIT(ib_state_notify);
-    ib_hook_t *hook = NULL;
+    IB_FTRACE_INIT(ib_hook_run);
     ib_status_t rc = IB_OK;
 
-    hook = ib->ectx->hook[event];
-
-    ib_log_debug(ib, 5, "EVENT: %s", ib_state_event_name(event));
-
     while (hook != NULL) {
         ib_state_hook_fn_t cb = (ib_state_hook_fn_t)hook->callback;
-        rc = cb(ib, param, hook->cdata);
+
+        IB_PROBE3(hook_enter, event, cb,
+                  hook->module ? hook->module->name : IB_DSTR_UNKNOWN);
+        if (ib->stats.hook_timing) {
+            uint64_t start = ib_stats_clock();
+            rc = cb(ib, param, hook->cdata);
+            ib_hook_stats_record(ib, event, hook, ib_stats_clock() - start);
+        }
+        else {
+            rc = cb(ib, param, hook->cdata);
+        }
+        IB_PROBE3(hook_return, event, cb, rc);
         if (rc != IB_OK) {
             /// @todo Or should we go on???
             ib_log_error(ib, 4, "Hook returned error: %s=%d",
@@ -724,6 +812,36 @@ static ib_status_t ib_state_notify(ib_engine_t *ib,
     IB_FTRACE_RET_STATUS(rc);
 }
 
+/**
+ * @internal
+ * Notify the engine that an event has occurred.
+ *
+ * This is a generic function that handles all types.
+ *
+ * @param ib Engine
+ * @param event Event
+ * @param param Parameter (type is event specific)
+ *
+ * @returns Status code
+ */
+static ib_status_t ib_state_notify(ib_engine_t *ib,
+                                   ib_state_event_type_t event,
+                                   void *param)
+{
+    IB_FTRACE_INIT(ib_state_notify);
+    ib_hook_t *hook = NULL;
+    ib_status_t rc = IB_OK;
+
+    hook = ib->ectx->hook[event];
+
+    ib_log_debug(ib, 5, "EVENT: %s", ib_state_event_name(event));
+    IB_PROBE2(state_notify, event, ib_state_event_name(event));
+
+    rc = ib_hook_run(ib, event, hook, param);
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
 /**
  * @internal
  * Notify the engine that a connection event has occurred.
@@ -742,6 +860,7 @@ static ib_status_t ib_state_notify_conn(ib_engine_t *ib,
     ib_hook_t *hook = NULL;
     ib_status_t rc = IB_OK;
     
+    IB_PROBE2(state_notify_conn, event, conn);
     rc = ib_state_notify(ib, event, conn);
     if ((rc != IB_OK) || (conn->ctx == NULL)) {
         IB_FTRACE_RET_STATUS(rc);
@@ -751,18 +870,7 @@ static ib_status_t ib_state_notify_conn(ib_engine_t *ib,
         hook = conn->ctx->hook[event];
     }
 
-    while (hook != NULL) {
-        ib_state_hook_fn_t cb = (ib_state_hook_fn_t)hook->callback;
-        rc = cb(ib, conn, hook->cdata);
-        if (rc != IB_OK) {
-            /// @todo Or should we go on???
-            ib_log_error(ib, 4, "Hook returned error: %s=%d",
-                         ib_state_event_name(event), rc);
-            break;
-        }
-
-        hook = hook->next;
-    }
+    rc = ib_hook_run(ib, event, hook, conn);
 
     IB_FTRACE_RET_STATUS(rc);
 }
@@ -786,6 +894,7 @@ static ib_status_t ib_state_notify_conn_data(ib_engine_t *ib,
     ib_hook_t *hook = NULL;
     ib_status_t rc = IB_OK;
     
+    IB_PROBE3(state_notify_conn_data, event, conn, conndata->dlen);
     rc = ib_state_notify(ib, event, conndata);
     if ((rc != IB_OK) || (conn->ctx == NULL)) {
         IB_FTRACE_RET_STATUS(rc);
@@ -795,18 +904,7 @@ static ib_status_t ib_state_notify_conn_data(ib_engine_t *ib,
         hook = conn->ctx->hook[event];
     }
 
-    while (hook != NULL) {
-        ib_state_hook_fn_t cb = (ib_state_hook_fn_t)hook->callback;
-        rc = cb(ib, conndata, hook->cdata);
-        if (rc != IB_OK) {
-            /// @todo Or should we go on???
-            ib_log_error(ib, 4, "Hook returned error: %s=%d",
-                         ib_state_event_name(event), rc);
-            break;
-        }
-
-        hook = hook->next;
-    }
+    rc = ib_hook_run(ib, event, hook, conndata);
 
     IB_FTRACE_RET_STATUS(rc);
 }
@@ -830,6 +928,7 @@ static ib_status_t ib_state_notify_tx_data(ib_engine_t *ib,
     ib_hook_t *hook = NULL;
     ib_status_t rc = IB_OK;
     
+    IB_PROBE3(state_notify_tx_data, event, tx, txdata->dlen);
     rc = ib_state_notify(ib, event, txdata);
     if ((rc != IB_OK) || (tx->ctx == NULL)) {
         IB_FTRACE_RET_STATUS(rc);
@@ -839,18 +938,7 @@ static ib_status_t ib_state_notify_tx_data(ib_engine_t *ib,
         hook = tx->ctx->hook[event];
     }
 
-    while (hook != NULL) {
-        ib_state_hook_fn_t cb = (ib_state_hook_fn_t)hook->callback;
-        rc = cb(ib, txdata, hook->cdata);
-        if (rc != IB_OK) {
-            /// @todo Or should we go on???
-            ib_log_error(ib, 4, "Hook returned error: %s=%d",
-                         ib_state_event_name(event), rc);
-            break;
-        }
-
-        hook = hook->next;
-    }
+    rc = ib_hook_run(ib, event, hook, txdata);
 
     IB_FTRACE_RET_STATUS(rc);
 }
@@ -873,6 +961,7 @@ static ib_status_t ib_state_notify_tx(ib_engine_t *ib,
     ib_hook_t *hook = NULL;
     ib_status_t rc = IB_OK;
     
+    IB_PROBE3(state_notify_tx, event, tx, tx->id);
     rc = ib_state_notify(ib, event, tx);
     if ((rc != IB_OK) || (tx->ctx == NULL)) {
         IB_FTRACE_RET_STATUS(rc);
@@ -882,18 +971,7 @@ static ib_status_t ib_state_notify_tx(ib_engine_t *ib,
         hook = tx->ctx->hook[event];
     }
 
-    while (hook != NULL) {
-        ib_state_hook_fn_t cb = (ib_state_hook_fn_t)hook->callback;
-        rc = cb(ib, tx, hook->cdata);
-        if (rc != IB_OK) {
-            /// @todo Or should we go on???
-            ib_log_error(ib, 4, "Hook returned error: %s=%d",
-                         ib_state_event_name(event), rc);
-            break;
-        }
-
-        hook = hook->next;
-    }
+    rc = ib_hook_run(ib, event, hook, tx);
 
     IB_FTRACE_RET_STATUS(rc);
 }
@@ -917,6 +995,7 @@ ib_status_t ib_state_notify_cfg_finished(ib_engine_t *ib)
 {
     IB_FTRACE_INIT(ib_state_notify_cfg_finished);
     ib_status_t rc;
+    ib_status_t jobrc;
 
     /* Initialize (and close) the main configuration context. */
     rc = ib_context_init(ib->ctx);
@@ -927,6 +1006,22 @@ ib_status_t ib_state_notify_cfg_finished(ib_engine_t *ib)
     /* Run the hooks. */
     rc = ib_state_notify(ib, cfg_finished_event, NULL);
 
+    /* Run the jobs added while configuring, including by the hooks. A
+     * failed job (such as a pattern which does not compile) fails the
+     * configuration, as it would have if run by the directive.
+     */
+    jobrc = ib_cfgjob_run(ib);
+    if (rc == IB_OK) {
+        rc = jobrc;
+    }
+
+    ib_log_debug(ib, 4, "Matcher cache: compiled %zu patterns, loaded %zu, "
+                 "%zu hits", ib->matcher_compiled, ib->matcher_loaded,
+                 ib->matcher_hits);
+
+    /* Save the compiled patterns for the next startup. */
+    ib_matcher_db_close(ib);
+
     /* Destroy the temporary memory pool. */
     ib_engine_pool_temp_destroy(ib);
 
@@ -997,6 +1092,8 @@ ib_status_t ib_state_notify_conn_data_in(ib_engine_t *ib,
         ib_conn_flags_set(conndata->conn, IB_CONN_FSEENDATAIN);
     }
 
+    ib_stat_add(ib, IB_STAT_BYTES_IN, conndata->dlen);
+
     /* Notify data handlers before the parser. */
     rc = ib_state_notify_conn_data(ib, conn_data_in_event, conndata);
     if (rc != IB_OK) {
@@ -1010,6 +1107,9 @@ ib_status_t ib_state_notify_conn_data_in(ib_engine_t *ib,
         IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
     }
     rc = iface->data_in(pi, conndata);
+    if (rc != IB_OK) {
+        ib_stat_inc(ib, IB_STAT_PARSER_ERRORS);
+    }
 
     IB_FTRACE_RET_STATUS(rc);
 }
@@ -1027,6 +1127,8 @@ ib_status_t ib_state_notify_conn_data_out(ib_engine_t *ib,
         ib_conn_flags_set(conndata->conn, IB_CONN_FSEENDATAOUT);
     }
 
+    ib_stat_add(ib, IB_STAT_BYTES_OUT, conndata->dlen);
+
     /* Notify data handlers before the parser. */
     rc = ib_state_notify_conn_data(ib, conn_data_out_event, conndata);
     if (rc != IB_OK) {
@@ -1040,6 +1142,9 @@ ib_status_t ib_state_notify_conn_data_out(ib_engine_t *ib,
         IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
     }
     rc = iface->data_out(pi, conndata);
+    if (rc != IB_OK) {
+        ib_stat_inc(ib, IB_STAT_PARSER_ERRORS);
+    }
 
     IB_FTRACE_RET_STATUS(rc);
 }
@@ -1436,6 +1541,10 @@ ib_status_t ib_state_notify_response_finished(ib_engine_t *ib,
     }
 
     rc = ib_state_notify_tx(ib, tx_finished_event, tx);
+
+    /* Log hook timing if it is time to do so. */
+    ib_hook_stats_periodic(ib);
+
     IB_FTRACE_RET_STATUS(rc);
 }
 
@@ -1456,6 +1565,7 @@ ib_status_t ib_hook_register(ib_engine_t *ib,
 
     hook->callback = cb;
     hook->cdata = cdata;
+    hook->module = ib->cur_module;
     hook->next = NULL;
 
     /* Insert the hook at the end of the list */
@@ -1524,6 +1634,7 @@ ib_status_t ib_hook_register_context(ib_context_t *ctx,
 
     hook->callback = cb;
     hook->cdata = cdata;
+    hook->module = ib->cur_module;
     hook->next = NULL;
 
     /* Insert the hook at the end of the list */
@@ -1587,6 +1698,7 @@ ib_status_t ib_hook_unregister_context(ib_context_t *ctx,
 ib_status_t ib_module_init(ib_module_t *m, ib_engine_t *ib)
 {
     IB_FTRACE_INIT(ib_module_init);
+    ib_module_t *prev_module = ib->cur_module;
     ib_status_t rc;
 
     /* Keep track of the module index. */
@@ -1622,9 +1734,13 @@ ib_status_t ib_module_init(ib_module_t *m, ib_engine_t *ib)
                      m->name);
     }
 
-    /* Init and register the module */
+    /* Init and register the module, tracking the module so that
+     * any hooks registered are associated with it.
+     */
     if (m->fn_init != NULL) {
+        ib->cur_module = m;
         rc = m->fn_init(ib, m);
+        ib->cur_module = prev_module;
         if (rc != IB_OK) {
             ib_log_error(ib, 1, "Failed to initialize module %s %d",
                          m->name, rc);
@@ -1889,7 +2005,11 @@ ib_status_t ib_context_init(ib_context_t *ctx)
         ib_module_t *m = cfgdata->module;
 
         if (m->fn_ctx_init != NULL) {
+            ib_module_t *prev_module = ib->cur_module;
+
+            ib->cur_module = m;
             rc = m->fn_ctx_init(ib, m, ctx);
+            ib->cur_module = prev_module;
             if (rc != IB_OK) {
                 /// @todo Log the error???  Fail???
                 ib_log_error(ib, 4, "Failed to call context init: %d", rc);
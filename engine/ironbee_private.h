@@ -25,6 +25,8 @@
  * @author Brian Rectanus <brectanus@qualys.com>
  */
 
+#include <pthread.h>
+
 #include <ironbee/engine.h>
 #include <ironbee/util.h>
 #include <ironbee/plugin.h>
@@ -39,14 +41,124 @@
 struct ib_hook_t {
     ib_void_fn_t        callback;         /**< Callback function */
     void               *cdata;            /**< Data passed to the callback */
+    ib_module_t        *module;           /**< Registering module (or NULL) */
     ib_hook_t          *next;             /**< The next callback in the list */
 };
 
+/**
+ * @internal
+ *
+ * Number of modules (by index) which hook timing is tracked for
+ * individually. Hooks from other modules, or registered outside of
+ * a module, are tracked together in an extra slot.
+ */
+#define IB_HOOK_STATS_MODULES         64
+
+/**
+ * @internal
+ *
+ * Assumed CPU cache line size.
+ */
+#define IB_STATS_CACHELINE            64
+
+/**
+ * @internal
+ *
+ * Number of counters in each per-thread counter chunk.
+ */
+#define IB_STATS_CHUNK_SIZE           64
+
+/**
+ * @internal
+ *
+ * Maximum number of per-thread counter chunks.
+ */
+#define IB_STATS_CHUNKS               256
+
+/**
+ * @internal
+ *
+ * Maximum number of counters.
+ */
+#define IB_STATS_MAX                  (IB_STATS_CHUNK_SIZE * IB_STATS_CHUNKS)
+
+/**
+ * @internal
+ *
+ * Built-in counter IDs (registered in this order at engine creation).
+ */
+typedef enum {
+    IB_STAT_CONNS,                       /**< Connections */
+    IB_STAT_TXS,                         /**< Transactions */
+    IB_STAT_BYTES_IN,                    /**< Connection bytes in */
+    IB_STAT_BYTES_OUT,                   /**< Connection bytes out */
+    IB_STAT_EVENTS,                      /**< Events generated */
+    IB_STAT_PARSER_ERRORS,               /**< Parser errors */
+    IB_STAT_CTX_MAIN,                    /**< Main context selections */
+    IB_STAT_AUDITLOGS,                   /**< Audit logs written */
+    IB_STAT_BUILTIN_NUM                  /**< Number of built-in counters */
+} ib_stat_builtin_t;
+
+/**
+ * @internal
+ *
+ * Chunk of per-thread counters.
+ *
+ * Chunks are allocated on a cache line boundary and only written by
+ * the owning thread, so counters never share a cache line with
+ * counters written by another thread.
+ */
+typedef struct ib_stats_chunk_t ib_stats_chunk_t;
+struct ib_stats_chunk_t {
+    uint64_t            val[IB_STATS_CHUNK_SIZE]; /**< Counter values */
+} __attribute__((aligned(IB_STATS_CACHELINE)));
+
+/**
+ * @internal
+ *
+ * Per-thread statistics.
+ *
+ * Each thread which notifies the engine of events gets one of these,
+ * which only that thread writes to. Readers walk the list of all
+ * threads and aggregate, so no locking is needed.
+ */
+typedef struct ib_stats_thread_t ib_stats_thread_t;
+struct ib_stats_thread_t {
+    ib_stats_thread_t  *next;             /**< Next thread in the list */
+    ib_engine_t        *ib;               /**< Engine */
+    pthread_t           tid;              /**< Owning thread */
+
+    /** Counter chunks (allocated on first use) */
+    ib_stats_chunk_t   *counter[IB_STATS_CHUNKS];
+
+    /** Hook timing histograms (allocated on first use) */
+    ib_hist_t          *hook_hist[IB_STATE_EVENT_NUM][IB_HOOK_STATS_MODULES + 1];
+};
+
+/**
+ * @internal
+ *
+ * Engine statistics.
+ */
+typedef struct ib_stats_t ib_stats_t;
+struct ib_stats_t {
+    ib_stats_thread_t  *threads;          /**< Per-thread statistics */
+    uint32_t            gen;              /**< Unique engine generation */
+    ib_array_t         *names;            /**< Counter names by ID */
+    ib_hash_t          *ids;              /**< Counter IDs by name */
+    int                 hook_timing;      /**< Hook timing enabled? */
+    time_t              hook_dump_interval; /**< Dump interval (secs) */
+    time_t              hook_dump_last;   /**< Time of last dump */
+};
+
 /**
  * @internal
  *
  * Engine handle.
  */
+typedef struct ib_matcher_db_t ib_matcher_db_t;
+typedef struct ib_matcher_job_t ib_matcher_job_t;
+
 struct ib_engine_t {
     ib_mpool_t         *mp;               /**< Primary memory pool */
     ib_mpool_t         *config_mp;        /**< Config memory pool */
@@ -68,6 +180,19 @@ struct ib_engine_t {
     ib_hash_t          *apis;             /**< Hash tracking provider APIs */
     ib_hash_t          *providers;        /**< Hash tracking providers */
     ib_hash_t          *tfns;             /**< Hash tracking transformations */
+    ib_hash_t          *tfn_pipelines;    /**< Hash tracking tfn pipelines */
+    size_t              tfn_pipeline_num; /**< Number of tfn pipelines */
+    ib_hash_t          *operators;        /**< Hash tracking operators */
+    ib_hash_t          *matcher_cache;    /**< Compiled patterns (config only) */
+    ib_list_t          *matcher_entries;  /**< Compiled patterns in order */
+    ib_matcher_db_t    *matcher_db;       /**< Pattern database (or NULL) */
+    size_t              matcher_compiled; /**< Patterns compiled into cache */
+    size_t              matcher_loaded;   /**< Patterns loaded from database */
+    size_t              matcher_hits;     /**< Compiled patterns shared */
+    ib_list_t          *cfgjobs;          /**< Jobs run when config finished */
+
+    ib_module_t        *cur_module;       /**< Module being initialized */
+    ib_stats_t          stats;            /**< Statistics */
 };
 
 /**
@@ -84,6 +209,7 @@ struct ib_site_t {
     ib_list_t               *hosts;       /**< Hostnames */
     ib_list_t               *locations;   /**< List of locations */
     ib_loc_t                *default_loc; /**< Default location */
+    ib_stat_id_t             stat_selected; /**< Context selection counter */
 };
 
 /**
@@ -106,6 +232,62 @@ struct ib_tfn_t {
     const char         *name;              /**< Tfn name */  
     ib_tfn_fn_t         transform;         /**< Tfn function */
     void               *fndata;            /**< Tfn function data */
+    const ib_tfn_fuse_t *fuse;             /**< Fusable stages (or NULL) */
+    const ib_tfn_stream_fns_t *stream;     /**< Streaming functions (or NULL) */
+};
+
+/**
+ * @internal
+ *
+ * Operator.
+ */
+struct ib_operator_t {
+    const char         *name;              /**< Operator name */
+    ib_operator_create_fn_t fn_create;     /**< Instance create function */
+    ib_operator_execute_fn_t fn_execute;   /**< Execute function */
+};
+
+/**
+ * @internal
+ *
+ * Operator instance.
+ */
+struct ib_operator_inst_t {
+    const ib_operator_t *op;               /**< Operator */
+    const char         *params;            /**< Parameters */
+    void               *data;              /**< Instance data */
+};
+
+/** Maximum number of stages fused into a single pass. */
+#define IB_TFN_FUSE_MAX_STAGES   16
+
+/**
+ * @internal
+ *
+ * Compiled transformation pipeline step.
+ *
+ * A step is either a single tfn or a fused group of stages
+ * from multiple adjacent fusable tfns.
+ */
+typedef struct ib_tfn_step_t ib_tfn_step_t;
+struct ib_tfn_step_t {
+    ib_tfn_t           *tfn;               /**< Tfn (if not fused) */
+    const ib_tfn_fuse_t *stage[IB_TFN_FUSE_MAX_STAGES]; /**< Fused stages */
+    size_t              nstage;            /**< Number of fused stages */
+};
+
+/**
+ * @internal
+ *
+ * Compiled transformation pipeline.
+ */
+struct ib_tfn_pipeline_t {
+    size_t              id;                /**< Unique pipeline ID */
+    const char         *spec;              /**< Comma separated tfn names */
+    size_t              ntfn;              /**< Number of tfns */
+    ib_tfn_t          **tfn;               /**< Tfns (in order) */
+    size_t              nstep;             /**< Number of steps */
+    ib_tfn_step_t      *step;              /**< Steps (in order) */
 };
 
 /**
@@ -155,4 +337,119 @@ struct ib_matcher_t {
     const char              *key;         /**< Matcher key */
 };
 
+/**
+ * @internal
+ * Matcher stream.
+ */
+struct ib_matcher_stream_t {
+    ib_matcher_t            *m;           /**< Matcher */
+    void                    *state;       /**< Provider stream state */
+    int                      finished;    /**< Stream has been finished */
+};
+
+/**
+ * @internal
+ *
+ * Compiled pattern shared during configuration.
+ */
+typedef struct ib_matcher_centry_t ib_matcher_centry_t;
+struct ib_matcher_centry_t {
+    ib_provider_t           *mpr;         /**< Matcher provider */
+    const char              *ckey;        /**< Cache key ("key:patt") */
+    void                    *cpatt;       /**< Compiled pattern */
+    ib_matcher_job_t        *job;         /**< Compile queued (or NULL) */
+};
+
+/**
+ * @internal
+ *
+ * Pattern database (compiled patterns saved between startups).
+ *
+ * The file is a header followed by an entry per compiled pattern,
+ * each a cache key and the buffer written by the provider serialize
+ * function. It is mapped while configuring, then written again if the
+ * patterns compiled differ from those saved.
+ */
+struct ib_matcher_db_t {
+    const char              *path;        /**< Database file */
+    void                    *map;         /**< Mapped file (or NULL) */
+    size_t                   size;        /**< Mapped file size */
+    ib_hash_t               *entries;     /**< Saved patterns by cache key */
+    uint64_t                 hash;        /**< Rule set hash saved */
+    int                      stale;       /**< File must be written */
+};
+
+/**
+ * @internal
+ *
+ * Write the pattern database if stale, then close it.
+ *
+ * Called once configuration is finished.
+ *
+ * @param ib Engine
+ *
+ * @returns Status code
+ */
+ib_status_t ib_matcher_db_close(ib_engine_t *ib);
+
+/**
+ * @internal
+ *
+ * Run all configuration jobs on worker threads and wait for them.
+ *
+ * Called once configuration is finished. Job errors are logged with
+ * the location the job was added at. All jobs are run even if some
+ * fail.
+ *
+ * @param ib Engine
+ *
+ * @returns Status code (that of the first failed job, in the order
+ *          the jobs were added, if any failed)
+ */
+ib_status_t ib_cfgjob_run(ib_engine_t *ib);
+
+/**
+ * @internal
+ *
+ * Initialize engine statistics.
+ *
+ * @param ib Engine
+ *
+ * @returns Status code
+ */
+ib_status_t ib_stats_init(ib_engine_t *ib);
+
+/**
+ * @internal
+ *
+ * Get a monotonic timestamp for measuring elapsed time.
+ *
+ * @returns Timestamp in nanoseconds
+ */
+uint64_t ib_stats_clock(void);
+
+/**
+ * @internal
+ *
+ * Record the time taken by a hook callback.
+ *
+ * @param ib Engine
+ * @param event Event the hook was called for
+ * @param hook Hook
+ * @param nsec Elapsed time in nanoseconds
+ */
+void ib_hook_stats_record(ib_engine_t *ib,
+                          ib_state_event_type_t event,
+                          const ib_hook_t *hook,
+                          uint64_t nsec);
+
+/**
+ * @internal
+ *
+ * Dump the hook timing statistics if the dump interval has elapsed.
+ *
+ * @param ib Engine
+ */
+void ib_hook_stats_periodic(ib_engine_t *ib);
+
 #endif /* IB_PRIVATE_H_ */
@@ -0,0 +1,108 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+#ifndef _IB_PROBES_H_
+#define _IB_PROBES_H_
+
+/**
+ * @file
+ * @brief IronBee - Static Probes
+ *
+ * When configured with --enable-probes, these expand to USDT (systemtap
+ * SDT) probes in the "ironbee" provider, which can be attached to with
+ * bpftrace, perf or systemtap. A probe which is not attached costs a
+ * single nop. Without --enable-probes they expand to nothing.
+ *
+ * Probes:
+ *
+ * - state_notify(event, name)
+ * - state_notify_conn(event, conn)
+ * - state_notify_conn_data(event, conn, dlen)
+ * - state_notify_tx(event, tx, id)
+ * - state_notify_tx_data(event, tx, dlen)
+ * - hook_enter(event, callback, module)
+ * - hook_return(event, callback, rc)
+ * - conn_create(conn)
+ * - tx_create(tx, conn, id)
+ * - tx_destroy(tx, id)
+ * - matcher_match_enter(matcher, key, dlen)
+ * - matcher_match_return(matcher, key, rc)
+ * - tfn_transform_enter(tfn, name, dlen)
+ * - tfn_transform_return(tfn, name, rc, flags)
+ * - tfn_fuse_enter(step, nstage, dlen)
+ * - tfn_fuse_return(step, dlen, modified)
+ *
+ * Every event fires state_notify, and connection and transaction
+ * events also fire the probe for their type first. Transformations
+ * fused into a single pipeline step fire the tfn_fuse probes instead
+ * of the tfn_transform probes. Streaming transformations are not
+ * probed per chunk.
+ *
+ * Probe arguments are evaluated even when no probe is attached, so
+ * they must be cheap (pass lengths which are computed anyway).
+ *
+ * Example:
+ * @code
+ * bpftrace -e 'usdt:/usr/lib/libironbee.so:ironbee:tx_create
+ *              { @start[arg0] = nsecs; }
+ *              usdt:/usr/lib/libironbee.so:ironbee:tx_destroy
+ *              /@start[arg0]/
+ *              { @tx_ns = hist(nsecs - @start[arg0]);
+ *                delete(@start[arg0]); }'
+ * @endcode
+ *
+ * @author Brian Rectanus <brectanus@qualys.com>
+ */
+
+#include "ironbee_config_auto.h"
+
+/**
+ * @defgroup IronBeeProbes Static Probes
+ * @ingroup IronBeeEngine
+ * @{
+ */
+
+#ifdef IB_ENABLE_PROBES
+
+#include <sys/sdt.h>
+
+#define IB_PROBE0(name) \
+    DTRACE_PROBE(ironbee, name)
+#define IB_PROBE1(name,a1) \
+    DTRACE_PROBE1(ironbee, name, a1)
+#define IB_PROBE2(name,a1,a2) \
+    DTRACE_PROBE2(ironbee, name, a1, a2)
+#define IB_PROBE3(name,a1,a2,a3) \
+    DTRACE_PROBE3(ironbee, name, a1, a2, a3)
+#define IB_PROBE4(name,a1,a2,a3,a4) \
+    DTRACE_PROBE4(ironbee, name, a1, a2, a3, a4)
+
+#else
+
+#define IB_PROBE0(name)
+#define IB_PROBE1(name,a1)
+#define IB_PROBE2(name,a1,a2)
+#define IB_PROBE3(name,a1,a2,a3)
+#define IB_PROBE4(name,a1,a2,a3,a4)
+
+#endif /* IB_ENABLE_PROBES */
+
+/**
+ * @} IronBeeProbes
+ */
+
+#endif /* _IB_PROBES_H_ */
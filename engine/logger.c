@@ -412,6 +412,9 @@ ib_status_t ib_clog_event(ib_context_t *ctx,
     api = (IB_PROVIDER_API_TYPE(logevent) *)pi->pr->api;
 
     rc = api->add_event(pi, e);
+    if (rc == IB_OK) {
+        ib_stat_inc(ctx->ib, IB_STAT_EVENTS);
+    }
     IB_FTRACE_RET_STATUS(rc);
 }
 
@@ -24,13 +24,79 @@
 
 #include "ironbee_config_auto.h"
 
+#include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <ironbee/engine.h>
 #include <ironbee/util.h>
 #include <ironbee/provider.h>
+#include <ironbee/config.h>
 
 #include "ironbee_private.h"
+#include "ironbee_probes.h"
+
+/** Pattern database magic (first bytes of the file). */
+#define IB_MATCHER_DB_MAGIC     "IBPATDB"
+
+/** Pattern database format version. */
+#define IB_MATCHER_DB_VERSION   1
+
+/**
+ * @internal
+ * Pattern database file header.
+ *
+ * All values are in host byte order, as are the saved patterns.
+ */
+typedef struct {
+    char                     magic[8];    /**< IB_MATCHER_DB_MAGIC */
+    uint32_t                 version;     /**< IB_MATCHER_DB_VERSION */
+    uint32_t                 count;       /**< Number of entries */
+    uint64_t                 hash;        /**< Rule set hash */
+} ib_matcher_db_hdr_t;
+
+/**
+ * @internal
+ * Pattern database entry header.
+ *
+ * Followed by the cache key and then the saved pattern, each padded
+ * to IB_MATCHER_DB_ALIGN bytes.
+ */
+typedef struct {
+    uint32_t                 klen;        /**< Cache key length */
+    uint32_t                 len;         /**< Saved pattern length */
+} ib_matcher_db_ent_t;
+
+/** Alignment of the parts of a pattern database entry. */
+#define IB_MATCHER_DB_ALIGN     8
+#define IB_MATCHER_DB_PAD(n) \
+    (((size_t)(n) + (IB_MATCHER_DB_ALIGN - 1)) \
+     & ~(size_t)(IB_MATCHER_DB_ALIGN - 1))
+
+/**
+ * @internal
+ * A saved pattern in the mapped pattern database.
+ */
+typedef struct {
+    const uint8_t           *buf;         /**< Saved pattern */
+    size_t                   len;         /**< Saved pattern length */
+} ib_matcher_saved_t;
+
+/**
+ * @internal
+ * Compilation of a pattern queued as a configuration job.
+ */
+struct ib_matcher_job_t {
+    ib_matcher_t            *m;           /**< Matcher */
+    const char              *patt;        /**< Regex pattern text */
+    ib_matcher_centry_t     *entry;       /**< Cache entry */
+    ib_list_t               *dests;       /**< Where to write the pattern */
+    int                      done;        /**< Already compiled */
+};
 
 
 ib_status_t ib_matcher_create(ib_engine_t *ib,
@@ -57,11 +123,214 @@ ib_status_t ib_matcher_create(ib_engine_t *ib,
     (*pm)->mp = pool;
     (*pm)->mpr = mpr;
     (*pm)->mpi = NULL;
-    (*pm)->key = ib_mpool_memdup(pool, key, strlen(key) + 1);
+    (*pm)->key = (const char *)ib_mpool_memdup(pool, key, strlen(key) + 1);
 
     IB_FTRACE_RET_STATUS(IB_OK);
 }
 
+/**
+ * @internal
+ * Load a compiled pattern from the pattern database.
+ *
+ * @param m Matcher
+ * @param ckey Cache key
+ * @param pcpatt Address which the compiled pattern is written
+ *
+ * @returns Status code (IB_ENOENT if not in the database)
+ */
+static ib_status_t ib_matcher_db_load(ib_matcher_t *m,
+                                      const char *ckey,
+                                      void **pcpatt)
+{
+    IB_FTRACE_INIT(ib_matcher_db_load);
+    ib_matcher_db_t *db = m->ib->matcher_db;
+    IB_PROVIDER_API_TYPE(matcher) *mapi;
+    const ib_matcher_saved_t *saved;
+    ib_status_t rc;
+
+    if ((db == NULL) || (db->entries == NULL)) {
+        IB_FTRACE_RET_STATUS(IB_ENOENT);
+    }
+
+    rc = ib_hash_get(db->entries, ckey, (void *)&saved);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(IB_ENOENT);
+    }
+
+    mapi = (IB_PROVIDER_API_TYPE(matcher) *)m->mpr->api;
+    rc = mapi->deserialize_pattern(m->mpr, m->mp, pcpatt,
+                                   saved->buf, saved->len);
+    if (rc != IB_OK) {
+        ib_log_debug(m->ib, 4, "Failed to load %s patt from pattern "
+                     "database: %d", m->key, rc);
+    }
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+/**
+ * @internal
+ * Whether compiled patterns of a provider can be saved.
+ *
+ * @param mpr Matcher provider
+ *
+ * @returns Non-zero if the provider can serialize compiled patterns
+ */
+static int ib_matcher_can_save(ib_provider_t *mpr)
+{
+    IB_PROVIDER_IFACE_TYPE(matcher) *iface;
+
+    iface = (IB_PROVIDER_IFACE_TYPE(matcher) *)mpr->iface;
+
+    return (iface->serialize != NULL) && (iface->deserialize != NULL);
+}
+
+/**
+ * @internal
+ * Create the cache key of a pattern if compiled patterns are shared.
+ *
+ * During configuration, patterns compiled into the configuration
+ * pool are shared by provider and pattern text, as they live as
+ * long as the configuration.
+ *
+ * @param m Matcher
+ * @param patt Regex pattern text
+ *
+ * @returns Cache key ("key:patt") or NULL if not shared
+ */
+static char *ib_matcher_ckey(ib_matcher_t *m,
+                             const char *patt)
+{
+    ib_engine_t *ib = m->ib;
+    size_t klen;
+    size_t plen;
+    char *ckey;
+
+    if ((ib->matcher_cache == NULL)
+        || (m->mp != ib_engine_pool_config_get(ib)))
+    {
+        return NULL;
+    }
+
+    /* Provider keys have no ':'. */
+    klen = strlen(m->key);
+    plen = strlen(patt);
+    ckey = (char *)ib_mpool_alloc(ib->temp_mp, klen + plen + 2);
+    if (ckey != NULL) {
+        memcpy(ckey, m->key, klen);
+        ckey[klen] = ':';
+        memcpy(ckey + klen + 1, patt, plen + 1);
+    }
+
+    return ckey;
+}
+
+/**
+ * @internal
+ * Add a compiled pattern to the cache.
+ *
+ * Not sharing only costs memory, so a failure is ignored.
+ *
+ * @param m Matcher
+ * @param ckey Cache key
+ * @param cpatt Compiled pattern (NULL if queued)
+ *
+ * @returns Cache entry (or NULL on failure)
+ */
+static ib_matcher_centry_t *ib_matcher_centry_add(ib_matcher_t *m,
+                                                  const char *ckey,
+                                                  void *cpatt)
+{
+    ib_engine_t *ib = m->ib;
+    ib_matcher_centry_t *entry;
+    ib_status_t rc;
+
+    entry = (ib_matcher_centry_t *)ib_mpool_calloc(ib->temp_mp, 1,
+                                                   sizeof(*entry));
+    if (entry == NULL) {
+        return NULL;
+    }
+    entry->mpr = m->mpr;
+    entry->ckey = ckey;
+    entry->cpatt = cpatt;
+
+    rc = ib_hash_set(ib->matcher_cache, ckey, entry);
+    if (rc != IB_OK) {
+        return NULL;
+    }
+    ib_list_push(ib->matcher_entries, entry);
+
+    return entry;
+}
+
+/**
+ * @internal
+ * Write the compiled pattern of a queued compilation.
+ *
+ * @param job Queued compilation
+ * @param cpatt Compiled pattern
+ */
+static void ib_matcher_job_finish(ib_matcher_job_t *job,
+                                  void *cpatt)
+{
+    ib_list_node_t *node;
+
+    IB_LIST_LOOP(job->dests, node) {
+        *(void **)ib_list_node_data(node) = cpatt;
+    }
+    job->entry->cpatt = cpatt;
+    job->entry->job = NULL;
+    job->done = 1;
+}
+
+/**
+ * @internal
+ * Compile a queued pattern (a configuration job).
+ *
+ * @param data Queued compilation
+ * @param pool Memory pool of the worker
+ * @param perr Address which an error message is written on failure
+ *
+ * @returns Status code
+ */
+static ib_status_t ib_matcher_job_compile(void *data,
+                                          ib_mpool_t *pool,
+                                          const char **perr)
+{
+    ib_matcher_job_t *job = (ib_matcher_job_t *)data;
+    ib_matcher_t *m = job->m;
+    IB_PROVIDER_API_TYPE(matcher) *mapi;
+    const char *errptr = NULL;
+    int erroffset = 0;
+    void *cpatt;
+    ib_status_t rc;
+
+    /* Compiled when used before jobs were run. */
+    if (job->done) {
+        return IB_OK;
+    }
+
+    mapi = (IB_PROVIDER_API_TYPE(matcher) *)m->mpr->api;
+    rc = mapi->compile_pattern(m->mpr, pool, &cpatt, job->patt,
+                               &errptr, &erroffset);
+    if (rc != IB_OK) {
+        size_t len = strlen(job->patt) + 128;
+        char *err = (char *)ib_mpool_alloc(pool, len);
+
+        if (err != NULL) {
+            snprintf(err, len, "Failed to compile %s patt \"%s\": %s "
+                     "at offset %d", m->key, job->patt,
+                     errptr ? errptr : "", erroffset);
+            *perr = err;
+        }
+        return rc;
+    }
+
+    ib_matcher_job_finish(job, cpatt);
+
+    return IB_OK;
+}
+
 void *ib_matcher_compile(ib_matcher_t *m,
                          const char *patt,
                          const char **errptr,
@@ -69,20 +338,149 @@ void *ib_matcher_compile(ib_matcher_t *m,
 {
     IB_FTRACE_INIT(ib_matcher_compile);
     IB_PROVIDER_API_TYPE(matcher) *mapi;
+    ib_engine_t *ib = m->ib;
+    ib_matcher_centry_t *entry = NULL;
+    char *ckey;
     void *cpatt;
     ib_status_t rc;
 
+    ckey = ib_matcher_ckey(m, patt);
+    if (ckey != NULL) {
+        rc = ib_hash_get(ib->matcher_cache, ckey, (void *)&entry);
+        if ((rc == IB_OK) && (entry->job == NULL)) {
+            ib->matcher_hits++;
+            IB_FTRACE_RET_PTR(void, entry->cpatt);
+        }
+        else if (rc != IB_OK) {
+            entry = NULL;
+
+            /* Otherwise it may have been saved by an earlier startup. */
+            rc = ib_matcher_db_load(m, ckey, &cpatt);
+            if (rc == IB_OK) {
+                ib->matcher_loaded++;
+                ib_matcher_centry_add(m, ckey, cpatt);
+                IB_FTRACE_RET_PTR(void, cpatt);
+            }
+        }
+    }
+
     mapi = (IB_PROVIDER_API_TYPE(matcher) *)m->mpr->api;
     rc = mapi->compile_pattern(m->mpr, m->mp, &cpatt, patt,
                                errptr, erroffset);
     if (rc != IB_OK) {
-        ib_log_debug(m->ib, 4, "Failed to compile %s patt: (%d) %s at offset %d", rc, errptr, erroffset);
+        ib_log_debug(ib, 4, "Failed to compile %s patt: (%d) %s at offset %d",
+                     m->key, rc,
+                     (errptr && *errptr) ? *errptr : "",
+                     erroffset ? *erroffset : 0);
         IB_FTRACE_RET_PTR(void, NULL);
     }
 
+    /* A queued compilation is needed now, so is finished early. */
+    if (entry != NULL) {
+        ib_matcher_job_finish(entry->job, cpatt);
+        IB_FTRACE_RET_PTR(void, cpatt);
+    }
+    if (ckey == NULL) {
+        IB_FTRACE_RET_PTR(void, cpatt);
+    }
+    ib->matcher_compiled++;
+
+    /* Anything compiled that could have been loaded must be saved. */
+    if ((ib->matcher_db != NULL) && ib_matcher_can_save(m->mpr)) {
+        ib->matcher_db->stale = 1;
+    }
+
+    ib_matcher_centry_add(m, ckey, cpatt);
+
     IB_FTRACE_RET_PTR(void, cpatt);
 }
 
+ib_status_t ib_matcher_compile_async(ib_matcher_t *m,
+                                     const char *patt,
+                                     void **pcpatt,
+                                     const char *file,
+                                     unsigned int lineno)
+{
+    IB_FTRACE_INIT(ib_matcher_compile_async);
+    ib_engine_t *ib = m->ib;
+    ib_matcher_centry_t *entry;
+    ib_matcher_job_t *job;
+    const char *errptr = NULL;
+    int erroffset = 0;
+    char *ckey;
+    void *cpatt;
+    ib_status_t rc;
+
+    *pcpatt = NULL;
+
+    /* Only shared patterns are queued, as they live as long as the
+     * configuration. Others are compiled now.
+     */
+    ckey = ib_matcher_ckey(m, patt);
+    if (ckey == NULL) {
+        cpatt = ib_matcher_compile(m, patt, &errptr, &erroffset);
+        if (cpatt == NULL) {
+            ib_log_error(ib, 1, "%s:%u: Failed to compile %s patt \"%s\": "
+                         "%s at offset %d",
+                         file ? file : "", lineno, m->key, patt,
+                         errptr ? errptr : "", erroffset);
+            IB_FTRACE_RET_STATUS(IB_EINVAL);
+        }
+        *pcpatt = cpatt;
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    rc = ib_hash_get(ib->matcher_cache, ckey, (void *)&entry);
+    if (rc == IB_OK) {
+        ib->matcher_hits++;
+        if (entry->job != NULL) {
+            rc = ib_list_push(entry->job->dests, pcpatt);
+            IB_FTRACE_RET_STATUS(rc);
+        }
+        *pcpatt = entry->cpatt;
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    rc = ib_matcher_db_load(m, ckey, &cpatt);
+    if (rc == IB_OK) {
+        ib->matcher_loaded++;
+        ib_matcher_centry_add(m, ckey, cpatt);
+        *pcpatt = cpatt;
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    /* Queue the compilation. The entry is what later uses of the
+     * pattern share, so it is required.
+     */
+    job = (ib_matcher_job_t *)ib_mpool_calloc(ib->temp_mp, 1, sizeof(*job));
+    if (job == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    job->m = m;
+    job->patt = patt;
+    rc = ib_list_create(&job->dests, ib->temp_mp);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    rc = ib_list_push(job->dests, pcpatt);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    job->entry = ib_matcher_centry_add(m, ckey, NULL);
+    if (job->entry == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    job->entry->job = job;
+    ib->matcher_compiled++;
+
+    if ((ib->matcher_db != NULL) && ib_matcher_can_save(m->mpr)) {
+        ib->matcher_db->stale = 1;
+    }
+
+    rc = ib_cfgjob_add(ib, file, lineno, ib_matcher_job_compile, job);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
 ib_status_t ib_matcher_match_buf(ib_matcher_t *m,
                                  void *cpatt,
                                  ib_flags_t flags,
@@ -94,7 +492,9 @@ ib_status_t ib_matcher_match_buf(ib_matcher_t *m,
     ib_status_t rc;
 
     mapi = (IB_PROVIDER_API_TYPE(matcher) *)m->mpr->api;
+    IB_PROBE3(matcher_match_enter, m, m->key, dlen);
     rc = mapi->match_compiled(m->mpr, cpatt, 0, data, dlen);
+    IB_PROBE3(matcher_match_return, m, m->key, rc);
 
     IB_FTRACE_RET_STATUS(rc);
 }
@@ -108,6 +508,7 @@ ib_status_t ib_matcher_match_field(ib_matcher_t *m,
     IB_PROVIDER_IFACE_TYPE(matcher) *iface;
     ib_bytestr_t *bs;
     char *cs;
+    size_t dlen;
     ib_status_t rc;
 
     iface = (IB_PROVIDER_IFACE_TYPE(matcher) *)m->mpr->iface;
@@ -115,15 +516,20 @@ ib_status_t ib_matcher_match_field(ib_matcher_t *m,
     switch (f->type) {
         case IB_FTYPE_BYTESTR:
             bs = ib_field_value_bytestr(f);
+            IB_PROBE3(matcher_match_enter, m, m->key, ib_bytestr_length(bs));
             rc = iface->match_compiled(m->mpr, cpatt, flags,
                                        ib_bytestr_ptr(bs),
                                        ib_bytestr_length(bs));
+            IB_PROBE3(matcher_match_return, m, m->key, rc);
             break;
         case IB_FTYPE_NULSTR:
             cs = ib_field_value_nulstr(f);
+            dlen = strlen(cs);
+            IB_PROBE3(matcher_match_enter, m, m->key, dlen);
             rc = iface->match_compiled(m->mpr, cpatt, flags,
                                        (uint8_t *)cs,
-                                       strlen(cs));
+                                       dlen);
+            IB_PROBE3(matcher_match_return, m, m->key, rc);
             break;
         /// @todo How to handle numeric fields???
         default:
@@ -136,26 +542,535 @@ ib_status_t ib_matcher_match_field(ib_matcher_t *m,
     IB_FTRACE_RET_STATUS(rc);
 }
 
+ib_status_t ib_matcher_serialize(ib_matcher_t *m,
+                                 void *cpatt,
+                                 ib_mpool_t *pool,
+                                 const uint8_t **pbuf,
+                                 size_t *plen)
+{
+    IB_FTRACE_INIT(ib_matcher_serialize);
+    IB_PROVIDER_API_TYPE(matcher) *mapi;
+    ib_status_t rc;
+
+    mapi = (IB_PROVIDER_API_TYPE(matcher) *)m->mpr->api;
+    rc = mapi->serialize_pattern(m->mpr, cpatt, pool, pbuf, plen);
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+ib_status_t ib_matcher_deserialize(ib_matcher_t *m,
+                                   const uint8_t *buf,
+                                   size_t len,
+                                   void **pcpatt)
+{
+    IB_FTRACE_INIT(ib_matcher_deserialize);
+    IB_PROVIDER_API_TYPE(matcher) *mapi;
+    ib_status_t rc;
+
+    mapi = (IB_PROVIDER_API_TYPE(matcher) *)m->mpr->api;
+    rc = mapi->deserialize_pattern(m->mpr, m->mp, pcpatt, buf, len);
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
 ib_status_t ib_matcher_add_pattern(ib_matcher_t *m,
-                                   const char *patt)
+                                   const char *patt,
+                                   ib_num_t id,
+                                   const char **errptr,
+                                   int *erroffset)
 {
     IB_FTRACE_INIT(ib_matcher_add_pattern);
-    IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+    IB_PROVIDER_API_TYPE(matcher) *mapi;
+    ib_status_t rc;
+
+    /* Patterns are added to a provider instance, created on first use. */
+    if (m->mpi == NULL) {
+        rc = ib_provider_instance_create(m->ib, IB_PROVIDER_TYPE_MATCHER,
+                                         m->key, &m->mpi, m->mp, NULL);
+        if (rc != IB_OK) {
+            ib_log_error(m->ib, 3,
+                         "Failed to create %s matcher instance: %d",
+                         m->key, rc);
+            m->mpi = NULL;
+            IB_FTRACE_RET_STATUS(rc);
+        }
+    }
+
+    mapi = (IB_PROVIDER_API_TYPE(matcher) *)m->mpr->api;
+    rc = mapi->add_pattern(m->mpi, patt, id, errptr, erroffset);
+    if (rc != IB_OK) {
+        ib_log_debug(m->ib, 4, "Failed to add %s patt \"%s\": (%d) %s at offset %d",
+                     m->key, patt, rc,
+                     ((errptr != NULL) && (*errptr != NULL)) ? *errptr : "",
+                     (erroffset != NULL) ? *erroffset : -1);
+    }
+
+    IB_FTRACE_RET_STATUS(rc);
 }
 
 ib_status_t ib_matcher_exec_buf(ib_matcher_t *m,
                                 ib_flags_t flags,
                                 const uint8_t *data,
-                                size_t dlen)
+                                size_t dlen,
+                                ib_matcher_callback_fn_t fn,
+                                void *cbdata)
 {
     IB_FTRACE_INIT(ib_matcher_exec_buf);
-    IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+    IB_PROVIDER_API_TYPE(matcher) *mapi;
+    ib_status_t rc;
+
+    /* No patterns added, so nothing can match. */
+    if (m->mpi == NULL) {
+        IB_FTRACE_RET_STATUS(IB_ENOENT);
+    }
+
+    mapi = (IB_PROVIDER_API_TYPE(matcher) *)m->mpr->api;
+    IB_PROBE3(matcher_match_enter, m, m->key, dlen);
+    rc = mapi->match(m->mpi, flags, data, dlen, fn, cbdata);
+    IB_PROBE3(matcher_match_return, m, m->key, rc);
+
+    IB_FTRACE_RET_STATUS(rc);
 }
 
 ib_status_t ib_matcher_exec_field(ib_matcher_t *m,
                                   ib_flags_t flags,
-                                  ib_field_t *f)
+                                  ib_field_t *f,
+                                  ib_matcher_callback_fn_t fn,
+                                  void *cbdata)
 {
     IB_FTRACE_INIT(ib_matcher_exec_field);
-    IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+    ib_bytestr_t *bs;
+    char *cs;
+    ib_status_t rc;
+
+    switch (f->type) {
+        case IB_FTYPE_BYTESTR:
+            bs = ib_field_value_bytestr(f);
+            rc = ib_matcher_exec_buf(m, flags,
+                                     ib_bytestr_ptr(bs),
+                                     ib_bytestr_length(bs),
+                                     fn, cbdata);
+            break;
+        case IB_FTYPE_NULSTR:
+            cs = ib_field_value_nulstr(f);
+            rc = ib_matcher_exec_buf(m, flags,
+                                     (uint8_t *)cs, strlen(cs),
+                                     fn, cbdata);
+            break;
+        /// @todo How to handle numeric fields???
+        default:
+            rc = IB_EINVAL;
+            ib_log_error(m->ib, 3, "Not matching against field type=%d",
+                         f->type);
+            break;
+    }
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+ib_status_t ib_matcher_stream_create(ib_matcher_t *m,
+                                     ib_mpool_t *pool,
+                                     ib_matcher_stream_t **pms)
+{
+    IB_FTRACE_INIT(ib_matcher_stream_create);
+    IB_PROVIDER_API_TYPE(matcher) *mapi;
+    ib_status_t rc;
+
+    *pms = (ib_matcher_stream_t *)ib_mpool_calloc(pool, 1, sizeof(**pms));
+    if (*pms == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    (*pms)->m = m;
+
+    /* No patterns added, so there is no state to keep. */
+    if (m->mpi == NULL) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    mapi = (IB_PROVIDER_API_TYPE(matcher) *)m->mpr->api;
+    rc = mapi->stream_create(m->mpi, pool, &(*pms)->state);
+    if (rc != IB_OK) {
+        *pms = NULL;
+    }
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+ib_status_t ib_matcher_stream_feed(ib_matcher_stream_t *ms,
+                                   ib_flags_t flags,
+                                   const uint8_t *data,
+                                   size_t dlen,
+                                   ib_matcher_callback_fn_t fn,
+                                   void *cbdata)
+{
+    IB_FTRACE_INIT(ib_matcher_stream_feed);
+    ib_matcher_t *m = ms->m;
+    IB_PROVIDER_API_TYPE(matcher) *mapi;
+    ib_status_t rc;
+
+    if (ms->finished) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+    if (ms->state == NULL) {
+        IB_FTRACE_RET_STATUS(IB_ENOENT);
+    }
+
+    mapi = (IB_PROVIDER_API_TYPE(matcher) *)m->mpr->api;
+    IB_PROBE3(matcher_match_enter, m, m->key, dlen);
+    rc = mapi->stream_feed(m->mpi, ms->state, flags, data, dlen, fn, cbdata);
+    IB_PROBE3(matcher_match_return, m, m->key, rc);
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+ib_status_t ib_matcher_stream_finish(ib_matcher_stream_t *ms,
+                                     ib_matcher_callback_fn_t fn,
+                                     void *cbdata)
+{
+    IB_FTRACE_INIT(ib_matcher_stream_finish);
+    ib_matcher_t *m = ms->m;
+    IB_PROVIDER_API_TYPE(matcher) *mapi;
+    ib_status_t rc;
+
+    if (ms->finished) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+    ms->finished = 1;
+    if (ms->state == NULL) {
+        IB_FTRACE_RET_STATUS(IB_ENOENT);
+    }
+
+    mapi = (IB_PROVIDER_API_TYPE(matcher) *)m->mpr->api;
+    rc = mapi->stream_finish(m->mpi, ms->state, fn, cbdata);
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+
+/* -- Pattern Database -- */
+
+/**
+ * @internal
+ * Hash a cache key (FNV-1a).
+ *
+ * The rule set hash is the sum of the hashes of its cache keys, so that
+ * it does not depend on the order patterns are compiled in.
+ *
+ * @param ckey Cache key
+ *
+ * @returns Hash
+ */
+static uint64_t ib_matcher_db_key_hash(const char *ckey)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    while (*ckey != '\0') {
+        h ^= (uint8_t)*ckey++;
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+/**
+ * @internal
+ * Index the entries of a mapped pattern database.
+ *
+ * @param ib Engine
+ * @param db Pattern database
+ *
+ * @returns Status code (IB_EINCOMPAT if not a valid database)
+ */
+static ib_status_t ib_matcher_db_index(ib_engine_t *ib,
+                                       ib_matcher_db_t *db)
+{
+    IB_FTRACE_INIT(ib_matcher_db_index);
+    const uint8_t *map = (const uint8_t *)db->map;
+    ib_matcher_db_hdr_t hdr;
+    size_t off = sizeof(hdr);
+    uint32_t i;
+    ib_status_t rc;
+
+    if (db->size < sizeof(hdr)) {
+        IB_FTRACE_RET_STATUS(IB_EINCOMPAT);
+    }
+    memcpy(&hdr, map, sizeof(hdr));
+    if ((memcmp(hdr.magic, IB_MATCHER_DB_MAGIC, sizeof(hdr.magic)) != 0)
+        || (hdr.version != IB_MATCHER_DB_VERSION))
+    {
+        IB_FTRACE_RET_STATUS(IB_EINCOMPAT);
+    }
+
+    rc = ib_hash_create(&db->entries, ib->temp_mp);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    for (i = 0; i < hdr.count; i++) {
+        ib_matcher_saved_t *saved;
+        ib_matcher_db_ent_t ent;
+        const char *ckey;
+
+        if ((db->size - off) < sizeof(ent)) {
+            IB_FTRACE_RET_STATUS(IB_EINCOMPAT);
+        }
+        memcpy(&ent, map + off, sizeof(ent));
+        off += sizeof(ent);
+
+        /* The key is NUL terminated (within its padding). */
+        if ((ent.klen == 0)
+            || ((db->size - off) < IB_MATCHER_DB_PAD((size_t)ent.klen + 1)))
+        {
+            IB_FTRACE_RET_STATUS(IB_EINCOMPAT);
+        }
+        ckey = (const char *)(map + off);
+        if (ckey[ent.klen] != '\0') {
+            IB_FTRACE_RET_STATUS(IB_EINCOMPAT);
+        }
+        off += IB_MATCHER_DB_PAD((size_t)ent.klen + 1);
+
+        if ((db->size - off) < IB_MATCHER_DB_PAD(ent.len)) {
+            IB_FTRACE_RET_STATUS(IB_EINCOMPAT);
+        }
+        saved = (ib_matcher_saved_t *)ib_mpool_alloc(ib->temp_mp,
+                                                     sizeof(*saved));
+        if (saved == NULL) {
+            IB_FTRACE_RET_STATUS(IB_EALLOC);
+        }
+        saved->buf = map + off;
+        saved->len = ent.len;
+        off += IB_MATCHER_DB_PAD(ent.len);
+
+        rc = ib_hash_set(db->entries, ckey, saved);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+    }
+
+    db->hash = hdr.hash;
+
+    ib_log_debug(ib, 4, "Loaded pattern database \"%s\" with %d patterns",
+                 db->path, (int)hdr.count);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+ib_status_t ib_matcher_db_open(ib_engine_t *ib,
+                               const char *path)
+{
+    IB_FTRACE_INIT(ib_matcher_db_open);
+    ib_matcher_db_t *db;
+    struct stat st;
+    void *map;
+    int fd;
+    ib_status_t rc;
+
+    /* Only patterns compiled during configuration are saved. */
+    if ((ib->matcher_cache == NULL) || (ib->matcher_db != NULL)) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    db = (ib_matcher_db_t *)ib_mpool_calloc(ib->temp_mp, 1, sizeof(*db));
+    if (db == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    db->path = (const char *)ib_mpool_memdup(ib->temp_mp, path,
+                                             strlen(path) + 1);
+    if (db->path == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    ib->matcher_db = db;
+
+    /* Until loaded, the file must be written. */
+    db->stale = 1;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        ib_log_debug(ib, 4, "Pattern database \"%s\" not loaded: %s",
+                     path, strerror(errno));
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+    if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+        close(fd);
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        ib_log_error(ib, 3, "Failed to map pattern database \"%s\": %s",
+                     path, strerror(errno));
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+    db->map = map;
+    db->size = (size_t)st.st_size;
+
+    rc = ib_matcher_db_index(ib, db);
+    if (rc != IB_OK) {
+        ib_log_error(ib, 3, "Ignoring invalid pattern database \"%s\": %d",
+                     path, rc);
+        db->entries = NULL;
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+    db->stale = 0;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Write bytes followed by padding to a pattern database file.
+ *
+ * @param fp File
+ * @param buf Bytes
+ * @param len Number of bytes
+ * @param padded Number of bytes including padding
+ *
+ * @returns Non-zero on success
+ */
+static int ib_matcher_db_write(FILE *fp,
+                               const void *buf,
+                               size_t len,
+                               size_t padded)
+{
+    static const uint8_t zero[IB_MATCHER_DB_ALIGN] = { 0 };
+
+    if ((len > 0) && (fwrite(buf, len, 1, fp) != 1)) {
+        return 0;
+    }
+    if ((padded > len) && (fwrite(zero, padded - len, 1, fp) != 1)) {
+        return 0;
+    }
+
+    return 1;
+}
+
+/**
+ * @internal
+ * Write the pattern database.
+ *
+ * The file is written under a temporary name and then renamed, so that
+ * another engine starting at the same time never maps a partial file.
+ *
+ * @param ib Engine
+ * @param db Pattern database
+ * @param hash Rule set hash
+ *
+ * @returns Status code
+ */
+static ib_status_t ib_matcher_db_save(ib_engine_t *ib,
+                                      ib_matcher_db_t *db,
+                                      uint64_t hash)
+{
+    IB_FTRACE_INIT(ib_matcher_db_save);
+    ib_matcher_db_hdr_t hdr;
+    ib_list_node_t *node;
+    size_t tlen = strlen(db->path) + 32;
+    char *tmp;
+    FILE *fp;
+    int ok = 1;
+
+    tmp = (char *)ib_mpool_alloc(ib->temp_mp, tlen);
+    if (tmp == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    snprintf(tmp, tlen, "%s.%ld", db->path, (long)getpid());
+
+    fp = fopen(tmp, "wb");
+    if (fp == NULL) {
+        ib_log_error(ib, 3, "Failed to write pattern database \"%s\": %s",
+                     tmp, strerror(errno));
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+
+    /* The count is written once known. */
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, IB_MATCHER_DB_MAGIC, sizeof(IB_MATCHER_DB_MAGIC));
+    hdr.version = IB_MATCHER_DB_VERSION;
+    hdr.hash = hash;
+    ok = ib_matcher_db_write(fp, &hdr, sizeof(hdr), sizeof(hdr));
+
+    IB_LIST_LOOP(ib->matcher_entries, node) {
+        const ib_matcher_centry_t *entry =
+            (const ib_matcher_centry_t *)ib_list_node_data(node);
+        IB_PROVIDER_API_TYPE(matcher) *mapi;
+        ib_matcher_db_ent_t ent;
+        const uint8_t *buf;
+        size_t len;
+        ib_status_t rc;
+
+        if (!ok) {
+            break;
+        }
+        if ((entry->cpatt == NULL) || !ib_matcher_can_save(entry->mpr)) {
+            continue;
+        }
+
+        mapi = (IB_PROVIDER_API_TYPE(matcher) *)entry->mpr->api;
+        rc = mapi->serialize_pattern(entry->mpr, entry->cpatt,
+                                     ib->temp_mp, &buf, &len);
+        if (rc != IB_OK) {
+            continue;
+        }
+
+        ent.klen = (uint32_t)strlen(entry->ckey);
+        ent.len = (uint32_t)len;
+        ok = ib_matcher_db_write(fp, &ent, sizeof(ent), sizeof(ent))
+             && ib_matcher_db_write(fp, entry->ckey, ent.klen + 1,
+                                    IB_MATCHER_DB_PAD(ent.klen + 1))
+             && ib_matcher_db_write(fp, buf, len, IB_MATCHER_DB_PAD(len));
+        hdr.count++;
+    }
+
+    if (ok) {
+        ok = (fseek(fp, 0, SEEK_SET) == 0)
+             && ib_matcher_db_write(fp, &hdr, sizeof(hdr), sizeof(hdr));
+    }
+    if ((fclose(fp) != 0) || !ok || (rename(tmp, db->path) != 0)) {
+        ib_log_error(ib, 3, "Failed to write pattern database \"%s\": %s",
+                     db->path, strerror(errno));
+        unlink(tmp);
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+
+    ib_log_debug(ib, 4, "Saved pattern database \"%s\" with %d patterns",
+                 db->path, (int)hdr.count);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+ib_status_t ib_matcher_db_close(ib_engine_t *ib)
+{
+    IB_FTRACE_INIT(ib_matcher_db_close);
+    ib_matcher_db_t *db = ib->matcher_db;
+    ib_list_node_t *node;
+    uint64_t hash = 0;
+    ib_status_t rc = IB_OK;
+
+    if (db == NULL) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    /* Patterns no longer used also make the file stale. */
+    IB_LIST_LOOP(ib->matcher_entries, node) {
+        const ib_matcher_centry_t *entry =
+            (const ib_matcher_centry_t *)ib_list_node_data(node);
+
+        if ((entry->cpatt != NULL) && ib_matcher_can_save(entry->mpr)) {
+            hash += ib_matcher_db_key_hash(entry->ckey);
+        }
+    }
+
+    if (db->stale || (hash != db->hash)) {
+        rc = ib_matcher_db_save(ib, db, hash);
+    }
+
+    /* Loaded patterns do not refer to the mapped file. */
+    if (db->map != NULL) {
+        munmap(db->map, db->size);
+        db->map = NULL;
+    }
+    ib->matcher_db = NULL;
+
+    IB_FTRACE_RET_STATUS(rc);
 }
@@ -0,0 +1,149 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee - Operators
+ *
+ * @author Brian Rectanus <brectanus@qualys.com>
+ */
+
+#include "ironbee_config_auto.h"
+
+#include <string.h>
+
+#include <ironbee/engine.h>
+#include <ironbee/util.h>
+
+#include "ironbee_private.h"
+
+
+/* -- Operator Routines -- */
+
+ib_status_t ib_operator_create(ib_engine_t *ib,
+                               const char *name,
+                               ib_operator_create_fn_t fn_create,
+                               ib_operator_execute_fn_t fn_execute,
+                               ib_operator_t **pop)
+{
+    IB_FTRACE_INIT(ib_operator_create);
+    ib_status_t rc;
+    ib_operator_t *op;
+    char *name_copy;
+    size_t name_len = strlen(name) + 1;
+
+    if (pop != NULL) {
+        *pop = NULL;
+    }
+
+    if (fn_execute == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    name_copy = (char *)ib_mpool_alloc(ib->mp, name_len);
+    if (name_copy == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    memcpy(name_copy, name, name_len);
+
+    op = (ib_operator_t *)ib_mpool_alloc(ib->mp, sizeof(*op));
+    if (op == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    op->name = name_copy;
+    op->fn_create = fn_create;
+    op->fn_execute = fn_execute;
+
+    rc = ib_hash_set(ib->operators, name_copy, op);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    if (pop != NULL) {
+        *pop = op;
+    }
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+ib_status_t ib_operator_lookup_ex(ib_engine_t *ib,
+                                  const char *name,
+                                  size_t nlen,
+                                  ib_operator_t **pop)
+{
+    IB_FTRACE_INIT(ib_operator_lookup_ex);
+    ib_status_t rc = ib_hash_get_ex(ib->operators, (void *)name, nlen,
+                                    (void *)pop);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+ib_status_t ib_operator_inst_create(ib_engine_t *ib,
+                                    ib_mpool_t *pool,
+                                    const char *name,
+                                    const char *params,
+                                    ib_operator_inst_t **pinst)
+{
+    IB_FTRACE_INIT(ib_operator_inst_create);
+    ib_operator_t *op;
+    ib_operator_inst_t *inst;
+    ib_status_t rc;
+
+    *pinst = NULL;
+
+    rc = ib_operator_lookup(ib, name, &op);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    inst = (ib_operator_inst_t *)ib_mpool_alloc(pool, sizeof(*inst));
+    if (inst == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    inst->op = op;
+    inst->params = (const char *)ib_mpool_memdup(pool, params,
+                                                 strlen(params) + 1);
+    inst->data = NULL;
+    if (inst->params == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    if (op->fn_create != NULL) {
+        rc = op->fn_create(ib, pool, inst->params, &inst->data);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+    }
+
+    *pinst = inst;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+const char *ib_operator_inst_name(const ib_operator_inst_t *inst)
+{
+    IB_FTRACE_INIT(ib_operator_inst_name);
+    IB_FTRACE_RET_CONSTSTR(inst->op->name);
+}
+
+ib_status_t ib_operator_execute(const ib_operator_inst_t *inst,
+                                ib_mpool_t *pool,
+                                ib_field_t *f)
+{
+    IB_FTRACE_INIT(ib_operator_execute);
+    ib_status_t rc = inst->op->fn_execute(inst->data, pool, f);
+    IB_FTRACE_RET_STATUS(rc);
+}
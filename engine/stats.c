@@ -0,0 +1,569 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee - Statistics
+ *
+ * @author Brian Rectanus <brectanus@qualys.com>
+ */
+
+#include "ironbee_config_auto.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+#include <pthread.h>
+
+#include <ironbee/engine.h>
+#include <ironbee/util.h>
+#include <ironbee/module.h>
+
+#include "ironbee_private.h"
+
+
+/* -- Per-Thread Statistics -- */
+
+/**
+ * @internal
+ * Engine generation counter.
+ *
+ * Each engine gets a unique generation so that a stale per-thread cache
+ * entry is never mistaken for the statistics of a new engine which was
+ * allocated at the same address.
+ */
+static uint32_t ib_stats_generation = 0;
+
+/**
+ * @internal
+ * Cached statistics for the calling thread.
+ *
+ * This is only a shortcut to avoid walking the engine thread list.
+ */
+static __thread struct {
+    ib_engine_t        *ib;               /**< Engine */
+    uint32_t            gen;              /**< Engine generation */
+    ib_stats_thread_t  *st;               /**< Thread statistics */
+} ib_stats_thread_cur;
+
+/**
+ * @internal
+ * Free all per-thread statistics when the engine is destroyed.
+ *
+ * @param data Engine
+ *
+ * @returns Status code
+ */
+static ib_status_t ib_stats_cleanup(void *data)
+{
+    IB_FTRACE_INIT(ib_stats_cleanup);
+    ib_engine_t *ib = (ib_engine_t *)data;
+    ib_stats_thread_t *st = ib->stats.threads;
+    size_t i;
+    size_t j;
+
+    ib->stats.threads = NULL;
+
+    while (st != NULL) {
+        ib_stats_thread_t *next = st->next;
+
+        for (i = 0; i < IB_STATS_CHUNKS; i++) {
+            free(st->counter[i]);
+        }
+        for (i = 0; i < IB_STATE_EVENT_NUM; i++) {
+            for (j = 0; j <= IB_HOOK_STATS_MODULES; j++) {
+                free(st->hook_hist[i][j]);
+            }
+        }
+        free(st);
+
+        st = next;
+    }
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Get the statistics for the calling thread, creating them if needed.
+ *
+ * Memory pools are not thread safe, so the per-thread statistics are
+ * allocated from the heap and pushed onto the engine list with an
+ * atomic compare-and-swap.
+ *
+ * @param ib Engine
+ *
+ * @returns Thread statistics (or NULL on allocation failure)
+ */
+static ib_stats_thread_t *ib_stats_thread_get(ib_engine_t *ib)
+{
+    IB_FTRACE_INIT(ib_stats_thread_get);
+    ib_stats_thread_t *st;
+    pthread_t self;
+
+    if (   (ib_stats_thread_cur.ib == ib)
+        && (ib_stats_thread_cur.gen == ib->stats.gen))
+    {
+        IB_FTRACE_RET_PTR(ib_stats_thread_t, ib_stats_thread_cur.st);
+    }
+
+    /* Another engine was used by this thread, so look it up. */
+    self = pthread_self();
+    for (st = ib->stats.threads; st != NULL; st = st->next) {
+        if (pthread_equal(st->tid, self)) {
+            ib_stats_thread_cur.ib = ib;
+            ib_stats_thread_cur.gen = ib->stats.gen;
+            ib_stats_thread_cur.st = st;
+            IB_FTRACE_RET_PTR(ib_stats_thread_t, st);
+        }
+    }
+
+    st = (ib_stats_thread_t *)calloc(1, sizeof(*st));
+    if (st == NULL) {
+        IB_FTRACE_RET_PTR(ib_stats_thread_t, NULL);
+    }
+    st->ib = ib;
+    st->tid = self;
+
+    do {
+        st->next = ib->stats.threads;
+    } while (!__sync_bool_compare_and_swap(&ib->stats.threads,
+                                           st->next, st));
+
+    ib_stats_thread_cur.ib = ib;
+    ib_stats_thread_cur.gen = ib->stats.gen;
+    ib_stats_thread_cur.st = st;
+
+    IB_FTRACE_RET_PTR(ib_stats_thread_t, st);
+}
+
+/**
+ * @internal
+ * Initialize engine statistics.
+ *
+ * @param ib Engine
+ *
+ * @returns Status code
+ */
+ib_status_t ib_stats_init(ib_engine_t *ib)
+{
+    IB_FTRACE_INIT(ib_stats_init);
+    static const char *builtin[IB_STAT_BUILTIN_NUM] = {
+        "conn.count",
+        "tx.count",
+        "conn.bytes_in",
+        "conn.bytes_out",
+        "logevent.count",
+        "parser.errors",
+        "context.main.selected",
+        "auditlog.count"
+    };
+    ib_stat_id_t id;
+    ib_status_t rc;
+    size_t i;
+
+    memset(&ib->stats, 0, sizeof(ib->stats));
+    ib->stats.gen = __sync_add_and_fetch(&ib_stats_generation, 1);
+    ib->stats.hook_dump_last = time(NULL);
+    ib_mpool_cleanup_register(ib->mp, ib, ib_stats_cleanup);
+
+    rc = ib_array_create(&ib->stats.names, ib->mp, 32, 32);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    rc = ib_hash_create(&ib->stats.ids, ib->mp);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    /* Register the built-in counters so their IDs are fixed. */
+    for (i = 0; i < IB_STAT_BUILTIN_NUM; i++) {
+        rc = ib_stat_register(ib, builtin[i], &id);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+    }
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+uint64_t ib_stats_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+
+/* -- Counters -- */
+
+ib_status_t ib_stat_register(ib_engine_t *ib,
+                             const char *name,
+                             ib_stat_id_t *pid)
+{
+    IB_FTRACE_INIT(ib_stat_register);
+    ib_stat_id_t *id;
+    char *name_copy;
+    ib_status_t rc;
+
+    rc = ib_stat_lookup(ib, name, pid);
+    if (rc == IB_OK) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    if (ib_array_elements(ib->stats.names) >= IB_STATS_MAX) {
+        ib_log_error(ib, 1, "Too many statistics counters registered: %s",
+                     name);
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    name_copy = (char *)ib_mpool_memdup(ib->mp, name, strlen(name) + 1);
+    id = (ib_stat_id_t *)ib_mpool_alloc(ib->mp, sizeof(*id));
+    if ((name_copy == NULL) || (id == NULL)) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    *id = ib_array_elements(ib->stats.names);
+
+    rc = ib_array_appendn(ib->stats.names, name_copy);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    rc = ib_hash_set(ib->stats.ids, name_copy, id);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    ib_log_debug(ib, 9, "Registered statistics counter %s=%zu",
+                 name_copy, *id);
+
+    *pid = *id;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+ib_status_t ib_stat_lookup(ib_engine_t *ib,
+                           const char *name,
+                           ib_stat_id_t *pid)
+{
+    IB_FTRACE_INIT(ib_stat_lookup);
+    ib_stat_id_t *id;
+    ib_status_t rc;
+
+    rc = ib_hash_get(ib->stats.ids, name, &id);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(IB_ENOENT);
+    }
+
+    *pid = *id;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+void ib_stat_add(ib_engine_t *ib,
+                 ib_stat_id_t id,
+                 uint64_t n)
+{
+    IB_FTRACE_INIT(ib_stat_add);
+    ib_stats_thread_t *st;
+    ib_stats_chunk_t *chunk;
+    size_t cidx = id / IB_STATS_CHUNK_SIZE;
+
+    if (cidx >= IB_STATS_CHUNKS) {
+        IB_FTRACE_RET_VOID();
+    }
+
+    st = ib_stats_thread_get(ib);
+    if (st == NULL) {
+        IB_FTRACE_RET_VOID();
+    }
+
+    chunk = st->counter[cidx];
+    if (chunk == NULL) {
+        void *mem;
+
+        if (posix_memalign(&mem, IB_STATS_CACHELINE, sizeof(*chunk)) != 0) {
+            IB_FTRACE_RET_VOID();
+        }
+        chunk = (ib_stats_chunk_t *)mem;
+        memset(chunk, 0, sizeof(*chunk));
+
+        /* Publish with a full barrier so readers see a zeroed chunk. */
+        __sync_bool_compare_and_swap(&st->counter[cidx], NULL, chunk);
+    }
+
+    /* Only this thread writes to the chunk, so no atomics are needed. */
+    chunk->val[id % IB_STATS_CHUNK_SIZE] += n;
+
+    IB_FTRACE_RET_VOID();
+}
+
+ib_status_t ib_stat_get(ib_engine_t *ib,
+                        ib_stat_id_t id,
+                        uint64_t *pval)
+{
+    IB_FTRACE_INIT(ib_stat_get);
+    size_t cidx = id / IB_STATS_CHUNK_SIZE;
+    ib_stats_thread_t *st;
+    uint64_t val = 0;
+
+    if (id >= ib_array_elements(ib->stats.names)) {
+        *pval = 0;
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    for (st = ib->stats.threads; st != NULL; st = st->next) {
+        const ib_stats_chunk_t *chunk = st->counter[cidx];
+        if (chunk != NULL) {
+            val += chunk->val[id % IB_STATS_CHUNK_SIZE];
+        }
+    }
+
+    *pval = val;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+ib_status_t ib_stat_walk(ib_engine_t *ib,
+                         ib_stat_fn_t cb,
+                         void *cbdata)
+{
+    IB_FTRACE_INIT(ib_stat_walk);
+    const char *name;
+    size_t n;
+    size_t i;
+
+    IB_ARRAY_LOOP(ib->stats.names, n, i, name) {
+        uint64_t val;
+
+        ib_stat_get(ib, i, &val);
+        cb(ib, name, val, cbdata);
+    }
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+
+/* -- Hook Timing -- */
+
+/**
+ * @internal
+ * Get the module slot used to record timing for a hook.
+ *
+ * @param m Module (or NULL)
+ *
+ * @returns Module slot
+ */
+static size_t ib_hook_stats_slot(const ib_module_t *m)
+{
+    if ((m == NULL) || (m->idx >= IB_HOOK_STATS_MODULES)) {
+        return IB_HOOK_STATS_MODULES;
+    }
+    return m->idx;
+}
+
+void ib_hook_stats_record(ib_engine_t *ib,
+                          ib_state_event_type_t event,
+                          const ib_hook_t *hook,
+                          uint64_t nsec)
+{
+    IB_FTRACE_INIT(ib_hook_stats_record);
+    ib_stats_thread_t *st = ib_stats_thread_get(ib);
+    size_t slot = ib_hook_stats_slot(hook->module);
+    ib_hist_t *h;
+
+    if (st == NULL) {
+        IB_FTRACE_RET_VOID();
+    }
+
+    h = st->hook_hist[event][slot];
+    if (h == NULL) {
+        h = (ib_hist_t *)malloc(sizeof(*h));
+        if (h == NULL) {
+            IB_FTRACE_RET_VOID();
+        }
+        ib_hist_clear(h);
+
+        /* Publish with a full barrier so readers see a cleared histogram. */
+        __sync_bool_compare_and_swap(&st->hook_hist[event][slot], NULL, h);
+    }
+
+    ib_hist_record(h, nsec);
+
+    IB_FTRACE_RET_VOID();
+}
+
+void ib_hook_stats_enable(ib_engine_t *ib,
+                          int enable)
+{
+    IB_FTRACE_INIT(ib_hook_stats_enable);
+    ib->stats.hook_timing = enable ? 1 : 0;
+    IB_FTRACE_RET_VOID();
+}
+
+void ib_hook_stats_dump_interval(ib_engine_t *ib,
+                                 time_t secs)
+{
+    IB_FTRACE_INIT(ib_hook_stats_dump_interval);
+    ib->stats.hook_dump_interval = secs;
+    IB_FTRACE_RET_VOID();
+}
+
+/**
+ * @internal
+ * Merge the hook timing for an event and module slot from all threads.
+ *
+ * @param ib Engine
+ * @param event Event
+ * @param slot Module slot
+ * @param h Histogram to merge into
+ */
+static void ib_hook_stats_merge(ib_engine_t *ib,
+                                ib_state_event_type_t event,
+                                size_t slot,
+                                ib_hist_t *h)
+{
+    ib_stats_thread_t *st;
+
+    for (st = ib->stats.threads; st != NULL; st = st->next) {
+        const ib_hist_t *th = st->hook_hist[event][slot];
+        if (th != NULL) {
+            ib_hist_merge(h, th);
+        }
+    }
+}
+
+ib_status_t ib_hook_stats_get(ib_engine_t *ib,
+                              ib_state_event_type_t event,
+                              ib_module_t *m,
+                              ib_hist_t *h)
+{
+    IB_FTRACE_INIT(ib_hook_stats_get);
+
+    if ((event < 0) || (event >= IB_STATE_EVENT_NUM)) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    ib_hook_stats_merge(ib, event, ib_hook_stats_slot(m), h);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+ib_status_t ib_hook_stats_walk(ib_engine_t *ib,
+                               ib_hook_stats_fn_t cb,
+                               void *cbdata)
+{
+    IB_FTRACE_INIT(ib_hook_stats_walk);
+    ib_hist_t *h;
+    size_t event;
+    size_t slot;
+
+    h = (ib_hist_t *)malloc(sizeof(*h));
+    if (h == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    for (event = 0; event < IB_STATE_EVENT_NUM; event++) {
+        for (slot = 0; slot <= IB_HOOK_STATS_MODULES; slot++) {
+            ib_module_t *m = NULL;
+
+            ib_hist_clear(h);
+            ib_hook_stats_merge(ib, (ib_state_event_type_t)event, slot, h);
+            if (h->count == 0) {
+                continue;
+            }
+
+            if (slot < IB_HOOK_STATS_MODULES) {
+                ib_array_get(ib->modules, slot, (void *)&m);
+            }
+
+            cb(ib, (ib_state_event_type_t)event, m, h, cbdata);
+        }
+    }
+
+    free(h);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Log the timing for one (event, module) pair.
+ *
+ * @param ib Engine
+ * @param event Event
+ * @param m Module
+ * @param h Histogram
+ * @param cbdata Log level
+ */
+static void ib_hook_stats_log(ib_engine_t *ib,
+                              ib_state_event_type_t event,
+                              ib_module_t *m,
+                              const ib_hist_t *h,
+                              void *cbdata)
+{
+    int level = *(int *)cbdata;
+
+    ib_log(ib, level,
+           "HOOK TIMING: %s module=%s count=%" PRIu64
+           " mean=%" PRIu64 "ns p50=%" PRIu64 "ns p90=%" PRIu64 "ns"
+           " p99=%" PRIu64 "ns p999=%" PRIu64 "ns max=%" PRIu64 "ns",
+           ib_state_event_name(event),
+           m ? m->name : IB_DSTR_UNKNOWN,
+           h->count,
+           ib_hist_mean(h),
+           ib_hist_percentile(h, 50.0),
+           ib_hist_percentile(h, 90.0),
+           ib_hist_percentile(h, 99.0),
+           ib_hist_percentile(h, 99.9),
+           h->max);
+}
+
+void ib_hook_stats_dump(ib_engine_t *ib,
+                        int level)
+{
+    IB_FTRACE_INIT(ib_hook_stats_dump);
+    ib_hook_stats_walk(ib, ib_hook_stats_log, &level);
+    IB_FTRACE_RET_VOID();
+}
+
+void ib_hook_stats_periodic(ib_engine_t *ib)
+{
+    IB_FTRACE_INIT(ib_hook_stats_periodic);
+    time_t last = ib->stats.hook_dump_last;
+    time_t now;
+
+    if (!ib->stats.hook_timing || (ib->stats.hook_dump_interval == 0)) {
+        IB_FTRACE_RET_VOID();
+    }
+
+    now = time(NULL);
+    if ((now - last) < ib->stats.hook_dump_interval) {
+        IB_FTRACE_RET_VOID();
+    }
+
+    /* Only the thread which wins the update does the dump. */
+    if (__sync_bool_compare_and_swap(&ib->stats.hook_dump_last, last, now)) {
+        ib_hook_stats_dump(ib, 1);
+    }
+
+    IB_FTRACE_RET_VOID();
+}
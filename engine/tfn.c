@@ -30,6 +30,7 @@
 #include <ironbee/util.h>
 
 #include "ironbee_private.h"
+#include "ironbee_probes.h"
 
 
 /* -- Transformation Routines -- */
@@ -65,6 +66,8 @@ ib_status_t ib_tfn_create(ib_engine_t *ib,
     tfn->name = name_copy;
     tfn->transform = transform;
     tfn->fndata = fndata;
+    tfn->fuse = NULL;
+    tfn->stream = NULL;
 
     rc = ib_hash_set(ib->tfns, name_copy, tfn);
     if (rc != IB_OK) {
@@ -81,6 +84,44 @@ ib_status_t ib_tfn_create(ib_engine_t *ib,
     IB_FTRACE_RET_STATUS(IB_OK);
 }
 
+ib_status_t ib_tfn_fuse_set(ib_tfn_t *tfn,
+                            const ib_tfn_fuse_t *stages)
+{
+    IB_FTRACE_INIT(ib_tfn_fuse_set);
+    size_t n = 0;
+
+    while (stages[n].type != IB_TFN_FUSE_END) {
+        if (   ((stages[n].type == IB_TFN_FUSE_MAP) && (stages[n].map == NULL))
+            || (   (stages[n].type == IB_TFN_FUSE_DECODE)
+                && ((stages[n].decode == NULL) || (stages[n].flush == NULL))))
+        {
+            IB_FTRACE_RET_STATUS(IB_EINVAL);
+        }
+        n++;
+    }
+    if ((n == 0) || (n > IB_TFN_FUSE_MAX_STAGES)) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    tfn->fuse = stages;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+ib_status_t ib_tfn_stream_set(ib_tfn_t *tfn,
+                              const ib_tfn_stream_fns_t *fns)
+{
+    IB_FTRACE_INIT(ib_tfn_stream_set);
+
+    if ((fns->update == NULL) || (fns->finish == NULL)) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    tfn->stream = fns;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
 ib_status_t ib_tfn_lookup_ex(ib_engine_t *ib,
                              const char *name,
                              size_t nlen,
@@ -100,7 +141,12 @@ ib_status_t ib_tfn_transform(ib_tfn_t *tfn,
                              ib_flags_t *pflags)
 {
     IB_FTRACE_INIT(ib_tfn_transform);
-    ib_status_t rc = tfn->transform(tfn->fndata, pool, data_in, dlen_in, data_out, dlen_out, pflags);
+    ib_status_t rc;
+
+    IB_PROBE3(tfn_transform_enter, tfn, tfn->name, dlen_in);
+    rc = tfn->transform(tfn->fndata, pool, data_in, dlen_in, data_out, dlen_out, pflags);
+    IB_PROBE4(tfn_transform_return, tfn, tfn->name, rc, *pflags);
+
     IB_FTRACE_RET_STATUS(rc);
 }
 
@@ -111,6 +157,7 @@ ib_status_t ib_tfn_transform_field(ib_tfn_t *tfn,
     IB_FTRACE_INIT(ib_tfn_transform);
     ib_bytestr_t *bs;
     char *str;
+    size_t dlen_in;
     uint8_t *data_out;
     size_t dlen_out;
     ib_status_t rc;
@@ -119,6 +166,8 @@ ib_status_t ib_tfn_transform_field(ib_tfn_t *tfn,
         case IB_FTYPE_BYTESTR:
             bs = ib_field_value_bytestr(f);
 
+            IB_PROBE3(tfn_transform_enter, tfn, tfn->name,
+                      ib_bytestr_length(bs));
             rc = tfn->transform(tfn->fndata,
                                 f->mp,
                                 ib_bytestr_ptr(bs),
@@ -126,6 +175,7 @@ ib_status_t ib_tfn_transform_field(ib_tfn_t *tfn,
                                 &data_out,
                                 &dlen_out,
                                 pflags);
+            IB_PROBE4(tfn_transform_return, tfn, tfn->name, rc, *pflags);
 
             /* If it is modified and not done inplace, then the
              * field value needs to be updated.
@@ -140,21 +190,24 @@ ib_status_t ib_tfn_transform_field(ib_tfn_t *tfn,
                     IB_FTRACE_RET_STATUS(rc);
                 }
 
-                rc = ib_field_setv(f, bs_new);
+                rc = ib_field_setv(f, &bs_new);
             }
 
             IB_FTRACE_RET_STATUS(rc);
 
         case IB_FTYPE_NULSTR:
-            str = ib_field_value_nulstr(f),
+            str = ib_field_value_nulstr(f);
+            dlen_in = strlen(str);
 
+            IB_PROBE3(tfn_transform_enter, tfn, tfn->name, dlen_in);
             rc = tfn->transform(tfn->fndata,
                                 f->mp,
                                 (uint8_t *)str,
-                                strlen(str),
+                                dlen_in,
                                 &data_out,
                                 &dlen_out,
                                 pflags);
+            IB_PROBE4(tfn_transform_return, tfn, tfn->name, rc, *pflags);
 
             /* If it is modified and not done inplace, then the
              * field value needs to be updated.
@@ -166,7 +219,7 @@ ib_status_t ib_tfn_transform_field(ib_tfn_t *tfn,
             if (   IB_TFN_CHECK_FMODIFIED(*pflags)
                 && !IB_TFN_CHECK_FINPLACE(*pflags))
             {
-                rc = ib_field_setv(f, data_out);
+                rc = ib_field_setv(f, &data_out);
             }
 
             IB_FTRACE_RET_STATUS(rc);
@@ -176,3 +229,745 @@ ib_status_t ib_tfn_transform_field(ib_tfn_t *tfn,
     IB_FTRACE_RET_STATUS(IB_EINVAL);
 }
 
+
+
+/* -- Fused Transformations -- */
+
+/**
+ * @internal
+ * Check for whitespace (as isspace() in the "C" locale).
+ */
+#define IB_TFN_ISSPACE(c) \
+    (((c) == ' ') || (((c) >= '\t') && ((c) <= '\r')))
+
+/**
+ * @internal
+ * Fused execution state.
+ */
+typedef struct {
+    const ib_tfn_step_t *step;            /**< Fused step */
+    uint8_t            *out;              /**< Output (in-place) */
+    size_t              olen;             /**< Output length */
+    size_t              keep;             /**< Output length to keep
+                                               (trimRight) */
+    int                 modified;         /**< Output differs from input */
+    struct {
+        int                  flag;        /**< Stage flag */
+        ib_tfn_fuse_dstate_t ds;          /**< Decoder state */
+    } st[IB_TFN_FUSE_MAX_STAGES];         /**< Per-stage state */
+} ib_tfn_fuse_run_t;
+
+/**
+ * @internal
+ * Push a byte through the fused stages, starting at a given stage.
+ *
+ * @param run Execution state
+ * @param k First stage
+ * @param c Byte
+ */
+static void ib_tfn_fuse_push(ib_tfn_fuse_run_t *run,
+                             size_t k,
+                             uint8_t c)
+{
+    const ib_tfn_step_t *step = run->step;
+
+    for (; k < step->nstage; k++) {
+        const ib_tfn_fuse_t *fz = step->stage[k];
+
+        switch (fz->type) {
+            case IB_TFN_FUSE_MAP:
+                c = fz->map[c];
+                break;
+
+            case IB_TFN_FUSE_COMPRESS_WS:
+                if (IB_TFN_ISSPACE(c)) {
+                    if (run->st[k].flag) {
+                        return;
+                    }
+                    run->st[k].flag = 1;
+                    c = ' ';
+                }
+                else {
+                    run->st[k].flag = 0;
+                }
+                break;
+
+            case IB_TFN_FUSE_TRIM_LEFT:
+                if (!run->st[k].flag) {
+                    if (IB_TFN_ISSPACE(c)) {
+                        return;
+                    }
+                    run->st[k].flag = 1;
+                }
+                break;
+
+            case IB_TFN_FUSE_TRIM_RIGHT:
+                /* Only byte maps may follow, so this byte will be
+                 * written at the current output position.
+                 */
+                if (!IB_TFN_ISSPACE(c)) {
+                    run->keep = run->olen + 1;
+                }
+                break;
+
+            case IB_TFN_FUSE_DECODE:
+            {
+                uint8_t buf[IB_TFN_FUSE_DECODE_MAX];
+                size_t n = fz->decode(&run->st[k].ds, c, buf);
+                size_t i;
+
+                for (i = 0; i < n; i++) {
+                    ib_tfn_fuse_push(run, k + 1, buf[i]);
+                }
+                return;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    if (run->out[run->olen] != c) {
+        run->out[run->olen] = c;
+        run->modified = 1;
+    }
+    run->olen++;
+}
+
+/**
+ * @internal
+ * Flush the decoders of a fused step at the end of the data.
+ *
+ * Decoders are flushed in order, so that later decoders see the
+ * flushed data of earlier decoders before being flushed.
+ *
+ * @param run Execution state
+ */
+static void ib_tfn_fuse_flush(ib_tfn_fuse_run_t *run)
+{
+    const ib_tfn_step_t *step = run->step;
+    size_t k;
+
+    for (k = 0; k < step->nstage; k++) {
+        const ib_tfn_fuse_t *fz = step->stage[k];
+
+        if (fz->type == IB_TFN_FUSE_DECODE) {
+            uint8_t buf[IB_TFN_FUSE_DECODE_MAX];
+            size_t n = fz->flush(&run->st[k].ds, buf);
+            size_t i;
+
+            for (i = 0; i < n; i++) {
+                ib_tfn_fuse_push(run, k + 1, buf[i]);
+            }
+        }
+    }
+}
+
+/**
+ * @internal
+ * Check if a fused step trims the right side (and so needs all
+ * of the data before its output is known).
+ *
+ * @param step Fused step
+ *
+ * @returns Non-zero if the step trims the right side
+ */
+static int ib_tfn_fuse_trims_right(const ib_tfn_step_t *step)
+{
+    size_t k;
+
+    for (k = 0; k < step->nstage; k++) {
+        if (step->stage[k]->type == IB_TFN_FUSE_TRIM_RIGHT) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @internal
+ * Execute a fused step in a single pass over the data.
+ *
+ * @param step Fused step
+ * @param data Data (modified in-place)
+ * @param dlen Data length
+ * @param pdlen Address which the new length is written
+ *
+ * @returns Non-zero if the data was modified
+ */
+static int ib_tfn_fuse_exec(const ib_tfn_step_t *step,
+                            uint8_t *data,
+                            size_t dlen,
+                            size_t *pdlen)
+{
+    ib_tfn_fuse_run_t run;
+    size_t i;
+    int modified;
+
+    IB_PROBE3(tfn_fuse_enter, step, step->nstage, dlen);
+
+    memset(&run, 0, sizeof(run));
+    run.step = step;
+    run.out = data;
+
+    for (i = 0; i < dlen; i++) {
+        ib_tfn_fuse_push(&run, 0, data[i]);
+    }
+    ib_tfn_fuse_flush(&run);
+
+    if (ib_tfn_fuse_trims_right(step) && (run.keep < run.olen)) {
+        run.olen = run.keep;
+    }
+
+    *pdlen = run.olen;
+    modified = run.modified || (run.olen != dlen);
+
+    IB_PROBE3(tfn_fuse_return, step, run.olen, modified);
+
+    return modified;
+}
+
+/**
+ * @internal
+ * Execute a fused step on a data field.
+ *
+ * @param step Fused step
+ * @param f Field
+ * @param pflags Address of flags set by the step
+ *
+ * @returns Status code
+ */
+static ib_status_t ib_tfn_fuse_exec_field(const ib_tfn_step_t *step,
+                                          ib_field_t *f,
+                                          ib_flags_t *pflags)
+{
+    IB_FTRACE_INIT(ib_tfn_fuse_exec_field);
+    ib_bytestr_t *bs;
+    ib_bytestr_t *bs_new;
+    uint8_t *data;
+    size_t dlen;
+    ib_status_t rc;
+
+    *pflags = IB_TFN_FINPLACE;
+
+    switch(f->type) {
+        case IB_FTYPE_BYTESTR:
+            bs = ib_field_value_bytestr(f);
+            data = ib_bytestr_ptr(bs);
+
+            if (!ib_tfn_fuse_exec(step, data, ib_bytestr_length(bs), &dlen)) {
+                IB_FTRACE_RET_STATUS(IB_OK);
+            }
+            *pflags |= IB_TFN_FMODIFIED;
+
+            if (dlen == ib_bytestr_length(bs)) {
+                IB_FTRACE_RET_STATUS(IB_OK);
+            }
+
+            /* The length changed, so the value needs to be updated. */
+            rc = ib_bytestr_alias_mem(&bs_new, f->mp, data, dlen);
+            if (rc != IB_OK) {
+                IB_FTRACE_RET_STATUS(rc);
+            }
+            rc = ib_field_setv(f, &bs_new);
+            IB_FTRACE_RET_STATUS(rc);
+
+        case IB_FTYPE_NULSTR:
+            data = (uint8_t *)ib_field_value_nulstr(f);
+
+            if (!ib_tfn_fuse_exec(step, data, strlen((char *)data), &dlen)) {
+                IB_FTRACE_RET_STATUS(IB_OK);
+            }
+            *pflags |= IB_TFN_FMODIFIED;
+            data[dlen] = '\0';
+
+            IB_FTRACE_RET_STATUS(IB_OK);
+
+        default:
+            break;
+    }
+
+    IB_FTRACE_RET_STATUS(IB_EINVAL);
+}
+
+
+/* -- Transformation Pipelines -- */
+
+/**
+ * @internal
+ * Group the tfns of a pipeline into steps, fusing adjacent
+ * fusable tfns into a single step.
+ *
+ * @param ib Engine
+ * @param pl Pipeline
+ *
+ * @returns Status code
+ */
+static ib_status_t ib_tfn_pipeline_fuse(ib_engine_t *ib,
+                                        ib_tfn_pipeline_t *pl)
+{
+    IB_FTRACE_INIT(ib_tfn_pipeline_fuse);
+    ib_tfn_step_t *step = NULL;
+    size_t nfused = 0;
+    size_t i;
+
+    pl->step = (ib_tfn_step_t *)ib_mpool_calloc(ib->mp, pl->ntfn,
+                                                sizeof(*pl->step));
+    if (pl->step == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    pl->nstep = 0;
+
+    for (i = 0; i < pl->ntfn; i++) {
+        ib_tfn_t *t = pl->tfn[i];
+        int fits = 0;
+        size_t n;
+        size_t j;
+
+        if (t->fuse == NULL) {
+            step = NULL;
+            pl->step[pl->nstep++].tfn = t;
+            continue;
+        }
+
+        for (n = 0; t->fuse[n].type != IB_TFN_FUSE_END; n++);
+
+        /* See if all the stages can join the current fused step. Once
+         * a step trims the right side, only byte maps may follow as
+         * the trim position must map directly to the output.
+         */
+        if ((step != NULL) && (step->nstage + n <= IB_TFN_FUSE_MAX_STAGES)) {
+            int trim_right = 0;
+
+            for (j = 0; j < step->nstage; j++) {
+                if (step->stage[j]->type == IB_TFN_FUSE_TRIM_RIGHT) {
+                    trim_right = 1;
+                }
+            }
+            fits = 1;
+            for (j = 0; j < n; j++) {
+                if (trim_right && (t->fuse[j].type != IB_TFN_FUSE_MAP)) {
+                    fits = 0;
+                    break;
+                }
+                if (t->fuse[j].type == IB_TFN_FUSE_TRIM_RIGHT) {
+                    trim_right = 1;
+                }
+            }
+        }
+
+        if (!fits) {
+            step = &pl->step[pl->nstep++];
+            step->tfn = t;
+            step->nstage = 0;
+        }
+        else {
+            /* More than one tfn, so this step is now fused. */
+            step->tfn = NULL;
+            nfused++;
+        }
+
+        for (j = 0; j < n; j++) {
+            step->stage[step->nstage++] = &t->fuse[j];
+        }
+    }
+
+    if (nfused > 0) {
+        ib_log_debug(ib, 7, "Fused %zu transformations in pipeline: %s",
+                     nfused, pl->spec);
+    }
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+ib_status_t ib_tfn_pipeline_create(ib_engine_t *ib,
+                                   const char *tfns,
+                                   ib_tfn_pipeline_t **ppl)
+{
+    IB_FTRACE_INIT(ib_tfn_pipeline_create);
+    ib_tfn_pipeline_t *pl;
+    const char *tname;
+    size_t tlen = strlen(tfns);
+    size_t i;
+    ib_status_t rc;
+
+    /* The same list of names always results in the same pipeline. */
+    rc = ib_hash_get(ib->tfn_pipelines, tfns, ppl);
+    if (rc == IB_OK) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    pl = (ib_tfn_pipeline_t *)ib_mpool_calloc(ib->mp, 1, sizeof(*pl));
+    if (pl == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    pl->spec = (const char *)ib_mpool_memdup(ib->mp, tfns, tlen + 1);
+    if (pl->spec == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    /* Count the tfns to size the array. */
+    pl->ntfn = 1;
+    for (i = 0; i < tlen; i++) {
+        if (tfns[i] == ',') {
+            pl->ntfn++;
+        }
+    }
+    pl->tfn = (ib_tfn_t **)ib_mpool_alloc(ib->mp,
+                                          pl->ntfn * sizeof(*pl->tfn));
+    if (pl->tfn == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    /* Resolve each tfn name. */
+    pl->ntfn = 0;
+    tname = tfns;
+    for (i = 0; i <= tlen; i++) {
+        if ((tfns[i] == ',') || (i == tlen)) {
+            const char *end = tfns + i;
+            size_t len;
+
+            /* Allow whitespace around the names. */
+            while ((tname < end) && ((*tname == ' ') || (*tname == '\t'))) {
+                tname++;
+            }
+            while ((end > tname) && ((end[-1] == ' ') || (end[-1] == '\t'))) {
+                end--;
+            }
+            len = end - tname;
+
+            if (len == 0) {
+                ib_log_error(ib, 1, "Empty transformation in \"%s\"", tfns);
+                IB_FTRACE_RET_STATUS(IB_EINVAL);
+            }
+
+            rc = ib_tfn_lookup_ex(ib, tname, len, &pl->tfn[pl->ntfn]);
+            if (rc != IB_OK) {
+                ib_log_error(ib, 1,
+                             "Unknown transformation: %" IB_BYTESTR_FMT,
+                             IB_BYTESTRSL_FMT_PARAM(tname, len));
+                IB_FTRACE_RET_STATUS(IB_EINVAL);
+            }
+            pl->ntfn++;
+
+            tname = tfns + i + 1;
+        }
+    }
+
+    rc = ib_tfn_pipeline_fuse(ib, pl);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    pl->id = ib->tfn_pipeline_num;
+    rc = ib_hash_set(ib->tfn_pipelines, pl->spec, pl);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    ib->tfn_pipeline_num++;
+
+    ib_log_debug(ib, 7, "Compiled transformation pipeline %zu: %s "
+                 "(%zu tfns in %zu passes)",
+                 pl->id, pl->spec, pl->ntfn, pl->nstep);
+
+    *ppl = pl;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+size_t ib_tfn_pipeline_id(const ib_tfn_pipeline_t *pl)
+{
+    IB_FTRACE_INIT(ib_tfn_pipeline_id);
+    IB_FTRACE_RET_SIZET(pl->id);
+}
+
+ib_status_t ib_tfn_pipeline_transform_field(const ib_tfn_pipeline_t *pl,
+                                            ib_field_t *f,
+                                            ib_flags_t *pflags)
+{
+    IB_FTRACE_INIT(ib_tfn_pipeline_transform_field);
+    ib_status_t rc;
+    size_t i;
+
+    *pflags = IB_TFN_FNONE;
+
+    for (i = 0; i < pl->nstep; i++) {
+        const ib_tfn_step_t *step = &pl->step[i];
+        ib_flags_t flags = IB_TFN_FNONE;
+
+        if (step->tfn != NULL) {
+            rc = ib_tfn_transform_field(step->tfn, f, &flags);
+        }
+        else {
+            rc = ib_tfn_fuse_exec_field(step, f, &flags);
+        }
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+        *pflags |= flags;
+    }
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+
+/* -- Streaming Transformations -- */
+
+/**
+ * @internal
+ * Streaming pipeline step state.
+ *
+ * A fused step keeps its execution state between chunks, while a
+ * streaming tfn keeps its own state plus any unconsumed data.
+ */
+typedef struct {
+    const ib_tfn_step_t *step;            /**< Step */
+    const ib_tfn_stream_fns_t *fns;       /**< Tfn streaming functions
+                                               (NULL if fused) */
+    void               *state;            /**< Tfn stream state */
+    ib_tfn_fuse_run_t   run;              /**< Fused execution state */
+    uint8_t             carry[IB_TFN_STREAM_CARRY_MAX]; /**< Unconsumed */
+    size_t              clen;             /**< Unconsumed length */
+} ib_tfn_stream_step_t;
+
+/**
+ * @internal
+ * Streaming pipeline.
+ *
+ * Each chunk is passed through the steps alternating between two
+ * buffers, which are only grown for a larger chunk than seen before.
+ */
+struct ib_tfn_stream_t {
+    const ib_tfn_pipeline_t *pl;          /**< Pipeline */
+    ib_mpool_t         *mp;               /**< Memory pool */
+    ib_tfn_stream_step_t *ss;             /**< Step states */
+    uint8_t            *buf[2];           /**< Work buffers */
+    size_t              bsize;            /**< Size of each work buffer */
+    size_t              extra;            /**< Most the output may grow
+                                               by in a chunk */
+    int                 finished;         /**< Stream finished */
+};
+
+ib_status_t ib_tfn_stream_create(const ib_tfn_pipeline_t *pl,
+                                 ib_mpool_t *mp,
+                                 ib_tfn_stream_t **pts)
+{
+    IB_FTRACE_INIT(ib_tfn_stream_create);
+    ib_tfn_stream_t *ts;
+    ib_status_t rc;
+    size_t i;
+
+    ts = (ib_tfn_stream_t *)ib_mpool_calloc(mp, 1, sizeof(*ts));
+    if (ts == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    ts->ss = (ib_tfn_stream_step_t *)ib_mpool_calloc(mp, pl->nstep,
+                                                     sizeof(*ts->ss));
+    if (ts->ss == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    ts->pl = pl;
+    ts->mp = mp;
+
+    for (i = 0; i < pl->nstep; i++) {
+        const ib_tfn_step_t *step = &pl->step[i];
+        ib_tfn_stream_step_t *ss = &ts->ss[i];
+
+        ss->step = step;
+
+        /* A tfn with streaming functions uses them, otherwise
+         * the fused stages are streamed directly.
+         */
+        if ((step->tfn != NULL) && (step->tfn->stream != NULL)) {
+            ss->fns = step->tfn->stream;
+            if (ss->fns->state_size > 0) {
+                ss->state = ib_mpool_calloc(mp, 1, ss->fns->state_size);
+                if (ss->state == NULL) {
+                    IB_FTRACE_RET_STATUS(IB_EALLOC);
+                }
+            }
+            if (ss->fns->init != NULL) {
+                rc = ss->fns->init(step->tfn->fndata, ss->state);
+                if (rc != IB_OK) {
+                    IB_FTRACE_RET_STATUS(rc);
+                }
+            }
+            ts->extra += IB_TFN_STREAM_CARRY_MAX;
+        }
+        else if ((step->nstage > 0) && !ib_tfn_fuse_trims_right(step)) {
+            ss->run.step = step;
+            ts->extra += step->nstage * IB_TFN_FUSE_DECODE_MAX;
+        }
+        else {
+            IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+        }
+    }
+
+    *pts = ts;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Make sure the work buffers can hold a chunk.
+ *
+ * @param ts Stream
+ * @param dlen Chunk length
+ *
+ * @returns Status code
+ */
+static ib_status_t ib_tfn_stream_reserve(ib_tfn_stream_t *ts,
+                                         size_t dlen)
+{
+    size_t need = dlen + ts->extra;
+
+    if (need <= ts->bsize) {
+        return IB_OK;
+    }
+
+    /* Grow geometrically so varying chunk sizes do not keep
+     * allocating from the pool.
+     */
+    if (need < ts->bsize * 2) {
+        need = ts->bsize * 2;
+    }
+    ts->buf[0] = (uint8_t *)ib_mpool_alloc(ts->mp, need);
+    ts->buf[1] = (uint8_t *)ib_mpool_alloc(ts->mp, need);
+    if ((ts->buf[0] == NULL) || (ts->buf[1] == NULL)) {
+        ts->bsize = 0;
+        return IB_EALLOC;
+    }
+    ts->bsize = need;
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Pass data through all steps of a stream.
+ *
+ * @param ts Stream
+ * @param dlen Length of data in the first work buffer
+ * @param final Non-zero if this is the end of the data
+ * @param pout Address which the output is written
+ * @param polen Address which the output length is written
+ *
+ * @returns Status code
+ */
+static ib_status_t ib_tfn_stream_run(ib_tfn_stream_t *ts,
+                                     size_t dlen,
+                                     int final,
+                                     const uint8_t **pout,
+                                     size_t *polen)
+{
+    size_t cur = 0;
+    size_t i;
+    ib_status_t rc;
+
+    for (i = 0; i < ts->pl->nstep; i++) {
+        ib_tfn_stream_step_t *ss = &ts->ss[i];
+        uint8_t *src = ts->buf[cur];
+        uint8_t *dst = ts->buf[cur ^ 1];
+        size_t len;
+
+        if (ss->fns == NULL) {
+            /* Fused stages stream a byte at a time into the other
+             * buffer, as flushed decoder data may make the output
+             * longer than this chunk.
+             */
+            ss->run.out = dst;
+            ss->run.olen = 0;
+            for (len = 0; len < dlen; len++) {
+                ib_tfn_fuse_push(&ss->run, 0, src[len]);
+            }
+            if (final) {
+                ib_tfn_fuse_flush(&ss->run);
+            }
+            dlen = ss->run.olen;
+        }
+        else {
+            void *fndata = ss->step->tfn->fndata;
+            size_t consumed;
+
+            /* Unconsumed data from the previous chunk goes first. */
+            memcpy(dst, ss->carry, ss->clen);
+            memcpy(dst + ss->clen, src, dlen);
+            len = ss->clen + dlen;
+            ss->clen = 0;
+
+            if (final) {
+                rc = ss->fns->finish(fndata, ss->state, dst, len, &dlen);
+                if (rc != IB_OK) {
+                    return rc;
+                }
+            }
+            else {
+                rc = ss->fns->update(fndata, ss->state,
+                                     dst, len, &dlen, &consumed);
+                if (rc != IB_OK) {
+                    return rc;
+                }
+                if (   (consumed > len)
+                    || (len - consumed > IB_TFN_STREAM_CARRY_MAX))
+                {
+                    return IB_EUNKNOWN;
+                }
+                ss->clen = len - consumed;
+                memcpy(ss->carry, dst + consumed, ss->clen);
+            }
+        }
+
+        cur ^= 1;
+    }
+
+    *pout = ts->buf[cur];
+    *polen = dlen;
+
+    return IB_OK;
+}
+
+ib_status_t ib_tfn_stream_update(ib_tfn_stream_t *ts,
+                                 const uint8_t *data,
+                                 size_t dlen,
+                                 const uint8_t **pout,
+                                 size_t *polen)
+{
+    IB_FTRACE_INIT(ib_tfn_stream_update);
+    ib_status_t rc;
+
+    if (ts->finished) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    rc = ib_tfn_stream_reserve(ts, dlen);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    memcpy(ts->buf[0], data, dlen);
+
+    rc = ib_tfn_stream_run(ts, dlen, 0, pout, polen);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+ib_status_t ib_tfn_stream_finish(ib_tfn_stream_t *ts,
+                                 const uint8_t **pout,
+                                 size_t *polen)
+{
+    IB_FTRACE_INIT(ib_tfn_stream_finish);
+    ib_status_t rc;
+
+    if (ts->finished) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+    ts->finished = 1;
+
+    rc = ib_tfn_stream_reserve(ts, 0);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    rc = ib_tfn_stream_run(ts, 0, 1, pout, polen);
+    IB_FTRACE_RET_STATUS(rc);
+}
@@ -67,6 +67,8 @@ struct ib_cfgparser_t {
     ib_site_t              *cur_site;    /**< Current site */
     ib_loc_t               *cur_loc;     /**< Current location */
     const char             *cur_blkname; /**< Current block name */
+    const char             *cur_file;    /**< Current file (or NULL) */
+    unsigned int            cur_lineno;  /**< Current line number */
 };
 
 /**
@@ -322,6 +324,48 @@ ib_status_t DLL_PUBLIC ib_cfgparser_block_pop(ib_cfgparser_t *cp,
 void DLL_PUBLIC ib_cfgparser_destroy(ib_cfgparser_t *cp);
 
 
+/**
+ * Configuration job function.
+ *
+ * Jobs run concurrently on worker threads once configuration is
+ * finished, so a job must only allocate from @a pool and must not log
+ * or otherwise use the engine. Any error is instead logged along with
+ * the location the job was added at.
+ *
+ * @param data Job data
+ * @param pool Memory pool of the worker (lives as long as the config)
+ * @param perr Address which an error message may be written on failure
+ *
+ * @returns Status code
+ */
+typedef ib_status_t (*ib_cfgjob_fn_t)(void *data,
+                                      ib_mpool_t *pool,
+                                      const char **perr);
+
+/**
+ * Add a job to run once configuration is finished.
+ *
+ * Expensive work such as compiling patterns and building automata
+ * can be added as a job by directive handlers and cfg_finished_event
+ * hooks. All jobs are run on a pool of worker threads (one per CPU)
+ * before @ref ib_state_notify_cfg_finished() returns, which fails if
+ * any of them do. After that the job is run immediately instead.
+ *
+ * @param ib Engine
+ * @param file Config file the job is for (or NULL)
+ * @param lineno Config line number the job is for
+ * @param fn Job function
+ * @param data Job data
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_cfgjob_add(ib_engine_t *ib,
+                                     const char *file,
+                                     unsigned int lineno,
+                                     ib_cfgjob_fn_t fn,
+                                     void *data);
+
+
 /**
  * Register directives with the engine.
  *
@@ -84,6 +84,10 @@ typedef struct ib_conndata_t ib_conndata_t;
 typedef struct ib_txdata_t ib_txdata_t;
 typedef struct ib_tx_t ib_tx_t;
 typedef struct ib_tfn_t ib_tfn_t;
+typedef struct ib_tfn_pipeline_t ib_tfn_pipeline_t;
+typedef struct ib_tfn_stream_t ib_tfn_stream_t;
+typedef struct ib_operator_t ib_operator_t;
+typedef struct ib_operator_inst_t ib_operator_inst_t;
 typedef struct ib_logevent_t ib_logevent_t;
 typedef struct timeval ib_timeval_t;
 typedef struct ib_uuid_t ib_uuid_t;
@@ -269,6 +273,7 @@ struct ib_tx_t {
     const char         *hostname;        /**< Hostname used in the request */
     const char         *path;            /**< Path used in the request */
     ib_flags_t          flags;           /**< Transaction flags */
+    ib_hash_t          *tfn_memo;        /**< Memoized transformations */
 };
 
 /**
@@ -939,6 +944,10 @@ ib_status_t DLL_PUBLIC ib_state_notify_cfg_started(ib_engine_t *ib);
 /**
  * Notify the state machine that the configuration process has finished.
  *
+ * This also runs the configuration jobs (see ib_cfgjob_add()). An
+ * error is returned if a hook or any job fails, in which case the
+ * configuration should not be used.
+ *
  * @param ib Engine handle
  *
  * @returns Status code
@@ -1182,6 +1191,196 @@ ib_status_t DLL_PUBLIC ib_hook_unregister_context(ib_context_t *ctx,
  * @} IronBeeEngineHooks
  */
 
+/**
+ * @defgroup IronBeeEngineHookStats Hook Timing Statistics
+ * @{
+ */
+
+/**
+ * Hook timing statistics callback.
+ *
+ * @param ib Engine handle
+ * @param event Event
+ * @param m Module which registered the hooks (NULL if unknown)
+ * @param h Aggregated histogram of hook times in nanoseconds
+ * @param cbdata Callback data
+ */
+typedef void (*ib_hook_stats_fn_t)(ib_engine_t *ib,
+                                   ib_state_event_type_t event,
+                                   ib_module_t *m,
+                                   const ib_hist_t *h,
+                                   void *cbdata);
+
+/**
+ * Enable or disable timing of hook callbacks.
+ *
+ * When enabled, every hook callback invoked for an event is timed
+ * and recorded into a per-thread histogram keyed by the event and
+ * the module which registered the hook.
+ *
+ * @param ib Engine handle
+ * @param enable Non-zero to enable
+ */
+void DLL_PUBLIC ib_hook_stats_enable(ib_engine_t *ib,
+                                     int enable);
+
+/**
+ * Set the interval which hook timing statistics are logged.
+ *
+ * @param ib Engine handle
+ * @param secs Interval in seconds (0 to disable)
+ */
+void DLL_PUBLIC ib_hook_stats_dump_interval(ib_engine_t *ib,
+                                            time_t secs);
+
+/**
+ * Get the hook timing for an event and module, aggregated over
+ * all threads.
+ *
+ * @param ib Engine handle
+ * @param event Event
+ * @param m Module (NULL for hooks not registered by a known module)
+ * @param h Histogram which times are merged into
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_hook_stats_get(ib_engine_t *ib,
+                                         ib_state_event_type_t event,
+                                         ib_module_t *m,
+                                         ib_hist_t *h);
+
+/**
+ * Call a function for every (event, module) pair which has
+ * recorded hook timing, aggregated over all threads.
+ *
+ * @param ib Engine handle
+ * @param cb Callback
+ * @param cbdata Callback data
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_hook_stats_walk(ib_engine_t *ib,
+                                          ib_hook_stats_fn_t cb,
+                                          void *cbdata);
+
+/**
+ * Log the hook timing statistics.
+ *
+ * @param ib Engine handle
+ * @param level Log level
+ */
+void DLL_PUBLIC ib_hook_stats_dump(ib_engine_t *ib,
+                                   int level);
+
+/**
+ * @} IronBeeEngineHookStats
+ */
+
+/**
+ * @defgroup IronBeeEngineStats Statistics Counters
+ * @{
+ */
+
+/** Statistics counter ID. */
+typedef size_t ib_stat_id_t;
+
+/**
+ * Statistics counter callback.
+ *
+ * @param ib Engine handle
+ * @param name Counter name
+ * @param val Counter value (aggregated over all threads)
+ * @param cbdata Callback data
+ */
+typedef void (*ib_stat_fn_t)(ib_engine_t *ib,
+                             const char *name,
+                             uint64_t val,
+                             void *cbdata);
+
+/**
+ * Register a statistics counter.
+ *
+ * Counters should be registered at configuration time (typically in
+ * a module init function), as registration is not thread safe.
+ * Registering a name which already exists returns the existing ID.
+ *
+ * Names are dot separated, lowercase words (ie "mymodule.requests").
+ *
+ * @param ib Engine handle
+ * @param name Counter name
+ * @param pid Address which the counter ID is written
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_stat_register(ib_engine_t *ib,
+                                        const char *name,
+                                        ib_stat_id_t *pid);
+
+/**
+ * Lookup a statistics counter by name.
+ *
+ * @param ib Engine handle
+ * @param name Counter name
+ * @param pid Address which the counter ID is written
+ *
+ * @returns Status code (IB_ENOENT if not registered)
+ */
+ib_status_t DLL_PUBLIC ib_stat_lookup(ib_engine_t *ib,
+                                      const char *name,
+                                      ib_stat_id_t *pid);
+
+/**
+ * Add to a statistics counter.
+ *
+ * The value is added to a counter private to the calling thread, so
+ * this never locks or contends with other threads.
+ *
+ * @param ib Engine handle
+ * @param id Counter ID
+ * @param n Value to add
+ */
+void DLL_PUBLIC ib_stat_add(ib_engine_t *ib,
+                            ib_stat_id_t id,
+                            uint64_t n);
+
+/**
+ * Increment a statistics counter.
+ *
+ * @param ib Engine handle
+ * @param id Counter ID
+ */
+#define ib_stat_inc(ib,id) ib_stat_add((ib),(id),1)
+
+/**
+ * Get the value of a statistics counter, aggregated over all threads.
+ *
+ * @param ib Engine handle
+ * @param id Counter ID
+ * @param pval Address which the value is written
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_stat_get(ib_engine_t *ib,
+                                   ib_stat_id_t id,
+                                   uint64_t *pval);
+
+/**
+ * Call a function for every registered statistics counter.
+ *
+ * @param ib Engine handle
+ * @param cb Callback
+ * @param cbdata Callback data
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_stat_walk(ib_engine_t *ib,
+                                    ib_stat_fn_t cb,
+                                    void *cbdata);
+
+/**
+ * @} IronBeeEngineStats
+ */
+
 /**
  * @defgroup IronBeeEngineData Data Field
  * @{
@@ -1324,6 +1523,46 @@ ib_status_t DLL_PUBLIC ib_data_tfn_get_ex(ib_provider_inst_t *dpi,
                                           ib_field_t **pf,
                                           const char *tfn);
 
+/**
+ * Get a transaction data field with a compiled transformation pipeline.
+ *
+ * The result is memoized in the transaction, keyed by the source
+ * field and the pipeline, so the same pipeline applied to the same
+ * field is only executed once per transaction. Replacing the source
+ * field (ie setting a new value) causes the pipeline to run again.
+ *
+ * @param tx Transaction
+ * @param name Name as byte string
+ * @param nlen Name length
+ * @param pf Pointer where transformed field is written
+ * @param pl Transformation pipeline (see ib_tfn_pipeline_create())
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_tx_data_tfn_get(ib_tx_t *tx,
+                                          const char *name,
+                                          size_t nlen,
+                                          ib_field_t **pf,
+                                          const ib_tfn_pipeline_t *pl);
+
+/**
+ * Transform a transaction data field already fetched.
+ *
+ * This is the same as ib_tx_data_tfn_get(), for callers which apply
+ * several pipelines to the same field and so fetch it only once.
+ *
+ * @param tx Transaction
+ * @param src Source field (from the transaction data)
+ * @param pf Pointer where transformed field is written
+ * @param pl Transformation pipeline (see ib_tfn_pipeline_create())
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_tx_field_tfn_get(ib_tx_t *tx,
+                                           ib_field_t *src,
+                                           ib_field_t **pf,
+                                           const ib_tfn_pipeline_t *pl);
+
 /**
  * Create and add a numeric data field.
  *
@@ -1440,18 +1679,75 @@ ib_status_t DLL_PUBLIC ib_data_tfn_get(ib_provider_inst_t *dpi,
  */
 
 typedef struct ib_matcher_t ib_matcher_t;
+typedef struct ib_matcher_stream_t ib_matcher_stream_t;
 typedef void ib_matcher_result_t; /// @todo Not implemented yet
 
+/**
+ * Matcher callback function.
+ *
+ * Called for each pattern matched by a matcher instance. Returning
+ * anything other than IB_OK stops the match and that status is
+ * returned to the caller.
+ *
+ * @param cbdata Callback data
+ * @param id ID given to the pattern when it was added
+ * @param end Offset just past the end of the match
+ *
+ * @returns Status code
+ */
+typedef ib_status_t (*ib_matcher_callback_fn_t)(void *cbdata,
+                                                ib_num_t id,
+                                                size_t end);
+
 ib_status_t DLL_PUBLIC ib_matcher_create(ib_engine_t *ib,
                                          ib_mpool_t *pool,
                                          const char *key,
                                          ib_matcher_t **pm);
 
+/**
+ * Compile a pattern.
+ *
+ * During configuration, a pattern compiled with a matcher allocated
+ * from the engine configuration pool is shared: compiling the same
+ * pattern text with the same matcher provider again returns the same
+ * compiled pattern, which must be treated as read-only.
+ *
+ * @param m Matcher
+ * @param patt Pattern
+ * @param errptr Address which any error is written (if non-NULL)
+ * @param erroffset Offset in pattern where the error occurred (if non-NULL)
+ *
+ * @returns Compiled pattern (or NULL on error)
+ */
 void DLL_PUBLIC *ib_matcher_compile(ib_matcher_t *m,
                                     const char *patt,
                                     const char **errptr,
                                     int *erroffset);
 
+/**
+ * Compile a pattern on a worker thread once configuration is finished.
+ *
+ * A pattern that would be shared (see ib_matcher_compile()) is queued
+ * as a configuration job, so that many patterns are compiled at once.
+ * The compiled pattern is written to @a pcpatt before
+ * ib_state_notify_cfg_finished() returns, which is left NULL if the
+ * pattern fails to compile. The error is then logged at the location
+ * given. Other patterns are compiled immediately.
+ *
+ * @param m Matcher
+ * @param patt Pattern (must live as long as the configuration)
+ * @param pcpatt Address which the compiled pattern is written
+ * @param file Config file the pattern is from (or NULL)
+ * @param lineno Config line number the pattern is from
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_matcher_compile_async(ib_matcher_t *m,
+                                                const char *patt,
+                                                void **pcpatt,
+                                                const char *file,
+                                                unsigned int lineno);
+
 ib_status_t DLL_PUBLIC ib_matcher_match_buf(ib_matcher_t *m,
                                             void *cpatt,
                                             ib_flags_t flags,
@@ -1463,17 +1759,185 @@ ib_status_t DLL_PUBLIC ib_matcher_match_field(ib_matcher_t *m,
                                               ib_flags_t flags,
                                               ib_field_t *f);
 
+/**
+ * Serialize a compiled pattern.
+ *
+ * The buffer can be loaded with ib_matcher_deserialize() by the same
+ * matcher provider (and library version) without compiling the
+ * pattern again.
+ *
+ * @param m Matcher
+ * @param cpatt Compiled pattern
+ * @param pool Memory pool the buffer is allocated from
+ * @param pbuf Address which the buffer is written
+ * @param plen Address which the buffer length is written
+ *
+ * @returns Status code (IB_ENOTIMPL if the provider cannot serialize)
+ */
+ib_status_t DLL_PUBLIC ib_matcher_serialize(ib_matcher_t *m,
+                                            void *cpatt,
+                                            ib_mpool_t *pool,
+                                            const uint8_t **pbuf,
+                                            size_t *plen);
+
+/**
+ * Load a compiled pattern written by ib_matcher_serialize().
+ *
+ * The buffer need not outlive the call.
+ *
+ * @param m Matcher
+ * @param buf Buffer
+ * @param len Buffer length
+ * @param pcpatt Address which the compiled pattern is written
+ *
+ * @returns Status code (IB_EINCOMPAT if written by an incompatible
+ *          provider or library version)
+ */
+ib_status_t DLL_PUBLIC ib_matcher_deserialize(ib_matcher_t *m,
+                                              const uint8_t *buf,
+                                              size_t len,
+                                              void **pcpatt);
+
+/**
+ * Open the pattern database.
+ *
+ * Patterns compiled during configuration (see ib_matcher_compile())
+ * are then loaded from the database file where saved, instead of
+ * being compiled. Once configuration is finished the file is written
+ * again if the patterns differ from those it holds. Only patterns of
+ * providers which can serialize them are saved.
+ *
+ * The file is specific to the library versions and architecture which
+ * wrote it. An incompatible file is ignored and written again.
+ *
+ * @param ib Engine
+ * @param path Database file
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_matcher_db_open(ib_engine_t *ib,
+                                          const char *path);
+
+/**
+ * Add a pattern to a matcher instance.
+ *
+ * All patterns added to a matcher are matched together by
+ * ib_matcher_exec_buf() and ib_matcher_exec_field(). The provider
+ * instance is created when the first pattern is added.
+ *
+ * @param m Matcher
+ * @param patt Pattern
+ * @param id ID passed to the callback when the pattern matches
+ * @param errptr Address which any error is written (if non-NULL)
+ * @param erroffset Offset in pattern where the error occurred (if non-NULL)
+ *
+ * @returns Status code
+ */
 ib_status_t DLL_PUBLIC ib_matcher_add_pattern(ib_matcher_t *m,
-                                              const char *patt);
+                                              const char *patt,
+                                              ib_num_t id,
+                                              const char **errptr,
+                                              int *erroffset);
 
+/**
+ * Match all patterns added to a matcher instance against a buffer.
+ *
+ * The callback is called for each match. If the callback is NULL,
+ * matching stops at the first match.
+ *
+ * @param m Matcher
+ * @param flags Flags
+ * @param data Data buffer
+ * @param dlen Data buffer length
+ * @param fn Callback function (or NULL)
+ * @param cbdata Callback data
+ *
+ * @returns IB_OK if anything matched, IB_ENOENT if not, the status
+ *          returned from the callback if it stopped the match, or
+ *          other status code on error
+ */
 ib_status_t DLL_PUBLIC ib_matcher_exec_buf(ib_matcher_t *m,
                                            ib_flags_t flags,
                                            const uint8_t *data,
-                                           size_t dlen);
+                                           size_t dlen,
+                                           ib_matcher_callback_fn_t fn,
+                                           void *cbdata);
 
+/**
+ * Match all patterns added to a matcher instance against a field.
+ *
+ * @param m Matcher
+ * @param flags Flags
+ * @param f Field (bytestr or nulstr)
+ * @param fn Callback function (or NULL)
+ * @param cbdata Callback data
+ *
+ * @returns Status code as with ib_matcher_exec_buf()
+ */
 ib_status_t DLL_PUBLIC ib_matcher_exec_field(ib_matcher_t *m,
                                              ib_flags_t flags,
-                                             ib_field_t *f);
+                                             ib_field_t *f,
+                                             ib_matcher_callback_fn_t fn,
+                                             void *cbdata);
+
+/**
+ * Create a stream to match all patterns added to a matcher instance
+ * across chunks of data.
+ *
+ * A stream holds the match state between chunks (typically for a
+ * request or response body), so that matches spanning chunks are
+ * found without buffering the data. Patterns must be added before the
+ * stream is created.
+ *
+ * @param m Matcher
+ * @param pool Memory pool the stream is allocated from
+ * @param pms Address which the stream is written
+ *
+ * @returns Status code (IB_ENOTIMPL if the provider cannot stream)
+ */
+ib_status_t DLL_PUBLIC ib_matcher_stream_create(ib_matcher_t *m,
+                                                ib_mpool_t *pool,
+                                                ib_matcher_stream_t **pms);
+
+/**
+ * Match the next chunk of a stream.
+ *
+ * End offsets passed to the callback are relative to the start of
+ * the stream.
+ *
+ * @param ms Matcher stream
+ * @param flags Flags
+ * @param data Data buffer
+ * @param dlen Data buffer length
+ * @param fn Callback function (or NULL)
+ * @param cbdata Callback data
+ *
+ * @returns IB_OK if anything matched in this chunk, IB_ENOENT if not,
+ *          or other status code as with ib_matcher_exec_buf()
+ */
+ib_status_t DLL_PUBLIC ib_matcher_stream_feed(ib_matcher_stream_t *ms,
+                                              ib_flags_t flags,
+                                              const uint8_t *data,
+                                              size_t dlen,
+                                              ib_matcher_callback_fn_t fn,
+                                              void *cbdata);
+
+/**
+ * Finish a stream.
+ *
+ * Reports any matches which depend on the end of the data (such as
+ * patterns anchored at the end). The stream cannot be fed afterwards.
+ *
+ * @param ms Matcher stream
+ * @param fn Callback function (or NULL)
+ * @param cbdata Callback data
+ *
+ * @returns IB_OK if anything matched, IB_ENOENT if not, or other
+ *          status code as with ib_matcher_exec_buf()
+ */
+ib_status_t DLL_PUBLIC ib_matcher_stream_finish(ib_matcher_stream_t *ms,
+                                                ib_matcher_callback_fn_t fn,
+                                                void *cbdata);
 
 /**
  * @} IronBeeEngineMatcher
@@ -1795,6 +2259,8 @@ ib_status_t DLL_PUBLIC ib_logevent_create(ib_logevent_t **ple,
  * @{
  */
 
+/** No transformation flags were set. */
+#define IB_TFN_FNONE              0
 /** Set if transformation modified the value. */
 #define IB_TFN_FMODIFIED          (1<<0)
 /** Set if transformation performed an in-place operation. */
@@ -1839,6 +2305,169 @@ typedef ib_status_t (*ib_tfn_fn_t)(void *fndata,
                                    size_t *dlen_out,
                                    ib_flags_t *pflags);
 
+/**
+ * @defgroup IronBeeEngineTfnFuse Fusable Transformations
+ *
+ * A transformation may declare that it can be fused with others by
+ * describing itself as a list of stages. Adjacent fusable
+ * transformations in a pipeline (see ib_tfn_pipeline_create()) are
+ * then executed together in a single pass over the data instead of
+ * one pass per transformation.
+ *
+ * Fused stages run in-place, so a stage must never produce more
+ * output than the input it has consumed.
+ *
+ * @{
+ */
+
+/** Fusable transformation stage type. */
+typedef enum {
+    IB_TFN_FUSE_END,                   /**< End of stage list */
+    IB_TFN_FUSE_MAP,                   /**< Map each byte via a table */
+    IB_TFN_FUSE_COMPRESS_WS,           /**< Compress whitespace to one space */
+    IB_TFN_FUSE_TRIM_LEFT,             /**< Remove leading whitespace */
+    IB_TFN_FUSE_TRIM_RIGHT,            /**< Remove trailing whitespace */
+    IB_TFN_FUSE_DECODE,                /**< Streaming decoder */
+} ib_tfn_fuse_type_t;
+
+/** Maximum bytes a decode stage may buffer (and so output at once). */
+#define IB_TFN_FUSE_DECODE_MAX    16
+
+/** Streaming decoder state. */
+typedef struct ib_tfn_fuse_dstate_t ib_tfn_fuse_dstate_t;
+struct ib_tfn_fuse_dstate_t {
+    int                 state;         /**< Decoder defined state */
+    size_t              blen;          /**< Length of buffered data */
+    uint8_t             buf[IB_TFN_FUSE_DECODE_MAX]; /**< Buffered data */
+};
+
+/**
+ * Streaming decoder step function.
+ *
+ * Called for each input byte. Writes zero or more decoded bytes (at
+ * most IB_TFN_FUSE_DECODE_MAX) and returns how many were written.
+ *
+ * @param ds Decoder state (zeroed before the first byte)
+ * @param c Input byte
+ * @param out Output buffer
+ *
+ * @returns Number of bytes written to @a out
+ */
+typedef size_t (*ib_tfn_fuse_decode_fn_t)(ib_tfn_fuse_dstate_t *ds,
+                                          uint8_t c,
+                                          uint8_t *out);
+
+/**
+ * Streaming decoder flush function.
+ *
+ * Called at the end of the input to write any buffered data.
+ *
+ * @param ds Decoder state
+ * @param out Output buffer
+ *
+ * @returns Number of bytes written to @a out
+ */
+typedef size_t (*ib_tfn_fuse_flush_fn_t)(ib_tfn_fuse_dstate_t *ds,
+                                         uint8_t *out);
+
+/** Fusable transformation stage. */
+typedef struct ib_tfn_fuse_t ib_tfn_fuse_t;
+struct ib_tfn_fuse_t {
+    ib_tfn_fuse_type_t       type;     /**< Stage type */
+    const uint8_t           *map;      /**< MAP: 256 byte table */
+    ib_tfn_fuse_decode_fn_t  decode;   /**< DECODE: step function */
+    ib_tfn_fuse_flush_fn_t   flush;    /**< DECODE: flush function */
+};
+
+/**
+ * @} IronBeeEngineTfnFuse
+ */
+
+/**
+ * @defgroup IronBeeEngineTfnStream Streaming Transformations
+ *
+ * A transformation may support streaming, so that data arriving in
+ * chunks (such as a request body) can be transformed as it arrives
+ * using bounded memory instead of first buffering all of the data.
+ *
+ * A stream is an init/update/finish lifecycle. Data which cannot be
+ * transformed until more data is seen (such as a partial "%2" escape
+ * at the end of a chunk) is either kept in the stream state, or is
+ * left unconsumed by update, in which case it is passed again at the
+ * start of the next chunk. Fusable transformations (other than those
+ * trimming the right side) stream without any streaming functions.
+ *
+ * @{
+ */
+
+/** Maximum number of bytes a streaming update may leave unconsumed. */
+#define IB_TFN_STREAM_CARRY_MAX   16
+
+/**
+ * Streaming transformation functions.
+ *
+ * All functions transform in-place and must never produce more
+ * output than the input passed.
+ */
+typedef struct ib_tfn_stream_fns_t ib_tfn_stream_fns_t;
+struct ib_tfn_stream_fns_t {
+    /** Size of the stream state (zeroed before init) */
+    size_t               state_size;
+
+    /**
+     * Initialize a stream (optional).
+     *
+     * @param fndata Transformation function data
+     * @param state Stream state
+     *
+     * @returns Status code
+     */
+    ib_status_t (*init)(void *fndata, void *state);
+
+    /**
+     * Transform a chunk.
+     *
+     * @param fndata Transformation function data
+     * @param state Stream state
+     * @param data Data (unconsumed data of the previous chunk followed
+     *             by the chunk)
+     * @param dlen Data length
+     * @param pdlen Address which the transformed length is written
+     * @param pconsumed Address which the consumed length is written
+     *                  (at most IB_TFN_STREAM_CARRY_MAX less than @a dlen)
+     *
+     * @returns Status code
+     */
+    ib_status_t (*update)(void *fndata,
+                          void *state,
+                          uint8_t *data,
+                          size_t dlen,
+                          size_t *pdlen,
+                          size_t *pconsumed);
+
+    /**
+     * Finish a stream, transforming the final data.
+     *
+     * @param fndata Transformation function data
+     * @param state Stream state
+     * @param data Data (unconsumed data of the previous chunk followed
+     *             by any final data)
+     * @param dlen Data length
+     * @param pdlen Address which the transformed length is written
+     *
+     * @returns Status code
+     */
+    ib_status_t (*finish)(void *fndata,
+                          void *state,
+                          uint8_t *data,
+                          size_t dlen,
+                          size_t *pdlen);
+};
+
+/**
+ * @} IronBeeEngineTfnStream
+ */
+
 /**
  * Create and register a new transformation.
  *
@@ -1856,6 +2485,36 @@ ib_status_t DLL_PUBLIC ib_tfn_create(ib_engine_t *ib,
                                      void *fndata,
                                      ib_tfn_t **ptfn);
 
+/**
+ * Declare that a transformation can be fused.
+ *
+ * The stages must produce exactly the same result as the
+ * transformation function and must remain valid for the lifetime
+ * of the engine (typically a static array).
+ *
+ * @param tfn Transformation
+ * @param stages Stages, terminated by an IB_TFN_FUSE_END stage
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_tfn_fuse_set(ib_tfn_t *tfn,
+                                       const ib_tfn_fuse_t *stages);
+
+/**
+ * Declare that a transformation can stream.
+ *
+ * The functions must produce exactly the same result as the
+ * transformation function, however the data is split into chunks,
+ * and must remain valid for the lifetime of the engine.
+ *
+ * @param tfn Transformation
+ * @param fns Streaming functions
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_tfn_stream_set(ib_tfn_t *tfn,
+                                         const ib_tfn_stream_fns_t *fns);
+
 /**
  * Lookup a transformation by name (extended version).
  *
@@ -1925,11 +2584,238 @@ ib_status_t DLL_PUBLIC ib_tfn_transform_field(ib_tfn_t *tfn,
                                               ib_field_t *f,
                                               ib_flags_t *pflags);
 
+/**
+ * Compile a transformation pipeline.
+ *
+ * The transformation names are resolved once, so that executing the
+ * pipeline does no parsing or lookups. Compiling the same list of
+ * names again returns the same pipeline (and the same pipeline ID).
+ *
+ * Adjacent fusable transformations are combined so that they run
+ * in a single pass over the data.
+ *
+ * @note This is not thread safe and should only be called at
+ *       configuration time.
+ *
+ * @param ib Engine
+ * @param tfns Transformations (comma separated names)
+ * @param ppl Address where pipeline will be written
+ *
+ * @returns Status code (IB_EINVAL for an unknown transformation)
+ */
+ib_status_t DLL_PUBLIC ib_tfn_pipeline_create(ib_engine_t *ib,
+                                              const char *tfns,
+                                              ib_tfn_pipeline_t **ppl);
+
+/**
+ * Get the unique ID of a transformation pipeline.
+ *
+ * @param pl Transformation pipeline
+ *
+ * @returns Pipeline ID
+ */
+size_t DLL_PUBLIC ib_tfn_pipeline_id(const ib_tfn_pipeline_t *pl);
+
+/**
+ * Transform a data field with all transformations in a pipeline.
+ *
+ * @param pl Transformation pipeline
+ * @param f Field to transform
+ * @param pflags Address of flags set by all transformations (combined)
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_tfn_pipeline_transform_field(const ib_tfn_pipeline_t *pl,
+                                                       ib_field_t *f,
+                                                       ib_flags_t *pflags);
+
+/**
+ * Create a stream to transform data in chunks with all
+ * transformations in a pipeline.
+ *
+ * @param pl Transformation pipeline
+ * @param mp Memory pool (for the lifetime of the stream)
+ * @param pts Address which the stream is written
+ *
+ * @returns Status code (IB_ENOTIMPL if a transformation in the
+ *          pipeline cannot stream)
+ */
+ib_status_t DLL_PUBLIC ib_tfn_stream_create(const ib_tfn_pipeline_t *pl,
+                                            ib_mpool_t *mp,
+                                            ib_tfn_stream_t **pts);
+
+/**
+ * Transform a chunk of data.
+ *
+ * The output may be shorter or longer than the chunk, as data may be
+ * held back until the following chunk.
+ *
+ * @param ts Stream
+ * @param data Chunk data (not modified)
+ * @param dlen Chunk data length
+ * @param pout Address which the output is written (valid until the
+ *             next update or finish)
+ * @param polen Address which the output length is written
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_tfn_stream_update(ib_tfn_stream_t *ts,
+                                            const uint8_t *data,
+                                            size_t dlen,
+                                            const uint8_t **pout,
+                                            size_t *polen);
+
+/**
+ * Finish a stream, transforming any data held back.
+ *
+ * The stream may not be updated again after this.
+ *
+ * @param ts Stream
+ * @param pout Address which the output is written
+ * @param polen Address which the output length is written
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_tfn_stream_finish(ib_tfn_stream_t *ts,
+                                            const uint8_t **pout,
+                                            size_t *polen);
+
 /**
  * @} IronBeeEngineTfn
  */
 
 
+/**
+ * @defgroup IronBeeEngineOperator Operators
+ * @ingroup IronBeeEngine
+ *
+ * An operator tests a field against a parameter, such as "field
+ * begins with this string" or "field is within this network". The
+ * parameter is parsed once, when an operator instance is created at
+ * configuration time, so that testing a field is cheap.
+ *
+ * @{
+ */
+
+/**
+ * Operator instance create function.
+ *
+ * @param ib Engine
+ * @param pool Memory pool for the instance data
+ * @param params Parameters (as configured)
+ * @param pdata Address which the instance data is written
+ *
+ * @returns Status code (IB_EINVAL for invalid parameters)
+ */
+typedef ib_status_t (*ib_operator_create_fn_t)(ib_engine_t *ib,
+                                               ib_mpool_t *pool,
+                                               const char *params,
+                                               void **pdata);
+
+/**
+ * Operator execute function.
+ *
+ * This must not modify the instance data, as an instance may be
+ * executed by any number of threads.
+ *
+ * @param data Instance data
+ * @param pool Memory pool for any temporary allocations
+ * @param f Field to test
+ *
+ * @returns IB_OK if true, IB_ENOENT if false, or other status on error
+ */
+typedef ib_status_t (*ib_operator_execute_fn_t)(void *data,
+                                                ib_mpool_t *pool,
+                                                ib_field_t *f);
+
+/**
+ * Create and register a new operator.
+ *
+ * @param ib Engine handle
+ * @param name Operator name
+ * @param fn_create Instance create function (or NULL if no data)
+ * @param fn_execute Execute function
+ * @param pop Address where new operator is written if non-NULL
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_operator_create(ib_engine_t *ib,
+                                          const char *name,
+                                          ib_operator_create_fn_t fn_create,
+                                          ib_operator_execute_fn_t fn_execute,
+                                          ib_operator_t **pop);
+
+/**
+ * Lookup an operator by name (extended version).
+ *
+ * @param ib Engine
+ * @param name Operator name
+ * @param nlen Operator name length
+ * @param pop Address where the operator is written
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_operator_lookup_ex(ib_engine_t *ib,
+                                             const char *name,
+                                             size_t nlen,
+                                             ib_operator_t **pop);
+
+/**
+ * Lookup an operator by name.
+ *
+ * @param ib Engine
+ * @param name Operator name
+ * @param pop Address where the operator is written
+ *
+ * @returns Status code
+ */
+#define ib_operator_lookup(ib, name, pop) \
+    ib_operator_lookup_ex(ib, name, strlen(name), pop)
+
+/**
+ * Create an instance of an operator with its parameters.
+ *
+ * @param ib Engine
+ * @param pool Memory pool
+ * @param name Operator name
+ * @param params Parameters
+ * @param pinst Address where the instance is written
+ *
+ * @returns Status code (IB_ENOENT if there is no such operator)
+ */
+ib_status_t DLL_PUBLIC ib_operator_inst_create(ib_engine_t *ib,
+                                               ib_mpool_t *pool,
+                                               const char *name,
+                                               const char *params,
+                                               ib_operator_inst_t **pinst);
+
+/**
+ * Get the name of the operator of an instance.
+ *
+ * @param inst Operator instance
+ *
+ * @returns Operator name
+ */
+const char DLL_PUBLIC *ib_operator_inst_name(const ib_operator_inst_t *inst);
+
+/**
+ * Test a field with an operator instance.
+ *
+ * @param inst Operator instance
+ * @param pool Memory pool for any temporary allocations
+ * @param f Field to test
+ *
+ * @returns IB_OK if true, IB_ENOENT if false, or other status on error
+ */
+ib_status_t DLL_PUBLIC ib_operator_execute(const ib_operator_inst_t *inst,
+                                           ib_mpool_t *pool,
+                                           ib_field_t *f);
+
+/**
+ * @} IronBeeEngineOperator
+ */
+
+
 /**
  * @defgroup IronBeeFilter Filter
  * @ingroup IronBee
@@ -134,7 +134,8 @@ typedef ib_status_t (*ib_module_fn_init_t)(ib_engine_t *ib,
 /**
  * Function to finish a module.
  *
- * This is called when the module is unloaded.
+ * This is called when the engine is destroyed, in the reverse order
+ * the modules were loaded, and before any engine memory is released.
  *
  * @param ib Engine handle
  *
@@ -218,6 +219,7 @@ struct ib_core_cfg_t {
     char         *audit;             /**< Active audit provider key */
     char         *parser;            /**< Active parser provider key */
     char         *data;              /**< Active data provider key */
+    char         *matcher;           /**< Default matcher provider key */
 };
 
 /**
@@ -507,13 +507,49 @@ IB_PROVIDER_DECLARE_IFACE(matcher) {
     IB_PROVIDER_FUNC(
         ib_status_t,
         add,
-        (ib_provider_inst_t *pi, void *cpatt)
+        (ib_provider_inst_t *mpi, const char *patt, ib_num_t id,
+         const char **errptr, int *erroffset)
     );
     IB_PROVIDER_FUNC(
         ib_status_t,
         match,
         (ib_provider_inst_t *mpi,
-         ib_flags_t flags, const uint8_t *data, size_t dlen)
+         ib_flags_t flags, const uint8_t *data, size_t dlen,
+         ib_matcher_callback_fn_t fn, void *cbdata)
+    );
+
+    /* Provider instance Stream Interface (optional) */
+    IB_PROVIDER_FUNC(
+        ib_status_t,
+        stream_create,
+        (ib_provider_inst_t *mpi, ib_mpool_t *pool, void *pstate)
+    );
+    IB_PROVIDER_FUNC(
+        ib_status_t,
+        stream_feed,
+        (ib_provider_inst_t *mpi, void *state,
+         ib_flags_t flags, const uint8_t *data, size_t dlen,
+         ib_matcher_callback_fn_t fn, void *cbdata)
+    );
+    IB_PROVIDER_FUNC(
+        ib_status_t,
+        stream_finish,
+        (ib_provider_inst_t *mpi, void *state,
+         ib_matcher_callback_fn_t fn, void *cbdata)
+    );
+
+    /* Provider Serialization Interface (optional) */
+    IB_PROVIDER_FUNC(
+        ib_status_t,
+        serialize,
+        (ib_provider_t *mpr, void *cpatt, ib_mpool_t *pool,
+         const uint8_t **pbuf, size_t *plen)
+    );
+    IB_PROVIDER_FUNC(
+        ib_status_t,
+        deserialize,
+        (ib_provider_t *mpr, ib_mpool_t *pool, void *pcpatt,
+         const uint8_t *buf, size_t len)
     );
 };
 
@@ -535,17 +571,52 @@ IB_PROVIDER_DECLARE_API(matcher) {
     );
 
     /* Provider Instance API */
-    /// @todo Need to add an _ex version with match/nomatch funcs and cbdata
     IB_PROVIDER_FUNC(
         ib_status_t,
         add_pattern,
-        (ib_provider_inst_t *mpi, const char *patt)
+        (ib_provider_inst_t *mpi, const char *patt, ib_num_t id,
+         const char **errptr, int *erroffset)
     );
     IB_PROVIDER_FUNC(
         ib_status_t,
         match,
         (ib_provider_inst_t *mpi,
-         ib_flags_t flags, const uint8_t *data, size_t dlen)
+         ib_flags_t flags, const uint8_t *data, size_t dlen,
+         ib_matcher_callback_fn_t fn, void *cbdata)
+    );
+
+    /* Provider Instance Stream API */
+    IB_PROVIDER_FUNC(
+        ib_status_t,
+        stream_create,
+        (ib_provider_inst_t *mpi, ib_mpool_t *pool, void *pstate)
+    );
+    IB_PROVIDER_FUNC(
+        ib_status_t,
+        stream_feed,
+        (ib_provider_inst_t *mpi, void *state,
+         ib_flags_t flags, const uint8_t *data, size_t dlen,
+         ib_matcher_callback_fn_t fn, void *cbdata)
+    );
+    IB_PROVIDER_FUNC(
+        ib_status_t,
+        stream_finish,
+        (ib_provider_inst_t *mpi, void *state,
+         ib_matcher_callback_fn_t fn, void *cbdata)
+    );
+
+    /* Provider Serialization API */
+    IB_PROVIDER_FUNC(
+        ib_status_t,
+        serialize_pattern,
+        (ib_provider_t *mpr, void *cpatt, ib_mpool_t *pool,
+         const uint8_t **pbuf, size_t *plen)
+    );
+    IB_PROVIDER_FUNC(
+        ib_status_t,
+        deserialize_pattern,
+        (ib_provider_t *mpr, ib_mpool_t *pool, void *pcpatt,
+         const uint8_t *buf, size_t len)
     );
 };
 
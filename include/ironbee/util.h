@@ -82,6 +82,7 @@ typedef enum ib_status_t {
     IB_ENOENT,                      /**< Entity does not exist */
     IB_ETIMEDOUT,                   /**< Operation timed out */
     IB_EAGAIN,                      /**< Not ready, try again later */
+    IB_ELIMIT,                      /**< Resource limit exceeded */
 } ib_status_t;
 
 /**
@@ -1561,6 +1562,18 @@ void DLL_PUBLIC ib_trace_str(const char *file,
         return __ib_ft_rv; \
     } while(0)
 
+/**
+ * Return wrapper for functions which return an unsigned int value.
+ *
+ * @param rv Return value
+ */
+#define IB_FTRACE_RET_UINT(rv) \
+    do { \
+        uintmax_t __ib_ft_rv = rv; \
+        ib_trace_num(__FILE__, __LINE__, __ib_fname__, "returned", (intmax_t)__ib_ft_rv); \
+        return __ib_ft_rv; \
+    } while(0)
+
 /**
  * Return wrapper for functions which return a size_t value.
  *
@@ -2064,6 +2077,935 @@ ib_status_t ib_radix_ip_to_prefix(const char *cidr,
 
 /** @} IronBeeUtilRadix */
 
+/**
+ * @defgroup IronBeeUtilHist Histogram
+ * @{
+ */
+
+/**
+ * Number of sub-bucket bits per power of two.
+ *
+ * With 3 bits, each power of two range is split into 8 linear
+ * sub-buckets, giving a worst case relative error of 12.5%.
+ */
+#define IB_HIST_SUB_BITS           3
+/** Number of sub-buckets per power of two. */
+#define IB_HIST_SUB_COUNT          (1 << IB_HIST_SUB_BITS)
+/** Total number of buckets (covers the full uint64_t range). */
+#define IB_HIST_BUCKETS            ((64 - IB_HIST_SUB_BITS + 1) * IB_HIST_SUB_COUNT)
+
+/**
+ * Log-linear (HDR style) histogram of unsigned 64-bit values.
+ *
+ * Values are recorded into buckets whose width grows with the
+ * magnitude of the value, so the histogram has a fixed size and
+ * a bounded relative error regardless of the range recorded.
+ *
+ * The histogram does no locking. It is meant to be written by
+ * a single thread and merged into another histogram for reading.
+ */
+typedef struct ib_hist_t ib_hist_t;
+struct ib_hist_t {
+    uint64_t            count;            /**< Number of values recorded */
+    uint64_t            sum;              /**< Sum of all values */
+    uint64_t            min;              /**< Minimum value recorded */
+    uint64_t            max;              /**< Maximum value recorded */
+    uint64_t            bucket[IB_HIST_BUCKETS]; /**< Bucket counts */
+};
+
+/**
+ * Create a histogram.
+ *
+ * @param ph Address which new histogram is written
+ * @param pool Memory pool
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_hist_create(ib_hist_t **ph,
+                                      ib_mpool_t *pool);
+
+/**
+ * Reset a histogram to its initial (empty) state.
+ *
+ * This can also be used to initialize a histogram that was not
+ * created with @ref ib_hist_create().
+ *
+ * @param h Histogram
+ */
+void DLL_PUBLIC ib_hist_clear(ib_hist_t *h);
+
+/**
+ * Record a value.
+ *
+ * @param h Histogram
+ * @param val Value
+ */
+void DLL_PUBLIC ib_hist_record(ib_hist_t *h,
+                               uint64_t val);
+
+/**
+ * Add all values recorded in one histogram to another.
+ *
+ * @param dst Destination histogram
+ * @param src Source histogram
+ */
+void DLL_PUBLIC ib_hist_merge(ib_hist_t *dst,
+                              const ib_hist_t *src);
+
+/**
+ * Get the value at a given percentile.
+ *
+ * The value returned is the upper bound of the bucket containing the
+ * percentile, limited to the maximum value recorded.
+ *
+ * @param h Histogram
+ * @param pct Percentile (0.0 - 100.0)
+ *
+ * @returns Value at the percentile (0 if the histogram is empty)
+ */
+uint64_t DLL_PUBLIC ib_hist_percentile(const ib_hist_t *h,
+                                       double pct);
+
+/**
+ * Get the mean of all values recorded.
+ *
+ * @param h Histogram
+ *
+ * @returns Mean value (0 if the histogram is empty)
+ */
+uint64_t DLL_PUBLIC ib_hist_mean(const ib_hist_t *h);
+
+/** @} IronBeeUtilHist */
+
+/**
+ * @defgroup IronBeeUtilCpu CPU Features
+ *
+ * CPU features are detected on first use and used to select the
+ * vector kernels used by the string operations, so a build for a
+ * baseline CPU uses wider vectors where available.
+ *
+ * @{
+ */
+
+#define IB_CPU_SSE2         (1 << 0)    /**< SSE2 */
+#define IB_CPU_SSE42        (1 << 1)    /**< SSE4.2 (including CRC32) */
+#define IB_CPU_AVX2         (1 << 2)    /**< AVX2 (and OS support) */
+#define IB_CPU_AVX512BW     (1 << 3)    /**< AVX-512 F/BW (and OS support) */
+
+/**
+ * Detect CPU features.
+ *
+ * This only detects once, and is called by ib_cpu_features() if
+ * needed.
+ */
+void DLL_PUBLIC ib_cpu_init(void);
+
+/**
+ * Get the active CPU features.
+ *
+ * @returns Active CPU features (IB_CPU_*)
+ */
+ib_flags_t DLL_PUBLIC ib_cpu_features(void);
+
+/**
+ * Limit the CPU features used to select kernels.
+ *
+ * This is meant for testing and benchmarking kernels, or to avoid
+ * features which are slower on some hosts. Features which were not
+ * detected cannot be enabled. Kernels are selected again on their
+ * next use.
+ *
+ * @param mask Mask of features (IB_CPU_*) to allow
+ *
+ * @returns Active CPU features
+ */
+ib_flags_t DLL_PUBLIC ib_cpu_features_limit(ib_flags_t mask);
+
+/**
+ * Format CPU features as a space separated string.
+ *
+ * @param flags CPU features (IB_CPU_*)
+ * @param buf Buffer
+ * @param blen Buffer length
+ *
+ * @returns String (within @a buf or a constant "none")
+ */
+const char DLL_PUBLIC *ib_cpu_features_str(ib_flags_t flags,
+                                           char *buf,
+                                           size_t blen);
+
+/** @} IronBeeUtilCpu */
+
+/**
+ * @defgroup IronBeeUtilStrOps String Operations
+ *
+ * Byte string operations used by transformations. These use ASCII
+ * ("C" locale) rules regardless of the process locale and use vector
+ * instructions where available.
+ *
+ * @{
+ */
+
+/**
+ * Lowercase ASCII letters in-place.
+ *
+ * @param data Data
+ * @param dlen Data length
+ *
+ * @returns Non-zero if any byte was modified
+ */
+int DLL_PUBLIC ib_strops_lower(uint8_t *data,
+                               size_t dlen);
+
+/**
+ * Count the leading whitespace bytes.
+ *
+ * @param data Data
+ * @param dlen Data length
+ *
+ * @returns Number of leading whitespace bytes
+ */
+size_t DLL_PUBLIC ib_strops_wsleft(const uint8_t *data,
+                                   size_t dlen);
+
+/**
+ * Get the length of data without any trailing whitespace bytes.
+ *
+ * @param data Data
+ * @param dlen Data length
+ *
+ * @returns Length without trailing whitespace
+ */
+size_t DLL_PUBLIC ib_strops_wsright(const uint8_t *data,
+                                    size_t dlen);
+
+/** Maximum set size that @ref ib_strops_find_any() vectorizes. */
+#define IB_STROPS_SET_MAX 4
+
+/**
+ * Find the first occurrence of any byte in a small set.
+ *
+ * Sets larger than @ref IB_STROPS_SET_MAX bytes are searched one
+ * byte at a time.
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param set Set of bytes
+ * @param nset Number of bytes in the set
+ *
+ * @returns Offset of the first byte in the set (dlen if not found)
+ */
+size_t DLL_PUBLIC ib_strops_find_any(const uint8_t *data,
+                                     size_t dlen,
+                                     const char *set,
+                                     size_t nset);
+
+/**
+ * Find the first occurrence of a substring.
+ *
+ * An empty needle is found at offset 0.
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param needle Substring to find
+ * @param nlen Substring length
+ *
+ * @returns Offset of the substring (dlen if not found)
+ */
+size_t DLL_PUBLIC ib_strops_find(const uint8_t *data,
+                                 size_t dlen,
+                                 const char *needle,
+                                 size_t nlen);
+
+/**
+ * Compare two byte strings of the same length ignoring ASCII case.
+ *
+ * @param a First string
+ * @param b Second string
+ * @param len Length of both strings
+ *
+ * @returns Non-zero if equal
+ */
+int DLL_PUBLIC ib_strops_caseeq(const uint8_t *a,
+                                const uint8_t *b,
+                                size_t len);
+
+/** @} IronBeeUtilStrOps */
+
+/**
+ * @defgroup IronBeeUtilDecode Decoding
+ *
+ * Decoding functions used by transformations. All decode in-place
+ * (the decoded data is never longer than the input) and return
+ * non-zero if the data was modified. Invalid encodings are left
+ * as-is unless noted.
+ *
+ * The _ex variants allow data to be decoded in chunks (for example,
+ * a body as it arrives). Given a non-NULL @a pconsumed, the decoder
+ * stops before any escape which may continue in the next chunk and
+ * writes the number of bytes consumed to @a pconsumed. The
+ * unconsumed bytes (at most IB_DECODE_PARTIAL_MAX) are left untouched
+ * and must be passed again at the start of the next chunk. The last
+ * chunk is passed with a NULL @a pconsumed.
+ *
+ * @{
+ */
+
+/** Maximum number of bytes left unconsumed by a partial decode. */
+#define IB_DECODE_PARTIAL_MAX   16
+
+/**
+ * Get the value of a hex digit.
+ *
+ * @param c Byte
+ *
+ * @returns Value (0-15) or -1 if not a hex digit
+ */
+int DLL_PUBLIC ib_decode_hexval(uint8_t c);
+
+/**
+ * Convert a UCS-2 code point (from a %u style escape) to a byte.
+ *
+ * Full width ASCII forms (U+FF01 - U+FF5E) map to their ASCII
+ * equivalents, otherwise the low byte is used.
+ *
+ * @param cp Code point
+ *
+ * @returns Byte
+ */
+uint8_t DLL_PUBLIC ib_decode_ucs2(uint32_t cp);
+
+/**
+ * URL decode (%XX, %uXXXX and '+').
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param pdlen Address which decoded length is written
+ *
+ * @returns Non-zero if modified
+ */
+int DLL_PUBLIC ib_decode_url(uint8_t *data,
+                             size_t dlen,
+                             size_t *pdlen);
+
+/**
+ * URL decode (chunked).
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param pdlen Address which decoded length is written
+ * @param pconsumed Address which consumed length is written, or
+ *                  NULL if this is the last chunk
+ *
+ * @returns Non-zero if modified
+ */
+int DLL_PUBLIC ib_decode_url_ex(uint8_t *data,
+                                size_t dlen,
+                                size_t *pdlen,
+                                size_t *pconsumed);
+
+/**
+ * Hex decode (pairs of hex digits).
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param pdlen Address which decoded length is written
+ *
+ * @returns Non-zero if modified
+ */
+int DLL_PUBLIC ib_decode_hex(uint8_t *data,
+                             size_t dlen,
+                             size_t *pdlen);
+
+/**
+ * Hex decode (chunked).
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param pdlen Address which decoded length is written
+ * @param pconsumed Address which consumed length is written, or
+ *                  NULL if this is the last chunk
+ *
+ * @returns Non-zero if modified
+ */
+int DLL_PUBLIC ib_decode_hex_ex(uint8_t *data,
+                                size_t dlen,
+                                size_t *pdlen,
+                                size_t *pconsumed);
+
+/**
+ * Base64 decode.
+ *
+ * Whitespace is ignored and decoding stops at padding or at
+ * the first invalid byte.
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param pdlen Address which decoded length is written
+ *
+ * @returns Non-zero if modified
+ */
+int DLL_PUBLIC ib_decode_base64(uint8_t *data,
+                                size_t dlen,
+                                size_t *pdlen);
+
+/** Base64 decoder state (for chunked decoding). */
+typedef struct ib_decode_base64_state_t ib_decode_base64_state_t;
+struct ib_decode_base64_state_t {
+    uint32_t            acc;           /**< Undecoded bits */
+    int                 bits;          /**< Number of undecoded bits */
+    int                 done;          /**< Padding or invalid byte seen */
+};
+
+/**
+ * Base64 decode (chunked).
+ *
+ * As base64 is decoded a byte at a time, all data is always consumed
+ * and the decoding state is instead carried in @a state, which must
+ * be zeroed before the first chunk.
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param pdlen Address which decoded length is written
+ * @param state Decoder state
+ *
+ * @returns Non-zero if modified
+ */
+int DLL_PUBLIC ib_decode_base64_ex(uint8_t *data,
+                                   size_t dlen,
+                                   size_t *pdlen,
+                                   ib_decode_base64_state_t *state);
+
+/**
+ * HTML entity decode (&#DDD;, &#xHH; and common named entities).
+ *
+ * The trailing ';' is optional. Numeric entities keep only the
+ * low byte of the value and are limited to 12 digits.
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param pdlen Address which decoded length is written
+ *
+ * @returns Non-zero if modified
+ */
+int DLL_PUBLIC ib_decode_html_entity(uint8_t *data,
+                                     size_t dlen,
+                                     size_t *pdlen);
+
+/**
+ * HTML entity decode (chunked).
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param pdlen Address which decoded length is written
+ * @param pconsumed Address which consumed length is written, or
+ *                  NULL if this is the last chunk
+ *
+ * @returns Non-zero if modified
+ */
+int DLL_PUBLIC ib_decode_html_entity_ex(uint8_t *data,
+                                        size_t dlen,
+                                        size_t *pdlen,
+                                        size_t *pconsumed);
+
+/**
+ * JavaScript escape decode (\uHHHH, \xHH, octal and character escapes).
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param pdlen Address which decoded length is written
+ *
+ * @returns Non-zero if modified
+ */
+int DLL_PUBLIC ib_decode_js(uint8_t *data,
+                            size_t dlen,
+                            size_t *pdlen);
+
+/**
+ * JavaScript escape decode (chunked).
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param pdlen Address which decoded length is written
+ * @param pconsumed Address which consumed length is written, or
+ *                  NULL if this is the last chunk
+ *
+ * @returns Non-zero if modified
+ */
+int DLL_PUBLIC ib_decode_js_ex(uint8_t *data,
+                               size_t dlen,
+                               size_t *pdlen,
+                               size_t *pconsumed);
+
+/**
+ * CSS escape decode (\ followed by 1-6 hex digits or a character).
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param pdlen Address which decoded length is written
+ *
+ * @returns Non-zero if modified
+ */
+int DLL_PUBLIC ib_decode_css(uint8_t *data,
+                             size_t dlen,
+                             size_t *pdlen);
+
+/**
+ * CSS escape decode (chunked).
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param pdlen Address which decoded length is written
+ * @param pconsumed Address which consumed length is written, or
+ *                  NULL if this is the last chunk
+ *
+ * @returns Non-zero if modified
+ */
+int DLL_PUBLIC ib_decode_css_ex(uint8_t *data,
+                                size_t dlen,
+                                size_t *pdlen,
+                                size_t *pconsumed);
+
+/**
+ * Normalize a path.
+ *
+ * Removes empty and "." segments and resolves ".." segments. An
+ * absolute path cannot go above the root.
+ *
+ * @param data Data
+ * @param dlen Data length
+ * @param pdlen Address which normalized length is written
+ * @param win If non-zero, first convert '\\' separators to '/'
+ *
+ * @returns Non-zero if modified
+ */
+int DLL_PUBLIC ib_decode_path(uint8_t *data,
+                              size_t dlen,
+                              size_t *pdlen,
+                              int win);
+
+/** @} IronBeeUtilDecode */
+
+/**
+ * @defgroup IronBeeUtilAC Aho-Corasick
+ *
+ * Multi-pattern literal matching. All patterns are found in a single
+ * linear pass over the data, however many patterns there are.
+ *
+ * Patterns are added, then the automaton is built once, after which
+ * it is read-only and may be used by any number of threads.
+ *
+ * @{
+ */
+
+/** Match case insensitively (ASCII). */
+#define IB_AC_FNOCASE           (1 << 0)
+
+/** Aho-Corasick automaton. */
+typedef struct ib_ac_t ib_ac_t;
+
+/**
+ * Aho-Corasick match callback, called for each pattern matched.
+ *
+ * @param cbdata Callback data
+ * @param id Pattern ID
+ * @param end Offset just past the end of the match
+ *
+ * @returns IB_OK to continue matching, any other status stops
+ *          matching and is returned by ib_ac_match()
+ */
+typedef ib_status_t (*ib_ac_callback_fn_t)(void *cbdata,
+                                           ib_num_t id,
+                                           size_t end);
+
+/**
+ * Create an Aho-Corasick automaton.
+ *
+ * @param pac Address which new automaton is written
+ * @param pool Memory pool
+ * @param flags Flags (IB_AC_F*)
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_ac_create(ib_ac_t **pac,
+                                    ib_mpool_t *pool,
+                                    ib_flags_t flags);
+
+/**
+ * Add a pattern.
+ *
+ * The same pattern may be added more than once (with different IDs).
+ *
+ * @param ac Automaton
+ * @param patt Pattern
+ * @param plen Pattern length
+ * @param id Pattern ID (reported when matched)
+ *
+ * @returns Status code (IB_EINVAL if empty or already built)
+ */
+ib_status_t DLL_PUBLIC ib_ac_add_pattern(ib_ac_t *ac,
+                                         const uint8_t *patt,
+                                         size_t plen,
+                                         ib_num_t id);
+
+/**
+ * Build the automaton from the added patterns.
+ *
+ * No more patterns may be added after building.
+ *
+ * @param ac Automaton
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_ac_build(ib_ac_t *ac);
+
+/**
+ * Check if an automaton has been built.
+ *
+ * @param ac Automaton
+ *
+ * @returns Non-zero if built
+ */
+int DLL_PUBLIC ib_ac_is_built(const ib_ac_t *ac);
+
+/**
+ * Get the number of patterns added.
+ *
+ * @param ac Automaton
+ *
+ * @returns Number of patterns
+ */
+size_t DLL_PUBLIC ib_ac_pattern_count(const ib_ac_t *ac);
+
+/**
+ * Get the memory used by a built automaton.
+ *
+ * @param ac Automaton
+ *
+ * @returns Size in bytes (0 if not built)
+ */
+size_t DLL_PUBLIC ib_ac_memory(const ib_ac_t *ac);
+
+/**
+ * Match all patterns against data.
+ *
+ * Every match is reported (including overlapping matches), in
+ * order of where the match ends.
+ *
+ * @param ac Automaton (built)
+ * @param data Data
+ * @param dlen Data length
+ * @param fn Callback, or NULL to stop at the first match
+ * @param cbdata Callback data
+ *
+ * @returns IB_OK if any pattern matched, IB_ENOENT if none did,
+ *          or the status returned by the callback to stop matching
+ */
+ib_status_t DLL_PUBLIC ib_ac_match(const ib_ac_t *ac,
+                                   const uint8_t *data,
+                                   size_t dlen,
+                                   ib_ac_callback_fn_t fn,
+                                   void *cbdata);
+
+/**
+ * Match state carried across chunks of a stream.
+ */
+typedef struct ib_ac_stream_t ib_ac_stream_t;
+struct ib_ac_stream_t {
+    int32_t                 state;        /**< Current state */
+    size_t                  offset;       /**< Bytes matched so far */
+};
+
+/**
+ * Initialize the match state for a new stream.
+ *
+ * @param as Stream match state
+ */
+void DLL_PUBLIC ib_ac_stream_init(ib_ac_stream_t *as);
+
+/**
+ * Match all patterns against the next chunk of a stream.
+ *
+ * This is the same as ib_ac_match(), except that matches spanning
+ * chunks are found and the end offsets reported to the callback are
+ * relative to the start of the stream. If the callback stops the
+ * match, the rest of the chunk is skipped.
+ *
+ * @param ac Automaton (built)
+ * @param as Stream match state
+ * @param data Data
+ * @param dlen Data length
+ * @param fn Callback, or NULL to stop at the first match
+ * @param cbdata Callback data
+ *
+ * @returns Status code as with ib_ac_match()
+ */
+ib_status_t DLL_PUBLIC ib_ac_match_stream(const ib_ac_t *ac,
+                                          ib_ac_stream_t *as,
+                                          const uint8_t *data,
+                                          size_t dlen,
+                                          ib_ac_callback_fn_t fn,
+                                          void *cbdata);
+
+/** @} IronBeeUtilAC */
+
+/**
+ * @defgroup IronBeeUtilRE Regular Expressions (DFA)
+ *
+ * Regular expression matching in time linear in the data, whatever
+ * the pattern. Any number of patterns are matched in a single pass.
+ *
+ * The syntax is that of PCRE (with PCRE_DOTALL and
+ * PCRE_DOLLAR_ENDONLY), less the constructs which need backtracking:
+ * back references, lookaround assertions, atomic groups, possessive
+ * quantifiers and word boundaries are rejected when a pattern is
+ * added. As only whether and where a pattern matches is reported,
+ * lazy quantifiers are the same as greedy ones.
+ *
+ * The DFA is built lazily as data is matched, into a cache of bounded
+ * size. A built regex may be used by any number of threads, however
+ * only one at a time uses the cache, the others matching more slowly
+ * without it.
+ *
+ * @{
+ */
+
+/** Match case insensitively (ASCII). */
+#define IB_RE_FNOCASE           (1 << 0)
+
+/** Regular expression (one or more patterns). */
+typedef struct ib_re_t ib_re_t;
+
+/** Match state carried across chunks of a stream. */
+typedef struct ib_re_stream_t ib_re_stream_t;
+
+/**
+ * Regular expression match callback, called once for each pattern
+ * matched.
+ *
+ * @param cbdata Callback data
+ * @param id Pattern ID
+ * @param end Offset just past the end of the first match
+ *
+ * @returns IB_OK to continue matching, any other status stops
+ *          matching and is returned by ib_re_match()
+ */
+typedef ib_status_t (*ib_re_callback_fn_t)(void *cbdata,
+                                           ib_num_t id,
+                                           size_t end);
+
+/**
+ * Create a regular expression.
+ *
+ * @param pre Address which new regex is written
+ * @param pool Memory pool
+ * @param flags Flags (IB_RE_F*)
+ * @param cache_max Maximum DFA cache size in bytes (0 for the default),
+ *                  which is raised if too small for the patterns
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_re_create(ib_re_t **pre,
+                                    ib_mpool_t *pool,
+                                    ib_flags_t flags,
+                                    size_t cache_max);
+
+/**
+ * Add a pattern.
+ *
+ * @param re Regex
+ * @param patt Pattern (NUL terminated)
+ * @param id Pattern ID (reported when matched)
+ * @param errptr Address which an error message is written (or NULL)
+ * @param erroffset Address which the error offset is written (or NULL)
+ *
+ * @returns Status code (IB_EINVAL if invalid, unsupported or
+ *          already built)
+ */
+ib_status_t DLL_PUBLIC ib_re_add_pattern(ib_re_t *re,
+                                         const char *patt,
+                                         ib_num_t id,
+                                         const char **errptr,
+                                         int *erroffset);
+
+/**
+ * Build the regex from the added patterns.
+ *
+ * No more patterns may be added after building.
+ *
+ * @param re Regex
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_re_build(ib_re_t *re);
+
+/**
+ * Check if a regex has been built.
+ *
+ * @param re Regex
+ *
+ * @returns Non-zero if built
+ */
+int DLL_PUBLIC ib_re_is_built(const ib_re_t *re);
+
+/**
+ * Get the number of patterns added.
+ *
+ * @param re Regex
+ *
+ * @returns Number of patterns
+ */
+size_t DLL_PUBLIC ib_re_pattern_count(const ib_re_t *re);
+
+/**
+ * Get the memory used by a built regex, including the DFA cache.
+ *
+ * @param re Regex
+ *
+ * @returns Size in bytes (0 if not built)
+ */
+size_t DLL_PUBLIC ib_re_memory(const ib_re_t *re);
+
+/**
+ * Get the number of times the DFA cache was full and flushed.
+ *
+ * @param re Regex
+ *
+ * @returns Number of flushes
+ */
+size_t DLL_PUBLIC ib_re_cache_flushes(const ib_re_t *re);
+
+/**
+ * Match all patterns against data.
+ *
+ * Each pattern matched is reported once, in order of where its first
+ * match ends (the shortest match from the earliest end).
+ *
+ * @param re Regex (built)
+ * @param data Data
+ * @param dlen Data length
+ * @param fn Callback, or NULL to stop at the first match
+ * @param cbdata Callback data
+ *
+ * @returns IB_OK if any pattern matched, IB_ENOENT if none did,
+ *          or the status returned by the callback to stop matching
+ */
+ib_status_t DLL_PUBLIC ib_re_match(const ib_re_t *re,
+                                   const uint8_t *data,
+                                   size_t dlen,
+                                   ib_re_callback_fn_t fn,
+                                   void *cbdata);
+
+/**
+ * Create the match state for a new stream.
+ *
+ * @param re Regex (built)
+ * @param pool Memory pool
+ * @param prs Address which the stream match state is written
+ *
+ * @returns Status code
+ */
+ib_status_t DLL_PUBLIC ib_re_stream_create(const ib_re_t *re,
+                                           ib_mpool_t *pool,
+                                           ib_re_stream_t **prs);
+
+/**
+ * Match all patterns against the next chunk of a stream.
+ *
+ * This is the same as ib_re_match(), except that matches spanning
+ * chunks are found, each pattern is reported once per stream and the
+ * end offsets reported are relative to the start of the stream.
+ * Patterns which need the end of the subject ($) are only matched by
+ * ib_re_match_finish(). If the callback stops the match, the rest of
+ * the chunk is skipped.
+ *
+ * @param re Regex (built)
+ * @param rs Stream match state
+ * @param data Data
+ * @param dlen Data length
+ * @param fn Callback, or NULL to stop at the first match
+ * @param cbdata Callback data
+ *
+ * @returns Status code as with ib_re_match()
+ */
+ib_status_t DLL_PUBLIC ib_re_match_stream(const ib_re_t *re,
+                                          ib_re_stream_t *rs,
+                                          const uint8_t *data,
+                                          size_t dlen,
+                                          ib_re_callback_fn_t fn,
+                                          void *cbdata);
+
+/**
+ * Finish a stream, matching patterns which end at the end of it.
+ *
+ * @param re Regex (built)
+ * @param rs Stream match state
+ * @param fn Callback, or NULL to stop at the first match
+ * @param cbdata Callback data
+ *
+ * @returns Status code as with ib_re_match()
+ */
+ib_status_t DLL_PUBLIC ib_re_match_finish(const ib_re_t *re,
+                                          ib_re_stream_t *rs,
+                                          ib_re_callback_fn_t fn,
+                                          void *cbdata);
+
+/**
+ * Analyze a pattern for constructs which make a backtracking matcher
+ * (such as PCRE) take exponential time on some input.
+ *
+ * Reported are repeated groups with a quantifier which can match a
+ * whole iteration by itself, such as (a+)+ or (\w+\s?)*, and
+ * alternations within a repeated group whose branches can match the
+ * same text, such as (\w|\d)+. The pattern is read as it is by the
+ * pcre matchers (PCRE_DOTALL), though here (?-s) is honored. Back
+ * references, assertions, atomic groups and possessive quantifiers are
+ * accepted, but not analyzed.
+ *
+ * This is a quick check of the pattern alone, so it can report some
+ * patterns which are safe and miss some which are not.
+ *
+ * @param patt Pattern (NUL terminated)
+ * @param flags Flags (IB_RE_F*)
+ * @param preason Address which a description of the risky construct
+ *                (or parse error) is written
+ * @param poffset Address which the offset of the risky construct
+ *                (or parse error) is written
+ *
+ * @returns IB_OK if nothing risky was found, IB_DECLINED if something
+ *          was, or IB_EINVAL if the pattern could not be parsed
+ */
+ib_status_t DLL_PUBLIC ib_re_analyze(const char *patt,
+                                     ib_flags_t flags,
+                                     const char **preason,
+                                     int *poffset);
+
+/**
+ * Find a literal which is within all text matched by a pattern.
+ *
+ * This is meant for prefiltering: a pattern cannot match data which
+ * does not contain the literal. The literal is in lower case and must
+ * be searched for case insensitively. The longest such literal found
+ * is used, for example "select" for "union\s+select". The pattern is
+ * read as by ib_re_analyze().
+ *
+ * @param patt Pattern (NUL terminated)
+ * @param flags Flags (IB_RE_F*)
+ * @param pool Memory pool to allocate the literal from
+ * @param plit Address which the literal is written
+ * @param plen Address which the literal length is written
+ *
+ * @returns IB_OK if a literal was found, IB_ENOENT if none was, or
+ *          IB_EINVAL if the pattern could not be parsed
+ */
+ib_status_t DLL_PUBLIC ib_re_literal(const char *patt,
+                                     ib_flags_t flags,
+                                     ib_mpool_t *pool,
+                                     const uint8_t **plit,
+                                     size_t *plen);
+
+/** @} IronBeeUtilRE */
+
 /**
  * @} IronBeeUtil
  */
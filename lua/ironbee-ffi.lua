@@ -70,7 +70,8 @@ ffi.cdef [[
         IB_EINVAL,
         IB_ENOENT,
         IB_ETIMEDOUT,
-        IB_EAGAIN
+        IB_EAGAIN,
+        IB_ELIMIT
     } ib_status_t;
     typedef enum {
         IB_FTYPE_GENERIC,
@@ -586,6 +587,8 @@ IB_EALLOC        = ffi.cast("int", c.IB_EALLOC)
 IB_EINVAL        = ffi.cast("int", c.IB_EINVAL)
 IB_ENOENT        = ffi.cast("int", c.IB_ENOENT)
 IB_ETIMEDOUT     = ffi.cast("int", c.IB_ETIMEDOUT)
+IB_EAGAIN        = ffi.cast("int", c.IB_EAGAIN)
+IB_ELIMIT        = ffi.cast("int", c.IB_ELIMIT)
 
 -- ===============================================
 -- Field Types
@@ -0,0 +1,498 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee - Aho-Corasick Module
+ *
+ * This module adds an Aho-Corasick based matcher named "ac".
+ *
+ * Patterns are literal strings. All patterns added to a matcher
+ * instance are matched in a single pass over the data, so this is
+ * suited to large keyword lists. Instances created during
+ * configuration are built concurrently when configuration is finished;
+ * any created later are built on their first match.
+ *
+ * @author Brian Rectanus <brectanus@qualys.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <ironbee/engine.h>
+#include <ironbee/util.h>
+#include <ironbee/module.h>
+#include <ironbee/provider.h>
+
+
+/* Define the module name as well as a string version of it. */
+#define MODULE_NAME        ac
+#define MODULE_NAME_STR    IB_XSTRINGIFY(MODULE_NAME)
+
+typedef struct modac_cfg_t modac_cfg_t;
+
+/* Define the public module symbol. */
+IB_MODULE_DECLARE();
+
+/**
+ * @internal
+ * Module Configuration Structure.
+ */
+struct modac_cfg_t {
+    ib_num_t       nocase;                /**< Case insensitive matching */
+};
+
+/* Instantiate a module global configuration. */
+static modac_cfg_t modac_global_cfg;
+
+
+/* -- Configuration -- */
+
+/**
+ * @internal
+ * Get the module configuration to use.
+ *
+ * Defaults and settings are only applied to the configuration
+ * contexts, so that of the main context is used. Automata may be
+ * created while configuring, before the main context is finished, so
+ * it is read each time rather than only once synced. The module
+ * global configuration is used if there is no main context yet.
+ *
+ * @param ib Engine
+ *
+ * @returns Module configuration
+ */
+static const modac_cfg_t *modac_cfg_get(ib_engine_t *ib)
+{
+    modac_cfg_t *cfg;
+    ib_status_t rc;
+
+    if (ib_context_main(ib) == NULL) {
+        return &modac_global_cfg;
+    }
+    rc = ib_context_module_config(ib_context_main(ib), &IB_MODULE_SYM,
+                                  (void *)&cfg);
+    if ((rc != IB_OK) || (cfg == NULL)) {
+        return &modac_global_cfg;
+    }
+
+    return cfg;
+}
+
+/**
+ * @internal
+ * Copy the main context configuration to the module global
+ * configuration.
+ *
+ * @param ib Engine
+ */
+static void modac_cfg_sync(ib_engine_t *ib)
+{
+    IB_FTRACE_INIT(modac_cfg_sync);
+    const modac_cfg_t *cfg = modac_cfg_get(ib);
+
+    if (cfg != &modac_global_cfg) {
+        modac_global_cfg = *cfg;
+    }
+
+    IB_FTRACE_RET_VOID();
+}
+
+
+/* -- Matcher Interface -- */
+
+/**
+ * @internal
+ * Create an empty automaton using the module configuration.
+ */
+static ib_status_t modac_create(ib_engine_t *ib,
+                                ib_ac_t **pac,
+                                ib_mpool_t *pool)
+{
+    IB_FTRACE_INIT(modac_create);
+    const modac_cfg_t *cfg = modac_cfg_get(ib);
+    ib_status_t rc;
+
+    rc = ib_ac_create(pac, pool, cfg->nocase ? IB_AC_FNOCASE : 0);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+/**
+ * @internal
+ * Build an automaton if not already built.
+ */
+static ib_status_t modac_build(ib_ac_t *ac)
+{
+    IB_FTRACE_INIT(modac_build);
+    ib_status_t rc;
+
+    if (ib_ac_is_built(ac)) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    rc = ib_ac_build(ac);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+static ib_status_t modac_compile(ib_provider_t *mpr,
+                                 ib_mpool_t *pool,
+                                 void *pcpatt,
+                                 const char *patt,
+                                 const char **errptr,
+                                 int *erroffset)
+{
+    IB_FTRACE_INIT(modac_compile);
+    ib_ac_t *ac;
+    ib_status_t rc;
+
+    *(void **)pcpatt = NULL;
+
+    rc = modac_create(mpr->ib, &ac, pool);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    rc = ib_ac_add_pattern(ac, (const uint8_t *)patt, strlen(patt), 0);
+    if (rc != IB_OK) {
+        if (errptr != NULL) {
+            *errptr = "empty pattern";
+        }
+        if (erroffset != NULL) {
+            *erroffset = 0;
+        }
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    rc = ib_ac_build(ac);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    *(void **)pcpatt = (void *)ac;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+static ib_status_t modac_match_compiled(ib_provider_t *mpr,
+                                        void *cpatt,
+                                        ib_flags_t flags,
+                                        const uint8_t *data,
+                                        size_t dlen)
+{
+    IB_FTRACE_INIT(modac_match_compiled);
+    ib_status_t rc;
+
+    rc = ib_ac_match((ib_ac_t *)cpatt, data, dlen, NULL, NULL);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+static ib_status_t modac_add_pattern(ib_provider_inst_t *mpi,
+                                     const char *patt,
+                                     ib_num_t id,
+                                     const char **errptr,
+                                     int *erroffset)
+{
+    IB_FTRACE_INIT(modac_add_pattern);
+    ib_ac_t *ac = (ib_ac_t *)mpi->data;
+    ib_status_t rc;
+
+    rc = ib_ac_add_pattern(ac, (const uint8_t *)patt, strlen(patt), id);
+    if (rc != IB_OK) {
+        if (errptr != NULL) {
+            *errptr = ib_ac_is_built(ac) ? "matcher already built"
+                                         : "empty pattern";
+        }
+        if (erroffset != NULL) {
+            *erroffset = 0;
+        }
+    }
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+static ib_status_t modac_match(ib_provider_inst_t *mpi,
+                               ib_flags_t flags,
+                               const uint8_t *data,
+                               size_t dlen,
+                               ib_matcher_callback_fn_t fn,
+                               void *cbdata)
+{
+    IB_FTRACE_INIT(modac_match);
+    ib_ac_t *ac = (ib_ac_t *)mpi->data;
+    ib_status_t rc;
+
+    rc = modac_build(ac);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    rc = ib_ac_match(ac, data, dlen, fn, cbdata);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+/**
+ * @internal
+ * Create the stream state, which is just the automaton state.
+ */
+static ib_status_t modac_stream_create(ib_provider_inst_t *mpi,
+                                       ib_mpool_t *pool,
+                                       void *pstate)
+{
+    IB_FTRACE_INIT(modac_stream_create);
+    ib_ac_stream_t *as;
+
+    as = (ib_ac_stream_t *)ib_mpool_alloc(pool, sizeof(*as));
+    if (as == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    ib_ac_stream_init(as);
+
+    *(void **)pstate = as;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+static ib_status_t modac_stream_feed(ib_provider_inst_t *mpi,
+                                     void *state,
+                                     ib_flags_t flags,
+                                     const uint8_t *data,
+                                     size_t dlen,
+                                     ib_matcher_callback_fn_t fn,
+                                     void *cbdata)
+{
+    IB_FTRACE_INIT(modac_stream_feed);
+    ib_ac_t *ac = (ib_ac_t *)mpi->data;
+    ib_status_t rc;
+
+    rc = modac_build(ac);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    rc = ib_ac_match_stream(ac, (ib_ac_stream_t *)state, data, dlen,
+                            fn, cbdata);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+/**
+ * @internal
+ * Finish a stream.
+ *
+ * Every match is reported as soon as its last byte is fed, so there
+ * is nothing left to match.
+ */
+static ib_status_t modac_stream_finish(ib_provider_inst_t *mpi,
+                                       void *state,
+                                       ib_matcher_callback_fn_t fn,
+                                       void *cbdata)
+{
+    IB_FTRACE_INIT(modac_stream_finish);
+    IB_FTRACE_RET_STATUS(IB_ENOENT);
+}
+
+/**
+ * @internal
+ * Initialize a matcher instance with an empty automaton.
+ *
+ * The automaton is also remembered so that it can be built once
+ * configuration is finished.
+ */
+static ib_status_t modac_inst_init(ib_provider_inst_t *mpi,
+                                   void *data)
+{
+    IB_FTRACE_INIT(modac_inst_init);
+    ib_list_t *pending = (ib_list_t *)mpi->pr->data;
+    ib_mpool_t *pool = mpi->mp;
+    ib_ac_t *ac;
+    ib_status_t rc;
+
+    /* Automata are built concurrently when configuration is finished,
+     * so each is allocated from its own pool.
+     */
+    if (pending != NULL) {
+        rc = ib_mpool_create(&pool, mpi->mp);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+    }
+
+    rc = modac_create(mpi->pr->ib, &ac, pool);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    mpi->data = ac;
+
+    if (pending != NULL) {
+        rc = ib_list_push(pending, ac);
+    }
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+static IB_PROVIDER_IFACE_TYPE(matcher) modac_matcher_iface = {
+    IB_PROVIDER_IFACE_HEADER_DEFAULTS,
+
+    /* Provider Interface */
+    modac_compile,
+    modac_match_compiled,
+
+    /* Provider Instance Interface */
+    modac_add_pattern,
+    modac_match,
+
+    /* Provider Instance Stream Interface */
+    modac_stream_create,
+    modac_stream_feed,
+    modac_stream_finish
+};
+
+
+/* -- Hooks -- */
+
+/**
+ * @internal
+ * Build an automaton (a configuration job).
+ */
+static ib_status_t modac_build_job(void *data,
+                                   ib_mpool_t *pool,
+                                   const char **perr)
+{
+    ib_status_t rc;
+
+    rc = modac_build((ib_ac_t *)data);
+    if (rc != IB_OK) {
+        *perr = MODULE_NAME_STR ": Failed to build matcher";
+    }
+
+    return rc;
+}
+
+/**
+ * @internal
+ * Queue building all automata created during configuration.
+ *
+ * They are built concurrently before configuration is finished. Later
+ * instances are built on first use instead. The finished main context
+ * configuration is also copied to the module global configuration.
+ */
+static ib_status_t modac_cfg_finished(ib_engine_t *ib,
+                                      void *param,
+                                      void *cbdata)
+{
+    IB_FTRACE_INIT(modac_cfg_finished);
+    ib_provider_t *mpr = (ib_provider_t *)cbdata;
+    ib_list_t *pending = (ib_list_t *)mpr->data;
+    ib_list_node_t *node;
+    size_t patterns = 0;
+    ib_status_t rc;
+
+    modac_cfg_sync(ib);
+
+    IB_LIST_LOOP(pending, node) {
+        ib_ac_t *ac = (ib_ac_t *)ib_list_node_data(node);
+
+        rc = ib_cfgjob_add(ib, NULL, 0, modac_build_job, ac);
+        if (rc != IB_OK) {
+            ib_log_error(ib, 1,
+                         MODULE_NAME_STR ": Failed to queue matcher build: %d",
+                         rc);
+            IB_FTRACE_RET_STATUS(rc);
+        }
+        patterns += ib_ac_pattern_count(ac);
+    }
+
+    ib_log_debug(ib, 4,
+                 MODULE_NAME_STR ": Building %zu matchers with %zu patterns",
+                 ib_list_elements(pending), patterns);
+
+    /* Instances created from now on are built on first use. */
+    mpr->data = NULL;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+
+/* -- Module Routines -- */
+
+static ib_status_t modac_init(ib_engine_t *ib,
+                              ib_module_t *m)
+{
+    IB_FTRACE_INIT(modac_init);
+    ib_provider_t *mpr;
+    ib_list_t *pending;
+    ib_status_t rc;
+
+    /* Settings are taken from the main context. */
+    modac_cfg_sync(ib);
+
+    /* Register as a matcher provider. */
+    rc = ib_provider_register(ib,
+                              IB_PROVIDER_TYPE_MATCHER,
+                              MODULE_NAME_STR,
+                              &mpr,
+                              &modac_matcher_iface,
+                              modac_inst_init);
+    if (rc != IB_OK) {
+        ib_log_error(ib, 3,
+                     MODULE_NAME_STR ": Error registering ac matcher provider: "
+                     "%d", rc);
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    /* Track instances to build when configuration is finished. */
+    rc = ib_list_create(&pending, ib_engine_pool_config_get(ib));
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    mpr->data = pending;
+
+    ib_hook_register(ib, cfg_finished_event,
+                     (ib_void_fn_t)modac_cfg_finished,
+                     mpr);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+static IB_CFGMAP_INIT_STRUCTURE(modac_config_map) = {
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".nocase",
+        IB_FTYPE_NUM,
+        &modac_global_cfg,
+        nocase,
+        0
+    ),
+    IB_CFGMAP_INIT_LAST
+};
+
+/**
+ * @internal
+ * Module structure.
+ *
+ * This structure defines some metadata, config data and various functions.
+ */
+IB_MODULE_INIT(
+    IB_MODULE_HEADER_DEFAULTS,            /**< Default metadata */
+    MODULE_NAME_STR,                      /**< Module name */
+    IB_MODULE_CONFIG(&modac_global_cfg),  /**< Global config data */
+    modac_config_map,                     /**< Configuration field map */
+    NULL,                                 /**< Config directive map */
+    modac_init,                           /**< Initialize function */
+    NULL,                                 /**< Finish function */
+    NULL,                                 /**< Context init function */
+);
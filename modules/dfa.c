@@ -0,0 +1,498 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee - DFA Regex Module
+ *
+ * This module adds a lazy DFA based regex matcher named "dfa".
+ *
+ * Patterns are a subset of PCRE syntax without backtracking features
+ * (backreferences, lookaround, atomic groups), so matching is linear in
+ * the length of the data whatever the pattern. This makes it suitable
+ * for patterns which are matched against untrusted input and could
+ * otherwise backtrack catastrophically. Select it with:
+ *
+ * @code
+ * Set matcher "dfa"
+ * @endcode
+ *
+ * All patterns added to a matcher instance are matched in a single
+ * pass. Instances created during configuration are built concurrently
+ * when configuration is finished; any created later are built on
+ * their first match.
+ *
+ * @author Brian Rectanus <brectanus@qualys.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <ironbee/engine.h>
+#include <ironbee/util.h>
+#include <ironbee/module.h>
+#include <ironbee/provider.h>
+
+
+/* Define the module name as well as a string version of it. */
+#define MODULE_NAME        dfa
+#define MODULE_NAME_STR    IB_XSTRINGIFY(MODULE_NAME)
+
+typedef struct moddfa_cfg_t moddfa_cfg_t;
+
+/* Define the public module symbol. */
+IB_MODULE_DECLARE();
+
+/**
+ * @internal
+ * Module Configuration Structure.
+ */
+struct moddfa_cfg_t {
+    ib_num_t       nocase;                /**< Case insensitive matching */
+    ib_num_t       cache_max;             /**< DFA cache size per matcher */
+};
+
+/* Instantiate a module global configuration. */
+static moddfa_cfg_t moddfa_global_cfg;
+
+
+/* -- Configuration -- */
+
+/**
+ * @internal
+ * Get the module configuration to use.
+ *
+ * Defaults and settings are only applied to the configuration
+ * contexts, so that of the main context is used. Regexes may be
+ * created while configuring, before the main context is finished, so
+ * it is read each time rather than only once synced. The module
+ * global configuration is used if there is no main context yet.
+ *
+ * @param ib Engine
+ *
+ * @returns Module configuration
+ */
+static const moddfa_cfg_t *moddfa_cfg_get(ib_engine_t *ib)
+{
+    moddfa_cfg_t *cfg;
+    ib_status_t rc;
+
+    if (ib_context_main(ib) == NULL) {
+        return &moddfa_global_cfg;
+    }
+    rc = ib_context_module_config(ib_context_main(ib), &IB_MODULE_SYM,
+                                  (void *)&cfg);
+    if ((rc != IB_OK) || (cfg == NULL)) {
+        return &moddfa_global_cfg;
+    }
+
+    return cfg;
+}
+
+/**
+ * @internal
+ * Copy the main context configuration to the module global
+ * configuration.
+ *
+ * @param ib Engine
+ */
+static void moddfa_cfg_sync(ib_engine_t *ib)
+{
+    IB_FTRACE_INIT(moddfa_cfg_sync);
+    const moddfa_cfg_t *cfg = moddfa_cfg_get(ib);
+
+    if (cfg != &moddfa_global_cfg) {
+        moddfa_global_cfg = *cfg;
+    }
+
+    IB_FTRACE_RET_VOID();
+}
+
+
+/* -- Matcher Interface -- */
+
+/**
+ * @internal
+ * Create an empty regex using the module configuration.
+ */
+static ib_status_t moddfa_create(ib_engine_t *ib,
+                                 ib_re_t **pre,
+                                 ib_mpool_t *pool)
+{
+    IB_FTRACE_INIT(moddfa_create);
+    const moddfa_cfg_t *cfg = moddfa_cfg_get(ib);
+    ib_status_t rc;
+
+    rc = ib_re_create(pre, pool,
+                      cfg->nocase ? IB_RE_FNOCASE : 0,
+                      (size_t)cfg->cache_max);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+/**
+ * @internal
+ * Build a regex if not already built.
+ */
+static ib_status_t moddfa_build(ib_re_t *re)
+{
+    IB_FTRACE_INIT(moddfa_build);
+    ib_status_t rc;
+
+    if (ib_re_is_built(re)) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    rc = ib_re_build(re);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+static ib_status_t moddfa_compile(ib_provider_t *mpr,
+                                  ib_mpool_t *pool,
+                                  void *pcpatt,
+                                  const char *patt,
+                                  const char **errptr,
+                                  int *erroffset)
+{
+    IB_FTRACE_INIT(moddfa_compile);
+    ib_re_t *re;
+    ib_status_t rc;
+
+    *(void **)pcpatt = NULL;
+
+    rc = moddfa_create(mpr->ib, &re, pool);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    rc = ib_re_add_pattern(re, patt, 0, errptr, erroffset);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    rc = ib_re_build(re);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    *(void **)pcpatt = (void *)re;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+static ib_status_t moddfa_match_compiled(ib_provider_t *mpr,
+                                         void *cpatt,
+                                         ib_flags_t flags,
+                                         const uint8_t *data,
+                                         size_t dlen)
+{
+    IB_FTRACE_INIT(moddfa_match_compiled);
+    ib_status_t rc;
+
+    rc = ib_re_match((ib_re_t *)cpatt, data, dlen, NULL, NULL);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+static ib_status_t moddfa_add_pattern(ib_provider_inst_t *mpi,
+                                      const char *patt,
+                                      ib_num_t id,
+                                      const char **errptr,
+                                      int *erroffset)
+{
+    IB_FTRACE_INIT(moddfa_add_pattern);
+    ib_re_t *re = (ib_re_t *)mpi->data;
+    ib_status_t rc;
+
+    rc = ib_re_add_pattern(re, patt, id, errptr, erroffset);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+static ib_status_t moddfa_match(ib_provider_inst_t *mpi,
+                                ib_flags_t flags,
+                                const uint8_t *data,
+                                size_t dlen,
+                                ib_matcher_callback_fn_t fn,
+                                void *cbdata)
+{
+    IB_FTRACE_INIT(moddfa_match);
+    ib_re_t *re = (ib_re_t *)mpi->data;
+    ib_status_t rc;
+
+    rc = moddfa_build(re);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    rc = ib_re_match(re, data, dlen, fn, cbdata);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+static ib_status_t moddfa_stream_create(ib_provider_inst_t *mpi,
+                                        ib_mpool_t *pool,
+                                        void *pstate)
+{
+    IB_FTRACE_INIT(moddfa_stream_create);
+    ib_re_t *re = (ib_re_t *)mpi->data;
+    ib_re_stream_t *rs;
+    ib_status_t rc;
+
+    rc = moddfa_build(re);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    rc = ib_re_stream_create(re, pool, &rs);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    *(void **)pstate = rs;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+static ib_status_t moddfa_stream_feed(ib_provider_inst_t *mpi,
+                                      void *state,
+                                      ib_flags_t flags,
+                                      const uint8_t *data,
+                                      size_t dlen,
+                                      ib_matcher_callback_fn_t fn,
+                                      void *cbdata)
+{
+    IB_FTRACE_INIT(moddfa_stream_feed);
+    ib_status_t rc;
+
+    rc = ib_re_match_stream((ib_re_t *)mpi->data, (ib_re_stream_t *)state,
+                            data, dlen, fn, cbdata);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+/**
+ * @internal
+ * Finish a stream, reporting patterns anchored to the end ($).
+ */
+static ib_status_t moddfa_stream_finish(ib_provider_inst_t *mpi,
+                                        void *state,
+                                        ib_matcher_callback_fn_t fn,
+                                        void *cbdata)
+{
+    IB_FTRACE_INIT(moddfa_stream_finish);
+    ib_status_t rc;
+
+    rc = ib_re_match_finish((ib_re_t *)mpi->data, (ib_re_stream_t *)state,
+                            fn, cbdata);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+/**
+ * @internal
+ * Initialize a matcher instance with an empty regex.
+ *
+ * The regex is also remembered so that it can be built once
+ * configuration is finished.
+ */
+static ib_status_t moddfa_inst_init(ib_provider_inst_t *mpi,
+                                    void *data)
+{
+    IB_FTRACE_INIT(moddfa_inst_init);
+    ib_list_t *pending = (ib_list_t *)mpi->pr->data;
+    ib_mpool_t *pool = mpi->mp;
+    ib_re_t *re;
+    ib_status_t rc;
+
+    /* Regexes are built concurrently when configuration is finished,
+     * so each is allocated from its own pool.
+     */
+    if (pending != NULL) {
+        rc = ib_mpool_create(&pool, mpi->mp);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+    }
+
+    rc = moddfa_create(mpi->pr->ib, &re, pool);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    mpi->data = re;
+
+    if (pending != NULL) {
+        rc = ib_list_push(pending, re);
+    }
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+static IB_PROVIDER_IFACE_TYPE(matcher) moddfa_matcher_iface = {
+    IB_PROVIDER_IFACE_HEADER_DEFAULTS,
+
+    /* Provider Interface */
+    moddfa_compile,
+    moddfa_match_compiled,
+
+    /* Provider Instance Interface */
+    moddfa_add_pattern,
+    moddfa_match,
+
+    /* Provider Instance Stream Interface */
+    moddfa_stream_create,
+    moddfa_stream_feed,
+    moddfa_stream_finish
+};
+
+
+/* -- Hooks -- */
+
+/**
+ * @internal
+ * Build a regex (a configuration job).
+ */
+static ib_status_t moddfa_build_job(void *data,
+                                    ib_mpool_t *pool,
+                                    const char **perr)
+{
+    ib_status_t rc;
+
+    rc = moddfa_build((ib_re_t *)data);
+    if (rc != IB_OK) {
+        *perr = MODULE_NAME_STR ": Failed to build matcher";
+    }
+
+    return rc;
+}
+
+/**
+ * @internal
+ * Queue building all regexes created during configuration.
+ *
+ * They are built concurrently before configuration is finished. Later
+ * instances are built on first use instead. The finished main context
+ * configuration is also copied to the module global configuration.
+ */
+static ib_status_t moddfa_cfg_finished(ib_engine_t *ib,
+                                       void *param,
+                                       void *cbdata)
+{
+    IB_FTRACE_INIT(moddfa_cfg_finished);
+    ib_provider_t *mpr = (ib_provider_t *)cbdata;
+    ib_list_t *pending = (ib_list_t *)mpr->data;
+    ib_list_node_t *node;
+    size_t patterns = 0;
+    ib_status_t rc;
+
+    moddfa_cfg_sync(ib);
+
+    IB_LIST_LOOP(pending, node) {
+        ib_re_t *re = (ib_re_t *)ib_list_node_data(node);
+
+        rc = ib_cfgjob_add(ib, NULL, 0, moddfa_build_job, re);
+        if (rc != IB_OK) {
+            ib_log_error(ib, 1,
+                         MODULE_NAME_STR ": Failed to queue matcher build: %d",
+                         rc);
+            IB_FTRACE_RET_STATUS(rc);
+        }
+        patterns += ib_re_pattern_count(re);
+    }
+
+    ib_log_debug(ib, 4,
+                 MODULE_NAME_STR ": Building %zu matchers with %zu patterns",
+                 ib_list_elements(pending), patterns);
+
+    /* Instances created from now on are built on first use. */
+    mpr->data = NULL;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+
+/* -- Module Routines -- */
+
+static ib_status_t moddfa_init(ib_engine_t *ib,
+                               ib_module_t *m)
+{
+    IB_FTRACE_INIT(moddfa_init);
+    ib_provider_t *mpr;
+    ib_list_t *pending;
+    ib_status_t rc;
+
+    /* Settings are taken from the main context. */
+    moddfa_cfg_sync(ib);
+
+    /* Register as a matcher provider. */
+    rc = ib_provider_register(ib,
+                              IB_PROVIDER_TYPE_MATCHER,
+                              MODULE_NAME_STR,
+                              &mpr,
+                              &moddfa_matcher_iface,
+                              moddfa_inst_init);
+    if (rc != IB_OK) {
+        ib_log_error(ib, 3,
+                     MODULE_NAME_STR ": Error registering dfa matcher provider: "
+                     "%d", rc);
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    /* Track instances to build when configuration is finished. */
+    rc = ib_list_create(&pending, ib_engine_pool_config_get(ib));
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    mpr->data = pending;
+
+    ib_hook_register(ib, cfg_finished_event,
+                     (ib_void_fn_t)moddfa_cfg_finished,
+                     mpr);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+static IB_CFGMAP_INIT_STRUCTURE(moddfa_config_map) = {
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".nocase",
+        IB_FTYPE_NUM,
+        &moddfa_global_cfg,
+        nocase,
+        0
+    ),
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".cache_max",
+        IB_FTYPE_NUM,
+        &moddfa_global_cfg,
+        cache_max,
+        (256 * 1024)
+    ),
+    IB_CFGMAP_INIT_LAST
+};
+
+/**
+ * @internal
+ * Module structure.
+ *
+ * This structure defines some metadata, config data and various functions.
+ */
+IB_MODULE_INIT(
+    IB_MODULE_HEADER_DEFAULTS,            /**< Default metadata */
+    MODULE_NAME_STR,                      /**< Module name */
+    IB_MODULE_CONFIG(&moddfa_global_cfg), /**< Global config data */
+    moddfa_config_map,                    /**< Configuration field map */
+    NULL,                                 /**< Config directive map */
+    moddfa_init,                          /**< Initialize function */
+    NULL,                                 /**< Finish function */
+    NULL,                                 /**< Context init function */
+);
@@ -0,0 +1,913 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee - Metrics Export Module
+ *
+ * This module exports the engine statistics counters and hook timing
+ * in the Prometheus text exposition format. Metrics are rendered by
+ * a dedicated exporter thread, which either serves them on a Unix
+ * domain socket (MetricsSocket) or periodically writes them to a file
+ * (MetricsFile), replacing the file atomically.
+ *
+ * The exporter only reads the per-thread statistics, so inspection
+ * threads never wait on it.
+ *
+ * The exporter is started by the first connection of each process
+ * rather than once configuration is finished, so that it runs in the
+ * children of servers which configure the engine and then fork, such
+ * as Apache httpd. A fork is noticed by a pthread_atfork() handler,
+ * so connections only test a flag. Each such process exports its own
+ * counters, so a "%p" in the MetricsSocket or MetricsFile path is
+ * replaced by the process ID to keep them apart.
+ *
+ * Counters are exported with the "_total" suffix, so that the
+ * "conn.count" counter is exported as "ironbee_conn_count_total".
+ *
+ * @author Brian Rectanus <brectanus@qualys.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <strings.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <ironbee/engine.h>
+#include <ironbee/util.h>
+#include <ironbee/module.h>
+
+/* Define the module name as well as a string version of it. */
+#define MODULE_NAME               metrics
+#define MODULE_NAME_STR           IB_XSTRINGIFY(MODULE_NAME)
+
+/* Declare the public module symbol. */
+IB_MODULE_DECLARE();
+
+/** Prefix for all exported metric names. */
+#define METRICS_PREFIX            "ironbee_"
+
+/** Suffix for all exported counter names. */
+#define METRICS_COUNTER_SUFFIX    "_total"
+
+/** Default file write interval (seconds). */
+#define METRICS_INTERVAL_DEFAULT  10
+
+/** Time to wait on a slow socket client (milliseconds). */
+#define METRICS_CLIENT_TIMEOUT    1000
+
+typedef struct metrics_cfg_t metrics_cfg_t;
+typedef struct metrics_buf_t metrics_buf_t;
+
+/** Module Configuration Structure */
+struct metrics_cfg_t {
+    /* Private. */
+    ib_engine_t        *ib;       /**< Engine */
+    const char         *sock_path;/**< Unix socket path */
+    const char         *file_path;/**< Metrics file path */
+    char                sock_name[PATH_MAX]; /**< Socket path ("%p" expanded) */
+    char                file_name[PATH_MAX]; /**< File path ("%p" expanded) */
+    pid_t               pid;      /**< Process which started the exporter */
+    volatile int        started;  /**< Exporter started in this process */
+    time_t              interval; /**< File write interval */
+    int                 sock_fd;  /**< Listening socket */
+    int                 wake[2];  /**< Pipe to wake the exporter thread */
+    pthread_t           thread;   /**< Exporter thread */
+    int                 running;  /**< Exporter thread is running */
+};
+
+/** Rendering buffer (heap allocated, private to the exporter thread) */
+struct metrics_buf_t {
+    char               *data;     /**< Buffer data */
+    size_t              len;      /**< Length of data */
+    size_t              size;     /**< Allocated size */
+    int                 failed;   /**< Allocation failed */
+};
+
+/* Instantiate a module global configuration. */
+static metrics_cfg_t metrics_global_cfg;
+
+/* Serializes starting the exporter between connections. */
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* The fork handlers are registered once per process. */
+static int metrics_atfork_registered;
+
+
+/* -- Rendering -- */
+
+/**
+ * @internal
+ * Append formatted text to a rendering buffer.
+ *
+ * @param buf Buffer
+ * @param fmt Format string
+ */
+static void metrics_buf_printf(metrics_buf_t *buf,
+                               const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (buf->failed) {
+        return;
+    }
+
+    for (;;) {
+        size_t avail = buf->size - buf->len;
+
+        va_start(ap, fmt);
+        n = vsnprintf(buf->data + buf->len, avail, fmt, ap);
+        va_end(ap);
+
+        if (n < 0) {
+            buf->failed = 1;
+            return;
+        }
+        if ((size_t)n < avail) {
+            buf->len += n;
+            return;
+        }
+
+        /* Grow and try again. */
+        {
+            size_t size = (buf->size * 2) + n + 1;
+            char *data = (char *)realloc(buf->data, size);
+            if (data == NULL) {
+                buf->failed = 1;
+                return;
+            }
+            buf->data = data;
+            buf->size = size;
+        }
+    }
+}
+
+/**
+ * @internal
+ * Append a counter name, converting it to a valid Prometheus name.
+ *
+ * Any character not valid in a Prometheus metric name is
+ * replaced with an underscore, and the counter suffix is added.
+ *
+ * @param buf Buffer
+ * @param name Statistics counter name
+ */
+static void metrics_buf_name(metrics_buf_t *buf,
+                             const char *name)
+{
+    char tmp[256];
+    size_t i;
+
+    for (i = 0; (name[i] != '\0') && (i < sizeof(tmp) - 1); i++) {
+        char c = name[i];
+        if (   ((c >= 'a') && (c <= 'z'))
+            || ((c >= 'A') && (c <= 'Z'))
+            || ((c >= '0') && (c <= '9'))
+            || (c == '_'))
+        {
+            tmp[i] = c;
+        }
+        else {
+            tmp[i] = '_';
+        }
+    }
+    tmp[i] = '\0';
+
+    metrics_buf_printf(buf, METRICS_PREFIX "%s" METRICS_COUNTER_SUFFIX, tmp);
+}
+
+/**
+ * @internal
+ * Render a statistics counter.
+ *
+ * @param ib Engine
+ * @param name Counter name
+ * @param val Counter value
+ * @param cbdata Rendering buffer
+ */
+static void metrics_render_stat(ib_engine_t *ib,
+                                const char *name,
+                                uint64_t val,
+                                void *cbdata)
+{
+    metrics_buf_t *buf = (metrics_buf_t *)cbdata;
+
+    metrics_buf_printf(buf, "# TYPE ");
+    metrics_buf_name(buf, name);
+    metrics_buf_printf(buf, " counter\n");
+    metrics_buf_name(buf, name);
+    metrics_buf_printf(buf, " %" PRIu64 "\n", val);
+}
+
+/**
+ * @internal
+ * Render hook timing for an (event, module) pair as a summary.
+ *
+ * @param ib Engine
+ * @param event Event
+ * @param m Module
+ * @param h Histogram (nanoseconds)
+ * @param cbdata Rendering buffer
+ */
+static void metrics_render_hook(ib_engine_t *ib,
+                                ib_state_event_type_t event,
+                                ib_module_t *m,
+                                const ib_hist_t *h,
+                                void *cbdata)
+{
+    static const double quantile[] = { 0.5, 0.9, 0.99, 0.999 };
+    metrics_buf_t *buf = (metrics_buf_t *)cbdata;
+    const char *evname = ib_state_event_name(event);
+    const char *mname = m ? m->name : IB_DSTR_UNKNOWN;
+    size_t i;
+
+    for (i = 0; i < sizeof(quantile) / sizeof(quantile[0]); i++) {
+        metrics_buf_printf(
+            buf,
+            METRICS_PREFIX "hook_duration_seconds"
+            "{event=\"%s\",module=\"%s\",quantile=\"%g\"} %.9f\n",
+            evname, mname, quantile[i],
+            (double)ib_hist_percentile(h, quantile[i] * 100.0) / 1e9);
+    }
+    metrics_buf_printf(
+        buf,
+        METRICS_PREFIX "hook_duration_seconds_sum"
+        "{event=\"%s\",module=\"%s\"} %.9f\n",
+        evname, mname, (double)h->sum / 1e9);
+    metrics_buf_printf(
+        buf,
+        METRICS_PREFIX "hook_duration_seconds_count"
+        "{event=\"%s\",module=\"%s\"} %" PRIu64 "\n",
+        evname, mname, h->count);
+}
+
+/**
+ * @internal
+ * Render all metrics.
+ *
+ * @param ib Engine
+ * @param buf Buffer (reset before rendering)
+ *
+ * @returns Status code
+ */
+static ib_status_t metrics_render(ib_engine_t *ib,
+                                  metrics_buf_t *buf)
+{
+    buf->len = 0;
+    buf->failed = 0;
+
+    ib_stat_walk(ib, metrics_render_stat, buf);
+
+    metrics_buf_printf(buf, "# TYPE " METRICS_PREFIX "hook_duration_seconds"
+                            " summary\n");
+    ib_hook_stats_walk(ib, metrics_render_hook, buf);
+
+    return buf->failed ? IB_EALLOC : IB_OK;
+}
+
+
+/* -- Output -- */
+
+/**
+ * @internal
+ * Write all data to a file descriptor.
+ *
+ * Socket descriptors are non-blocking, so wait (bounded) for a slow
+ * client rather than spinning.
+ *
+ * @param fd File descriptor
+ * @param data Data
+ * @param dlen Data length
+ *
+ * @returns Status code
+ */
+static ib_status_t metrics_write_all(int fd,
+                                     const char *data,
+                                     size_t dlen)
+{
+    while (dlen > 0) {
+        ssize_t n = send(fd, data, dlen, MSG_NOSIGNAL);
+
+        if (n < 0 && errno == ENOTSOCK) {
+            n = write(fd, data, dlen);
+        }
+        if (n < 0) {
+            struct pollfd pfd;
+
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno != EAGAIN) && (errno != EWOULDBLOCK)) {
+                return IB_EUNKNOWN;
+            }
+
+            pfd.fd = fd;
+            pfd.events = POLLOUT;
+            if (poll(&pfd, 1, METRICS_CLIENT_TIMEOUT) <= 0) {
+                return IB_ETIMEDOUT;
+            }
+            continue;
+        }
+
+        data += n;
+        dlen -= n;
+    }
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Atomically replace the metrics file.
+ *
+ * The metrics are written to a temporary file which is then renamed
+ * over the metrics file so that readers never see a partial file.
+ *
+ * @param cfg Module configuration
+ * @param buf Rendering buffer
+ */
+static void metrics_write_file(metrics_cfg_t *cfg,
+                               metrics_buf_t *buf)
+{
+    ib_engine_t *ib = cfg->ib;
+    char tmp[PATH_MAX];
+    int fd;
+    ib_status_t rc;
+
+    if (metrics_render(ib, buf) != IB_OK) {
+        ib_log_error(ib, 3, "Failed to render metrics");
+        return;
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", cfg->file_name);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        ib_log_error(ib, 3, "Failed to open metrics file \"%s\": %s",
+                     tmp, strerror(errno));
+        return;
+    }
+
+    rc = metrics_write_all(fd, buf->data, buf->len);
+    close(fd);
+    if (rc != IB_OK) {
+        ib_log_error(ib, 3, "Failed to write metrics file \"%s\": %s",
+                     tmp, strerror(errno));
+        unlink(tmp);
+        return;
+    }
+
+    if (rename(tmp, cfg->file_name) != 0) {
+        ib_log_error(ib, 3, "Failed to rename metrics file \"%s\": %s",
+                     tmp, strerror(errno));
+        unlink(tmp);
+    }
+}
+
+/**
+ * @internal
+ * Serve the metrics to a socket client.
+ *
+ * If the client sent an HTTP request, an HTTP response is returned,
+ * otherwise only the metrics are written (ie for "socat - UNIX:...").
+ *
+ * @param cfg Module configuration
+ * @param buf Rendering buffer
+ */
+static void metrics_serve_client(metrics_cfg_t *cfg,
+                                 metrics_buf_t *buf)
+{
+    ib_engine_t *ib = cfg->ib;
+    struct pollfd pfd;
+    char req[512];
+    ssize_t n = 0;
+    int fd;
+
+    fd = accept(cfg->sock_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    /* Give the client a brief chance to send a request. */
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 100) > 0) {
+        n = recv(fd, req, sizeof(req), 0);
+    }
+
+    if (metrics_render(ib, buf) != IB_OK) {
+        ib_log_error(ib, 3, "Failed to render metrics");
+        close(fd);
+        return;
+    }
+
+    if ((n >= 4) && (memcmp(req, "GET ", 4) == 0)) {
+        char hdr[128];
+        int hlen = snprintf(hdr, sizeof(hdr),
+                            "HTTP/1.0 200 OK\r\n"
+                            "Content-Type: text/plain; version=0.0.4\r\n"
+                            "Content-Length: %zu\r\n"
+                            "\r\n",
+                            buf->len);
+        if (metrics_write_all(fd, hdr, hlen) != IB_OK) {
+            close(fd);
+            return;
+        }
+    }
+
+    metrics_write_all(fd, buf->data, buf->len);
+    close(fd);
+}
+
+
+/* -- Exporter Thread -- */
+
+/**
+ * @internal
+ * Exporter thread main loop.
+ *
+ * @param data Module configuration
+ *
+ * @returns NULL
+ */
+static void *metrics_thread(void *data)
+{
+    metrics_cfg_t *cfg = (metrics_cfg_t *)data;
+    metrics_buf_t buf;
+    time_t next = 0;
+
+    memset(&buf, 0, sizeof(buf));
+
+    for (;;) {
+        struct pollfd pfd[2];
+        int timeout = -1;
+        nfds_t nfds = 1;
+        time_t now;
+
+        if (cfg->file_path != NULL) {
+            now = time(NULL);
+            if (now >= next) {
+                metrics_write_file(cfg, &buf);
+                next = now + cfg->interval;
+            }
+            timeout = (int)(next - now) * 1000;
+        }
+
+        pfd[0].fd = cfg->wake[0];
+        pfd[0].events = POLLIN;
+        if (cfg->sock_fd >= 0) {
+            pfd[1].fd = cfg->sock_fd;
+            pfd[1].events = POLLIN;
+            nfds++;
+        }
+
+        if (poll(pfd, nfds, timeout) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+
+        /* Any activity on the wake pipe means shutdown. */
+        if (pfd[0].revents != 0) {
+            break;
+        }
+
+        if ((nfds > 1) && (pfd[1].revents & POLLIN)) {
+            metrics_serve_client(cfg, &buf);
+        }
+    }
+
+    /* Write a final copy so the last values are not lost. */
+    if (cfg->file_path != NULL) {
+        metrics_write_file(cfg, &buf);
+    }
+
+    free(buf.data);
+
+    return NULL;
+}
+
+/**
+ * @internal
+ * Open the listening Unix domain socket.
+ *
+ * @param cfg Module configuration
+ *
+ * @returns Status code
+ */
+static ib_status_t metrics_listen(metrics_cfg_t *cfg)
+{
+    IB_FTRACE_INIT(metrics_listen);
+    ib_engine_t *ib = cfg->ib;
+    struct sockaddr_un sun;
+    int fd;
+
+    if (strlen(cfg->sock_name) >= sizeof(sun.sun_path)) {
+        ib_log_error(ib, 1, "Metrics socket path too long: %s",
+                     cfg->sock_name);
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    strcpy(sun.sun_path, cfg->sock_name);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        ib_log_error(ib, 1, "Failed to create metrics socket: %s",
+                     strerror(errno));
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    /* Remove a stale socket from a previous run. */
+    unlink(cfg->sock_name);
+
+    if (   (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0)
+        || (listen(fd, 16) != 0))
+    {
+        ib_log_error(ib, 1, "Failed to listen on metrics socket \"%s\": %s",
+                     cfg->sock_name, strerror(errno));
+        close(fd);
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+
+    cfg->sock_fd = fd;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Expand the first "%p" in a path to the process ID.
+ *
+ * @param buf Buffer for the expanded path
+ * @param size Size of buf
+ * @param path Configured path
+ * @param pid Process ID
+ */
+static void metrics_path_expand(char *buf,
+                                size_t size,
+                                const char *path,
+                                pid_t pid)
+{
+    const char *p = strstr(path, "%p");
+
+    if (p == NULL) {
+        snprintf(buf, size, "%s", path);
+        return;
+    }
+    snprintf(buf, size, "%.*s%ld%s",
+             (int)(p - path), path, (long)pid, p + 2);
+}
+
+/**
+ * @internal
+ * Start the exporter thread in this process.
+ *
+ * @param cfg Module configuration
+ * @param pid Process ID
+ *
+ * @returns Status code
+ */
+static ib_status_t metrics_start(metrics_cfg_t *cfg,
+                                 pid_t pid)
+{
+    IB_FTRACE_INIT(metrics_start);
+    ib_engine_t *ib = cfg->ib;
+    ib_status_t rc;
+
+    if (cfg->sock_path != NULL) {
+        metrics_path_expand(cfg->sock_name, sizeof(cfg->sock_name),
+                            cfg->sock_path, pid);
+    }
+    if (cfg->file_path != NULL) {
+        metrics_path_expand(cfg->file_name, sizeof(cfg->file_name),
+                            cfg->file_path, pid);
+    }
+
+    if (pipe(cfg->wake) != 0) {
+        ib_log_error(ib, 1, "Failed to create metrics pipe: %s",
+                     strerror(errno));
+        cfg->wake[0] = cfg->wake[1] = -1;
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+    fcntl(cfg->wake[0], F_SETFD, FD_CLOEXEC);
+    fcntl(cfg->wake[1], F_SETFD, FD_CLOEXEC);
+
+    if (cfg->sock_path != NULL) {
+        rc = metrics_listen(cfg);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+    }
+
+    if (pthread_create(&cfg->thread, NULL, metrics_thread, cfg) != 0) {
+        ib_log_error(ib, 1, "Failed to start metrics exporter thread");
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+    cfg->running = 1;
+
+    ib_log_debug(ib, 4, "Metrics exporter started: pid=%ld socket=%s file=%s",
+                 (long)pid,
+                 cfg->sock_path ? cfg->sock_name : "none",
+                 cfg->file_path ? cfg->file_name : "none");
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Stop the exporter thread.
+ *
+ * @param cfg Module configuration
+ *
+ * @returns Status code
+ */
+static ib_status_t metrics_stop(metrics_cfg_t *cfg)
+{
+    IB_FTRACE_INIT(metrics_stop);
+
+    if (cfg->running) {
+        ssize_t n;
+
+        do {
+            n = write(cfg->wake[1], "x", 1);
+        } while ((n < 0) && (errno == EINTR));
+        pthread_join(cfg->thread, NULL);
+        cfg->running = 0;
+    }
+
+    if (cfg->sock_fd >= 0) {
+        close(cfg->sock_fd);
+        unlink(cfg->sock_name);
+        cfg->sock_fd = -1;
+    }
+    if (cfg->wake[0] >= 0) {
+        close(cfg->wake[0]);
+        close(cfg->wake[1]);
+        cfg->wake[0] = cfg->wake[1] = -1;
+    }
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+
+/* -- Directive Handlers -- */
+
+/**
+ * @internal
+ * Handle MetricsSocket, MetricsFile and MetricsInterval directives.
+ *
+ * @param cp Config parser
+ * @param name Directive name
+ * @param p1 First parameter
+ * @param cbdata Callback data (from directive registration)
+ *
+ * @returns Status code
+ */
+static ib_status_t metrics_dir_param1(ib_cfgparser_t *cp,
+                                      const char *name,
+                                      const char *p1,
+                                      void *cbdata)
+{
+    IB_FTRACE_INIT(metrics_dir_param1);
+    ib_engine_t *ib = cp->ib;
+    metrics_cfg_t *cfg = &metrics_global_cfg;
+    ib_mpool_t *mp = ib_engine_pool_main_get(ib);
+
+    ib_log_debug(ib, 7, "%s: \"%s\"", name, p1);
+
+    if (strcasecmp("MetricsSocket", name) == 0) {
+        cfg->sock_path = ib_mpool_memdup(mp, p1, strlen(p1) + 1);
+        IB_FTRACE_RET_STATUS(cfg->sock_path ? IB_OK : IB_EALLOC);
+    }
+    else if (strcasecmp("MetricsFile", name) == 0) {
+        cfg->file_path = ib_mpool_memdup(mp, p1, strlen(p1) + 1);
+        IB_FTRACE_RET_STATUS(cfg->file_path ? IB_OK : IB_EALLOC);
+    }
+    else if (strcasecmp("MetricsInterval", name) == 0) {
+        long secs = strtol(p1, NULL, 10);
+        if (secs <= 0) {
+            ib_log_error(ib, 1, "Invalid %s: %s", name, p1);
+            IB_FTRACE_RET_STATUS(IB_EINVAL);
+        }
+        cfg->interval = (time_t)secs;
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    ib_log_error(ib, 1, "Unhandled directive: %s %s", name, p1);
+    IB_FTRACE_RET_STATUS(IB_EINVAL);
+}
+
+
+/* -- Configuration Data -- */
+
+/* Directive initialization structure. */
+static IB_DIRMAP_INIT_STRUCTURE(metrics_directive_map) = {
+    /* MetricsSocket - Serve metrics on a Unix domain socket */
+    IB_DIRMAP_INIT_PARAM1(
+        "MetricsSocket",
+        metrics_dir_param1,
+        NULL
+    ),
+
+    /* MetricsFile - Periodically write metrics to a file */
+    IB_DIRMAP_INIT_PARAM1(
+        "MetricsFile",
+        metrics_dir_param1,
+        NULL
+    ),
+
+    /* MetricsInterval - Interval (seconds) to write the metrics file */
+    IB_DIRMAP_INIT_PARAM1(
+        "MetricsInterval",
+        metrics_dir_param1,
+        NULL
+    ),
+
+    /* End */
+    IB_DIRMAP_INIT_LAST
+};
+
+
+/* -- Fork Handlers -- */
+
+/**
+ * @internal
+ * Hold the exporter lock over a fork.
+ */
+static void metrics_atfork_prepare(void)
+{
+    pthread_mutex_lock(&metrics_lock);
+}
+
+/**
+ * @internal
+ * Release the exporter lock in the parent after a fork.
+ */
+static void metrics_atfork_parent(void)
+{
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+/**
+ * @internal
+ * Reset the exporter in the child after a fork.
+ *
+ * The child inherits the state of the exporter, but not its thread,
+ * so it is started again by the first connection of the child. The
+ * descriptors of the parent are closed, but only the parent may
+ * remove its socket.
+ */
+static void metrics_atfork_child(void)
+{
+    metrics_cfg_t *cfg = &metrics_global_cfg;
+
+    if (cfg->sock_fd >= 0) {
+        close(cfg->sock_fd);
+        cfg->sock_fd = -1;
+    }
+    if (cfg->wake[0] >= 0) {
+        close(cfg->wake[0]);
+        close(cfg->wake[1]);
+        cfg->wake[0] = cfg->wake[1] = -1;
+    }
+    cfg->running = 0;
+    cfg->started = 0;
+
+    pthread_mutex_unlock(&metrics_lock);
+}
+
+
+/* -- Hook Handlers -- */
+
+/**
+ * @internal
+ * Start the exporter thread with the first connection of a process.
+ *
+ * @param ib Engine
+ * @param conn Connection
+ * @param cbdata Unused
+ *
+ * @returns Status code
+ */
+static ib_status_t metrics_handle_conn_started(ib_engine_t *ib,
+                                               ib_conn_t *conn,
+                                               void *cbdata)
+{
+    IB_FTRACE_INIT(metrics_handle_conn_started);
+    metrics_cfg_t *cfg = &metrics_global_cfg;
+    ib_status_t rc = IB_OK;
+
+    if (cfg->started) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+    if ((cfg->sock_path == NULL) && (cfg->file_path == NULL)) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    pthread_mutex_lock(&metrics_lock);
+    if (!cfg->started) {
+        /* Attempt this once per process, even if it fails. */
+        cfg->pid = getpid();
+        rc = metrics_start(cfg, cfg->pid);
+        cfg->started = 1;
+    }
+    pthread_mutex_unlock(&metrics_lock);
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+
+/* -- Module Routines -- */
+
+static ib_status_t metrics_init(ib_engine_t *ib,
+                                ib_module_t *m)
+{
+    IB_FTRACE_INIT(metrics_init);
+
+    memset(&metrics_global_cfg, 0, sizeof(metrics_global_cfg));
+    metrics_global_cfg.ib = ib;
+    metrics_global_cfg.interval = METRICS_INTERVAL_DEFAULT;
+    metrics_global_cfg.sock_fd = -1;
+    metrics_global_cfg.wake[0] = metrics_global_cfg.wake[1] = -1;
+
+    if (!metrics_atfork_registered) {
+        if (pthread_atfork(metrics_atfork_prepare,
+                           metrics_atfork_parent,
+                           metrics_atfork_child) != 0)
+        {
+            ib_log_error(ib, 1, "Failed to register metrics fork handlers");
+            IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+        }
+        metrics_atfork_registered = 1;
+    }
+
+    ib_hook_register(ib, conn_started_event,
+                     (ib_void_fn_t)metrics_handle_conn_started,
+                     NULL);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+static ib_status_t metrics_fini(ib_engine_t *ib,
+                                ib_module_t *m)
+{
+    IB_FTRACE_INIT(metrics_fini);
+
+    /* Stop the thread before any engine memory is released, unless
+     * it was started by another process.
+     */
+    if (metrics_global_cfg.started) {
+        metrics_stop(&metrics_global_cfg);
+    }
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * Module structure.
+ *
+ * This structure defines some metadata, config data and various functions.
+ */
+IB_MODULE_INIT(
+    IB_MODULE_HEADER_DEFAULTS,           /**< Default metadata */
+    MODULE_NAME_STR,                     /**< Module name */
+    NULL, 0,                             /**< Global config data */
+    NULL,                                /**< Configuration field map */
+    metrics_directive_map,               /**< Config directive map */
+    metrics_init,                        /**< Initialize function */
+    metrics_fini,                        /**< Finish function */
+    NULL,                                /**< Context init function */
+);
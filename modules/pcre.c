@@ -21,6 +21,13 @@
  *
  * This module adds a PCRE based matcher named "pcre".
  *
+ * The configured match limits are applied to every match, and JIT
+ * compiled patterns run on a per-thread JIT stack limited to
+ * pcre.jit_stack_max bytes, so that a pattern which backtracks
+ * catastrophically fails with IB_ELIMIT instead of pinning a thread.
+ * Such failures are counted in the "pcre.limit_exceeded" statistic.
+ * Compiled patterns can be serialized.
+ *
  * @author Brian Rectanus <brectanus@qualys.com>
  */
 
@@ -31,6 +38,7 @@
 #include <strings.h>
 #include <time.h>
 #include <ctype.h>
+#include <pthread.h>
 
 #include <ironbee/engine.h>
 #include <ironbee/util.h>
@@ -46,6 +54,15 @@
 
 typedef struct modpcre_cfg_t modpcre_cfg_t;
 typedef struct modpcre_cpatt_t modpcre_cpatt_t;
+typedef struct modpcre_spatt_t modpcre_spatt_t;
+typedef struct modpcre_stream_t modpcre_stream_t;
+typedef struct modpcre_thread_t modpcre_thread_t;
+
+/** Initial size of a per-thread JIT stack. */
+#define MODPCRE_JIT_STACK_MIN   (32 * 1024)
+
+/** Size of the serialized pattern header. */
+#define MODPCRE_SER_HDR         (4 * sizeof(uint32_t))
 
 /* Define the public module symbol. */
 IB_MODULE_DECLARE();
@@ -58,6 +75,8 @@ struct modpcre_cfg_t {
     ib_num_t       study;                 /**< Study compiled regexs */
     ib_num_t       match_limit;           /**< Match limit */
     ib_num_t       match_limit_recursion; /**< Match recursion depth limit */
+    ib_num_t       partial_max;           /**< Max partial match kept in streams */
+    ib_num_t       jit_stack_max;         /**< Max per-thread JIT stack size */
 };
 
 /**
@@ -68,14 +87,335 @@ struct modpcre_cpatt_t {
     pcre          *cpatt;                 /**< Compiled pattern */
     pcre_extra    *edata;                 /**< PCRE Study data */
     const char    *patt;                  /**< Regex pattern text */
+    ib_num_t       id;                    /**< Pattern ID (instances only) */
+    int            ovecsize;              /**< Ovector size for captures */
+};
+
+/**
+ * @internal
+ * Per pattern stream state.
+ *
+ * Where a chunk ends in a partial match, the data from the start of
+ * the partial match is kept so that it can be matched again with the
+ * next chunk.
+ */
+struct modpcre_spatt_t {
+    modpcre_cpatt_t *cpatt;               /**< Compiled pattern */
+    uint8_t         *buf;                 /**< Kept data (partial match) */
+    size_t           blen;                /**< Kept data length */
+    size_t           bsize;               /**< Kept data buffer size */
+    size_t           boff;                /**< Stream offset of kept data */
+    int              done;                /**< Pattern has matched */
+};
+
+/**
+ * @internal
+ * Stream state for a matcher instance.
+ */
+struct modpcre_stream_t {
+    ib_mpool_t      *mp;                  /**< Memory pool */
+    modpcre_spatt_t *spatt;               /**< Pattern states */
+    size_t           npatt;               /**< Number of patterns */
+    size_t           offset;              /**< Stream offset of next chunk */
+};
+
+/**
+ * @internal
+ * Per-thread match resources, reused for every match on the thread.
+ */
+struct modpcre_thread_t {
+#ifdef PCRE_HAVE_SLJIT
+    pcre_jit_stack  *jit_stack;           /**< JIT stack */
+#endif
+    int             *ovector;             /**< Ovector */
+    int              ovecsize;            /**< Ovector size */
 };
 
 /* Instantiate a module global configuration. */
 static modpcre_cfg_t modpcre_global_cfg;
 
+/** Key for the per-thread match resources. */
+static pthread_key_t modpcre_thread_key;
+
+/** Statistics counter of matches which exceeded a limit. */
+static ib_stat_id_t modpcre_stat_limit;
+
+
+/* -- PCRE Execution -- */
+
+/**
+ * @internal
+ * Free the match resources of an exiting thread.
+ */
+static void modpcre_thread_free(void *data)
+{
+    modpcre_thread_t *t = (modpcre_thread_t *)data;
+
+#ifdef PCRE_HAVE_SLJIT
+    if (t->jit_stack != NULL) {
+        pcre_jit_stack_free(t->jit_stack);
+    }
+#endif
+    free(t->ovector);
+    free(t);
+}
+
+/**
+ * @internal
+ * Get the match resources of the calling thread.
+ *
+ * @param ovecsize Minimum ovector size
+ *
+ * @returns Thread match resources, or NULL on allocation failure
+ */
+static modpcre_thread_t *modpcre_thread_get(int ovecsize)
+{
+    modpcre_thread_t *t;
+
+    t = (modpcre_thread_t *)pthread_getspecific(modpcre_thread_key);
+    if (t == NULL) {
+        t = (modpcre_thread_t *)calloc(1, sizeof(*t));
+        if (t == NULL) {
+            return NULL;
+        }
+        if (pthread_setspecific(modpcre_thread_key, t) != 0) {
+            free(t);
+            return NULL;
+        }
+    }
+
+    if (t->ovecsize < ovecsize) {
+        int *ovector = (int *)realloc(t->ovector, ovecsize * sizeof(int));
+
+        if (ovector == NULL) {
+            return NULL;
+        }
+        t->ovector = ovector;
+        t->ovecsize = ovecsize;
+    }
+
+    return t;
+}
+
+#ifdef PCRE_HAVE_SLJIT
+/**
+ * @internal
+ * JIT stack callback, which returns the calling thread's JIT stack.
+ *
+ * Returning NULL makes PCRE use a small stack on the machine stack.
+ */
+static pcre_jit_stack *modpcre_jit_stack(void *data)
+{
+    modpcre_thread_t *t = modpcre_thread_get(0);
+    int max = (int)modpcre_global_cfg.jit_stack_max;
+
+    if (t == NULL) {
+        return NULL;
+    }
+
+    if (t->jit_stack == NULL) {
+        if (max < MODPCRE_JIT_STACK_MIN) {
+            max = MODPCRE_JIT_STACK_MIN;
+        }
+        t->jit_stack = pcre_jit_stack_alloc(MODPCRE_JIT_STACK_MIN, max);
+    }
+
+    return t->jit_stack;
+}
+#endif /* PCRE_HAVE_SLJIT */
+
+/**
+ * @internal
+ * Execute a compiled pattern.
+ *
+ * The ovector is the calling thread's, sized for the pattern's
+ * captures so that PCRE never allocates one for back references. It
+ * is only valid until the next match on the thread.
+ *
+ * The match limits are those configured now, rather than when the
+ * pattern was compiled (which may be before the configuration is
+ * finished, or from a pattern database).
+ *
+ * @param pcre_cpatt Compiled pattern
+ * @param subj Subject
+ * @param slen Subject length
+ * @param options PCRE exec options
+ * @param povector Address which the ovector is written
+ *
+ * @returns pcre_exec() result
+ */
+static int modpcre_exec(const modpcre_cpatt_t *pcre_cpatt,
+                        const uint8_t *subj,
+                        size_t slen,
+                        int options,
+                        const int **povector)
+{
+    modpcre_thread_t *t = modpcre_thread_get(pcre_cpatt->ovecsize);
+    pcre_extra edata = *pcre_cpatt->edata;
+
+    if (t == NULL) {
+        return PCRE_ERROR_NOMEMORY;
+    }
+    *povector = t->ovector;
+
+    edata.flags &= ~(  PCRE_EXTRA_MATCH_LIMIT
+                     | PCRE_EXTRA_MATCH_LIMIT_RECURSION);
+    if (modpcre_global_cfg.match_limit > 0) {
+        edata.flags |= PCRE_EXTRA_MATCH_LIMIT;
+        edata.match_limit = (unsigned long)modpcre_global_cfg.match_limit;
+    }
+    if (modpcre_global_cfg.match_limit_recursion > 0) {
+        edata.flags |= PCRE_EXTRA_MATCH_LIMIT_RECURSION;
+        edata.match_limit_recursion =
+            (unsigned long)modpcre_global_cfg.match_limit_recursion;
+    }
+
+    return pcre_exec(pcre_cpatt->cpatt, &edata,
+                     (const char *)subj, (int)slen,
+                     0, options, t->ovector, t->ovecsize);
+}
+
+/**
+ * @internal
+ * Convert a pcre_exec() result to a status code.
+ *
+ * @param ib Engine
+ * @param pcre_cpatt Compiled pattern
+ * @param ec pcre_exec() result
+ *
+ * @returns IB_OK on a match, IB_ENOENT if no match, IB_ELIMIT if
+ *          a match or stack limit was exceeded, else an error status
+ */
+static ib_status_t modpcre_status(ib_engine_t *ib,
+                                  const modpcre_cpatt_t *pcre_cpatt,
+                                  int ec)
+{
+    if (ec >= 0) {
+        return IB_OK;
+    }
+
+    switch (ec) {
+        case PCRE_ERROR_NOMATCH:
+            return IB_ENOENT;
+        case PCRE_ERROR_MATCHLIMIT:
+        case PCRE_ERROR_RECURSIONLIMIT:
+#ifdef PCRE_ERROR_JIT_STACKLIMIT
+        case PCRE_ERROR_JIT_STACKLIMIT:
+#endif
+            ib_stat_inc(ib, modpcre_stat_limit);
+            ib_log_debug(ib, 4, "PCRE limit exceeded (%d) for \"%s\"",
+                         ec, pcre_cpatt->patt);
+            return IB_ELIMIT;
+        case PCRE_ERROR_NOMEMORY:
+            return IB_EALLOC;
+        default:
+            break;
+    }
+
+    ib_log_error(ib, 3, "PCRE match error (%d) for \"%s\"",
+                 ec, pcre_cpatt->patt);
+
+    return IB_EINVAL;
+}
+
 
 /* -- Matcher Interface -- */
 
+/**
+ * @internal
+ * Create the internal representation of a compiled pattern.
+ *
+ * The pattern is studied (JIT compiled where supported). The match
+ * limits are applied by modpcre_exec(). Only @a pool is allocated from, as
+ * patterns may be compiled concurrently while configuring.
+ *
+ * Without JIT support, study data saved by modpcre_serialize() is
+ * used as is rather than studying the pattern again. JIT code cannot
+ * be saved, so with JIT support the pattern is always studied.
+ *
+ * @param pool Memory pool
+ * @param cpatt PCRE compiled pattern
+ * @param patt Regex pattern text
+ * @param study Saved study data (or NULL to study the pattern)
+ * @param studylen Length of @a study (0 if studying found nothing)
+ * @param errptr Address which any study error is written
+ * @param ppcre_cpatt Address which the compiled pattern is written
+ *
+ * @returns Status code
+ */
+static ib_status_t modpcre_cpatt_create(ib_mpool_t *pool,
+                                        pcre *cpatt,
+                                        const char *patt,
+                                        const uint8_t *study,
+                                        size_t studylen,
+                                        const char **errptr,
+                                        modpcre_cpatt_t **ppcre_cpatt)
+{
+    IB_FTRACE_INIT(modpcre_cpatt_create);
+    modpcre_cpatt_t *pcre_cpatt;
+    int ncapture = 0;
+
+    pcre_cpatt = (modpcre_cpatt_t *)ib_mpool_alloc(pool, sizeof(*pcre_cpatt));
+    if (pcre_cpatt == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    pcre_cpatt->patt = patt; /// @todo Copy
+    pcre_cpatt->cpatt = cpatt;
+
+    /* Size the ovector so that back references never need one allocated. */
+    pcre_fullinfo(cpatt, NULL, PCRE_INFO_CAPTURECOUNT, &ncapture);
+    pcre_cpatt->ovecsize = (ncapture + 1) * 3;
+    pcre_cpatt->edata = NULL;
+
+#ifdef PCRE_HAVE_SLJIT
+    pcre_cpatt->edata = pcre_study(pcre_cpatt->cpatt,
+                                   PCRE_STUDY_JIT_COMPILE
+                                   | PCRE_STUDY_JIT_PARTIAL_HARD_COMPILE,
+                                   errptr);
+    if(*errptr != NULL)  {
+        ib_util_log_error(4,"PCRE-SLJIT study failed : %s", *errptr);
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+    if ((pcre_cpatt->edata == NULL) || !(pcre_cpatt->edata->flags & PCRE_EXTRA_EXECUTABLE_FUNC)) {
+        ib_util_log_error(4,"PCRE-SLJIT compiler does not support: %s. It will fallback to the normal PCRE", pcre_cpatt->patt);
+    }
+#else
+    if (study == NULL) {
+        pcre_cpatt->edata = pcre_study(pcre_cpatt->cpatt, 0, errptr);
+        if(*errptr != NULL)  {
+            ib_util_log_error(4,"PCRE study failed : %s", *errptr);
+        }
+    }
+    else if (studylen > 0) {
+        pcre_cpatt->edata = (pcre_extra *)ib_mpool_calloc(pool, 1,
+                                                          sizeof(pcre_extra));
+        if (pcre_cpatt->edata == NULL) {
+            IB_FTRACE_RET_STATUS(IB_EALLOC);
+        }
+        pcre_cpatt->edata->flags = PCRE_EXTRA_STUDY_DATA;
+        pcre_cpatt->edata->study_data = (void *)study;
+    }
+#endif /*PCRE_HAVE_SLJIT*/
+
+    /* Extra data is needed for the limits even if not studied. */
+    if (pcre_cpatt->edata == NULL) {
+        pcre_cpatt->edata = (pcre_extra *)ib_mpool_calloc(pool, 1,
+                                                          sizeof(pcre_extra));
+        if (pcre_cpatt->edata == NULL) {
+            IB_FTRACE_RET_STATUS(IB_EALLOC);
+        }
+    }
+
+#ifdef PCRE_HAVE_SLJIT
+    pcre_assign_jit_stack(pcre_cpatt->edata, modpcre_jit_stack, NULL);
+#endif /*PCRE_HAVE_SLJIT*/
+
+    *ppcre_cpatt = pcre_cpatt;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
 static ib_status_t modpcre_compile(ib_provider_t *mpr,
                                    ib_mpool_t *pool,
                                    void *pcpatt,
@@ -86,6 +426,17 @@ static ib_status_t modpcre_compile(ib_provider_t *mpr,
     IB_FTRACE_INIT(modpcre_compile);
     pcre *cpatt;
     modpcre_cpatt_t *pcre_cpatt;
+    const char *err = NULL;
+    int erroff = 0;
+    ib_status_t rc;
+
+    /* PCRE needs somewhere to write errors, which callers may not. */
+    if (errptr == NULL) {
+        errptr = &err;
+    }
+    if (erroffset == NULL) {
+        erroffset = &erroff;
+    }
 
     cpatt = pcre_compile(patt,
                          PCRE_DOTALL | PCRE_DOLLAR_ENDONLY,
@@ -97,30 +448,12 @@ static ib_status_t modpcre_compile(ib_provider_t *mpr,
         IB_FTRACE_RET_STATUS(IB_EINVAL);
     }
 
-    pcre_cpatt = (modpcre_cpatt_t *)ib_mpool_alloc(mpr->mp, sizeof(*pcre_cpatt));
-    if (pcre_cpatt == NULL) {
+    rc = modpcre_cpatt_create(pool, cpatt, patt, NULL, 0, errptr,
+                              &pcre_cpatt);
+    if (rc != IB_OK) {
         *(void **)pcpatt = NULL;
-        IB_FTRACE_RET_STATUS(IB_EALLOC);
-    }
-
-    pcre_cpatt->patt = patt; /// @todo Copy
-    pcre_cpatt->cpatt = cpatt;
-
-#ifdef PCRE_HAVE_SLJIT
-    pcre_cpatt->edata = pcre_study(pcre_cpatt->cpatt, PCRE_STUDY_JIT_COMPILE, errptr);
-    if(*errptr != NULL)  {
-        ib_util_log_error(4,"PCRE-SLJIT study failed : %s", *errptr);
-        IB_FTRACE_RET_STATUS(IB_EINVAL);
-    }
-    if (!(pcre_cpatt->edata->flags & PCRE_EXTRA_EXECUTABLE_FUNC)) {
-        ib_util_log_error(4,"PCRE-SLJIT compiler does not support: %s. It will fallback to the normal PCRE", pcre_cpatt->patt);
-    }
-#else
-    pcre_cpatt->edata = pcre_study(pcre_cpatt->cpatt, 0, errptr);
-    if(*errptr != NULL)  {
-        ib_util_log_error(4,"PCRE study failed : %s", *errptr);
+        IB_FTRACE_RET_STATUS(rc);
     }
-#endif /*PCRE_HAVE_SLJIT*/
 
     *(void **)pcpatt = (void *)pcre_cpatt;
 
@@ -135,36 +468,517 @@ static ib_status_t modpcre_match_compiled(ib_provider_t *mpr,
 {
     IB_FTRACE_INIT(modpcre_match_compiled);
     modpcre_cpatt_t *pcre_cpatt = (modpcre_cpatt_t *)cpatt;
-    int ovector[30];
+    const int *ovector;
     int ec;
 
-    ec = pcre_exec(pcre_cpatt->cpatt, pcre_cpatt->edata,
-                   (const char *)data, dlen,
-                   0, 0, ovector, 30);
-    if (ec >= 0) {
-        IB_FTRACE_RET_STATUS(IB_OK);
-    }
-    else if (ec == PCRE_ERROR_NOMATCH) {
-        IB_FTRACE_RET_STATUS(IB_ENOENT);
-    }
+    ec = modpcre_exec(pcre_cpatt, data, dlen, 0, &ovector);
 
-    IB_FTRACE_RET_STATUS(IB_EINVAL);
+    IB_FTRACE_RET_STATUS(modpcre_status(mpr->ib, pcre_cpatt, ec));
 }
 
-static ib_status_t modpcre_add_pattern(ib_provider_inst_t *pi,
-                                       void *cpatt)
+static ib_status_t modpcre_add_pattern(ib_provider_inst_t *mpi,
+                                       const char *patt,
+                                       ib_num_t id,
+                                       const char **errptr,
+                                       int *erroffset)
 {
-    IB_FTRACE_INIT(modpcre_add);
-    IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+    IB_FTRACE_INIT(modpcre_add_pattern);
+    ib_list_t *patts = (ib_list_t *)mpi->data;
+    modpcre_cpatt_t *pcre_cpatt;
+    ib_status_t rc;
+
+    rc = modpcre_compile(mpi->pr, mpi->mp, &pcre_cpatt, patt,
+                         errptr, erroffset);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    pcre_cpatt->id = id;
+
+    rc = ib_list_push(patts, pcre_cpatt);
+    IB_FTRACE_RET_STATUS(rc);
 }
 
+/**
+ * @internal
+ * Match each instance pattern in turn.
+ *
+ * Unlike a multi-pattern matcher, this costs one pcre_exec() per
+ * pattern, so large keyword lists are better served by another
+ * matcher provider.
+ */
 static ib_status_t modpcre_match(ib_provider_inst_t *mpi,
                                  ib_flags_t flags,
                                  const uint8_t *data,
-                                 size_t dlen)
+                                 size_t dlen,
+                                 ib_matcher_callback_fn_t fn,
+                                 void *cbdata)
 {
     IB_FTRACE_INIT(modpcre_match);
-    IB_FTRACE_RET_STATUS(IB_ENOTIMPL);
+    ib_list_t *patts = (ib_list_t *)mpi->data;
+    ib_list_node_t *node;
+    int matched = 0;
+    int limited = 0;
+    ib_status_t rc;
+
+    IB_LIST_LOOP(patts, node) {
+        modpcre_cpatt_t *pcre_cpatt = (modpcre_cpatt_t *)ib_list_node_data(node);
+        const int *ovector;
+        int ec;
+
+        ec = modpcre_exec(pcre_cpatt, data, dlen, 0, &ovector);
+        rc = modpcre_status(mpi->pr->ib, pcre_cpatt, ec);
+        if (rc == IB_ENOENT) {
+            continue;
+        }
+        else if (rc == IB_ELIMIT) {
+            /* Do not let one pattern prevent matching the others. */
+            limited = 1;
+            continue;
+        }
+        else if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+
+        if (fn == NULL) {
+            IB_FTRACE_RET_STATUS(IB_OK);
+        }
+        rc = fn(cbdata, pcre_cpatt->id, (size_t)ovector[1]);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+        matched = 1;
+    }
+
+    if (matched) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    IB_FTRACE_RET_STATUS(limited ? IB_ELIMIT : IB_ENOENT);
+}
+
+/**
+ * @internal
+ * Initialize a matcher instance, which holds a list of patterns.
+ */
+static ib_status_t modpcre_inst_init(ib_provider_inst_t *mpi,
+                                     void *data)
+{
+    IB_FTRACE_INIT(modpcre_inst_init);
+    ib_list_t *patts;
+    ib_status_t rc;
+
+    rc = ib_list_create(&patts, mpi->mp);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    mpi->data = patts;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Create the stream state for all instance patterns.
+ */
+static ib_status_t modpcre_stream_create(ib_provider_inst_t *mpi,
+                                         ib_mpool_t *pool,
+                                         void *pstate)
+{
+    IB_FTRACE_INIT(modpcre_stream_create);
+    ib_list_t *patts = (ib_list_t *)mpi->data;
+    ib_list_node_t *node;
+    modpcre_stream_t *st;
+    size_t i = 0;
+
+    st = (modpcre_stream_t *)ib_mpool_calloc(pool, 1, sizeof(*st));
+    if (st == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    st->mp = pool;
+    st->npatt = ib_list_elements(patts);
+    st->spatt = (modpcre_spatt_t *)ib_mpool_calloc(pool, st->npatt,
+                                                   sizeof(*st->spatt));
+    if ((st->spatt == NULL) && (st->npatt > 0)) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    IB_LIST_LOOP(patts, node) {
+        st->spatt[i++].cpatt = (modpcre_cpatt_t *)ib_list_node_data(node);
+    }
+
+    *(void **)pstate = st;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Keep data for matching with the next chunk.
+ *
+ * The kept data may already be at the start of the buffer, in which
+ * case the data is appended to it.
+ */
+static ib_status_t modpcre_stream_keep(modpcre_stream_t *st,
+                                       modpcre_spatt_t *sp,
+                                       const uint8_t *data,
+                                       size_t dlen)
+{
+    if (sp->blen + dlen > sp->bsize) {
+        size_t bsize = (sp->bsize * 2 > sp->blen + dlen)
+            ? sp->bsize * 2 : sp->blen + dlen;
+        uint8_t *buf = (uint8_t *)ib_mpool_alloc(st->mp, bsize);
+
+        if (buf == NULL) {
+            return IB_EALLOC;
+        }
+        if (sp->blen > 0) {
+            memcpy(buf, sp->buf, sp->blen);
+        }
+        sp->buf = buf;
+        sp->bsize = bsize;
+    }
+
+    memmove(sp->buf + sp->blen, data, dlen);
+    sp->blen += dlen;
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Match each instance pattern against the next chunk of a stream.
+ *
+ * Partial matching is used to find where a chunk ends part way
+ * through a match, and only that part of the data is kept. Each
+ * pattern is reported at most once per stream. Partial matches longer
+ * than pcre.partial_max are dropped.
+ *
+ * Hard partial matching is used, so a match which could still depend
+ * on the next chunk (such as "foo$" or "select\b" at the end of the
+ * chunk) is kept rather than reported. Such matches are reported by
+ * the next chunk, or by modpcre_stream_finish().
+ *
+ * @note Lookbehind assertions do not see data before kept data.
+ */
+static ib_status_t modpcre_stream_feed(ib_provider_inst_t *mpi,
+                                       void *state,
+                                       ib_flags_t flags,
+                                       const uint8_t *data,
+                                       size_t dlen,
+                                       ib_matcher_callback_fn_t fn,
+                                       void *cbdata)
+{
+    IB_FTRACE_INIT(modpcre_stream_feed);
+    modpcre_stream_t *st = (modpcre_stream_t *)state;
+    int matched = 0;
+    int limited = 0;
+    size_t i;
+    ib_status_t rc;
+
+    for (i = 0; i < st->npatt; i++) {
+        modpcre_spatt_t *sp = &st->spatt[i];
+        const int *ovector;
+        const uint8_t *subj;
+        size_t slen;
+        size_t soff;
+        int ec;
+
+        if (sp->done) {
+            continue;
+        }
+
+        /* Match the kept data with this chunk appended. */
+        if (sp->blen > 0) {
+            rc = modpcre_stream_keep(st, sp, data, dlen);
+            if (rc != IB_OK) {
+                IB_FTRACE_RET_STATUS(rc);
+            }
+            subj = sp->buf;
+            slen = sp->blen;
+            soff = sp->boff;
+        }
+        else {
+            subj = data;
+            slen = dlen;
+            soff = st->offset;
+        }
+
+        ec = modpcre_exec(sp->cpatt, subj, slen,
+                          PCRE_PARTIAL_HARD | ((soff > 0) ? PCRE_NOTBOL : 0),
+                          &ovector);
+        if (ec == PCRE_ERROR_PARTIAL) {
+            size_t start = (size_t)ovector[0];
+            size_t keep = slen - start;
+
+            if (keep > (size_t)modpcre_global_cfg.partial_max) {
+                sp->blen = 0;
+                continue;
+            }
+            if (subj == sp->buf) {
+                memmove(sp->buf, sp->buf + start, keep);
+                sp->blen = keep;
+            }
+            else {
+                rc = modpcre_stream_keep(st, sp, subj + start, keep);
+                if (rc != IB_OK) {
+                    IB_FTRACE_RET_STATUS(rc);
+                }
+            }
+            sp->boff = soff + start;
+            continue;
+        }
+
+        sp->blen = 0;
+        rc = modpcre_status(mpi->pr->ib, sp->cpatt, ec);
+        if (rc == IB_ENOENT) {
+            continue;
+        }
+        else if (rc == IB_ELIMIT) {
+            limited = 1;
+            continue;
+        }
+        else if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+
+        /* Without a callback, the other patterns still need to see
+         * the chunk to keep their state. */
+        sp->done = 1;
+        matched = 1;
+        if (fn == NULL) {
+            continue;
+        }
+        rc = fn(cbdata, sp->cpatt->id, soff + (size_t)ovector[1]);
+        if (rc != IB_OK) {
+            st->offset += dlen;
+            IB_FTRACE_RET_STATUS(rc);
+        }
+    }
+
+    st->offset += dlen;
+
+    if (matched) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    IB_FTRACE_RET_STATUS(limited ? IB_ELIMIT : IB_ENOENT);
+}
+
+/**
+ * @internal
+ * Finish a stream by matching any kept data as the end of the subject.
+ */
+static ib_status_t modpcre_stream_finish(ib_provider_inst_t *mpi,
+                                         void *state,
+                                         ib_matcher_callback_fn_t fn,
+                                         void *cbdata)
+{
+    IB_FTRACE_INIT(modpcre_stream_finish);
+    modpcre_stream_t *st = (modpcre_stream_t *)state;
+    int matched = 0;
+    int limited = 0;
+    size_t i;
+    ib_status_t rc;
+
+    for (i = 0; i < st->npatt; i++) {
+        modpcre_spatt_t *sp = &st->spatt[i];
+        const int *ovector;
+        int ec;
+
+        if (sp->done || (sp->blen == 0)) {
+            continue;
+        }
+
+        ec = modpcre_exec(sp->cpatt, sp->buf, sp->blen,
+                          (sp->boff > 0) ? PCRE_NOTBOL : 0,
+                          &ovector);
+        sp->blen = 0;
+        rc = modpcre_status(mpi->pr->ib, sp->cpatt, ec);
+        if (rc == IB_ENOENT) {
+            continue;
+        }
+        else if (rc == IB_ELIMIT) {
+            limited = 1;
+            continue;
+        }
+        else if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+
+        sp->done = 1;
+        if (fn == NULL) {
+            IB_FTRACE_RET_STATUS(IB_OK);
+        }
+        rc = fn(cbdata, sp->cpatt->id, sp->boff + (size_t)ovector[1]);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+        matched = 1;
+    }
+
+    if (matched) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    IB_FTRACE_RET_STATUS(limited ? IB_ELIMIT : IB_ENOENT);
+}
+
+/**
+ * @internal
+ * Serialize a compiled pattern.
+ *
+ * The buffer is a header holding the PCRE version, compiled code,
+ * study data and pattern text lengths (host byte order), followed by
+ * the PCRE version string, the compiled code, the study data (if the
+ * pattern was studied) and the pattern text. Only the same PCRE
+ * version on the same architecture can load it. JIT code is not
+ * included.
+ */
+static ib_status_t modpcre_serialize(ib_provider_t *mpr,
+                                     void *cpatt,
+                                     ib_mpool_t *pool,
+                                     const uint8_t **pbuf,
+                                     size_t *plen)
+{
+    IB_FTRACE_INIT(modpcre_serialize);
+    modpcre_cpatt_t *pcre_cpatt = (modpcre_cpatt_t *)cpatt;
+    const char *version = pcre_version();
+    size_t size = 0;
+    size_t studysize = 0;
+    uint32_t hdr[4];
+    uint8_t *buf;
+    uint8_t *p;
+    int ec;
+
+    ec = pcre_fullinfo(pcre_cpatt->cpatt, NULL, PCRE_INFO_SIZE, &size);
+    if (ec != 0) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    /* The size is zero if studying found nothing useful. */
+    if (pcre_cpatt->edata->flags & PCRE_EXTRA_STUDY_DATA) {
+        ec = pcre_fullinfo(pcre_cpatt->cpatt, pcre_cpatt->edata,
+                           PCRE_INFO_STUDYSIZE, &studysize);
+        if (ec != 0) {
+            IB_FTRACE_RET_STATUS(IB_EINVAL);
+        }
+    }
+
+    hdr[0] = (uint32_t)strlen(version);
+    hdr[1] = (uint32_t)size;
+    hdr[2] = (uint32_t)studysize;
+    hdr[3] = (uint32_t)strlen(pcre_cpatt->patt);
+
+    buf = (uint8_t *)ib_mpool_alloc(pool, MODPCRE_SER_HDR + hdr[0] + hdr[1]
+                                          + hdr[2] + hdr[3]);
+    if (buf == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    p = buf;
+    memcpy(p, hdr, MODPCRE_SER_HDR);
+    p += MODPCRE_SER_HDR;
+    memcpy(p, version, hdr[0]);
+    p += hdr[0];
+    memcpy(p, pcre_cpatt->cpatt, hdr[1]);
+    p += hdr[1];
+    if (hdr[2] > 0) {
+        memcpy(p, pcre_cpatt->edata->study_data, hdr[2]);
+        p += hdr[2];
+    }
+    memcpy(p, pcre_cpatt->patt, hdr[3]);
+    p += hdr[3];
+
+    *pbuf = buf;
+    *plen = (size_t)(p - buf);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Load a compiled pattern written by modpcre_serialize().
+ *
+ * The saved study data is used without JIT support. With JIT support
+ * the pattern is studied again, as JIT code is not serialized (which
+ * also redoes the study, so little startup time is saved).
+ */
+static ib_status_t modpcre_deserialize(ib_provider_t *mpr,
+                                       ib_mpool_t *pool,
+                                       void *pcpatt,
+                                       const uint8_t *buf,
+                                       size_t len)
+{
+    IB_FTRACE_INIT(modpcre_deserialize);
+    const char *version = pcre_version();
+    modpcre_cpatt_t *pcre_cpatt;
+    const char *errptr = NULL;
+    size_t size = 0;
+    uint32_t hdr[4];
+    const uint8_t *p;
+    uint8_t *study;
+    pcre *cpatt;
+    char *patt;
+    ib_status_t rc;
+
+    *(void **)pcpatt = NULL;
+
+    if (len < MODPCRE_SER_HDR) {
+        IB_FTRACE_RET_STATUS(IB_EINCOMPAT);
+    }
+    memcpy(hdr, buf, MODPCRE_SER_HDR);
+    if ((size_t)hdr[0] + hdr[1] + hdr[2] + hdr[3] != len - MODPCRE_SER_HDR) {
+        IB_FTRACE_RET_STATUS(IB_EINCOMPAT);
+    }
+    if ((hdr[0] != strlen(version))
+        || (memcmp(buf + MODPCRE_SER_HDR, version, hdr[0]) != 0))
+    {
+        IB_FTRACE_RET_STATUS(IB_EINCOMPAT);
+    }
+
+    /* The code is allocated as pcre_compile() would (and aligned). */
+    cpatt = (pcre *)(*pcre_malloc)(hdr[1]);
+    if (cpatt == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    p = buf + MODPCRE_SER_HDR + hdr[0];
+    memcpy(cpatt, p, hdr[1]);
+    p += hdr[1];
+
+    /* Checks the magic number (and byte order). */
+    if ((pcre_fullinfo(cpatt, NULL, PCRE_INFO_SIZE, &size) != 0)
+        || (size != hdr[1]))
+    {
+        (*pcre_free)(cpatt);
+        IB_FTRACE_RET_STATUS(IB_EINCOMPAT);
+    }
+
+    /* The study data is copied so that it is aligned. */
+    study = (uint8_t *)ib_mpool_alloc(pool, (hdr[2] > 0) ? hdr[2] : 1);
+    if (study == NULL) {
+        (*pcre_free)(cpatt);
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    memcpy(study, p, hdr[2]);
+    p += hdr[2];
+
+    patt = (char *)ib_mpool_alloc(pool, hdr[3] + 1);
+    if (patt == NULL) {
+        (*pcre_free)(cpatt);
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    memcpy(patt, p, hdr[3]);
+    patt[hdr[3]] = '\0';
+
+    rc = modpcre_cpatt_create(pool, cpatt, patt, study, hdr[2], &errptr,
+                              &pcre_cpatt);
+    if (rc != IB_OK) {
+        (*pcre_free)(cpatt);
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    *(void **)pcpatt = (void *)pcre_cpatt;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
 }
 
 static IB_PROVIDER_IFACE_TYPE(matcher) modpcre_matcher_iface = {
@@ -176,25 +990,96 @@ static IB_PROVIDER_IFACE_TYPE(matcher) modpcre_matcher_iface = {
 
     /* Provider Instance Interface */
     modpcre_add_pattern,
-    modpcre_match
+    modpcre_match,
+
+    /* Provider Instance Stream Interface */
+    modpcre_stream_create,
+    modpcre_stream_feed,
+    modpcre_stream_finish,
+
+    /* Provider Serialization Interface */
+    modpcre_serialize,
+    modpcre_deserialize
 };
 
 
 /* -- Module Routines -- */
 
+/**
+ * @internal
+ * Use the main context configuration for the (engine wide) provider.
+ *
+ * The engine applies the configuration map defaults and any "Set"
+ * directives to the copy of the configuration in each context, not
+ * to the module global configuration.
+ *
+ * @param ib Engine
+ */
+static void modpcre_cfg_sync(ib_engine_t *ib)
+{
+    IB_FTRACE_INIT(modpcre_cfg_sync);
+    modpcre_cfg_t *cfg;
+    ib_status_t rc;
+
+    rc = ib_context_module_config(ib_context_main(ib), &IB_MODULE_SYM,
+                                  (void *)&cfg);
+    if ((rc == IB_OK) && (cfg != NULL)) {
+        modpcre_global_cfg = *cfg;
+    }
+
+    IB_FTRACE_RET_VOID();
+}
+
+/**
+ * @internal
+ * Pick up the main context configuration once it is finished.
+ *
+ * @param ib Engine
+ * @param param Unused
+ * @param cbdata Unused
+ *
+ * @returns Status code
+ */
+static ib_status_t modpcre_cfg_finished(ib_engine_t *ib,
+                                        void *param,
+                                        void *cbdata)
+{
+    IB_FTRACE_INIT(modpcre_cfg_finished);
+    modpcre_cfg_sync(ib);
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
 static ib_status_t modpcre_init(ib_engine_t *ib,
                                 ib_module_t *m)
 {
     IB_FTRACE_INIT(modpcre_init);
     ib_status_t rc;
 
+    /* Match resources are kept per thread and freed on thread exit. */
+    if (pthread_key_create(&modpcre_thread_key, modpcre_thread_free) != 0) {
+        ib_log_error(ib, 1, MODULE_NAME_STR ": Failed to create thread key");
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+
+    rc = ib_stat_register(ib, MODULE_NAME_STR ".limit_exceeded",
+                          &modpcre_stat_limit);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    /* Settings are taken from the main context. */
+    modpcre_cfg_sync(ib);
+    ib_hook_register(ib, cfg_finished_event,
+                     (ib_void_fn_t)modpcre_cfg_finished,
+                     NULL);
+
     /* Register as a matcher provider. */
     rc = ib_provider_register(ib,
                               IB_PROVIDER_TYPE_MATCHER,
                               MODULE_NAME_STR,
                               NULL,
                               &modpcre_matcher_iface,
-                              NULL);
+                              modpcre_inst_init);
     if (rc != IB_OK) {
         ib_log_error(ib, 3,
                      MODULE_NAME_STR ": Error registering pcre matcher provider: "
@@ -206,6 +1091,23 @@ static ib_status_t modpcre_init(ib_engine_t *ib,
     IB_FTRACE_RET_STATUS(IB_OK);
 }
 
+static ib_status_t modpcre_fini(ib_engine_t *ib,
+                                ib_module_t *m)
+{
+    IB_FTRACE_INIT(modpcre_fini);
+    modpcre_thread_t *t;
+
+    /* Only other threads' resources are freed when they exit. */
+    t = (modpcre_thread_t *)pthread_getspecific(modpcre_thread_key);
+    if (t != NULL) {
+        pthread_setspecific(modpcre_thread_key, NULL);
+        modpcre_thread_free(t);
+    }
+    pthread_key_delete(modpcre_thread_key);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
 static IB_CFGMAP_INIT_STRUCTURE(modpcre_config_map) = {
     IB_CFGMAP_INIT_ENTRY(
         MODULE_NAME_STR ".study",
@@ -228,6 +1130,20 @@ static IB_CFGMAP_INIT_STRUCTURE(modpcre_config_map) = {
         match_limit_recursion,
         5000
     ),
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".partial_max",
+        IB_FTYPE_NUM,
+        &modpcre_global_cfg,
+        partial_max,
+        8192
+    ),
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".jit_stack_max",
+        IB_FTYPE_NUM,
+        &modpcre_global_cfg,
+        jit_stack_max,
+        512 * 1024
+    ),
     IB_CFGMAP_INIT_LAST
 };
 
@@ -244,7 +1160,7 @@ IB_MODULE_INIT(
     modpcre_config_map,                   /**< Configuration field map */
     NULL,                                 /**< Config directive map */
     modpcre_init,                         /**< Initialize function */
-    NULL,                                 /**< Finish function */
+    modpcre_fini,                         /**< Finish function */
     NULL,                                 /**< Context init function */
 );
 
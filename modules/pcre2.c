@@ -0,0 +1,1108 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee - PCRE2 Module
+ *
+ * This module adds a PCRE2 based matcher named "pcre2", which can be
+ * used in place of the "pcre" matcher with:
+ *
+ * @code
+ * Set matcher "pcre2"
+ * @endcode
+ *
+ * Patterns are JIT compiled where supported, and the match data,
+ * match context (limits) and JIT stack are created once per thread
+ * and reused for every match. Compiled patterns can be serialized.
+ *
+ * @author Brian Rectanus <brectanus@qualys.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <pthread.h>
+
+#include <ironbee/engine.h>
+#include <ironbee/util.h>
+#include <ironbee/module.h>
+#include <ironbee/provider.h>
+
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+
+
+/* Define the module name as well as a string version of it. */
+#define MODULE_NAME        pcre2
+#define MODULE_NAME_STR    IB_XSTRINGIFY(MODULE_NAME)
+
+typedef struct modpcre2_cfg_t modpcre2_cfg_t;
+typedef struct modpcre2_cpatt_t modpcre2_cpatt_t;
+typedef struct modpcre2_spatt_t modpcre2_spatt_t;
+typedef struct modpcre2_stream_t modpcre2_stream_t;
+typedef struct modpcre2_thread_t modpcre2_thread_t;
+
+/** Initial size of a per-thread JIT stack. */
+#define MODPCRE2_JIT_STACK_MIN  (32 * 1024)
+
+/** Serialized pattern header size (encoded and pattern lengths). */
+#define MODPCRE2_SER_HDR        (2 * sizeof(uint32_t))
+
+/* Define the public module symbol. */
+IB_MODULE_DECLARE();
+
+/**
+ * @internal
+ * Module Configuration Structure.
+ */
+struct modpcre2_cfg_t {
+    ib_num_t       jit;                   /**< JIT compile patterns */
+    ib_num_t       match_limit;           /**< Match limit */
+    ib_num_t       depth_limit;           /**< Match depth limit */
+    ib_num_t       partial_max;           /**< Max partial match kept in streams */
+    ib_num_t       jit_stack_max;         /**< Max per-thread JIT stack size */
+};
+
+/**
+ * @internal
+ * Internal representation of PCRE2 compiled patterns.
+ */
+struct modpcre2_cpatt_t {
+    pcre2_code    *code;                  /**< Compiled pattern */
+    const char    *patt;                  /**< Regex pattern text */
+    ib_num_t       id;                    /**< Pattern ID (instances only) */
+    uint32_t       ovecpairs;             /**< Ovector pairs for captures */
+    int            jit;                   /**< Pattern is JIT compiled */
+};
+
+/**
+ * @internal
+ * Per pattern stream state.
+ *
+ * Where a chunk ends in a partial match, the data from the start of
+ * the partial match is kept so that it can be matched again with the
+ * next chunk.
+ */
+struct modpcre2_spatt_t {
+    modpcre2_cpatt_t *cpatt;              /**< Compiled pattern */
+    uint8_t          *buf;                /**< Kept data (partial match) */
+    size_t            blen;               /**< Kept data length */
+    size_t            bsize;              /**< Kept data buffer size */
+    size_t            boff;               /**< Stream offset of kept data */
+    int               done;               /**< Pattern has matched */
+};
+
+/**
+ * @internal
+ * Stream state for a matcher instance.
+ */
+struct modpcre2_stream_t {
+    ib_mpool_t       *mp;                 /**< Memory pool */
+    modpcre2_spatt_t *spatt;              /**< Pattern states */
+    size_t            npatt;              /**< Number of patterns */
+    size_t            offset;             /**< Stream offset of next chunk */
+};
+
+/**
+ * @internal
+ * Per-thread match resources, reused for every match on the thread.
+ */
+struct modpcre2_thread_t {
+    pcre2_match_data    *md;              /**< Match data (ovector) */
+    uint32_t             ovecpairs;       /**< Match data ovector pairs */
+    pcre2_match_context *mctx;            /**< Match context (limits) */
+    pcre2_jit_stack     *jit_stack;       /**< JIT stack */
+};
+
+/* Instantiate a module global configuration. */
+static modpcre2_cfg_t modpcre2_global_cfg;
+
+/** Key for the per-thread match resources. */
+static pthread_key_t modpcre2_thread_key;
+
+/** Statistics counter of matches which exceeded a limit. */
+static ib_stat_id_t modpcre2_stat_limit;
+
+
+/* -- PCRE2 Execution -- */
+
+/**
+ * @internal
+ * Free the match resources of an exiting thread.
+ */
+static void modpcre2_thread_free(void *data)
+{
+    modpcre2_thread_t *t = (modpcre2_thread_t *)data;
+
+    if (t->md != NULL) {
+        pcre2_match_data_free(t->md);
+    }
+    if (t->mctx != NULL) {
+        pcre2_match_context_free(t->mctx);
+    }
+    if (t->jit_stack != NULL) {
+        pcre2_jit_stack_free(t->jit_stack);
+    }
+    free(t);
+}
+
+/**
+ * @internal
+ * Create the match context of a thread.
+ *
+ * The limits are those configured when the thread first matches.
+ *
+ * @param t Thread match resources
+ *
+ * @returns Status code
+ */
+static ib_status_t modpcre2_thread_mctx(modpcre2_thread_t *t)
+{
+    PCRE2_SIZE max = (PCRE2_SIZE)modpcre2_global_cfg.jit_stack_max;
+
+    t->mctx = pcre2_match_context_create(NULL);
+    if (t->mctx == NULL) {
+        return IB_EALLOC;
+    }
+
+    if (modpcre2_global_cfg.match_limit > 0) {
+        pcre2_set_match_limit(t->mctx,
+                              (uint32_t)modpcre2_global_cfg.match_limit);
+    }
+    if (modpcre2_global_cfg.depth_limit > 0) {
+        pcre2_set_depth_limit(t->mctx,
+                              (uint32_t)modpcre2_global_cfg.depth_limit);
+    }
+
+    /* Without a JIT stack, PCRE2 uses a small one on the machine stack. */
+    if (modpcre2_global_cfg.jit) {
+        if (max < MODPCRE2_JIT_STACK_MIN) {
+            max = MODPCRE2_JIT_STACK_MIN;
+        }
+        t->jit_stack = pcre2_jit_stack_create(MODPCRE2_JIT_STACK_MIN, max,
+                                              NULL);
+        if (t->jit_stack != NULL) {
+            pcre2_jit_stack_assign(t->mctx, NULL, t->jit_stack);
+        }
+    }
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Get the match resources of the calling thread.
+ *
+ * @param ovecpairs Minimum ovector pairs
+ *
+ * @returns Thread match resources, or NULL on allocation failure
+ */
+static modpcre2_thread_t *modpcre2_thread_get(uint32_t ovecpairs)
+{
+    modpcre2_thread_t *t;
+
+    t = (modpcre2_thread_t *)pthread_getspecific(modpcre2_thread_key);
+    if (t == NULL) {
+        t = (modpcre2_thread_t *)calloc(1, sizeof(*t));
+        if (t == NULL) {
+            return NULL;
+        }
+        if (modpcre2_thread_mctx(t) != IB_OK) {
+            modpcre2_thread_free(t);
+            return NULL;
+        }
+        if (pthread_setspecific(modpcre2_thread_key, t) != 0) {
+            modpcre2_thread_free(t);
+            return NULL;
+        }
+    }
+
+    if ((t->md == NULL) || (t->ovecpairs < ovecpairs)) {
+        pcre2_match_data *md = pcre2_match_data_create(ovecpairs, NULL);
+
+        if (md == NULL) {
+            return NULL;
+        }
+        if (t->md != NULL) {
+            pcre2_match_data_free(t->md);
+        }
+        t->md = md;
+        t->ovecpairs = ovecpairs;
+    }
+
+    return t;
+}
+
+/**
+ * @internal
+ * Execute a compiled pattern.
+ *
+ * JIT compiled patterns skip the checks done by pcre2_match(). The
+ * ovector is the calling thread's and is only valid until the next
+ * match on the thread.
+ *
+ * @param pcre2_cpatt Compiled pattern
+ * @param subj Subject
+ * @param slen Subject length
+ * @param options PCRE2 match options
+ * @param povector Address which the ovector is written
+ *
+ * @returns pcre2_match() result
+ */
+static int modpcre2_exec(const modpcre2_cpatt_t *pcre2_cpatt,
+                         const uint8_t *subj,
+                         size_t slen,
+                         uint32_t options,
+                         const PCRE2_SIZE **povector)
+{
+    modpcre2_thread_t *t = modpcre2_thread_get(pcre2_cpatt->ovecpairs);
+
+    if (t == NULL) {
+        return PCRE2_ERROR_NOMEMORY;
+    }
+    *povector = pcre2_get_ovector_pointer(t->md);
+
+    if (pcre2_cpatt->jit) {
+        return pcre2_jit_match(pcre2_cpatt->code, subj, slen,
+                               0, options, t->md, t->mctx);
+    }
+
+    return pcre2_match(pcre2_cpatt->code, subj, slen,
+                       0, options, t->md, t->mctx);
+}
+
+/**
+ * @internal
+ * Convert a pcre2_match() result to a status code.
+ *
+ * @param ib Engine
+ * @param pcre2_cpatt Compiled pattern
+ * @param ec pcre2_match() result
+ *
+ * @returns IB_OK on a match, IB_ENOENT if no match, IB_ELIMIT if
+ *          a match, depth, heap or stack limit was exceeded, else an
+ *          error status
+ */
+static ib_status_t modpcre2_status(ib_engine_t *ib,
+                                   const modpcre2_cpatt_t *pcre2_cpatt,
+                                   int ec)
+{
+    if (ec >= 0) {
+        return IB_OK;
+    }
+
+    switch (ec) {
+        case PCRE2_ERROR_NOMATCH:
+            return IB_ENOENT;
+        case PCRE2_ERROR_MATCHLIMIT:
+        case PCRE2_ERROR_DEPTHLIMIT:
+#ifdef PCRE2_ERROR_HEAPLIMIT
+        case PCRE2_ERROR_HEAPLIMIT:
+#endif
+        case PCRE2_ERROR_JIT_STACKLIMIT:
+            ib_stat_inc(ib, modpcre2_stat_limit);
+            ib_log_debug(ib, 4, "PCRE2 limit exceeded (%d) for \"%s\"",
+                         ec, pcre2_cpatt->patt);
+            return IB_ELIMIT;
+        case PCRE2_ERROR_NOMEMORY:
+            return IB_EALLOC;
+        default:
+            break;
+    }
+
+    ib_log_error(ib, 3, "PCRE2 match error (%d) for \"%s\"",
+                 ec, pcre2_cpatt->patt);
+
+    return IB_EINVAL;
+}
+
+/**
+ * @internal
+ * Free a compiled pattern when its memory pool is destroyed.
+ */
+static ib_status_t modpcre2_cpatt_free(void *data)
+{
+    modpcre2_cpatt_t *pcre2_cpatt = (modpcre2_cpatt_t *)data;
+
+    pcre2_code_free(pcre2_cpatt->code);
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Wrap PCRE2 code as a compiled pattern.
+ *
+ * The code is JIT compiled (if enabled) and freed with the pool.
+ *
+ * @param pool Memory pool
+ * @param code PCRE2 code (freed on failure)
+ * @param patt Regex pattern text
+ * @param ppcre2_cpatt Address which the compiled pattern is written
+ *
+ * @returns Status code
+ */
+static ib_status_t modpcre2_cpatt_create(ib_mpool_t *pool,
+                                         pcre2_code *code,
+                                         const char *patt,
+                                         modpcre2_cpatt_t **ppcre2_cpatt)
+{
+    modpcre2_cpatt_t *pcre2_cpatt;
+    uint32_t ncapture = 0;
+    int ec;
+
+    pcre2_cpatt = (modpcre2_cpatt_t *)ib_mpool_calloc(pool, 1,
+                                                      sizeof(*pcre2_cpatt));
+    if (pcre2_cpatt == NULL) {
+        pcre2_code_free(code);
+        return IB_EALLOC;
+    }
+    pcre2_cpatt->code = code;
+    pcre2_cpatt->patt = patt;
+    ib_mpool_cleanup_register(pool, pcre2_cpatt, modpcre2_cpatt_free);
+
+    /* Size the match data so that it never needs to grow while matching. */
+    pcre2_pattern_info(code, PCRE2_INFO_CAPTURECOUNT, &ncapture);
+    pcre2_cpatt->ovecpairs = ncapture + 1;
+
+    /* Patterns the JIT cannot handle fall back to the interpreter. */
+    if (modpcre2_global_cfg.jit) {
+        ec = pcre2_jit_compile(code,
+                               PCRE2_JIT_COMPLETE | PCRE2_JIT_PARTIAL_HARD);
+        if (ec == 0) {
+            pcre2_cpatt->jit = 1;
+        }
+        else {
+            ib_util_log_error(4, "PCRE2 JIT compile failed (%d) for \"%s\", "
+                              "using the interpreter", ec, patt);
+        }
+    }
+
+    *ppcre2_cpatt = pcre2_cpatt;
+
+    return IB_OK;
+}
+
+
+/* -- Matcher Interface -- */
+
+static ib_status_t modpcre2_compile(ib_provider_t *mpr,
+                                    ib_mpool_t *pool,
+                                    void *pcpatt,
+                                    const char *patt,
+                                    const char **errptr,
+                                    int *erroffset)
+{
+    IB_FTRACE_INIT(modpcre2_compile);
+    modpcre2_cpatt_t *pcre2_cpatt;
+    pcre2_code *code;
+    PCRE2_SIZE erroff;
+    int errcode;
+    ib_status_t rc;
+
+    *(void **)pcpatt = NULL;
+
+    code = pcre2_compile((PCRE2_SPTR)patt, PCRE2_ZERO_TERMINATED,
+                         PCRE2_DOTALL | PCRE2_DOLLAR_ENDONLY,
+                         &errcode, &erroff, NULL);
+    if (code == NULL) {
+        PCRE2_UCHAR msg[256];
+
+        pcre2_get_error_message(errcode, msg, sizeof(msg));
+        if (errptr != NULL) {
+            *errptr = (const char *)ib_mpool_memdup(pool, msg,
+                                                    strlen((char *)msg) + 1);
+        }
+        if (erroffset != NULL) {
+            *erroffset = (int)erroff;
+        }
+        ib_util_log_error(4, "PCRE2 compile error for \"%s\": %s at offset %d",
+                          patt, (const char *)msg, (int)erroff);
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    rc = modpcre2_cpatt_create(pool, code,
+                               (const char *)ib_mpool_memdup(pool, patt,
+                                                             strlen(patt) + 1),
+                               &pcre2_cpatt);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    *(void **)pcpatt = (void *)pcre2_cpatt;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+static ib_status_t modpcre2_match_compiled(ib_provider_t *mpr,
+                                           void *cpatt,
+                                           ib_flags_t flags,
+                                           const uint8_t *data,
+                                           size_t dlen)
+{
+    IB_FTRACE_INIT(modpcre2_match_compiled);
+    modpcre2_cpatt_t *pcre2_cpatt = (modpcre2_cpatt_t *)cpatt;
+    const PCRE2_SIZE *ovector;
+    int ec;
+
+    ec = modpcre2_exec(pcre2_cpatt, data, dlen, 0, &ovector);
+
+    IB_FTRACE_RET_STATUS(modpcre2_status(mpr->ib, pcre2_cpatt, ec));
+}
+
+static ib_status_t modpcre2_add_pattern(ib_provider_inst_t *mpi,
+                                        const char *patt,
+                                        ib_num_t id,
+                                        const char **errptr,
+                                        int *erroffset)
+{
+    IB_FTRACE_INIT(modpcre2_add_pattern);
+    ib_list_t *patts = (ib_list_t *)mpi->data;
+    modpcre2_cpatt_t *pcre2_cpatt;
+    ib_status_t rc;
+
+    rc = modpcre2_compile(mpi->pr, mpi->mp, &pcre2_cpatt, patt,
+                          errptr, erroffset);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    pcre2_cpatt->id = id;
+
+    rc = ib_list_push(patts, pcre2_cpatt);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+/**
+ * @internal
+ * Match each instance pattern in turn.
+ */
+static ib_status_t modpcre2_match(ib_provider_inst_t *mpi,
+                                  ib_flags_t flags,
+                                  const uint8_t *data,
+                                  size_t dlen,
+                                  ib_matcher_callback_fn_t fn,
+                                  void *cbdata)
+{
+    IB_FTRACE_INIT(modpcre2_match);
+    ib_list_t *patts = (ib_list_t *)mpi->data;
+    ib_list_node_t *node;
+    int matched = 0;
+    int limited = 0;
+    ib_status_t rc;
+
+    IB_LIST_LOOP(patts, node) {
+        modpcre2_cpatt_t *pcre2_cpatt =
+            (modpcre2_cpatt_t *)ib_list_node_data(node);
+        const PCRE2_SIZE *ovector;
+        int ec;
+
+        ec = modpcre2_exec(pcre2_cpatt, data, dlen, 0, &ovector);
+        rc = modpcre2_status(mpi->pr->ib, pcre2_cpatt, ec);
+        if (rc == IB_ENOENT) {
+            continue;
+        }
+        else if (rc == IB_ELIMIT) {
+            /* Do not let one pattern prevent matching the others. */
+            limited = 1;
+            continue;
+        }
+        else if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+
+        if (fn == NULL) {
+            IB_FTRACE_RET_STATUS(IB_OK);
+        }
+        rc = fn(cbdata, pcre2_cpatt->id, (size_t)ovector[1]);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+        matched = 1;
+    }
+
+    if (matched) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    IB_FTRACE_RET_STATUS(limited ? IB_ELIMIT : IB_ENOENT);
+}
+
+/**
+ * @internal
+ * Initialize a matcher instance, which holds a list of patterns.
+ */
+static ib_status_t modpcre2_inst_init(ib_provider_inst_t *mpi,
+                                      void *data)
+{
+    IB_FTRACE_INIT(modpcre2_inst_init);
+    ib_list_t *patts;
+    ib_status_t rc;
+
+    rc = ib_list_create(&patts, mpi->mp);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    mpi->data = patts;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Create the stream state for all instance patterns.
+ */
+static ib_status_t modpcre2_stream_create(ib_provider_inst_t *mpi,
+                                          ib_mpool_t *pool,
+                                          void *pstate)
+{
+    IB_FTRACE_INIT(modpcre2_stream_create);
+    ib_list_t *patts = (ib_list_t *)mpi->data;
+    ib_list_node_t *node;
+    modpcre2_stream_t *st;
+    size_t i = 0;
+
+    st = (modpcre2_stream_t *)ib_mpool_calloc(pool, 1, sizeof(*st));
+    if (st == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    st->mp = pool;
+    st->npatt = ib_list_elements(patts);
+    st->spatt = (modpcre2_spatt_t *)ib_mpool_calloc(pool, st->npatt,
+                                                    sizeof(*st->spatt));
+    if ((st->spatt == NULL) && (st->npatt > 0)) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    IB_LIST_LOOP(patts, node) {
+        st->spatt[i++].cpatt = (modpcre2_cpatt_t *)ib_list_node_data(node);
+    }
+
+    *(void **)pstate = st;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Keep data for matching with the next chunk.
+ *
+ * The kept data may already be at the start of the buffer, in which
+ * case the data is appended to it.
+ */
+static ib_status_t modpcre2_stream_keep(modpcre2_stream_t *st,
+                                        modpcre2_spatt_t *sp,
+                                        const uint8_t *data,
+                                        size_t dlen)
+{
+    if (sp->blen + dlen > sp->bsize) {
+        size_t bsize = (sp->bsize * 2 > sp->blen + dlen)
+            ? sp->bsize * 2 : sp->blen + dlen;
+        uint8_t *buf = (uint8_t *)ib_mpool_alloc(st->mp, bsize);
+
+        if (buf == NULL) {
+            return IB_EALLOC;
+        }
+        if (sp->blen > 0) {
+            memcpy(buf, sp->buf, sp->blen);
+        }
+        sp->buf = buf;
+        sp->bsize = bsize;
+    }
+
+    memmove(sp->buf + sp->blen, data, dlen);
+    sp->blen += dlen;
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Match each instance pattern against the next chunk of a stream.
+ *
+ * This works as the "pcre" matcher does: hard partial matches are
+ * kept (up to pcre2.partial_max bytes) and each pattern is reported
+ * at most once per stream.
+ *
+ * @note Lookbehind assertions do not see data before kept data.
+ */
+static ib_status_t modpcre2_stream_feed(ib_provider_inst_t *mpi,
+                                        void *state,
+                                        ib_flags_t flags,
+                                        const uint8_t *data,
+                                        size_t dlen,
+                                        ib_matcher_callback_fn_t fn,
+                                        void *cbdata)
+{
+    IB_FTRACE_INIT(modpcre2_stream_feed);
+    modpcre2_stream_t *st = (modpcre2_stream_t *)state;
+    int matched = 0;
+    int limited = 0;
+    size_t i;
+    ib_status_t rc;
+
+    for (i = 0; i < st->npatt; i++) {
+        modpcre2_spatt_t *sp = &st->spatt[i];
+        const PCRE2_SIZE *ovector;
+        const uint8_t *subj;
+        size_t slen;
+        size_t soff;
+        int ec;
+
+        if (sp->done) {
+            continue;
+        }
+
+        /* Match the kept data with this chunk appended. */
+        if (sp->blen > 0) {
+            rc = modpcre2_stream_keep(st, sp, data, dlen);
+            if (rc != IB_OK) {
+                IB_FTRACE_RET_STATUS(rc);
+            }
+            subj = sp->buf;
+            slen = sp->blen;
+            soff = sp->boff;
+        }
+        else {
+            subj = data;
+            slen = dlen;
+            soff = st->offset;
+        }
+
+        ec = modpcre2_exec(sp->cpatt, subj, slen,
+                           PCRE2_PARTIAL_HARD
+                           | ((soff > 0) ? PCRE2_NOTBOL : 0),
+                           &ovector);
+        if (ec == PCRE2_ERROR_PARTIAL) {
+            size_t start = (size_t)ovector[0];
+            size_t keep = slen - start;
+
+            if (keep > (size_t)modpcre2_global_cfg.partial_max) {
+                sp->blen = 0;
+                continue;
+            }
+            if (subj == sp->buf) {
+                memmove(sp->buf, sp->buf + start, keep);
+                sp->blen = keep;
+            }
+            else {
+                rc = modpcre2_stream_keep(st, sp, subj + start, keep);
+                if (rc != IB_OK) {
+                    IB_FTRACE_RET_STATUS(rc);
+                }
+            }
+            sp->boff = soff + start;
+            continue;
+        }
+
+        sp->blen = 0;
+        rc = modpcre2_status(mpi->pr->ib, sp->cpatt, ec);
+        if (rc == IB_ENOENT) {
+            continue;
+        }
+        else if (rc == IB_ELIMIT) {
+            limited = 1;
+            continue;
+        }
+        else if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+
+        /* Without a callback, the other patterns still need to see
+         * the chunk to keep their state. */
+        sp->done = 1;
+        matched = 1;
+        if (fn == NULL) {
+            continue;
+        }
+        rc = fn(cbdata, sp->cpatt->id, soff + (size_t)ovector[1]);
+        if (rc != IB_OK) {
+            st->offset += dlen;
+            IB_FTRACE_RET_STATUS(rc);
+        }
+    }
+
+    st->offset += dlen;
+
+    if (matched) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    IB_FTRACE_RET_STATUS(limited ? IB_ELIMIT : IB_ENOENT);
+}
+
+/**
+ * @internal
+ * Finish a stream by matching any kept data as the end of the subject.
+ */
+static ib_status_t modpcre2_stream_finish(ib_provider_inst_t *mpi,
+                                          void *state,
+                                          ib_matcher_callback_fn_t fn,
+                                          void *cbdata)
+{
+    IB_FTRACE_INIT(modpcre2_stream_finish);
+    modpcre2_stream_t *st = (modpcre2_stream_t *)state;
+    int matched = 0;
+    int limited = 0;
+    size_t i;
+    ib_status_t rc;
+
+    for (i = 0; i < st->npatt; i++) {
+        modpcre2_spatt_t *sp = &st->spatt[i];
+        const PCRE2_SIZE *ovector;
+        int ec;
+
+        if (sp->done || (sp->blen == 0)) {
+            continue;
+        }
+
+        ec = modpcre2_exec(sp->cpatt, sp->buf, sp->blen,
+                           (sp->boff > 0) ? PCRE2_NOTBOL : 0,
+                           &ovector);
+        sp->blen = 0;
+        rc = modpcre2_status(mpi->pr->ib, sp->cpatt, ec);
+        if (rc == IB_ENOENT) {
+            continue;
+        }
+        else if (rc == IB_ELIMIT) {
+            limited = 1;
+            continue;
+        }
+        else if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+
+        sp->done = 1;
+        if (fn == NULL) {
+            IB_FTRACE_RET_STATUS(IB_OK);
+        }
+        rc = fn(cbdata, sp->cpatt->id, sp->boff + (size_t)ovector[1]);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+        matched = 1;
+    }
+
+    if (matched) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    IB_FTRACE_RET_STATUS(limited ? IB_ELIMIT : IB_ENOENT);
+}
+
+/**
+ * @internal
+ * Serialize a compiled pattern.
+ *
+ * The buffer is a header holding the encoded code and pattern text
+ * lengths (host byte order), followed by the pcre2_serialize_encode()
+ * bytes and the pattern text. Only the same PCRE2 build on the same
+ * architecture can load it.
+ */
+static ib_status_t modpcre2_serialize(ib_provider_t *mpr,
+                                      void *cpatt,
+                                      ib_mpool_t *pool,
+                                      const uint8_t **pbuf,
+                                      size_t *plen)
+{
+    IB_FTRACE_INIT(modpcre2_serialize);
+    modpcre2_cpatt_t *pcre2_cpatt = (modpcre2_cpatt_t *)cpatt;
+    const pcre2_code *codes[1];
+    uint8_t *bytes;
+    PCRE2_SIZE size;
+    uint32_t hdr[2];
+    uint8_t *buf;
+    int32_t ec;
+
+    codes[0] = pcre2_cpatt->code;
+    ec = pcre2_serialize_encode(codes, 1, &bytes, &size, NULL);
+    if (ec < 0) {
+        IB_FTRACE_RET_STATUS((ec == PCRE2_ERROR_NOMEMORY)
+                             ? IB_EALLOC : IB_EINVAL);
+    }
+
+    hdr[0] = (uint32_t)size;
+    hdr[1] = (uint32_t)strlen(pcre2_cpatt->patt);
+
+    buf = (uint8_t *)ib_mpool_alloc(pool, MODPCRE2_SER_HDR + hdr[0] + hdr[1]);
+    if (buf == NULL) {
+        pcre2_serialize_free(bytes);
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    memcpy(buf, hdr, MODPCRE2_SER_HDR);
+    memcpy(buf + MODPCRE2_SER_HDR, bytes, hdr[0]);
+    memcpy(buf + MODPCRE2_SER_HDR + hdr[0], pcre2_cpatt->patt, hdr[1]);
+    pcre2_serialize_free(bytes);
+
+    *pbuf = buf;
+    *plen = MODPCRE2_SER_HDR + hdr[0] + hdr[1];
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Load a compiled pattern written by modpcre2_serialize().
+ *
+ * The code is JIT compiled again, as JIT code is not serialized.
+ */
+static ib_status_t modpcre2_deserialize(ib_provider_t *mpr,
+                                        ib_mpool_t *pool,
+                                        void *pcpatt,
+                                        const uint8_t *buf,
+                                        size_t len)
+{
+    IB_FTRACE_INIT(modpcre2_deserialize);
+    modpcre2_cpatt_t *pcre2_cpatt;
+    const uint8_t *bytes;
+    pcre2_code *code;
+    uint32_t hdr[2];
+    char *patt;
+    int32_t ec;
+    ib_status_t rc;
+
+    *(void **)pcpatt = NULL;
+
+    if (len < MODPCRE2_SER_HDR) {
+        IB_FTRACE_RET_STATUS(IB_EINCOMPAT);
+    }
+    memcpy(hdr, buf, MODPCRE2_SER_HDR);
+    if ((size_t)hdr[0] + hdr[1] != len - MODPCRE2_SER_HDR) {
+        IB_FTRACE_RET_STATUS(IB_EINCOMPAT);
+    }
+
+    /* PCRE2 reads the encoded header in place, so it must be aligned. */
+    bytes = buf + MODPCRE2_SER_HDR;
+    if (((uintptr_t)bytes % sizeof(void *)) != 0) {
+        bytes = (const uint8_t *)ib_mpool_memdup(pool, bytes, hdr[0]);
+        if (bytes == NULL) {
+            IB_FTRACE_RET_STATUS(IB_EALLOC);
+        }
+    }
+
+    ec = pcre2_serialize_decode(&code, 1, bytes, NULL);
+    if (ec < 0) {
+        IB_FTRACE_RET_STATUS((ec == PCRE2_ERROR_NOMEMORY)
+                             ? IB_EALLOC : IB_EINCOMPAT);
+    }
+
+    patt = (char *)ib_mpool_alloc(pool, hdr[1] + 1);
+    if (patt == NULL) {
+        pcre2_code_free(code);
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    memcpy(patt, buf + MODPCRE2_SER_HDR + hdr[0], hdr[1]);
+    patt[hdr[1]] = '\0';
+
+    rc = modpcre2_cpatt_create(pool, code, patt, &pcre2_cpatt);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    *(void **)pcpatt = (void *)pcre2_cpatt;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+static IB_PROVIDER_IFACE_TYPE(matcher) modpcre2_matcher_iface = {
+    IB_PROVIDER_IFACE_HEADER_DEFAULTS,
+
+    /* Provider Interface */
+    modpcre2_compile,
+    modpcre2_match_compiled,
+
+    /* Provider Instance Interface */
+    modpcre2_add_pattern,
+    modpcre2_match,
+
+    /* Provider Instance Stream Interface */
+    modpcre2_stream_create,
+    modpcre2_stream_feed,
+    modpcre2_stream_finish,
+
+    /* Provider Serialization Interface */
+    modpcre2_serialize,
+    modpcre2_deserialize
+};
+
+
+/* -- Module Routines -- */
+
+/**
+ * @internal
+ * Use the main context configuration for the (engine wide) provider.
+ *
+ * The engine applies the configuration map defaults and any "Set"
+ * directives to the copy of the configuration in each context, not
+ * to the module global configuration.
+ *
+ * @param ib Engine
+ */
+static void modpcre2_cfg_sync(ib_engine_t *ib)
+{
+    IB_FTRACE_INIT(modpcre2_cfg_sync);
+    modpcre2_cfg_t *cfg;
+    ib_status_t rc;
+
+    rc = ib_context_module_config(ib_context_main(ib), &IB_MODULE_SYM,
+                                  (void *)&cfg);
+    if ((rc == IB_OK) && (cfg != NULL)) {
+        modpcre2_global_cfg = *cfg;
+    }
+
+    IB_FTRACE_RET_VOID();
+}
+
+/**
+ * @internal
+ * Pick up the main context configuration once it is finished.
+ *
+ * @param ib Engine
+ * @param param Unused
+ * @param cbdata Unused
+ *
+ * @returns Status code
+ */
+static ib_status_t modpcre2_cfg_finished(ib_engine_t *ib,
+                                         void *param,
+                                         void *cbdata)
+{
+    IB_FTRACE_INIT(modpcre2_cfg_finished);
+    modpcre2_cfg_sync(ib);
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+static ib_status_t modpcre2_init(ib_engine_t *ib,
+                                 ib_module_t *m)
+{
+    IB_FTRACE_INIT(modpcre2_init);
+    char version[64];
+    ib_status_t rc;
+
+    /* Match resources are kept per thread and freed on thread exit. */
+    if (pthread_key_create(&modpcre2_thread_key, modpcre2_thread_free) != 0) {
+        ib_log_error(ib, 1, MODULE_NAME_STR ": Failed to create thread key");
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+
+    rc = ib_stat_register(ib, MODULE_NAME_STR ".limit_exceeded",
+                          &modpcre2_stat_limit);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    /* Settings are taken from the main context. */
+    modpcre2_cfg_sync(ib);
+    ib_hook_register(ib, cfg_finished_event,
+                     (ib_void_fn_t)modpcre2_cfg_finished,
+                     NULL);
+
+    /* Register as a matcher provider. */
+    rc = ib_provider_register(ib,
+                              IB_PROVIDER_TYPE_MATCHER,
+                              MODULE_NAME_STR,
+                              NULL,
+                              &modpcre2_matcher_iface,
+                              modpcre2_inst_init);
+    if (rc != IB_OK) {
+        ib_log_error(ib, 3,
+                     MODULE_NAME_STR ": Error registering pcre2 matcher provider: "
+                     "%d", rc);
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    version[0] = '\0';
+    pcre2_config(PCRE2_CONFIG_VERSION, version);
+    ib_log_debug(ib, 4, "PCRE2 Status: compiled=\"%d.%d\" loaded=\"%s\"",
+                 PCRE2_MAJOR, PCRE2_MINOR, version);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+static ib_status_t modpcre2_fini(ib_engine_t *ib,
+                                 ib_module_t *m)
+{
+    IB_FTRACE_INIT(modpcre2_fini);
+    modpcre2_thread_t *t;
+
+    /* Only other threads' resources are freed when they exit. */
+    t = (modpcre2_thread_t *)pthread_getspecific(modpcre2_thread_key);
+    if (t != NULL) {
+        pthread_setspecific(modpcre2_thread_key, NULL);
+        modpcre2_thread_free(t);
+    }
+    pthread_key_delete(modpcre2_thread_key);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+static IB_CFGMAP_INIT_STRUCTURE(modpcre2_config_map) = {
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".jit",
+        IB_FTYPE_NUM,
+        &modpcre2_global_cfg,
+        jit,
+        1
+    ),
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".match_limit",
+        IB_FTYPE_NUM,
+        &modpcre2_global_cfg,
+        match_limit,
+        5000
+    ),
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".depth_limit",
+        IB_FTYPE_NUM,
+        &modpcre2_global_cfg,
+        depth_limit,
+        5000
+    ),
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".partial_max",
+        IB_FTYPE_NUM,
+        &modpcre2_global_cfg,
+        partial_max,
+        8192
+    ),
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".jit_stack_max",
+        IB_FTYPE_NUM,
+        &modpcre2_global_cfg,
+        jit_stack_max,
+        512 * 1024
+    ),
+    IB_CFGMAP_INIT_LAST
+};
+
+/**
+ * @internal
+ * Module structure.
+ *
+ * This structure defines some metadata, config data and various functions.
+ */
+IB_MODULE_INIT(
+    IB_MODULE_HEADER_DEFAULTS,            /**< Default metadata */
+    MODULE_NAME_STR,                      /**< Module name */
+    IB_MODULE_CONFIG(&modpcre2_global_cfg),/**< Global config data */
+    modpcre2_config_map,                  /**< Configuration field map */
+    NULL,                                 /**< Config directive map */
+    modpcre2_init,                        /**< Initialize function */
+    modpcre2_fini,                        /**< Finish function */
+    NULL,                                 /**< Context init function */
+);
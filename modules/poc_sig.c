@@ -23,11 +23,60 @@
  * a signature language. The module is purposefully simplistic
  * so that it is easy to follow.
  *
+ * Request and response body signatures (PocSigReqBody, PocSigResBody)
+ * are matched against the body data as it streams through the
+ * engine, so they do not require the body to be buffered.
+ *
+ * Patterns for backtracking matchers (pcre, pcre2) are analyzed for
+ * constructs which can backtrack catastrophically. These are logged as
+ * they are configured and again once configuration is finished. With
+ * PocSigReDoSRoute enabled, such patterns are instead compiled with the
+ * linear-time "dfa" matcher where it supports them.
+ *
+ * Other signatures are grouped by phase, target field and target
+ * transformations, so each field is fetched once per phase. With a
+ * multi-pattern matcher (dfa, ac) the signatures of a group are all
+ * matched in a single pass. With others, where a regex pattern
+ * requires a literal (such as "select" for "union\s+select"), the
+ * literals of a group are matched against the target in a single pass
+ * first, and only signatures whose literal was seen are matched.
+ *
+ * The operator of a signature is a regex pattern, or "@name params" to
+ * test the target with a named operator instead (see
+ * ib_operator_create()), which is much cheaper for simple string,
+ * numeric and network checks. "@rx patt" is the same as "patt".
+ * Named operators are not supported by body signatures.
+ *
+ * Once configuration is finished, the signatures of each context are
+ * compiled into a program per phase (fetch a field, transform it, test
+ * a signature, branch, log an event), which is run by a small
+ * interpreter instead of walking the signature lists. A signature
+ * with the "chain" option after its action must be followed by the
+ * next signature of the phase for its event to be logged, so the
+ * signatures of a chain are ANDed with short-circuit evaluation and
+ * the event uses the action of the first.
+ *
+ * A context inherits the signatures of its parent context, which are
+ * run (already compiled) before its own. Identical patterns are only
+ * compiled once across all contexts, as the matchers are allocated
+ * from the engine configuration pool.
+ *
+ * With PocSigProfile enabled, the cost of each signature is logged
+ * when the engine is destroyed, every PocSigProfileDumpInterval
+ * seconds, and on request by sending the signal configured with
+ * PocSigProfileDumpSignal (such as USR2) to the process. A requested
+ * dump is logged by the next transaction to finish.
+ *
  * @author Brian Rectanus <brectanus@qualys.com>
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
 
 #include <ironbee/engine.h>
 #include <ironbee/util.h>
@@ -43,13 +92,19 @@ IB_MODULE_DECLARE();
 
 typedef struct pocsig_cfg_t pocsig_cfg_t;
 typedef struct pocsig_sig_t pocsig_sig_t;
+typedef struct pocsig_prof_t pocsig_prof_t;
+typedef struct pocsig_target_t pocsig_target_t;
+typedef struct pocsig_group_t pocsig_group_t;
+typedef struct pocsig_insn_t pocsig_insn_t;
 
 /** Signature Phases */
 typedef enum {
     POCSIG_PRE,                   /**< Pre transaction phase */
     POCSIG_REQHEAD,               /**< Request headers phase */
+    POCSIG_REQBODY,               /**< Request body (streamed) phase */
     POCSIG_REQ,                   /**< Request phase */
     POCSIG_RESHEAD,               /**< Response headers phase */
+    POCSIG_RESBODY,               /**< Response body (streamed) phase */
     POCSIG_RES,                   /**< Response phase */
     POCSIG_POST,                  /**< Post transaction phase */
 
@@ -57,173 +112,1313 @@ typedef enum {
     POCSIG_PHASE_NUM
 } pocsig_phase_t;
 
+/** Signature Profile Counters (updated atomically) */
+struct pocsig_prof_t {
+    uint64_t            evals;    /**< Number of evaluations */
+    uint64_t            matches;  /**< Number of matches */
+    uint64_t            nsec;     /**< Total evaluation time (ns) */
+    uint64_t            nsec_max; /**< Longest evaluation time (ns) */
+    uint64_t            bytes;    /**< Total bytes scanned */
+    uint64_t            skips;    /**< Evaluations skipped by prefilter */
+};
+
 /** Signature Structure */
 struct pocsig_sig_t {
     const char         *target;   /**< Target name */
+    const char         *field;    /**< Target field name (without tfns) */
+    size_t              flen;     /**< Target field name length */
+    ib_tfn_pipeline_t  *tfn;      /**< Target transformations (or NULL) */
     const char         *patt;     /**< Pattern to match in target */
-    void               *cpatt;    /**< Compiled PCRE regex */
+    ib_operator_inst_t *op;       /**< Operator (or NULL for a regex) */
+    ib_matcher_t       *m;        /**< Matcher which compiled cpatt */
+    void               *cpatt;    /**< Compiled PCRE regex (or NULL) */
+    const char         *risk;     /**< Backtracking risk (or NULL) */
+    int                 risk_off; /**< Pattern offset of the risk */
+    int                 routed;   /**< Routed to the linear-time matcher */
+    const uint8_t      *lit;      /**< Literal required to match (or NULL) */
+    size_t              litlen;   /**< Literal length */
+    size_t              idx;      /**< Index in the signature group */
+    int                 inset;    /**< In the group combined matcher */
     const char         *emsg;     /**< Event message */
+    int                 chained;  /**< Has the "chain" option */
+    int                 inchain;  /**< Is a later condition of a chain */
+    pocsig_sig_t       *next;     /**< Next condition of a chain (or NULL) */
+    pocsig_phase_t      phase;    /**< Phase */
+    pocsig_prof_t       prof;     /**< Profile counters */
+};
+
+/** Signature Target (signature groups of a phase on the same field) */
+struct pocsig_target_t {
+    const char         *field;    /**< Field name */
+    size_t              flen;     /**< Field name length */
+    ib_list_t          *groups;   /**< Signature groups */
+};
+
+/** Signature Group (signatures of a target with the same tfns) */
+struct pocsig_group_t {
+    const char         *target;   /**< Target name (of the first signature) */
+    ib_tfn_pipeline_t  *tfn;      /**< Target transformations (or NULL) */
+    ib_list_t          *sigs;     /**< Signatures in configured order */
+    size_t              nsigs;    /**< Number of signatures */
+    size_t              nlits;    /**< Signatures with a literal */
+    ib_ac_t            *prefilter;/**< Literal prefilter (or NULL) */
+    ib_ac_t            *building; /**< Prefilter being built (or NULL) */
+    ib_matcher_t       *set;      /**< Combined matcher (or NULL) */
+    const char         *setkey;   /**< Combined matcher provider key */
+    size_t              nset;     /**< Signatures in the combined matcher */
+};
+
+/** Signature Program Opcodes */
+typedef enum {
+    POCSIG_OP_END,                /**< Stop */
+    POCSIG_OP_FETCH,              /**< Fetch a signature target field */
+    POCSIG_OP_TFN,                /**< Transform the target field */
+    POCSIG_OP_GROUP,              /**< Run a group matcher and prefilter */
+    POCSIG_OP_SET,                /**< Test a group matcher result */
+    POCSIG_OP_MATCH,              /**< Test a signature pattern */
+    POCSIG_OP_OPER,               /**< Test a signature operator */
+    POCSIG_OP_EVENT,              /**< Log a signature event */
+
+    /* Keep track of the number of defined opcodes. */
+    POCSIG_OP_NUM
+} pocsig_opcode_t;
+
+/**
+ * Signature Program Instruction
+ *
+ * FETCH, TFN and the tests continue with the next instruction on
+ * success, or jump on failure.
+ */
+struct pocsig_insn_t {
+    uint32_t            op;       /**< Opcode */
+    uint32_t            jmp;      /**< Instruction jumped to on failure */
+    union {
+        pocsig_sig_t   *sig;      /**< Signature (or of the target) */
+        const pocsig_group_t *group; /**< Signature group (GROUP) */
+    } arg;
 };
 
 /** Module Configuration Structure */
 struct pocsig_cfg_t {
     /* Exposed as configuration parameters. */
     ib_num_t            trace;    /**< Log signature tracing */
+    ib_num_t            profile;  /**< Profile signatures */
+    ib_num_t            redos_route; /**< Route risky patterns to "dfa" */
 
     /* Private. */
     ib_list_t          *phase[POCSIG_PHASE_NUM]; /**< Phase signature lists */
-    ib_matcher_t       *pcre;     /**< PCRE matcher */
+    ib_list_t          *target[POCSIG_PHASE_NUM]; /**< Phase signature targets */
+    pocsig_insn_t      *prog[POCSIG_PHASE_NUM]; /**< Phase programs (or NULL) */
+    pocsig_sig_t       *chain[POCSIG_PHASE_NUM]; /**< Open chains (or NULL) */
+    ib_matcher_t       *pcre;     /**< Regex matcher (or NULL if unused) */
+    ib_matcher_t       *dfa;      /**< Matcher for risky patterns */
+    ib_matcher_t       *reqbody;  /**< Request body signature matcher */
+    ib_matcher_t       *resbody;  /**< Response body signature matcher */
+    const pocsig_cfg_t *base;     /**< Parent signatures (or NULL) */
+    ib_context_t       *ctx;      /**< Context owning the signatures */
+    int                 depth;    /**< Number of parent signature layers */
 };
 
 /* Instantiate a module global configuration. */
 static pocsig_cfg_t pocsig_global_cfg;
 
+/** Signature profiling data (engine wide) */
+static struct {
+    ib_list_t          *sigs;     /**< All signatures */
+    time_t              dump_interval; /**< Periodic dump interval */
+    time_t              dump_last;/**< Time of last periodic dump */
+    int                 dump_signal; /**< Signal requesting a dump (or 0) */
+    struct sigaction    dump_oldact; /**< Action replaced for dump_signal */
+} pocsig_prof;
 
-/* -- Directive Handlers -- */
+/** A profile dump was requested by a signal. */
+static volatile sig_atomic_t pocsig_prof_dump_requested;
+
+/** Signature groups to finish building (engine wide) */
+static ib_list_t *pocsig_groups;
+
+/** Signature configurations to compile programs for (engine wide) */
+static ib_list_t *pocsig_cfgs;
+
+/** Backtracking analysis data (engine wide) */
+static struct {
+    int                 no_route; /**< Routing matcher is unavailable */
+} pocsig_redos;
+
+/** Phase names (for profile output) */
+static const char *pocsig_phase_name[POCSIG_PHASE_NUM] = {
+    "PreTx",
+    "ReqHead",
+    "ReqBody",
+    "Req",
+    "ResHead",
+    "ResBody",
+    "Res",
+    "PostTx"
+};
+
+
+/* -- Profiling -- */
 
 /**
  * @internal
- * Handle a PocSigTrace directive.
+ * Get a monotonic timestamp.
  *
- * @param cp Config parser
- * @param name Directive name
- * @param p1 First parameter
- * @param cbdata Callback data (from directive registration)
+ * @returns Time in nanoseconds
+ */
+static uint64_t pocsig_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @internal
+ * Record a signature evaluation.
  *
- * @returns Status code
+ * Signatures are shared by all threads, so the counters are
+ * updated atomically.
+ *
+ * @param s Signature
+ * @param nsec Evaluation time
+ * @param bytes Bytes scanned
+ * @param match Non-zero if the signature matched
  */
-static ib_status_t pocsig_dir_trace(ib_cfgparser_t *cp,
-                                    const char *name,
-                                    const char *p1,
-                                    void *cbdata)
+static void pocsig_prof_record(pocsig_sig_t *s,
+                               uint64_t nsec,
+                               size_t bytes,
+                               int match)
 {
-    IB_FTRACE_INIT(pocsig_dir_trace);
-    ib_engine_t *ib = cp->ib;
-    ib_context_t *ctx = cp->cur_ctx ? cp->cur_ctx : ib_context_main(ib);
-    ib_status_t rc;
+    uint64_t max;
 
-    ib_log_debug(ib, 7, "%s: \"%s\" ctx=%p", name, p1, ctx);
-    if (strcasecmp("On", p1) == 0) {
-        rc = ib_context_set_num(ctx, MODULE_NAME_STR ".trace", 1);
-        IB_FTRACE_RET_STATUS(rc);
+    __sync_fetch_and_add(&s->prof.evals, 1);
+    __sync_fetch_and_add(&s->prof.nsec, nsec);
+    __sync_fetch_and_add(&s->prof.bytes, (uint64_t)bytes);
+    if (match) {
+        __sync_fetch_and_add(&s->prof.matches, 1);
     }
-    else if (strcasecmp("Off", p1) == 0) {
-        rc = ib_context_set_num(ctx, MODULE_NAME_STR ".trace", 0);
-        IB_FTRACE_RET_STATUS(rc);
+
+    max = s->prof.nsec_max;
+    while (nsec > max) {
+        if (__sync_bool_compare_and_swap(&s->prof.nsec_max, max, nsec)) {
+            break;
+        }
+        max = s->prof.nsec_max;
     }
+}
 
-    ib_log_error(ib, 1, "Failed to parse directive: %s \"%s\"", name, p1);
-    IB_FTRACE_RET_STATUS(IB_EINVAL);
+/**
+ * @internal
+ * Profile snapshot used for sorting.
+ */
+typedef struct {
+    const pocsig_sig_t *sig;      /**< Signature */
+    pocsig_prof_t       prof;     /**< Copy of the counters */
+} pocsig_prof_entry_t;
+
+/**
+ * @internal
+ * Sort profile entries by descending total time.
+ */
+static int pocsig_prof_cmp(const void *a,
+                           const void *b)
+{
+    const pocsig_prof_entry_t *pa = (const pocsig_prof_entry_t *)a;
+    const pocsig_prof_entry_t *pb = (const pocsig_prof_entry_t *)b;
+
+    if (pa->prof.nsec > pb->prof.nsec) {
+        return -1;
+    }
+    if (pa->prof.nsec < pb->prof.nsec) {
+        return 1;
+    }
+    return 0;
 }
 
 /**
  * @internal
- * Handle a PocSig directive.
- *
- * @param cp Config parser
- * @param name Directive name
- * @param args List of directive arguments
- * @param cbdata Callback data (from directive registration)
+ * Log the profile of all evaluated signatures, most expensive first.
  *
- * @returns Status code
+ * @param ib Engine
+ * @param level Log level
  */
-static ib_status_t pocsig_dir_signature(ib_cfgparser_t *cp,
-                                        const char *name,
-                                        ib_list_t *args,
-                                        void *cbdata)
+static void pocsig_prof_dump(ib_engine_t *ib,
+                             int level)
 {
-    IB_FTRACE_INIT(pocsig_dir_signature);
-    ib_engine_t *ib = cp->ib;
-    ib_context_t *ctx = cp->cur_ctx ? cp->cur_ctx : ib_context_main(ib);
-    ib_list_t *list;
-    const char *target;
-    const char *op;
-    const char *action;
-    pocsig_cfg_t *cfg;
-    pocsig_phase_t phase;
-    pocsig_sig_t *sig;
-    const char *errptr;
-    int erroff;
-    ib_status_t rc;
+    IB_FTRACE_INIT(pocsig_prof_dump);
+    pocsig_prof_entry_t *entry;
+    ib_list_node_t *node;
+    size_t n = 0;
+    size_t i;
 
-    /* Get the pocsig configuration for this context. */
-    rc = ib_context_module_config(ctx, &IB_MODULE_SYM, (void *)&cfg);
-    if (rc != IB_OK) {
-        ib_log_error(ib, 1, "Failed to fetch %s config: %d",
-                     MODULE_NAME_STR, rc);
+    if ((pocsig_prof.sigs == NULL) || (ib_list_elements(pocsig_prof.sigs) == 0)) {
+        IB_FTRACE_RET_VOID();
     }
 
-    /* Setup the PCRE matcher. */
-    if (cfg->pcre == NULL) {
-        rc = ib_matcher_create(ib, ib_engine_pool_config_get(ib),
-                               "pcre", &cfg->pcre);
-        if (rc != IB_OK) {
-            ib_log_error(ib, 2, "Could not create a PCRE matcher: %d", rc);
-            IB_FTRACE_RET_STATUS(rc);
-        }
+    entry = (pocsig_prof_entry_t *)malloc(ib_list_elements(pocsig_prof.sigs)
+                                          * sizeof(*entry));
+    if (entry == NULL) {
+        IB_FTRACE_RET_VOID();
     }
 
-    /* Determine phase and initialize the phase list if required. */
-    if (strcasecmp("PocSigPreTx", name) == 0) {
-        phase = POCSIG_PRE;
-        if (cfg->phase[phase] == NULL) {
-            rc = ib_list_create(cfg->phase + POCSIG_PRE,
-                                ib_engine_pool_config_get(ib));
-            if (rc != IB_OK) {
-                IB_FTRACE_RET_STATUS(rc);
-            }
+    /* Snapshot the counters so they do not change while sorting. */
+    IB_LIST_LOOP(pocsig_prof.sigs, node) {
+        const pocsig_sig_t *s = (const pocsig_sig_t *)ib_list_node_data(node);
+
+        if ((s->prof.evals == 0) && (s->prof.skips == 0)) {
+            continue;
         }
+        entry[n].sig = s;
+        entry[n].prof = s->prof;
+        n++;
     }
-    else if (strcasecmp("PocSigReqHead", name) == 0) {
-        phase = POCSIG_REQHEAD;
-        if (cfg->phase[phase] == NULL) {
-            ib_log_debug(ib, 4, "Creating list for phase=%d", phase);
-            rc = ib_list_create(&list,
-                                ib_engine_pool_config_get(ib));
-            if (rc != IB_OK) {
-                IB_FTRACE_RET_STATUS(rc);
-            }
-            ib_log_debug(ib, 4, "List for phase=%d list=%p", phase, list);
-            cfg->phase[phase] = list;
-        }
+
+    qsort(entry, n, sizeof(*entry), pocsig_prof_cmp);
+
+    ib_log(ib, level, "PocSig PROFILE: %zu of %zu signatures evaluated",
+           n, ib_list_elements(pocsig_prof.sigs));
+    for (i = 0; i < n; i++) {
+        const pocsig_prof_t *p = &entry[i].prof;
+
+        ib_log(ib, level,
+               "PocSig PROFILE: phase=%s target=%s patt=\"%s\""
+               " evals=%" PRIu64 " matches=%" PRIu64
+               " total=%" PRIu64 "ns mean=%" PRIu64 "ns max=%" PRIu64 "ns"
+               " bytes=%" PRIu64 " skips=%" PRIu64,
+               pocsig_phase_name[entry[i].sig->phase],
+               entry[i].sig->target, entry[i].sig->patt,
+               p->evals, p->matches,
+               p->nsec, (p->evals > 0) ? (p->nsec / p->evals) : 0,
+               p->nsec_max, p->bytes, p->skips);
     }
-    else if (strcasecmp("PocSigReq", name) == 0) {
-        phase = POCSIG_REQ;
-        if (cfg->phase[phase] == NULL) {
-            rc = ib_list_create(&cfg->phase[phase],
-                                ib_engine_pool_config_get(ib));
+
+    free(entry);
+
+    IB_FTRACE_RET_VOID();
+}
+
+/**
+ * @internal
+ * Request a profile dump (signal handler).
+ *
+ * @param sig Signal
+ */
+static void pocsig_prof_signal(int sig)
+{
+    pocsig_prof_dump_requested = 1;
+}
+
+/**
+ * @internal
+ * Dump the profile if requested or if the dump interval has elapsed.
+ *
+ * @param ib Engine
+ */
+static void pocsig_prof_periodic(ib_engine_t *ib)
+{
+    time_t last = pocsig_prof.dump_last;
+    time_t now;
+
+    /* Only the thread which takes the request does the dump. */
+    if (   pocsig_prof_dump_requested
+        && __sync_bool_compare_and_swap(&pocsig_prof_dump_requested, 1, 0))
+    {
+        pocsig_prof_dump(ib, 1);
+    }
+
+    if (pocsig_prof.dump_interval == 0) {
+        return;
+    }
+
+    now = time(NULL);
+    if ((now - last) < pocsig_prof.dump_interval) {
+        return;
+    }
+
+    /* Only the thread which wins the update does the dump. */
+    if (__sync_bool_compare_and_swap(&pocsig_prof.dump_last, last, now)) {
+        pocsig_prof_dump(ib, 1);
+    }
+}
+
+
+/* -- Inheritance -- */
+
+/**
+ * @internal
+ * Take ownership of the signatures of a context configuration.
+ *
+ * A context configuration starts as a copy of its parent, including
+ * the pointers to its signature lists. The first time a context is
+ * seen these are replaced by a reference to the parent configuration
+ * (whose signatures are then run before those of the context) and
+ * empty lists for the signatures of the context itself.
+ *
+ * @param ctx Config context
+ * @param cfg Module configuration for the context
+ *
+ * @returns Status code
+ */
+static ib_status_t pocsig_cfg_own(ib_context_t *ctx,
+                                  pocsig_cfg_t *cfg)
+{
+    IB_FTRACE_INIT(pocsig_cfg_own);
+    ib_context_t *parent;
+    pocsig_cfg_t *pcfg;
+    ib_status_t rc;
+
+    if (cfg->ctx == ctx) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    cfg->base = NULL;
+    cfg->depth = 0;
+    parent = ib_context_parent_get(ctx);
+    if (parent != NULL) {
+        rc = ib_context_module_config(parent, &IB_MODULE_SYM, (void *)&pcfg);
+        if (rc == IB_OK) {
+            rc = pocsig_cfg_own(parent, pcfg);
             if (rc != IB_OK) {
                 IB_FTRACE_RET_STATUS(rc);
             }
+            cfg->base = pcfg;
+            cfg->depth = pcfg->depth + 1;
         }
     }
-    else if (strcasecmp("PocSigResHead", name) == 0) {
-        phase = POCSIG_RESHEAD;
-        if (cfg->phase[phase] == NULL) {
-            rc = ib_list_create(&cfg->phase[phase],
-                                ib_engine_pool_config_get(ib));
-            if (rc != IB_OK) {
-                IB_FTRACE_RET_STATUS(rc);
-            }
+
+    memset(cfg->phase, 0, sizeof(cfg->phase));
+    memset(cfg->target, 0, sizeof(cfg->target));
+    memset(cfg->prog, 0, sizeof(cfg->prog));
+    memset(cfg->chain, 0, sizeof(cfg->chain));
+    cfg->reqbody = NULL;
+    cfg->resbody = NULL;
+
+    /* Matchers are created for the context matcher setting. */
+    cfg->pcre = NULL;
+    cfg->dfa = NULL;
+
+    cfg->ctx = ctx;
+
+    /* Programs are compiled for each once configuration is finished. */
+    rc = ib_list_push(pocsig_cfgs, cfg);
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+/**
+ * @internal
+ * Count the signatures for a phase, including those inherited.
+ *
+ * @param cfg Module configuration
+ * @param phase Phase
+ *
+ * @returns Number of signatures
+ */
+static size_t pocsig_phase_count(const pocsig_cfg_t *cfg,
+                                 pocsig_phase_t phase)
+{
+    size_t n = 0;
+
+    for (; cfg != NULL; cfg = cfg->base) {
+        if (cfg->phase[phase] != NULL) {
+            n += ib_list_elements(cfg->phase[phase]);
         }
     }
-    else if (strcasecmp("PocSigRes", name) == 0) {
-        phase = POCSIG_RES;
-        if (cfg->phase[POCSIG_RES] == NULL) {
-            rc = ib_list_create(&cfg->phase[POCSIG_RES],
-                                ib_engine_pool_config_get(ib));
+
+    return n;
+}
+
+
+/* -- Backtracking Analysis -- */
+
+/**
+ * @internal
+ * Get the matcher provider key configured for a context.
+ *
+ * @param ctx Config context
+ *
+ * @returns Matcher provider key (from "Set matcher")
+ */
+static const char *pocsig_matcher_key(ib_context_t *ctx)
+{
+    ib_core_cfg_t *corecfg;
+    ib_status_t rc;
+
+    rc = ib_context_module_config(ctx, ib_core_module(), (void *)&corecfg);
+    if ((rc != IB_OK) || (corecfg->matcher == NULL)) {
+        return "pcre";
+    }
+
+    return corecfg->matcher;
+}
+
+/** Linear-time matcher which risky patterns are routed to */
+#define POCSIG_ROUTE_KEY          "dfa"
+
+/**
+ * @internal
+ * Whether a matcher backtracks, so its patterns are worth analyzing.
+ *
+ * @param key Matcher provider key
+ *
+ * @returns Non-zero if the matcher backtracks
+ */
+static int pocsig_backtracks(const char *key)
+{
+    return (strcmp(key, "pcre") == 0) || (strcmp(key, "pcre2") == 0);
+}
+
+/**
+ * @internal
+ * Analyze a signature pattern for catastrophic backtracking.
+ *
+ * A risky pattern is logged and marked for the summary logged when
+ * configuration is finished. If routing is enabled, the pattern is
+ * compiled with the linear-time matcher if that supports it, which
+ * sets the signature matcher and compiled pattern. Body signatures
+ * share a single streaming matcher, so are never routed.
+ *
+ * @param ib Engine
+ * @param ctx Config context
+ * @param cfg Module configuration for the context
+ * @param sig Signature
+ */
+static void pocsig_analyze(ib_engine_t *ib,
+                           ib_context_t *ctx,
+                           pocsig_cfg_t *cfg,
+                           pocsig_sig_t *sig)
+{
+    IB_FTRACE_INIT(pocsig_analyze);
+    const char *reason;
+    const char *errptr;
+    int offset;
+    int erroff;
+    ib_status_t rc;
+
+    if (!pocsig_backtracks(pocsig_matcher_key(ctx))) {
+        IB_FTRACE_RET_VOID();
+    }
+
+    rc = ib_re_analyze(sig->patt, 0, &reason, &offset);
+    if (rc == IB_EINVAL) {
+        ib_log_debug(ib, 7, "PocSig: Not analyzing patt=\"%s\": %s "
+                     "at offset=%d", sig->patt, reason, offset);
+        IB_FTRACE_RET_VOID();
+    }
+    else if (rc != IB_DECLINED) {
+        IB_FTRACE_RET_VOID();
+    }
+    sig->risk = reason;
+    sig->risk_off = offset;
+
+    if (cfg->redos_route
+        && (sig->phase != POCSIG_REQBODY) && (sig->phase != POCSIG_RESBODY))
+    {
+        if ((cfg->dfa == NULL) && !pocsig_redos.no_route) {
+            rc = ib_matcher_create(ib, ib_engine_pool_config_get(ib),
+                                   POCSIG_ROUTE_KEY, &cfg->dfa);
             if (rc != IB_OK) {
-                IB_FTRACE_RET_STATUS(rc);
+                ib_log_error(ib, 2, "Could not create a \"%s\" matcher "
+                             "for risky patterns (load the %s module?): %d",
+                             POCSIG_ROUTE_KEY, POCSIG_ROUTE_KEY, rc);
+                pocsig_redos.no_route = 1;
+                cfg->dfa = NULL;
             }
         }
-    }
-    else if (strcasecmp("PocSigPostTx", name) == 0) {
-        phase = POCSIG_POST;
-        if (cfg->phase[phase] == NULL) {
-            rc = ib_list_create(&cfg->phase[phase],
-                                ib_engine_pool_config_get(ib));
-            if (rc != IB_OK) {
-                IB_FTRACE_RET_STATUS(rc);
+        if (cfg->dfa != NULL) {
+            sig->cpatt = ib_matcher_compile(cfg->dfa, sig->patt,
+                                            &errptr, &erroff);
+            if (sig->cpatt != NULL) {
+                sig->m = cfg->dfa;
+                sig->routed = 1;
+            }
+        }
+    }
+
+    ib_log_error(ib, 3, "PocSig: Pattern \"%s\" may backtrack "
+                 "catastrophically (%s at offset=%d)%s",
+                 sig->patt, sig->risk, sig->risk_off,
+                 sig->routed ? ", routed to the \"" POCSIG_ROUTE_KEY
+                               "\" matcher" : "");
+
+    IB_FTRACE_RET_VOID();
+}
+
+
+/* -- Prefilter -- */
+
+/**
+ * @internal
+ * Whether a matcher matches all of its patterns in a single pass.
+ *
+ * @param key Matcher provider key
+ *
+ * @returns Non-zero if the matcher is multi-pattern
+ */
+static int pocsig_multi(const char *key)
+{
+    return (strcmp(key, "dfa") == 0) || (strcmp(key, "ac") == 0);
+}
+
+/**
+ * @internal
+ * Find (or create) the signature group for a signature.
+ *
+ * @param ib Engine
+ * @param cfg Module configuration for the context
+ * @param sig Signature
+ * @param pgroup Address which the group is written
+ *
+ * @returns Status code
+ */
+static ib_status_t pocsig_group_get(ib_engine_t *ib,
+                                    pocsig_cfg_t *cfg,
+                                    const pocsig_sig_t *sig,
+                                    pocsig_group_t **pgroup)
+{
+    IB_FTRACE_INIT(pocsig_group_get);
+    ib_mpool_t *pool = ib_engine_pool_config_get(ib);
+    pocsig_target_t *target = NULL;
+    pocsig_group_t *group;
+    ib_list_node_t *node;
+    ib_status_t rc;
+
+    if (cfg->target[sig->phase] == NULL) {
+        rc = ib_list_create(&cfg->target[sig->phase], pool);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+    }
+
+    IB_LIST_LOOP(cfg->target[sig->phase], node) {
+        pocsig_target_t *t = (pocsig_target_t *)ib_list_node_data(node);
+
+        if ((t->flen == sig->flen)
+            && (memcmp(t->field, sig->field, sig->flen) == 0))
+        {
+            target = t;
+            break;
+        }
+    }
+
+    if (target == NULL) {
+        target = (pocsig_target_t *)ib_mpool_calloc(pool, 1, sizeof(*target));
+        if (target == NULL) {
+            IB_FTRACE_RET_STATUS(IB_EALLOC);
+        }
+        target->field = sig->field;
+        target->flen = sig->flen;
+        rc = ib_list_create(&target->groups, pool);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+        rc = ib_list_push(cfg->target[sig->phase], target);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+    }
+
+    /* Pipelines are shared by spec, so compare by pointer. */
+    IB_LIST_LOOP(target->groups, node) {
+        group = (pocsig_group_t *)ib_list_node_data(node);
+
+        if (group->tfn == sig->tfn) {
+            *pgroup = group;
+            IB_FTRACE_RET_STATUS(IB_OK);
+        }
+    }
+
+    group = (pocsig_group_t *)ib_mpool_calloc(pool, 1, sizeof(*group));
+    if (group == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    group->target = sig->target;
+    group->tfn = sig->tfn;
+    rc = ib_list_create(&group->sigs, pool);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    rc = ib_list_push(target->groups, group);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    rc = ib_list_push(pocsig_groups, group);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    *pgroup = group;
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Add a signature to the group for its phase and target.
+ *
+ * Signatures with a named operator are tested on their own. With a
+ * multi-pattern matcher the pattern is added to the group combined
+ * matcher. Otherwise the literal required by a regex pattern
+ * is found, to be added to the group prefilter when configuration is
+ * finished.
+ *
+ * @param ib Engine
+ * @param ctx Config context
+ * @param cfg Module configuration for the context
+ * @param sig Signature
+ *
+ * @returns Status code
+ */
+static ib_status_t pocsig_group_add(ib_engine_t *ib,
+                                    ib_context_t *ctx,
+                                    pocsig_cfg_t *cfg,
+                                    pocsig_sig_t *sig)
+{
+    IB_FTRACE_INIT(pocsig_group_add);
+    ib_mpool_t *pool = ib_engine_pool_config_get(ib);
+    const char *key = sig->routed ? POCSIG_ROUTE_KEY : pocsig_matcher_key(ctx);
+    pocsig_group_t *group;
+    const char *errptr;
+    int erroff;
+    ib_status_t rc;
+
+    rc = pocsig_group_get(ib, cfg, sig, &group);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    sig->idx = group->nsigs++;
+    rc = ib_list_push(group->sigs, sig);
+    if ((rc != IB_OK) || (sig->op != NULL)) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    /* The group combined matcher is of the first multi-pattern matcher
+     * used; signatures using another are matched on their own. The
+     * matcher is only kept once a pattern has been added to it, so a
+     * group never has an empty combined matcher.
+     */
+    if (pocsig_multi(key)
+        && ((group->set == NULL) || (strcmp(group->setkey, key) == 0)))
+    {
+        ib_matcher_t *set = group->set;
+
+        if (set == NULL) {
+            rc = ib_matcher_create(ib, pool, key, &set);
+            if (rc != IB_OK) {
+                IB_FTRACE_RET_STATUS(rc);
+            }
+        }
+        rc = ib_matcher_add_pattern(set, sig->patt,
+                                    (ib_num_t)sig->idx,
+                                    &errptr, &erroff);
+        if (rc == IB_OK) {
+            group->set = set;
+            group->setkey = key;
+            sig->inset = 1;
+            group->nset++;
+            IB_FTRACE_RET_STATUS(IB_OK);
+        }
+    }
+
+    /* Only regex patterns have literals found, which are always in the
+     * syntax the "dfa" matcher parses.
+     */
+    if (!pocsig_backtracks(key) && (strcmp(key, "dfa") != 0)) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+    rc = ib_re_literal(sig->patt, 0, pool, &sig->lit, &sig->litlen);
+    if (rc == IB_OK) {
+        group->nlits++;
+    }
+    else if (rc == IB_EALLOC) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Build the prefilter automaton of a signature group (a configuration
+ * job).
+ *
+ * The prefilter is only used once built.
+ *
+ * @param data Signature group
+ * @param pool Unused
+ * @param perr Address which an error message is written on failure
+ *
+ * @returns Status code
+ */
+static ib_status_t pocsig_prefilter_job(void *data,
+                                        ib_mpool_t *pool,
+                                        const char **perr)
+{
+    pocsig_group_t *group = (pocsig_group_t *)data;
+    ib_status_t rc;
+
+    rc = ib_ac_build(group->building);
+    if (rc != IB_OK) {
+        *perr = "PocSig: Failed to build prefilter";
+        return rc;
+    }
+    group->prefilter = group->building;
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Queue building the prefilter for a signature group.
+ *
+ * @param ib Engine
+ * @param group Signature group
+ *
+ * @returns Status code
+ */
+static ib_status_t pocsig_prefilter_build(ib_engine_t *ib,
+                                          pocsig_group_t *group)
+{
+    IB_FTRACE_INIT(pocsig_prefilter_build);
+    ib_list_node_t *node;
+    ib_mpool_t *pool;
+    ib_ac_t *ac;
+    ib_status_t rc;
+
+    if (group->nlits == 0) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    /* Prefilters are built concurrently, so each is allocated from
+     * its own pool.
+     */
+    rc = ib_mpool_create(&pool, ib_engine_pool_config_get(ib));
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    rc = ib_ac_create(&ac, pool, IB_AC_FNOCASE);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    IB_LIST_LOOP(group->sigs, node) {
+        const pocsig_sig_t *s = (const pocsig_sig_t *)ib_list_node_data(node);
+
+        if (s->lit == NULL) {
+            continue;
+        }
+        rc = ib_ac_add_pattern(ac, s->lit, s->litlen, (ib_num_t)s->idx);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(rc);
+        }
+    }
+
+    group->building = ac;
+    rc = ib_cfgjob_add(ib, NULL, 0, pocsig_prefilter_job, group);
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+
+/* -- Signature Programs -- */
+
+/**
+ * @internal
+ * Emit an instruction, or only count it if sizing the program.
+ *
+ * @param prog Program (or NULL if sizing)
+ * @param pn Address of the number of instructions (incremented)
+ * @param op Opcode
+ * @param sig Signature operand (or NULL)
+ * @param group Group operand (or NULL)
+ *
+ * @returns Index of the instruction
+ */
+static size_t pocsig_emit(pocsig_insn_t *prog,
+                          size_t *pn,
+                          pocsig_opcode_t op,
+                          pocsig_sig_t *sig,
+                          const pocsig_group_t *group)
+{
+    size_t i = (*pn)++;
+
+    if (prog != NULL) {
+        prog[i].op = (uint32_t)op;
+        prog[i].jmp = 0;
+        if (group != NULL) {
+            prog[i].arg.group = group;
+        }
+        else {
+            prog[i].arg.sig = sig;
+        }
+    }
+
+    return i;
+}
+
+/**
+ * @internal
+ * Set where an instruction jumps to on failure.
+ *
+ * @param prog Program (or NULL if sizing)
+ * @param i Index of the instruction
+ * @param jmp Index of the instruction jumped to
+ */
+static void pocsig_patch(pocsig_insn_t *prog,
+                         size_t i,
+                         size_t jmp)
+{
+    if (prog != NULL) {
+        prog[i].jmp = (uint32_t)jmp;
+    }
+}
+
+/**
+ * @internal
+ * Emit the test of a signature (other than in a combined matcher).
+ *
+ * @param prog Program (or NULL if sizing)
+ * @param pn Address of the number of instructions
+ * @param s Signature
+ *
+ * @returns Index of the instruction
+ */
+static size_t pocsig_emit_test(pocsig_insn_t *prog,
+                               size_t *pn,
+                               pocsig_sig_t *s)
+{
+    return pocsig_emit(prog, pn,
+                       (s->op != NULL) ? POCSIG_OP_OPER : POCSIG_OP_MATCH,
+                       s, NULL);
+}
+
+/**
+ * @internal
+ * Emit the program of a phase for a layer of configuration.
+ *
+ * The layers inherited are emitted first. Then for each target, the
+ * field is fetched once and each group is run against it through the
+ * group transformations, testing each signature of the group and
+ * logging an event if it passes. Last, the conditions of each chain
+ * are tested in order, stopping at the first which fails, and the
+ * event of the first signature of the chain is logged if all pass.
+ *
+ * @param layer Configuration layer
+ * @param phase Phase
+ * @param prog Program (or NULL if sizing)
+ * @param pn Address of the number of instructions
+ */
+static void pocsig_prog_layer(const pocsig_cfg_t *layer,
+                              pocsig_phase_t phase,
+                              pocsig_insn_t *prog,
+                              size_t *pn)
+{
+    ib_list_node_t *tnode;
+    ib_list_node_t *gnode;
+    ib_list_node_t *snode;
+
+    if (layer->base != NULL) {
+        pocsig_prog_layer(layer->base, phase, prog, pn);
+    }
+
+    if (layer->target[phase] != NULL) {
+        IB_LIST_LOOP(layer->target[phase], tnode) {
+            pocsig_target_t *t = (pocsig_target_t *)ib_list_node_data(tnode);
+            pocsig_group_t *g0 = (pocsig_group_t *)
+                ib_list_node_data(ib_list_first(t->groups));
+            size_t fetch;
+
+            /* Any signature of the target fetches the same field. */
+            fetch = pocsig_emit(prog, pn, POCSIG_OP_FETCH,
+                (pocsig_sig_t *)ib_list_node_data(ib_list_first(g0->sigs)),
+                NULL);
+
+            IB_LIST_LOOP(t->groups, gnode) {
+                pocsig_group_t *g = (pocsig_group_t *)ib_list_node_data(gnode);
+                size_t tfn;
+
+                /* Any signature of the group has the same tfns. */
+                tfn = pocsig_emit(prog, pn, POCSIG_OP_TFN,
+                    (pocsig_sig_t *)ib_list_node_data(ib_list_first(g->sigs)),
+                    NULL);
+                pocsig_emit(prog, pn, POCSIG_OP_GROUP, NULL, g);
+
+                IB_LIST_LOOP(g->sigs, snode) {
+                    pocsig_sig_t *s = (pocsig_sig_t *)ib_list_node_data(snode);
+                    size_t test;
+
+                    if (s->inset) {
+                        test = pocsig_emit(prog, pn, POCSIG_OP_SET, s, NULL);
+                    }
+                    else {
+                        test = pocsig_emit_test(prog, pn, s);
+                    }
+                    pocsig_emit(prog, pn, POCSIG_OP_EVENT, s, NULL);
+                    pocsig_patch(prog, test, *pn);
+                }
+
+                pocsig_patch(prog, tfn, *pn);
+            }
+
+            pocsig_patch(prog, fetch, *pn);
+        }
+    }
+
+    if (layer->phase[phase] != NULL) {
+        IB_LIST_LOOP(layer->phase[phase], snode) {
+            pocsig_sig_t *s = (pocsig_sig_t *)ib_list_node_data(snode);
+            pocsig_sig_t *c;
+            size_t first = *pn;
+            size_t i;
+
+            if (!s->chained || s->inchain) {
+                continue;
+            }
+
+            for (c = s; c != NULL; c = c->next) {
+                pocsig_emit(prog, pn, POCSIG_OP_FETCH, c, NULL);
+                pocsig_emit(prog, pn, POCSIG_OP_TFN, c, NULL);
+                pocsig_emit_test(prog, pn, c);
+            }
+            pocsig_emit(prog, pn, POCSIG_OP_EVENT, s, NULL);
+
+            /* Any failure skips the rest of the chain. */
+            for (i = first; i < *pn - 1; i++) {
+                pocsig_patch(prog, i, *pn);
+            }
+        }
+    }
+}
+
+/** Opcode names (for program tracing) */
+static const char *pocsig_opcode_name[POCSIG_OP_NUM] = {
+    "END",
+    "FETCH",
+    "TFN",
+    "GROUP",
+    "SET",
+    "MATCH",
+    "OPER",
+    "EVENT"
+};
+
+/**
+ * @internal
+ * Compile the program of a phase for a configuration.
+ *
+ * @param ib Engine
+ * @param cfg Module configuration
+ * @param phase Phase
+ * @param pn Address of the total number of instructions (updated)
+ *
+ * @returns Status code
+ */
+static ib_status_t pocsig_prog_compile(ib_engine_t *ib,
+                                       pocsig_cfg_t *cfg,
+                                       pocsig_phase_t phase,
+                                       size_t *pn)
+{
+    IB_FTRACE_INIT(pocsig_prog_compile);
+    pocsig_insn_t *prog;
+    size_t n = 0;
+    size_t i;
+
+    /* Size, then emit. */
+    pocsig_prog_layer(cfg, phase, NULL, &n);
+    if (n == 0) {
+        cfg->prog[phase] = NULL;
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    prog = (pocsig_insn_t *)ib_mpool_alloc(ib_engine_pool_config_get(ib),
+                                           (n + 1) * sizeof(*prog));
+    if (prog == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    n = 0;
+    pocsig_prog_layer(cfg, phase, prog, &n);
+    pocsig_emit(prog, &n, POCSIG_OP_END, NULL, NULL);
+
+    ib_log_debug(ib, 9, "PocSig: Program for phase=%s ctx=%p:",
+                 pocsig_phase_name[phase], cfg->ctx);
+    for (i = 0; i < n; i++) {
+        const pocsig_insn_t *pc = &prog[i];
+
+        ib_log_debug(ib, 9, "PocSig:   %4zu: %-5s %4u %s",
+                     i, pocsig_opcode_name[pc->op], pc->jmp,
+                     (pc->op == POCSIG_OP_END) ? ""
+                     : (pc->op == POCSIG_OP_GROUP) ? pc->arg.group->target
+                     : (   (pc->op == POCSIG_OP_FETCH)
+                        || (pc->op == POCSIG_OP_TFN)) ? pc->arg.sig->target
+                     : pc->arg.sig->patt);
+    }
+
+    cfg->prog[phase] = prog;
+    *pn += n;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+
+/* -- Directive Handlers -- */
+
+/**
+ * @internal
+ * Handle an On/Off directive (PocSigTrace, PocSigProfile).
+ *
+ * @param cp Config parser
+ * @param name Directive name
+ * @param p1 First parameter
+ * @param cbdata Configuration field name (from directive registration)
+ *
+ * @returns Status code
+ */
+static ib_status_t pocsig_dir_onoff(ib_cfgparser_t *cp,
+                                    const char *name,
+                                    const char *p1,
+                                    void *cbdata)
+{
+    IB_FTRACE_INIT(pocsig_dir_onoff);
+    ib_engine_t *ib = cp->ib;
+    ib_context_t *ctx = cp->cur_ctx ? cp->cur_ctx : ib_context_main(ib);
+    const char *field = (const char *)cbdata;
+    ib_status_t rc;
+
+    ib_log_debug(ib, 7, "%s: \"%s\" ctx=%p", name, p1, ctx);
+    if (strcasecmp("On", p1) == 0) {
+        rc = ib_context_set_num(ctx, field, 1);
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    else if (strcasecmp("Off", p1) == 0) {
+        rc = ib_context_set_num(ctx, field, 0);
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    ib_log_error(ib, 1, "Failed to parse directive: %s \"%s\"", name, p1);
+    IB_FTRACE_RET_STATUS(IB_EINVAL);
+}
+
+/**
+ * @internal
+ * Handle a PocSigProfileDumpInterval directive.
+ *
+ * @param cp Config parser
+ * @param name Directive name
+ * @param p1 First parameter
+ * @param cbdata Callback data (from directive registration)
+ *
+ * @returns Status code
+ */
+static ib_status_t pocsig_dir_dump_interval(ib_cfgparser_t *cp,
+                                            const char *name,
+                                            const char *p1,
+                                            void *cbdata)
+{
+    IB_FTRACE_INIT(pocsig_dir_dump_interval);
+    ib_engine_t *ib = cp->ib;
+    long secs = strtol(p1, NULL, 10);
+
+    if (secs < 0) {
+        ib_log_error(ib, 1, "Failed to parse directive: %s \"%s\"", name, p1);
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    ib_log_debug(ib, 7, "%s: %ld", name, secs);
+    pocsig_prof.dump_interval = (time_t)secs;
+    pocsig_prof.dump_last = time(NULL);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Handle a PocSigProfileDumpSignal directive.
+ *
+ * The signal is a name (with or without "SIG") or a number, and is
+ * handled once configuration is finished.
+ *
+ * @param cp Config parser
+ * @param name Directive name
+ * @param p1 First parameter
+ * @param cbdata Callback data (from directive registration)
+ *
+ * @returns Status code
+ */
+static ib_status_t pocsig_dir_dump_signal(ib_cfgparser_t *cp,
+                                          const char *name,
+                                          const char *p1,
+                                          void *cbdata)
+{
+    IB_FTRACE_INIT(pocsig_dir_dump_signal);
+    static const struct {
+        const char     *name;
+        int             sig;
+    } sigs[] = {
+        { "HUP",  SIGHUP },
+        { "USR1", SIGUSR1 },
+        { "USR2", SIGUSR2 },
+        { NULL,   0 }
+    };
+    ib_engine_t *ib = cp->ib;
+    const char *signame = p1;
+    char *end;
+    long sig;
+    int i;
+
+    if (strncasecmp("SIG", signame, 3) == 0) {
+        signame += 3;
+    }
+    sig = 0;
+    for (i = 0; sigs[i].name != NULL; i++) {
+        if (strcasecmp(sigs[i].name, signame) == 0) {
+            sig = sigs[i].sig;
+            break;
+        }
+    }
+    if (sig == 0) {
+        sig = strtol(p1, &end, 10);
+        if ((end == p1) || (*end != '\0') || (sig <= 0) || (sig >= NSIG)) {
+            ib_log_error(ib, 1, "Failed to parse directive: %s \"%s\"",
+                         name, p1);
+            IB_FTRACE_RET_STATUS(IB_EINVAL);
+        }
+    }
+
+    ib_log_debug(ib, 7, "%s: %ld", name, sig);
+    pocsig_prof.dump_signal = (int)sig;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Handle a PocSig directive.
+ *
+ * @param cp Config parser
+ * @param name Directive name
+ * @param args List of directive arguments
+ * @param cbdata Callback data (from directive registration)
+ *
+ * @returns Status code
+ */
+static ib_status_t pocsig_dir_signature(ib_cfgparser_t *cp,
+                                        const char *name,
+                                        ib_list_t *args,
+                                        void *cbdata)
+{
+    IB_FTRACE_INIT(pocsig_dir_signature);
+    ib_engine_t *ib = cp->ib;
+    ib_context_t *ctx = cp->cur_ctx ? cp->cur_ctx : ib_context_main(ib);
+    ib_list_t *list;
+    const char *target;
+    const char *op;
+    const char *action;
+    const char *option;
+    int chained = 0;
+    pocsig_cfg_t *cfg;
+    pocsig_phase_t phase;
+    pocsig_sig_t *sig;
+    const char *errptr;
+    int erroff;
+    ib_status_t rc;
+
+    /* Get the pocsig configuration for this context. */
+    rc = ib_context_module_config(ctx, &IB_MODULE_SYM, (void *)&cfg);
+    if (rc != IB_OK) {
+        ib_log_error(ib, 1, "Failed to fetch %s config: %d",
+                     MODULE_NAME_STR, rc);
+    }
+    rc = pocsig_cfg_own(ctx, cfg);
+    if (rc != IB_OK) {
+        ib_log_error(ib, 1, "Failed to own %s config: %d",
+                     MODULE_NAME_STR, rc);
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    /* Determine phase and initialize the phase list if required. */
+    if (strcasecmp("PocSigPreTx", name) == 0) {
+        phase = POCSIG_PRE;
+        if (cfg->phase[phase] == NULL) {
+            rc = ib_list_create(cfg->phase + POCSIG_PRE,
+                                ib_engine_pool_config_get(ib));
+            if (rc != IB_OK) {
+                IB_FTRACE_RET_STATUS(rc);
+            }
+        }
+    }
+    else if (strcasecmp("PocSigReqHead", name) == 0) {
+        phase = POCSIG_REQHEAD;
+        if (cfg->phase[phase] == NULL) {
+            ib_log_debug(ib, 4, "Creating list for phase=%d", phase);
+            rc = ib_list_create(&list,
+                                ib_engine_pool_config_get(ib));
+            if (rc != IB_OK) {
+                IB_FTRACE_RET_STATUS(rc);
+            }
+            ib_log_debug(ib, 4, "List for phase=%d list=%p", phase, list);
+            cfg->phase[phase] = list;
+        }
+    }
+    else if (strcasecmp("PocSigReqBody", name) == 0) {
+        phase = POCSIG_REQBODY;
+        if (cfg->phase[phase] == NULL) {
+            rc = ib_list_create(&cfg->phase[phase],
+                                ib_engine_pool_config_get(ib));
+            if (rc != IB_OK) {
+                IB_FTRACE_RET_STATUS(rc);
+            }
+        }
+    }
+    else if (strcasecmp("PocSigReq", name) == 0) {
+        phase = POCSIG_REQ;
+        if (cfg->phase[phase] == NULL) {
+            rc = ib_list_create(&cfg->phase[phase],
+                                ib_engine_pool_config_get(ib));
+            if (rc != IB_OK) {
+                IB_FTRACE_RET_STATUS(rc);
+            }
+        }
+    }
+    else if (strcasecmp("PocSigResHead", name) == 0) {
+        phase = POCSIG_RESHEAD;
+        if (cfg->phase[phase] == NULL) {
+            rc = ib_list_create(&cfg->phase[phase],
+                                ib_engine_pool_config_get(ib));
+            if (rc != IB_OK) {
+                IB_FTRACE_RET_STATUS(rc);
+            }
+        }
+    }
+    else if (strcasecmp("PocSigResBody", name) == 0) {
+        phase = POCSIG_RESBODY;
+        if (cfg->phase[phase] == NULL) {
+            rc = ib_list_create(&cfg->phase[phase],
+                                ib_engine_pool_config_get(ib));
+            if (rc != IB_OK) {
+                IB_FTRACE_RET_STATUS(rc);
+            }
+        }
+    }
+    else if (strcasecmp("PocSigRes", name) == 0) {
+        phase = POCSIG_RES;
+        if (cfg->phase[POCSIG_RES] == NULL) {
+            rc = ib_list_create(&cfg->phase[POCSIG_RES],
+                                ib_engine_pool_config_get(ib));
+            if (rc != IB_OK) {
+                IB_FTRACE_RET_STATUS(rc);
+            }
+        }
+    }
+    else if (strcasecmp("PocSigPostTx", name) == 0) {
+        phase = POCSIG_POST;
+        if (cfg->phase[phase] == NULL) {
+            rc = ib_list_create(&cfg->phase[phase],
+                                ib_engine_pool_config_get(ib));
+            if (rc != IB_OK) {
+                IB_FTRACE_RET_STATUS(rc);
             }
         }
     }
@@ -232,135 +1427,877 @@ static ib_status_t pocsig_dir_signature(ib_cfgparser_t *cp,
         IB_FTRACE_RET_STATUS(IB_EINVAL);
     }
 
-    /* Target */
-    rc = ib_list_shift(args, &target);
+    /* Target */
+    rc = ib_list_shift(args, &target);
+    if (rc != IB_OK) {
+        ib_log_error(ib, 1, "No PocSig target");
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    /* Operator */
+    rc = ib_list_shift(args, &op);
+    if (rc != IB_OK) {
+        ib_log_error(ib, 1, "No PocSig operator");
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    /* Action */
+    rc = ib_list_shift(args, &action);
+    if (rc != IB_OK) {
+        ib_log_debug(ib, 4, "No PocSig action");
+        action = "";
+    }
+
+    /* Options */
+    while (ib_list_shift(args, &option) == IB_OK) {
+        if (strcasecmp("chain", option) == 0) {
+            chained = 1;
+        }
+        else {
+            ib_log_error(ib, 1, "Unknown PocSig option: %s", option);
+            IB_FTRACE_RET_STATUS(IB_EINVAL);
+        }
+    }
+    if ((chained || (cfg->chain[phase] != NULL))
+        && ((phase == POCSIG_REQBODY) || (phase == POCSIG_RESBODY)))
+    {
+        ib_log_error(ib, 1, "PocSig body signatures do not support "
+                     "chains: %s", target);
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    /* Signature */
+    sig = (pocsig_sig_t *)ib_mpool_alloc(ib_engine_pool_config_get(ib),
+                                         sizeof(*sig));
+    if (sig == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    sig->target = ib_mpool_memdup(ib_engine_pool_config_get(ib),
+                                  target, strlen(target) + 1);
+    sig->field = sig->target;
+    sig->flen = strlen(sig->target);
+    sig->tfn = NULL;
+    sig->op = NULL;
+    sig->patt = ib_mpool_memdup(ib_engine_pool_config_get(ib),
+                                 op, strlen(op) + 1);
+    sig->emsg = ib_mpool_memdup(ib_engine_pool_config_get(ib),
+                                action, strlen(action) + 1);
+    if ((sig->target == NULL) || (sig->patt == NULL) || (sig->emsg == NULL)) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    /* A target of "name.t(tfn,...)" has the transformations compiled
+     * now so that they are not parsed for every transaction.
+     */
+    if (sig->flen > 0 && sig->target[sig->flen - 1] == ')') {
+        const char *tfns = strstr(sig->target, ".t(");
+
+        if (tfns != NULL) {
+            char *spec;
+            size_t slen = (sig->target + sig->flen - 1) - (tfns + 3);
+
+            spec = (char *)ib_mpool_memdup(ib_engine_pool_config_get(ib),
+                                           tfns + 3, slen + 1);
+            if (spec == NULL) {
+                IB_FTRACE_RET_STATUS(IB_EALLOC);
+            }
+            spec[slen] = '\0';
+
+            rc = ib_tfn_pipeline_create(ib, spec, &sig->tfn);
+            if (rc != IB_OK) {
+                ib_log_error(ib, 1, "Invalid PocSig target transformations: %s",
+                             sig->target);
+                IB_FTRACE_RET_STATUS(rc);
+            }
+            sig->flen = tfns - sig->target;
+        }
+    }
+    sig->phase = phase;
+    sig->m = NULL;
+    sig->cpatt = NULL;
+    sig->risk = NULL;
+    sig->risk_off = 0;
+    sig->routed = 0;
+    sig->lit = NULL;
+    sig->litlen = 0;
+    sig->idx = 0;
+    sig->inset = 0;
+    sig->chained = chained;
+    sig->inchain = (cfg->chain[phase] != NULL);
+    sig->next = NULL;
+    memset(&sig->prof, 0, sizeof(sig->prof));
+
+    /* An operator of "@name params" is a named operator, except for
+     * "@rx patt" which is the same as "patt".
+     */
+    if (op[0] == '@') {
+        size_t nlen = strcspn(op + 1, " \t");
+        const char *params = op + 1 + nlen;
+        char *opname;
+
+        params += strspn(params, " \t");
+        if ((nlen == 2) && (strncmp(op + 1, "rx", 2) == 0)) {
+            sig->patt = sig->patt + (params - op);
+        }
+        else if ((phase == POCSIG_REQBODY) || (phase == POCSIG_RESBODY)) {
+            ib_log_error(ib, 1, "PocSig body signatures only support "
+                         "regex patterns: %s", op);
+            IB_FTRACE_RET_STATUS(IB_EINVAL);
+        }
+        else {
+            opname = (char *)ib_mpool_memdup(ib_engine_pool_config_get(ib),
+                                             op + 1, nlen + 1);
+            if (opname == NULL) {
+                IB_FTRACE_RET_STATUS(IB_EALLOC);
+            }
+            opname[nlen] = '\0';
+
+            rc = ib_operator_inst_create(ib, ib_engine_pool_config_get(ib),
+                                         opname, params, &sig->op);
+            if (rc == IB_ENOENT) {
+                ib_log_error(ib, 1, "Unknown PocSig operator: %s", opname);
+                IB_FTRACE_RET_STATUS(IB_EINVAL);
+            }
+            else if (rc != IB_OK) {
+                ib_log_error(ib, 1, "Invalid PocSig operator: %s", op);
+                IB_FTRACE_RET_STATUS(IB_EINVAL);
+            }
+        }
+    }
+
+    /* Check regex patterns for catastrophic backtracking, which may
+     * route the signature to a linear-time matcher.
+     */
+    if (sig->op == NULL) {
+        pocsig_analyze(ib, ctx, cfg, sig);
+    }
+
+    /* Body signatures are all matched together on the streamed body,
+     * others compile the PCRE patt (unless tested by an operator).
+     */
+    if ((phase == POCSIG_REQBODY) || (phase == POCSIG_RESBODY)) {
+        ib_matcher_t **pm = (phase == POCSIG_REQBODY) ? &cfg->reqbody
+                                                      : &cfg->resbody;
+
+        if (sig->tfn != NULL) {
+            ib_log_error(ib, 1, "PocSig body signatures do not support "
+                         "transformations: %s", sig->target);
+            IB_FTRACE_RET_STATUS(IB_EINVAL);
+        }
+
+        if (*pm == NULL) {
+            rc = ib_matcher_create(ib, ib_engine_pool_config_get(ib),
+                                   pocsig_matcher_key(ctx), pm);
+            if (rc != IB_OK) {
+                ib_log_error(ib, 2, "Could not create a \"%s\" matcher: %d",
+                             pocsig_matcher_key(ctx), rc);
+                IB_FTRACE_RET_STATUS(rc);
+            }
+        }
+
+        /* The signature is the pattern ID. */
+        errptr = NULL;
+        erroff = 0;
+        rc = ib_matcher_add_pattern(*pm, sig->patt,
+                                    (ib_num_t)(uintptr_t)sig,
+                                    &errptr, &erroff);
+        if (rc != IB_OK) {
+            ib_log_error(ib, 2, "Error at offset=%d of PCRE patt=\"%s\": %s",
+                         erroff, sig->patt, errptr ? errptr : "");
+            IB_FTRACE_RET_STATUS(IB_EINVAL);
+        }
+    }
+    else if ((sig->op == NULL) && (sig->cpatt == NULL)) {
+        /* The patt is compiled with the others once configuration is
+         * finished, which also reports any error (and fails the
+         * configuration). Until then the signature is skipped. The
+         * matcher is only created for the first such signature.
+         */
+        if (cfg->pcre == NULL) {
+            rc = ib_matcher_create(ib, ib_engine_pool_config_get(ib),
+                                   pocsig_matcher_key(ctx), &cfg->pcre);
+            if (rc != IB_OK) {
+                ib_log_error(ib, 2, "Could not create a \"%s\" matcher "
+                             "(load the %s module?): %d",
+                             pocsig_matcher_key(ctx),
+                             pocsig_matcher_key(ctx), rc);
+                IB_FTRACE_RET_STATUS(rc);
+            }
+        }
+        sig->m = cfg->pcre;
+        rc = ib_matcher_compile_async(cfg->pcre, sig->patt, &sig->cpatt,
+                                      cp->cur_file, cp->cur_lineno);
+        if (rc != IB_OK) {
+            IB_FTRACE_RET_STATUS(IB_EINVAL);
+        }
+    }
+
+    ib_log_debug(ib, 4, "POCSIG: \"%s\" \"%s\" \"%s\" phase=%d ctx=%p",
+                 target, op, action, phase, ctx);
+
+    /* Add the signature to the phase list. */
+    rc = ib_list_push(cfg->phase[phase], sig);
     if (rc != IB_OK) {
-        ib_log_error(ib, 1, "No PocSig target");
-        IB_FTRACE_RET_STATUS(IB_EINVAL);
+        ib_log_error(ib, 1, "Failed to add signature");
+        IB_FTRACE_RET_STATUS(rc);
     }
 
-    /* Operator */
-    rc = ib_list_shift(args, &op);
+    /* A chain continues with the next signature of the phase. */
+    if (sig->inchain) {
+        cfg->chain[phase]->next = sig;
+    }
+    cfg->chain[phase] = sig->chained ? sig : NULL;
+
+    /* Group the signature by target and transformations, unless it is
+     * part of a chain (whose conditions are tested in order).
+     */
+    if (   (phase != POCSIG_REQBODY) && (phase != POCSIG_RESBODY)
+        && !sig->chained && !sig->inchain)
+    {
+        rc = pocsig_group_add(ib, ctx, cfg, sig);
+        if (rc != IB_OK) {
+            ib_log_error(ib, 1, "Failed to group signature");
+            IB_FTRACE_RET_STATUS(rc);
+        }
+    }
+
+    /* Track all signatures for profiling. */
+    rc = ib_list_push(pocsig_prof.sigs, sig);
+    if (rc != IB_OK) {
+        ib_log_error(ib, 1, "Failed to track signature");
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+
+/* -- Configuration Data -- */
+
+/* Configuration parameter initialization structure. */
+static IB_CFGMAP_INIT_STRUCTURE(pocsig_config_map) = {
+    /* trace */
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".trace",
+        IB_FTYPE_NUM,
+        &pocsig_global_cfg,
+        trace,
+        0
+    ),
+
+    /* profile */
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".profile",
+        IB_FTYPE_NUM,
+        &pocsig_global_cfg,
+        profile,
+        0
+    ),
+
+    /* redos_route */
+    IB_CFGMAP_INIT_ENTRY(
+        MODULE_NAME_STR ".redos_route",
+        IB_FTYPE_NUM,
+        &pocsig_global_cfg,
+        redos_route,
+        0
+    ),
+
+    /* End */
+    IB_CFGMAP_INIT_LAST
+};
+
+/* Directive initialization structure. */
+static IB_DIRMAP_INIT_STRUCTURE(pocsig_directive_map) = {
+    /* PocSigTrace - Enable/Disable tracing */
+    IB_DIRMAP_INIT_PARAM1(
+        "PocSigTrace",
+        pocsig_dir_onoff,
+        MODULE_NAME_STR ".trace"
+    ),
+
+    /* PocSigProfile - Enable/Disable per-signature profiling */
+    IB_DIRMAP_INIT_PARAM1(
+        "PocSigProfile",
+        pocsig_dir_onoff,
+        MODULE_NAME_STR ".profile"
+    ),
+
+    /* PocSigReDoSRoute - Route risky patterns to a linear-time matcher */
+    IB_DIRMAP_INIT_PARAM1(
+        "PocSigReDoSRoute",
+        pocsig_dir_onoff,
+        MODULE_NAME_STR ".redos_route"
+    ),
+
+    /* PocSigProfileDumpInterval - Log the profile every N seconds */
+    IB_DIRMAP_INIT_PARAM1(
+        "PocSigProfileDumpInterval",
+        pocsig_dir_dump_interval,
+        NULL
+    ),
+
+    /* PocSigProfileDumpSignal - Log the profile when signaled */
+    IB_DIRMAP_INIT_PARAM1(
+        "PocSigProfileDumpSignal",
+        pocsig_dir_dump_signal,
+        NULL
+    ),
+
+    /* PocSig* - Define a signature in various phases */
+    IB_DIRMAP_INIT_LIST(
+        "PocSigPreTx",
+        pocsig_dir_signature,
+        NULL
+    ),
+    IB_DIRMAP_INIT_LIST(
+        "PocSigReqHead",
+        pocsig_dir_signature,
+        NULL
+    ),
+    IB_DIRMAP_INIT_LIST(
+        "PocSigReqBody",
+        pocsig_dir_signature,
+        NULL
+    ),
+    IB_DIRMAP_INIT_LIST(
+        "PocSigReq",
+        pocsig_dir_signature,
+        NULL
+    ),
+    IB_DIRMAP_INIT_LIST(
+        "PocSigResHead",
+        pocsig_dir_signature,
+        NULL
+    ),
+    IB_DIRMAP_INIT_LIST(
+        "PocSigResBody",
+        pocsig_dir_signature,
+        NULL
+    ),
+    IB_DIRMAP_INIT_LIST(
+        "PocSigRes",
+        pocsig_dir_signature,
+        NULL
+    ),
+    IB_DIRMAP_INIT_LIST(
+        "PocSigPostTx",
+        pocsig_dir_signature,
+        NULL
+    ),
+
+    /* End */
+    IB_DIRMAP_INIT_LAST
+};
+
+
+/* -- Hook Handlers -- */
+
+/**
+ * @internal
+ * Log an event for a matched signature.
+ *
+ * @param ib Engine
+ * @param tx Transaction
+ * @param s Signature
+ */
+static void pocsig_event(ib_engine_t *ib,
+                         ib_tx_t *tx,
+                         const pocsig_sig_t *s)
+{
+    IB_FTRACE_INIT(pocsig_event);
+    ib_logevent_t *e;
+    ib_status_t rc;
+
+    /* Create the event. */
+    rc = ib_logevent_create(
+        &e,
+        tx->mp,
+        "-",
+        IB_LEVENT_TYPE_ALERT,
+        IB_LEVENT_ACT_UNKNOWN,
+        IB_LEVENT_PCLASS_UNKNOWN,
+        IB_LEVENT_SCLASS_UNKNOWN,
+        90,
+        80,
+        IB_LEVENT_SYS_UNKNOWN,
+        IB_LEVENT_ACTION_IGNORE,
+        IB_LEVENT_ACTION_IGNORE,
+        s->emsg
+    );
+    if (rc != IB_OK) {
+        ib_log_error(ib, 3, "PocSig: Error generating event: %d", rc);
+        IB_FTRACE_RET_VOID();
+    }
+
+    /* Log the event. */
+    ib_clog_event(tx->ctx, e);
+
+    IB_FTRACE_RET_VOID();
+}
+
+/**
+ * @internal
+ * Mark a signature that was matched (or whose literal was seen).
+ *
+ * @param cbdata Array of flags (by signature index in the group)
+ * @param id Signature index
+ * @param end Unused
+ *
+ * @returns IB_OK to continue matching
+ */
+static ib_status_t pocsig_mark(void *cbdata,
+                               ib_num_t id,
+                               size_t end)
+{
+    ((uint8_t *)cbdata)[id] = 1;
+
+    return IB_OK;
+}
+
+/* Dispatch program instructions with computed goto where available
+ * (define POCSIG_VM_NO_COMPUTED_GOTO to use the portable switch).
+ */
+#if defined(__GNUC__) && !defined(POCSIG_VM_NO_COMPUTED_GOTO)
+#define POCSIG_VM_COMPUTED_GOTO
+#endif
+
+#ifdef POCSIG_VM_COMPUTED_GOTO
+#define POCSIG_VM_OP(name)  op_##name:
+#define POCSIG_VM_NEXT()    goto *dispatch[pc->op]
+#else
+#define POCSIG_VM_OP(name)  case POCSIG_OP_##name:
+#define POCSIG_VM_NEXT()    goto dispatch
+#endif
+
+/** Continue with the next instruction. */
+#define POCSIG_VM_PASS()    do { pc++; POCSIG_VM_NEXT(); } while (0)
+
+/** Continue with the instruction jumped to on failure. */
+#define POCSIG_VM_FAIL()    do { pc = prog + pc->jmp; POCSIG_VM_NEXT(); } while (0)
+
+/**
+ * @internal
+ * Run a signature program.
+ *
+ * The state is the fetched and transformed target field, and the
+ * results of the combined matcher and prefilter of the last group.
+ * These are only valid for the instructions which follow a FETCH and
+ * TFN (or GROUP), as emitted by pocsig_prog_layer().
+ *
+ * @param ib Engine
+ * @param tx Transaction
+ * @param cfg Module configuration for the transaction context
+ * @param prog Program
+ * @param dbglvl Trace log level
+ */
+static void pocsig_prog_exec(ib_engine_t *ib,
+                             ib_tx_t *tx,
+                             const pocsig_cfg_t *cfg,
+                             const pocsig_insn_t *prog,
+                             int dbglvl)
+{
+    IB_FTRACE_INIT(pocsig_prog_exec);
+#ifdef POCSIG_VM_COMPUTED_GOTO
+    static const void *dispatch[POCSIG_OP_NUM] = {
+        &&op_END,
+        &&op_FETCH,
+        &&op_TFN,
+        &&op_GROUP,
+        &&op_SET,
+        &&op_MATCH,
+        &&op_OPER,
+        &&op_EVENT
+    };
+#endif
+    const pocsig_insn_t *pc = prog;
+    const pocsig_group_t *g;
+    pocsig_sig_t *s;
+    ib_field_t *src = NULL;
+    ib_field_t *f = NULL;
+    const uint8_t *data = NULL;
+    size_t bytes = 0;
+    uint8_t *matched = NULL;
+    uint8_t *seen = NULL;
+    uint64_t setnsec = 0;
+    uint64_t start = 0;
+    ib_status_t rc;
+
+#ifdef POCSIG_VM_COMPUTED_GOTO
+    POCSIG_VM_NEXT();
+#else
+dispatch:
+    switch (pc->op) {
+#endif
+
+    /* Fetch the target field of a signature. */
+    POCSIG_VM_OP(FETCH)
+        s = pc->arg.sig;
+        rc = ib_data_get_ex(tx->dpi, s->field, s->flen, &src);
+        if (rc != IB_OK) {
+            ib_log_error(ib, 4, "PocSig: No field named \"%.*s\"",
+                         (int)s->flen, s->field);
+            POCSIG_VM_FAIL();
+        }
+        POCSIG_VM_PASS();
+
+    /* Transform the target field with the tfns of a signature. */
+    POCSIG_VM_OP(TFN)
+        s = pc->arg.sig;
+        f = src;
+        if (s->tfn != NULL) {
+            rc = ib_tx_field_tfn_get(tx, src, &f, s->tfn);
+            if (rc != IB_OK) {
+                ib_log_error(ib, 4, "PocSig: Failed to transform "
+                             "field \"%s\": %d", s->target, rc);
+                POCSIG_VM_FAIL();
+            }
+        }
+        data = NULL;
+        bytes = 0;
+        if (f->type == IB_FTYPE_BYTESTR) {
+            data = ib_bytestr_ptr(ib_field_value_bytestr(f));
+            bytes = ib_bytestr_length(ib_field_value_bytestr(f));
+        }
+        else if (f->type == IB_FTYPE_NULSTR) {
+            data = (const uint8_t *)ib_field_value_nulstr(f);
+            bytes = strlen((const char *)data);
+        }
+        matched = NULL;
+        seen = NULL;
+        POCSIG_VM_PASS();
+
+    /* Match all the signatures in the group combined matcher at once
+     * and find which literals are in the field.
+     */
+    POCSIG_VM_OP(GROUP)
+        g = pc->arg.group;
+        if (g->set != NULL) {
+            matched = (uint8_t *)ib_mpool_calloc(tx->mp, g->nsigs, 1);
+        }
+        if (matched != NULL) {
+            ib_log_debug(ib, dbglvl, "PocSig: Matching %zu signatures "
+                         "against field \"%s\"", g->nset, g->target);
+            if (cfg->profile) {
+                setnsec = pocsig_clock();
+            }
+            rc = ib_matcher_exec_field(g->set, 0, f, pocsig_mark, matched);
+            if (cfg->profile) {
+                /* The pass is shared, so spread its cost over the group. */
+                setnsec = (pocsig_clock() - setnsec) / g->nset;
+            }
+            if (rc == IB_ELIMIT) {
+                ib_log_error(ib, 3, "PocSig: Match limit exceeded for %zu "
+                             "signatures against field \"%s\"",
+                             g->nset, g->target);
+            }
+        }
+        if ((g->prefilter != NULL) && (data != NULL)) {
+            seen = (uint8_t *)ib_mpool_calloc(tx->mp, g->nsigs, 1);
+            if (seen != NULL) {
+                ib_ac_match(g->prefilter, data, bytes, pocsig_mark, seen);
+            }
+        }
+        POCSIG_VM_PASS();
+
+    /* Test if the group combined matcher matched a signature. */
+    POCSIG_VM_OP(SET)
+        s = pc->arg.sig;
+        if (cfg->profile) {
+            pocsig_prof_record(s, setnsec, bytes,
+                               (matched != NULL) && matched[s->idx]);
+        }
+        if ((matched == NULL) || !matched[s->idx]) {
+            POCSIG_VM_FAIL();
+        }
+        POCSIG_VM_PASS();
+
+    /* Test a signature pattern, unless its literal was not seen. */
+    POCSIG_VM_OP(MATCH)
+        s = pc->arg.sig;
+        if ((seen != NULL) && (s->lit != NULL) && !seen[s->idx]) {
+            ib_log_debug(ib, dbglvl, "PocSig: Prefilter skipped \"%s\" "
+                         "against field \"%s\"", s->patt, s->target);
+            if (cfg->profile) {
+                __sync_fetch_and_add(&s->prof.skips, 1);
+            }
+            POCSIG_VM_FAIL();
+        }
+
+        /* Failed to compile (logged when configuration finished). */
+        if (s->cpatt == NULL) {
+            POCSIG_VM_FAIL();
+        }
+
+        ib_log_debug(ib, dbglvl, "PocSig: Matching \"%s\" against "
+                     "field \"%s\"", s->patt, s->target);
+        if (cfg->profile) {
+            start = pocsig_clock();
+        }
+        rc = ib_matcher_match_field(s->m, s->cpatt, 0, f);
+        goto tested;
+
+    /* Test a signature operator. */
+    POCSIG_VM_OP(OPER)
+        s = pc->arg.sig;
+        ib_log_debug(ib, dbglvl, "PocSig: Testing \"%s\" against "
+                     "field \"%s\"", s->patt, s->target);
+        if (cfg->profile) {
+            start = pocsig_clock();
+        }
+        rc = ib_operator_execute(s->op, tx->mp, f);
+
+    tested:
+        if (cfg->profile) {
+            pocsig_prof_record(s, pocsig_clock() - start, bytes,
+                               (rc == IB_OK));
+        }
+        if (rc == IB_OK) {
+            POCSIG_VM_PASS();
+        }
+        if (rc == IB_ELIMIT) {
+            ib_log_error(ib, 3, "PocSig: Match limit exceeded for \"%s\" "
+                         "against field \"%s\"", s->patt, s->target);
+        }
+        else {
+            ib_log_debug(ib, dbglvl, "PocSig NOMATCH");
+        }
+        POCSIG_VM_FAIL();
+
+    /* Log the event of a signature. */
+    POCSIG_VM_OP(EVENT)
+        s = pc->arg.sig;
+        ib_log_debug(ib, dbglvl, "PocSig MATCH: %s at %s",
+                     s->patt, s->target);
+        pocsig_event(ib, tx, s);
+        POCSIG_VM_PASS();
+
+    POCSIG_VM_OP(END)
+        IB_FTRACE_RET_VOID();
+
+#ifndef POCSIG_VM_COMPUTED_GOTO
+    }
+
+    IB_FTRACE_RET_VOID();
+#endif
+}
+
+/**
+ * @internal
+ * Handle signature execution.
+ *
+ * @param ib Engine
+ * @param tx Transaction
+ * @param cbdata Phase passed as pointer value
+ *
+ * @return Status code
+ */
+static ib_status_t pocsig_handle_sigs(ib_engine_t *ib,
+                                      ib_tx_t *tx,
+                                      void *cbdata)
+{
+    IB_FTRACE_INIT(pocsig_handle_post);
+    pocsig_cfg_t *cfg;
+    pocsig_phase_t phase = (pocsig_phase_t)(uintptr_t)cbdata;
+    size_t nsigs;
+    int dbglvl;
+    ib_status_t rc;
+
+    /* Get the pocsig configuration for this context. */
+    rc = ib_context_module_config(tx->ctx, &IB_MODULE_SYM, (void *)&cfg);
     if (rc != IB_OK) {
-        ib_log_error(ib, 1, "No PocSig operator");
-        IB_FTRACE_RET_STATUS(IB_EINVAL);
+        ib_log_error(ib, 1, "Failed to fetch %s config: %d",
+                     MODULE_NAME_STR, rc);
     }
 
-    /* Action */
-    rc = ib_list_shift(args, &action);
-    if (rc != IB_OK) {
-        ib_log_debug(ib, 4, "No PocSig action");
-        action = "";
+    /* If tracing is enabled, lower the log level. */
+    dbglvl = cfg->trace ? 4 : 9;
+
+    /* Dump the profile as transactions finish, with or without
+     * signatures for this phase.
+     */
+    if (phase == POCSIG_POST) {
+        pocsig_prof_periodic(ib);
     }
 
-    /* Signature */
-    sig = (pocsig_sig_t *)ib_mpool_alloc(ib_engine_pool_config_get(ib),
-                                         sizeof(*sig));
-    if (sig == NULL) {
-        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    nsigs = pocsig_phase_count(cfg, phase);
+    if (nsigs == 0) {
+        ib_log_debug(ib, dbglvl, "No signatures for phase=%d ctx=%p",
+                     phase, tx->ctx);
+        IB_FTRACE_RET_STATUS(IB_OK);
     }
 
-    sig->target = ib_mpool_memdup(ib_engine_pool_config_get(ib),
-                                  target, strlen(target));
-    sig->patt = ib_mpool_memdup(ib_engine_pool_config_get(ib),
-                                 op, strlen(op));
-    sig->emsg = ib_mpool_memdup(ib_engine_pool_config_get(ib),
-                                action, strlen(action));
+    ib_log_debug(ib, dbglvl, "Executing %zu signatures for phase=%d ctx=%p",
+                 nsigs, phase, tx->ctx);
 
-    /* Compile the PCRE patt. */
-    if (cfg->pcre == NULL) {
-        ib_log_error(ib, 2, "No PCRE matcher available (load the pcre module?)");
-        IB_FTRACE_RET_STATUS(IB_EINVAL);
-    }
-    sig->cpatt = ib_matcher_compile(cfg->pcre, sig->patt, &errptr, &erroff);
-    if (sig->cpatt == NULL) {
-        ib_log_error(ib, 2, "Error at offset=%d of PCRE patt=\"%s\": %s",
-                     erroff, sig->patt, errptr);
-        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    /* Run the program of all the sigs for this phase. */
+    if (cfg->prog[phase] != NULL) {
+        pocsig_prog_exec(ib, tx, cfg, cfg->prog[phase], dbglvl);
     }
 
-    ib_log_debug(ib, 4, "POCSIG: \"%s\" \"%s\" \"%s\" phase=%d ctx=%p",
-                 target, op, action, phase, ctx);
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
 
-    /* Add the signature to the phase list. */
-    rc = ib_list_push(cfg->phase[phase], sig);
-    if (rc != IB_OK) {
-        ib_log_error(ib, 1, "Failed to add signature");
+/**
+ * @internal
+ * Body match callback data.
+ */
+typedef struct {
+    ib_tx_t            *tx;       /**< Transaction */
+    int                 dbglvl;   /**< Trace log level */
+} pocsig_body_cbdata_t;
+
+/**
+ * @internal
+ * Handle a body signature match.
+ *
+ * @param cbdata Body match callback data
+ * @param id Signature (as the pattern ID)
+ * @param end Offset in the body just past the match
+ *
+ * @returns IB_OK to continue matching
+ */
+static ib_status_t pocsig_body_match(void *cbdata,
+                                     ib_num_t id,
+                                     size_t end)
+{
+    IB_FTRACE_INIT(pocsig_body_match);
+    pocsig_body_cbdata_t *cb = (pocsig_body_cbdata_t *)cbdata;
+    const pocsig_sig_t *s = (const pocsig_sig_t *)(uintptr_t)id;
+    ib_engine_t *ib = cb->tx->ib;
+
+    ib_log_debug(ib, cb->dbglvl, "PocSig MATCH: %s at %s offset=%zu",
+                 s->patt, s->target, end);
+    pocsig_event(ib, cb->tx, s);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Get the body matcher streams for a transaction.
+ *
+ * There is a stream per configuration layer (indexed by its depth),
+ * each created on the first body chunk and kept in the transaction
+ * data until the body is finished.
+ *
+ * @param tx Transaction
+ * @param cfg Module configuration for the transaction context
+ * @param phase Body phase
+ * @param create Create the streams if they do not exist
+ * @param pstreams Address which the stream array is written
+ *
+ * @returns Status code
+ */
+static ib_status_t pocsig_body_streams(ib_tx_t *tx,
+                                       const pocsig_cfg_t *cfg,
+                                       pocsig_phase_t phase,
+                                       int create,
+                                       ib_matcher_stream_t ***pstreams)
+{
+    IB_FTRACE_INIT(pocsig_body_streams);
+    const char *key = (phase == POCSIG_REQBODY) ? MODULE_NAME_STR ".reqbody"
+                                                : MODULE_NAME_STR ".resbody";
+    ib_status_t rc;
+
+    rc = ib_hash_get(tx->data, key, (void *)pstreams);
+    if ((rc == IB_OK) || !create) {
         IB_FTRACE_RET_STATUS(rc);
     }
 
-    IB_FTRACE_RET_STATUS(IB_OK);
+    *pstreams = (ib_matcher_stream_t **)ib_mpool_calloc(tx->mp,
+                                                        cfg->depth + 1,
+                                                        sizeof(**pstreams));
+    if (*pstreams == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    rc = ib_hash_set(tx->data, key, *pstreams);
+    IB_FTRACE_RET_STATUS(rc);
 }
 
+/**
+ * @internal
+ * Handle body signatures on a chunk of transaction data.
+ *
+ * The chunk is fed to the body matcher of each configuration layer.
+ *
+ * @param ib Engine
+ * @param txdata Transaction data
+ * @param cbdata Phase passed as pointer value
+ *
+ * @return Status code
+ */
+static ib_status_t pocsig_handle_body(ib_engine_t *ib,
+                                      ib_txdata_t *txdata,
+                                      void *cbdata)
+{
+    IB_FTRACE_INIT(pocsig_handle_body);
+    pocsig_phase_t phase = (pocsig_phase_t)(uintptr_t)cbdata;
+    ib_tx_t *tx = txdata->tx;
+    pocsig_body_cbdata_t cb;
+    ib_matcher_stream_t **streams = NULL;
+    const pocsig_cfg_t *layer;
+    pocsig_cfg_t *cfg;
+    ib_status_t rc;
 
-/* -- Configuration Data -- */
+    if (txdata->dtype != IB_DTYPE_HTTP_BODY) {
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
 
-/* Configuration parameter initialization structure. */
-static IB_CFGMAP_INIT_STRUCTURE(pocsig_config_map) = {
-    /* trace */
-    IB_CFGMAP_INIT_ENTRY(
-        MODULE_NAME_STR ".trace",
-        IB_FTYPE_NUM,
-        &pocsig_global_cfg,
-        trace,
-        0
-    ),
+    /* Get the pocsig configuration for this context. */
+    rc = ib_context_module_config(tx->ctx, &IB_MODULE_SYM, (void *)&cfg);
+    if (rc != IB_OK) {
+        ib_log_error(ib, 1, "Failed to fetch %s config: %d",
+                     MODULE_NAME_STR, rc);
+        IB_FTRACE_RET_STATUS(rc);
+    }
 
-    /* End */
-    IB_CFGMAP_INIT_LAST
-};
+    cb.tx = tx;
+    cb.dbglvl = cfg->trace ? 4 : 9;
 
-/* Directive initialization structure. */
-static IB_DIRMAP_INIT_STRUCTURE(pocsig_directive_map) = {
-    /* PocSigTrace - Enable/Disable tracing */
-    IB_DIRMAP_INIT_PARAM1(
-        "PocSigTrace",
-        pocsig_dir_trace,
-        NULL
-    ),
+    for (layer = cfg; layer != NULL; layer = layer->base) {
+        ib_matcher_t *m = (phase == POCSIG_REQBODY) ? layer->reqbody
+                                                    : layer->resbody;
+        ib_matcher_stream_t **pms;
 
-    /* PocSig* - Define a signature in various phases */
-    IB_DIRMAP_INIT_LIST(
-        "PocSigPreTx",
-        pocsig_dir_signature,
-        NULL
-    ),
-    IB_DIRMAP_INIT_LIST(
-        "PocSigReqHead",
-        pocsig_dir_signature,
-        NULL
-    ),
-    IB_DIRMAP_INIT_LIST(
-        "PocSigReq",
-        pocsig_dir_signature,
-        NULL
-    ),
-    IB_DIRMAP_INIT_LIST(
-        "PocSigResHead",
-        pocsig_dir_signature,
-        NULL
-    ),
-    IB_DIRMAP_INIT_LIST(
-        "PocSigRes",
-        pocsig_dir_signature,
-        NULL
-    ),
-    IB_DIRMAP_INIT_LIST(
-        "PocSigPostTx",
-        pocsig_dir_signature,
-        NULL
-    ),
+        if (m == NULL) {
+            continue;
+        }
 
-    /* End */
-    IB_DIRMAP_INIT_LAST
-};
+        if (streams == NULL) {
+            rc = pocsig_body_streams(tx, cfg, phase, 1, &streams);
+            if (rc != IB_OK) {
+                ib_log_error(ib, 3, "PocSig: Failed to create body "
+                             "streams: %d", rc);
+                IB_FTRACE_RET_STATUS(IB_OK);
+            }
+        }
+
+        pms = &streams[layer->depth];
+        if (*pms == NULL) {
+            rc = ib_matcher_stream_create(m, tx->mp, pms);
+            if (rc != IB_OK) {
+                ib_log_error(ib, 3, "PocSig: Failed to create body "
+                             "stream: %d", rc);
+                continue;
+            }
+        }
 
+        rc = ib_matcher_stream_feed(*pms, 0, txdata->data, txdata->dlen,
+                                    pocsig_body_match, &cb);
+        if ((rc != IB_OK) && (rc != IB_ENOENT)) {
+            ib_log_error(ib, 3, "PocSig: Error matching body: %d", rc);
+        }
+    }
 
-/* -- Hook Handlers -- */
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
 
 /**
  * @internal
- * Handle signature execution.
+ * Finish body signatures once the body is complete.
  *
  * @param ib Engine
  * @param tx Transaction
@@ -368,87 +2305,175 @@ static IB_DIRMAP_INIT_STRUCTURE(pocsig_directive_map) = {
  *
  * @return Status code
  */
-static ib_status_t pocsig_handle_sigs(ib_engine_t *ib,
-                                      ib_tx_t *tx,
-                                      void *cbdata)
+static ib_status_t pocsig_handle_body_finish(ib_engine_t *ib,
+                                             ib_tx_t *tx,
+                                             void *cbdata)
 {
-    IB_FTRACE_INIT(pocsig_handle_post);
-    pocsig_cfg_t *cfg;
+    IB_FTRACE_INIT(pocsig_handle_body_finish);
     pocsig_phase_t phase = (pocsig_phase_t)(uintptr_t)cbdata;
-    ib_list_t *sigs;
-    ib_list_node_t *node;
-    int dbglvl;
+    pocsig_body_cbdata_t cb;
+    ib_matcher_stream_t **streams;
+    pocsig_cfg_t *cfg;
     ib_status_t rc;
+    int i;
 
-    /* Get the pocsig configuration for this context. */
     rc = ib_context_module_config(tx->ctx, &IB_MODULE_SYM, (void *)&cfg);
     if (rc != IB_OK) {
         ib_log_error(ib, 1, "Failed to fetch %s config: %d",
                      MODULE_NAME_STR, rc);
+        IB_FTRACE_RET_STATUS(rc);
     }
 
-    /* If tracing is enabled, lower the log level. */
-    dbglvl = cfg->trace ? 4 : 9;
-
-    /* Get the list of sigs for this phase. */
-    sigs = cfg->phase[phase];
-    if (sigs == NULL) {
-        ib_log_debug(ib, dbglvl, "No signatures for phase=%d ctx=%p",
-                     phase, tx->ctx);
+    /* No body was seen. */
+    rc = pocsig_body_streams(tx, cfg, phase, 0, &streams);
+    if (rc != IB_OK) {
         IB_FTRACE_RET_STATUS(IB_OK);
     }
 
-    ib_log_debug(ib, dbglvl, "Executing %d signatures for phase=%d ctx=%p",
-                 ib_list_elements(sigs), phase, tx->ctx);
+    cb.tx = tx;
+    cb.dbglvl = cfg->trace ? 4 : 9;
+    for (i = 0; i <= cfg->depth; i++) {
+        if (streams[i] == NULL) {
+            continue;
+        }
+        rc = ib_matcher_stream_finish(streams[i], pocsig_body_match, &cb);
+        if ((rc != IB_OK) && (rc != IB_ENOENT)) {
+            ib_log_error(ib, 3, "PocSig: Error matching body: %d", rc);
+        }
+    }
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+
+/**
+ * @internal
+ * Finish signature configuration.
+ *
+ * The group prefilters are built, the signature programs of each
+ * configuration are compiled and a summary of the signature groups
+ * and of the patterns which risk catastrophic backtracking is logged.
+ *
+ * @param ib Engine
+ * @param param Unused
+ * @param cbdata Unused
+ *
+ * @return Status code
+ */
+static ib_status_t pocsig_cfg_finished(ib_engine_t *ib,
+                                       void *param,
+                                       void *cbdata)
+{
+    IB_FTRACE_INIT(pocsig_cfg_finished);
+    ib_list_node_t *node;
+    size_t prefilters = 0;
+    size_t lits = 0;
+    size_t sets = 0;
+    size_t insets = 0;
+    size_t risky = 0;
+    size_t routed = 0;
+    size_t insns = 0;
+    ib_status_t rc;
+
+    /* Dump the profile when signaled. */
+    if (pocsig_prof.dump_signal != 0) {
+        struct sigaction sa;
+
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = pocsig_prof_signal;
+        sa.sa_flags = SA_RESTART;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(pocsig_prof.dump_signal, &sa,
+                      &pocsig_prof.dump_oldact) != 0)
+        {
+            ib_log_error(ib, 1, "PocSig: Failed to handle signal %d: %s",
+                         pocsig_prof.dump_signal, strerror(errno));
+            pocsig_prof.dump_signal = 0;
+            IB_FTRACE_RET_STATUS(IB_EINVAL);
+        }
+    }
 
-    /* Run all the sigs for this phase. */
-    IB_LIST_LOOP(sigs, node) {
-        pocsig_sig_t *s = (pocsig_sig_t *)ib_list_node_data(node);
-        ib_field_t *f;
+    IB_LIST_LOOP(pocsig_groups, node) {
+        pocsig_group_t *g = (pocsig_group_t *)ib_list_node_data(node);
 
-        /* Fetch the field. */
-        rc = ib_data_get(tx->dpi, s->target, &f);
+        rc = pocsig_prefilter_build(ib, g);
         if (rc != IB_OK) {
-            ib_log_error(ib, 4, "PocSig: No field named \"%s\"", s->target);
-            continue;
+            ib_log_error(ib, 1, "PocSig: Failed to queue prefilter for "
+                         "target \"%s\": %d", g->target, rc);
+            IB_FTRACE_RET_STATUS(rc);
+        }
+        if (g->building != NULL) {
+            prefilters++;
+            lits += g->nlits;
         }
+        if (g->set != NULL) {
+            sets++;
+            insets += g->nset;
+        }
+    }
+    ib_log_debug(ib, 4, "PocSig: Building prefilters for %zu of %zu "
+                 "signature groups covering %zu signatures",
+                 prefilters, ib_list_elements(pocsig_groups), lits);
+    ib_log_debug(ib, 4, "PocSig: Combined matchers for %zu of %zu "
+                 "signature groups covering %zu signatures",
+                 sets, ib_list_elements(pocsig_groups), insets);
 
-        /* Perform the match. */
-        ib_log_debug(ib, dbglvl, "PocSig: Matching \"%s\" against field \"%s\"",
-                     s->patt, s->target);
-        rc = ib_matcher_match_field(cfg->pcre, s->cpatt, 0, f);
-        if (rc == IB_OK) {
-            ib_logevent_t *e;
-
-            ib_log_debug(ib, dbglvl, "PocSig MATCH: %s at %s", s->patt, s->target);
-
-            /* Create the event. */
-            rc = ib_logevent_create(
-                &e,
-                tx->mp,
-                "-",
-                IB_LEVENT_TYPE_ALERT,
-                IB_LEVENT_ACT_UNKNOWN,
-                IB_LEVENT_PCLASS_UNKNOWN,
-                IB_LEVENT_SCLASS_UNKNOWN,
-                90,
-                80,
-                IB_LEVENT_SYS_UNKNOWN,
-                IB_LEVENT_ACTION_IGNORE,
-                IB_LEVENT_ACTION_IGNORE,
-                s->emsg
-            );
-            if (rc != IB_OK) {
-                ib_log_error(ib, 3, "PocSig: Error generating event: %d", rc);
+    IB_LIST_LOOP(pocsig_cfgs, node) {
+        pocsig_cfg_t *cfg = (pocsig_cfg_t *)ib_list_node_data(node);
+        int phase;
+
+        for (phase = 0; phase < POCSIG_PHASE_NUM; phase++) {
+            if ((phase == POCSIG_REQBODY) || (phase == POCSIG_RESBODY)) {
                 continue;
             }
+            rc = pocsig_prog_compile(ib, cfg, (pocsig_phase_t)phase, &insns);
+            if (rc != IB_OK) {
+                ib_log_error(ib, 1, "PocSig: Failed to compile program "
+                             "for phase=%s: %d",
+                             pocsig_phase_name[phase], rc);
+                IB_FTRACE_RET_STATUS(rc);
+            }
+        }
+    }
+    ib_log_debug(ib, 4, "PocSig: Compiled programs for %zu contexts with "
+                 "%zu instructions",
+                 ib_list_elements(pocsig_cfgs), insns);
+
+    IB_LIST_LOOP(pocsig_prof.sigs, node) {
+        const pocsig_sig_t *s = (const pocsig_sig_t *)ib_list_node_data(node);
 
-            /* Log the event. */
-            ib_clog_event(tx->ctx, e);
+        if (s->chained && (s->next == NULL)) {
+            ib_log_error(ib, 3, "PocSig: Chained signature phase=%s "
+                         "target=%s patt=\"%s\" has no next signature",
+                         pocsig_phase_name[s->phase], s->target, s->patt);
         }
-        else {
-            ib_log_debug(ib, dbglvl, "PocSig NOMATCH");
+        if (s->risk != NULL) {
+            risky++;
+            routed += s->routed;
+        }
+    }
+
+    if (risky == 0) {
+        ib_log_debug(ib, 4, "PocSig: No patterns of %zu signatures risk "
+                     "catastrophic backtracking",
+                     ib_list_elements(pocsig_prof.sigs));
+        IB_FTRACE_RET_STATUS(IB_OK);
+    }
+
+    ib_log_error(ib, 3, "PocSig: %zu of %zu signature patterns risk "
+                 "catastrophic backtracking (%zu routed to the \"%s\" "
+                 "matcher)", risky, ib_list_elements(pocsig_prof.sigs),
+                 routed, POCSIG_ROUTE_KEY);
+    IB_LIST_LOOP(pocsig_prof.sigs, node) {
+        const pocsig_sig_t *s = (const pocsig_sig_t *)ib_list_node_data(node);
+
+        if (s->risk == NULL) {
+            continue;
         }
+        ib_log_error(ib, 3, "PocSig: phase=%s target=%s patt=\"%s\" "
+                     "%s at offset=%d%s",
+                     pocsig_phase_name[s->phase], s->target, s->patt,
+                     s->risk, s->risk_off, s->routed ? " (routed)" : "");
     }
 
     IB_FTRACE_RET_STATUS(IB_OK);
@@ -461,12 +2486,67 @@ static ib_status_t pocsig_init(ib_engine_t *ib,
                                ib_module_t *m)
 {
     IB_FTRACE_INIT(pocsig_init);
+    ib_status_t rc;
 
     /* Initialize the global config items that are not mapped to config
      * parameters as these will not have default values.
      */
     memset(pocsig_global_cfg.phase, 0, sizeof(pocsig_global_cfg.phase));
+    memset(pocsig_global_cfg.target, 0, sizeof(pocsig_global_cfg.target));
+    memset(pocsig_global_cfg.prog, 0, sizeof(pocsig_global_cfg.prog));
+    memset(pocsig_global_cfg.chain, 0, sizeof(pocsig_global_cfg.chain));
     pocsig_global_cfg.pcre = NULL;
+    pocsig_global_cfg.dfa = NULL;
+    pocsig_global_cfg.reqbody = NULL;
+    pocsig_global_cfg.resbody = NULL;
+    pocsig_global_cfg.base = NULL;
+    pocsig_global_cfg.ctx = NULL;
+    pocsig_global_cfg.depth = 0;
+
+    /* Track all signatures so that they can be profiled. */
+    memset(&pocsig_prof, 0, sizeof(pocsig_prof));
+    pocsig_prof_dump_requested = 0;
+    rc = ib_list_create(&pocsig_prof.sigs, ib_engine_pool_config_get(ib));
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    /* Group signatures so that prefilters can be built. */
+    rc = ib_list_create(&pocsig_groups, ib_engine_pool_config_get(ib));
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    /* Track configurations so that programs can be compiled. */
+    rc = ib_list_create(&pocsig_cfgs, ib_engine_pool_config_get(ib));
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    /* Build prefilters, compile programs and summarize risky patterns
+     * once all signatures are configured.
+     */
+    memset(&pocsig_redos, 0, sizeof(pocsig_redos));
+    ib_hook_register(ib, cfg_finished_event,
+                     (ib_void_fn_t)pocsig_cfg_finished,
+                     NULL);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+static ib_status_t pocsig_fini(ib_engine_t *ib,
+                               ib_module_t *m)
+{
+    IB_FTRACE_INIT(pocsig_fini);
+
+    /* Dump the profile of any signatures evaluated. */
+    pocsig_prof_dump(ib, 1);
+
+    /* Restore the previous handler of the dump signal. */
+    if (pocsig_prof.dump_signal != 0) {
+        sigaction(pocsig_prof.dump_signal, &pocsig_prof.dump_oldact, NULL);
+        pocsig_prof.dump_signal = 0;
+    }
 
     IB_FTRACE_RET_STATUS(IB_OK);
 }
@@ -485,7 +2565,13 @@ static ib_status_t pocsig_context_init(ib_engine_t *ib,
                      MODULE_NAME_STR, rc);
     }
 
-    /// @todo Inherit signatures from parent context???
+    /* Reference the parent signatures if no signatures were added. */
+    rc = pocsig_cfg_own(ctx, cfg);
+    if (rc != IB_OK) {
+        ib_log_error(ib, 1, "Failed to own %s config: %d",
+                     MODULE_NAME_STR, rc);
+        IB_FTRACE_RET_STATUS(rc);
+    }
 
     /* Register hooks to handle the phases. */
     ib_hook_register_context(ctx, handle_context_tx_event,
@@ -494,12 +2580,24 @@ static ib_status_t pocsig_context_init(ib_engine_t *ib,
     ib_hook_register_context(ctx, handle_request_headers_event,
                              (ib_void_fn_t)pocsig_handle_sigs,
                              (void *)POCSIG_REQHEAD);
+    ib_hook_register_context(ctx, tx_data_in_event,
+                             (ib_void_fn_t)pocsig_handle_body,
+                             (void *)POCSIG_REQBODY);
+    ib_hook_register_context(ctx, handle_request_event,
+                             (ib_void_fn_t)pocsig_handle_body_finish,
+                             (void *)POCSIG_REQBODY);
     ib_hook_register_context(ctx, handle_request_event,
                              (ib_void_fn_t)pocsig_handle_sigs,
                              (void *)POCSIG_REQ);
     ib_hook_register_context(ctx, handle_response_headers_event,
                              (ib_void_fn_t)pocsig_handle_sigs,
                              (void *)POCSIG_RESHEAD);
+    ib_hook_register_context(ctx, tx_data_out_event,
+                             (ib_void_fn_t)pocsig_handle_body,
+                             (void *)POCSIG_RESBODY);
+    ib_hook_register_context(ctx, handle_response_event,
+                             (ib_void_fn_t)pocsig_handle_body_finish,
+                             (void *)POCSIG_RESBODY);
     ib_hook_register_context(ctx, handle_response_event,
                              (ib_void_fn_t)pocsig_handle_sigs,
                              (void *)POCSIG_RES);
@@ -522,7 +2620,7 @@ IB_MODULE_INIT(
     pocsig_config_map,                   /**< Configuration field map */
     pocsig_directive_map,                /**< Config directive map */
     pocsig_init,                         /**< Initialize function */
-    NULL,                                /**< Finish function */
+    pocsig_fini,                         /**< Finish function */
     pocsig_context_init,                 /**< Context init function */
 );
 
@@ -877,7 +877,12 @@ static int ironbee_post_config(apr_pool_t *p, apr_pool_t *plog, apr_pool_t *ptmp
         /* Notify the engine that the config process has finished. This
          * will also close out the main configuration context.
          */
-        ib_state_notify_cfg_finished(ironbee);
+        rc = ib_state_notify_cfg_finished(ironbee);
+        if (rc != IB_OK) {
+            ap_log_error(APLOG_MARK, APLOG_ERR, 0, s,
+                         IB_PRODUCT_NAME ": Error finishing config: %d", rc);
+            return HTTP_INTERNAL_SERVER_ERROR;
+        }
     }
     else {
         ap_log_error(APLOG_MARK, APLOG_DEBUG, 0, s,
@@ -0,0 +1,188 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee - String Operation Benchmark
+///
+/// Compares the scalar and vector string operation kernels over a
+/// range of data sizes. Kernels the CPU does not support are skipped. Not run as part of "make check"; build with
+/// "make bench_util_strops".
+///
+/// Usage: bench_util_strops [total MB per run]
+///
+/// @author Brian Rectanus <brectanus@qualys.com>
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ironbee_config_auto.h"
+
+#include "util/cpu.c"
+#include "util/strops.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/// Kernel being benchmarked.
+typedef struct {
+    const char *name;
+    size_t (*fn)(uint8_t *data, size_t dlen);
+    ib_flags_t cpu;
+} kernel_t;
+
+/* Wrappers giving all kernels the same signature. */
+#define BENCH_WRAP(op, kind, expr) \
+    static size_t bench_##op##_##kind(uint8_t *data, size_t dlen) \
+    { return (size_t)(expr); }
+
+#define BENCH_WRAP_ALL(op, expr_scalar, expr_sse2, expr_avx2) \
+    BENCH_WRAP(op, scalar, expr_scalar) \
+    BENCH_WRAP(op, sse2, expr_sse2) \
+    BENCH_WRAP(op, avx2, expr_avx2)
+
+#ifdef IB_STROPS_X86
+BENCH_WRAP_ALL(lower,
+               ib_strops_lower_scalar(data, dlen),
+               ib_strops_lower_sse2(data, dlen),
+               ib_strops_lower_avx2(data, dlen))
+BENCH_WRAP_ALL(wsleft,
+               ib_strops_wsleft_scalar(data, dlen),
+               ib_strops_wsleft_sse2(data, dlen),
+               ib_strops_wsleft_avx2(data, dlen))
+BENCH_WRAP_ALL(wsright,
+               ib_strops_wsright_scalar(data, dlen),
+               ib_strops_wsright_sse2(data, dlen),
+               ib_strops_wsright_avx2(data, dlen))
+BENCH_WRAP_ALL(find_any,
+               ib_strops_find_any_scalar(data, dlen, (const uint8_t *)"%+", 2),
+               ib_strops_find_any_sse2(data, dlen, (const uint8_t *)"%+", 2),
+               ib_strops_find_any_avx2(data, dlen, (const uint8_t *)"%+", 2))
+BENCH_WRAP(lower, avx512, ib_strops_lower_avx512(data, dlen))
+BENCH_WRAP(find_any, avx512,
+           ib_strops_find_any_avx512(data, dlen, (const uint8_t *)"%+", 2))
+
+static const kernel_t kernels[] = {
+    { "lower/scalar",    bench_lower_scalar,    0 },
+    { "lower/sse2",      bench_lower_sse2,      0 },
+    { "lower/avx2",      bench_lower_avx2,      IB_CPU_AVX2 },
+    { "lower/avx512",    bench_lower_avx512,    IB_CPU_AVX512BW },
+    { "wsleft/scalar",   bench_wsleft_scalar,   0 },
+    { "wsleft/sse2",     bench_wsleft_sse2,     0 },
+    { "wsleft/avx2",     bench_wsleft_avx2,     IB_CPU_AVX2 },
+    { "wsright/scalar",  bench_wsright_scalar,  0 },
+    { "wsright/sse2",    bench_wsright_sse2,    0 },
+    { "wsright/avx2",    bench_wsright_avx2,    IB_CPU_AVX2 },
+    { "find_any/scalar", bench_find_any_scalar, 0 },
+    { "find_any/sse2",   bench_find_any_sse2,   0 },
+    { "find_any/avx2",   bench_find_any_avx2,   IB_CPU_AVX2 },
+    { "find_any/avx512", bench_find_any_avx512, IB_CPU_AVX512BW },
+};
+#else
+BENCH_WRAP(lower, scalar, ib_strops_lower_scalar(data, dlen))
+BENCH_WRAP(wsleft, scalar, ib_strops_wsleft_scalar(data, dlen))
+BENCH_WRAP(wsright, scalar, ib_strops_wsright_scalar(data, dlen))
+
+BENCH_WRAP(find_any, scalar,
+           ib_strops_find_any_scalar(data, dlen, (const uint8_t *)"%+", 2))
+
+static const kernel_t kernels[] = {
+    { "lower/scalar",    bench_lower_scalar,    0 },
+    { "wsleft/scalar",   bench_wsleft_scalar,   0 },
+    { "wsright/scalar",  bench_wsright_scalar,  0 },
+    { "find_any/scalar", bench_find_any_scalar, 0 },
+};
+#endif
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    static const size_t sizes[] = { 16, 64, 256, 1024, 4096, 65536 };
+    size_t total = ((argc > 1) ? (size_t)atoi(argv[1]) : 256) << 20;
+    size_t maxlen = sizes[sizeof(sizes) / sizeof(*sizes) - 1];
+    uint8_t *pattern = (uint8_t *)malloc(maxlen);
+    uint8_t *buf = (uint8_t *)malloc(maxlen);
+    ib_flags_t cpu;
+    size_t sink = 0;
+
+    ib_cpu_init();
+    cpu = ib_cpu_features();
+
+    /* Mostly lowercase header-like text with some uppercase and
+     * whitespace at the ends only, so the trim kernels scan the
+     * whitespace and stop on the first non-whitespace byte.
+     */
+    for (size_t i = 0; i < maxlen; i++) {
+        pattern[i] = (uint8_t)("content-Type: text/HTML; charset=utf-8"[i % 38]);
+    }
+
+    printf("%-16s", "kernel");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+        printf(" %9zu", sizes[s]);
+    }
+    printf("   (MB/s)\n");
+
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(*kernels); k++) {
+        if ((kernels[k].cpu & cpu) != kernels[k].cpu) {
+            continue;
+        }
+        printf("%-16s", kernels[k].name);
+
+        for (size_t s = 0; s < sizeof(sizes) / sizeof(*sizes); s++) {
+            size_t len = sizes[s];
+            size_t iters = total / len;
+            double start;
+            double elapsed;
+
+            /* All whitespace except the last byte so the trim
+             * kernels scan the full length.
+             */
+            if (strncmp(kernels[k].name, "ws", 2) == 0) {
+                memset(buf, ' ', len);
+                buf[(kernels[k].name[2] == 'l') ? len - 1 : 0] = 'x';
+            }
+            /* No escapes, so the full length is scanned. */
+            else if (kernels[k].name[0] == 'f') {
+                memcpy(buf, pattern, len);
+            }
+
+            start = now();
+            for (size_t i = 0; i < iters; i++) {
+                if (kernels[k].name[0] == 'l') {
+                    memcpy(buf, pattern, len);
+                }
+                sink += kernels[k].fn(buf, len);
+            }
+            elapsed = now() - start;
+
+            printf(" %9.0f", (double)(iters * len) / elapsed / (1 << 20));
+        }
+        printf("\n");
+    }
+
+    free(pattern);
+    free(buf);
+
+    return (sink == 0) ? 1 : 0;
+}
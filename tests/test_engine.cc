@@ -35,7 +35,10 @@
 #include "engine/config-parser.c"
 #include "engine/data.c"
 #include "engine/tfn.c"
+#include "engine/operator.c"
+#include "engine/matcher.c"
 #include "engine/filter.c"
+#include "engine/stats.c"
 #include "engine/core.c"
 #include "util/debug.c"
 
@@ -138,6 +141,871 @@ TEST(TestIronBee, test_tfn)
     ib_engine_destroy(ib);
 }
 
+/// @test Test ironbee library - operators
+TEST(TestIronBee, test_operator)
+{
+    ib_engine_t *ib;
+    ib_operator_t *op = (ib_operator_t *)-1;
+    ib_operator_inst_t *inst;
+    ib_field_t *f;
+    const char *value;
+    ib_num_t n = 42;
+    static const struct {
+        const char *op;
+        const char *params;
+        const char *value;
+        ib_status_t expect;
+    } cases[] = {
+        { "streq", "foo", "foo", IB_OK },
+        { "streq", "foo", "Foo", IB_ENOENT },
+        { "streqNoCase", "Content-Type", "content-type", IB_OK },
+        { "streqNoCase", "Content-Type", "content-typ", IB_ENOENT },
+        { "beginsWith", "/admin", "/admin/login", IB_OK },
+        { "beginsWith", "/admin", "/adm", IB_ENOENT },
+        { "endsWith", ".php", "/index.php", IB_OK },
+        { "endsWith", ".php", "/index.php5", IB_ENOENT },
+        { "contains", "select", "1 union select 2 from dual", IB_OK },
+        { "contains", "select", "1 union selec", IB_ENOENT },
+        { "contains", "", "", IB_OK },
+        { "eq", "42", "42", IB_OK },
+        { "ne", "42", "42", IB_ENOENT },
+        { "lt", "10", "-5", IB_OK },
+        { "le", "10", "11", IB_ENOENT },
+        { "gt", "10", "x", IB_ENOENT },
+        { "ge", "10", "10", IB_OK },
+        { "ipMatch", "10.0.0.0/8, 192.168.1.1 ::1", "10.1.2.3", IB_OK },
+        { "ipMatch", "10.0.0.0/8, 192.168.1.1 ::1", "192.168.1.2", IB_ENOENT },
+        { "ipMatch", "10.0.0.0/8, 192.168.1.1 ::1", "::1", IB_OK },
+        { "ipMatch", "10.0.0.0/8, 192.168.1.1 ::1", "not an address", IB_ENOENT },
+        { "ipMatch", "10.0.0.0/8, 192.168.1.1 ::1", "::ffff:10.1.2.3", IB_OK },
+        { "ipMatch", "10.0.0.0/8, 192.168.1.1 ::1", "::FFFF:192.168.1.1", IB_OK },
+        { "ipMatch", "10.0.0.0/8, 192.168.1.1 ::1", "::ffff:192.168.1.2", IB_ENOENT },
+        { "ipMatch", "10.0.0.0/8, 192.168.1.1 ::1", "::ffff:0a01:0203", IB_OK },
+        { "ipMatch", "10.0.0.0/8, 192.168.1.1 ::1", "::10.1.2.3", IB_ENOENT },
+        { "ipMatch", "::ffff:10.0.0.0/104", "::ffff:10.1.2.3", IB_OK },
+        { "ipMatch", "::ffff:10.0.0.0/104", "10.1.2.3", IB_ENOENT },
+        { "inSet", "GET HEAD POST", "HEAD", IB_OK },
+        { "inSet", "GET HEAD POST", "HEA", IB_ENOENT },
+        { "pm", "passwd shadow", "/etc/PASSWD", IB_OK },
+        { "pm", "passwd shadow", "/etc/hosts", IB_ENOENT },
+    };
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = ib_initialize();
+    ASSERT_TRUE(rc == IB_OK) << "ib_initialize() failed - rc != IB_OK";
+
+    rc = ib_engine_create(&ib, &ibplugin);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_create() failed - rc != IB_OK";
+
+    rc = ib_operator_lookup(ib, "contains", &op);
+    ASSERT_TRUE(rc == IB_OK) << "ib_operator_lookup() failed - rc != IB_OK";
+    ASSERT_TRUE(op != (ib_operator_t *)-1) << "ib_operator_lookup() failed - unset";
+    rc = ib_operator_lookup(ib, "nosuchop", &op);
+    ASSERT_TRUE(rc == IB_ENOENT) << "ib_operator_lookup() failed - rc != IB_ENOENT";
+    rc = ib_operator_inst_create(ib, ib->mp, "nosuchop", "", &inst);
+    ASSERT_TRUE(rc == IB_ENOENT) << "ib_operator_inst_create() failed - unknown operator";
+    rc = ib_operator_inst_create(ib, ib->mp, "gt", "ten", &inst);
+    ASSERT_TRUE(rc == IB_EINVAL) << "ib_operator_inst_create() failed - invalid number";
+    rc = ib_operator_inst_create(ib, ib->mp, "ipMatch", "10.0.0.0/33", &inst);
+    ASSERT_TRUE(rc == IB_EINVAL) << "ib_operator_inst_create() failed - invalid network";
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        rc = ib_operator_inst_create(ib, ib->mp, cases[i].op, cases[i].params, &inst);
+        ASSERT_TRUE(rc == IB_OK) << "ib_operator_inst_create() failed - " << cases[i].op;
+        ASSERT_STREQ(cases[i].op, ib_operator_inst_name(inst));
+        value = cases[i].value;
+        rc = ib_field_create(&f, ib->mp, "f", IB_FTYPE_NULSTR, &value);
+        ASSERT_TRUE(rc == IB_OK) << "ib_field_create() failed - rc != IB_OK";
+        rc = ib_operator_execute(inst, ib->mp, f);
+        ASSERT_TRUE(rc == cases[i].expect) << "ib_operator_execute() failed - " << cases[i].op << " \"" << cases[i].params << "\" \"" << cases[i].value << "\" rc=" << rc;
+    }
+
+    /* Numeric field. */
+    rc = ib_operator_inst_create(ib, ib->mp, "ge", "42", &inst);
+    ASSERT_TRUE(rc == IB_OK) << "ib_operator_inst_create() failed - rc != IB_OK";
+    rc = ib_field_create(&f, ib->mp, "f", IB_FTYPE_NUM, &n);
+    ASSERT_TRUE(rc == IB_OK) << "ib_field_create() failed - rc != IB_OK";
+    rc = ib_operator_execute(inst, ib->mp, f);
+    ASSERT_TRUE(rc == IB_OK) << "ib_operator_execute() failed - numeric field";
+
+    ib_engine_destroy(ib);
+}
+
+static int count_calls = 0;
+
+static ib_status_t count(void *fndata,
+                         ib_mpool_t *pool,
+                         uint8_t *data_in, size_t dlen_in,
+                         uint8_t **data_out, size_t *dlen_out,
+                         ib_flags_t *pflags)
+{
+    count_calls++;
+    *data_out = data_in;
+    *dlen_out = dlen_in;
+
+    return IB_OK;
+}
+
+/// @test Test ironbee library - transformation pipelines
+TEST(TestIronBee, test_tfn_pipeline)
+{
+    ib_engine_t *ib;
+    ib_tfn_pipeline_t *pl;
+    ib_tfn_pipeline_t *pl2;
+    ib_conn_t *conn;
+    ib_tx_t *tx;
+    ib_field_t *f;
+    ib_field_t *f2;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = ib_initialize();
+    ASSERT_TRUE(rc == IB_OK) << "ib_initialize() failed - rc != IB_OK";
+
+    rc = ib_engine_create(&ib, &ibplugin);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_create() failed - rc != IB_OK";
+
+    rc = ib_tfn_create(ib, "foo2bar", foo2bar, NULL, NULL);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tfn_create() failed - rc != IB_OK";
+    rc = ib_tfn_create(ib, "count", count, NULL, NULL);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tfn_create() failed - rc != IB_OK";
+
+    rc = ib_tfn_pipeline_create(ib, "foo2bar,count", &pl);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tfn_pipeline_create() failed - rc != IB_OK";
+    rc = ib_tfn_pipeline_create(ib, "foo2bar,count", &pl2);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tfn_pipeline_create() failed - rc != IB_OK";
+    ASSERT_TRUE(pl == pl2) << "ib_tfn_pipeline_create() failed - not reused";
+    rc = ib_tfn_pipeline_create(ib, "foo2bar,nosuchtfn", &pl2);
+    ASSERT_TRUE(rc == IB_EINVAL) << "ib_tfn_pipeline_create() failed - unknown tfn accepted";
+
+    rc = ib_conn_create(ib, &conn, NULL);
+    ASSERT_TRUE(rc == IB_OK) << "ib_conn_create() failed - rc != IB_OK";
+    rc = ib_tx_create(ib, &tx, conn, NULL);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tx_create() failed - rc != IB_OK";
+
+    rc = ib_data_add_nulstr_ex(tx->dpi, "target", 6, (char *)"foo", NULL);
+    ASSERT_TRUE(rc == IB_OK) << "ib_data_add_nulstr_ex() failed - rc != IB_OK";
+
+    count_calls = 0;
+    rc = ib_tx_data_tfn_get(tx, "target", 6, &f, pl);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tx_data_tfn_get() failed - rc != IB_OK";
+    ASSERT_TRUE(strcmp("bar", ib_field_value_nulstr(f)) == 0) << "ib_tx_data_tfn_get() failed - not transformed";
+    rc = ib_tx_data_tfn_get(tx, "target", 6, &f2, pl);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tx_data_tfn_get() failed - rc != IB_OK";
+    ASSERT_TRUE(f == f2) << "ib_tx_data_tfn_get() failed - not memoized";
+    ASSERT_TRUE(count_calls == 1) << "ib_tx_data_tfn_get() failed - pipeline ran more than once";
+
+    rc = ib_data_get(tx->dpi, "target", &f);
+    ASSERT_TRUE(rc == IB_OK) << "ib_data_get() failed - rc != IB_OK";
+    ASSERT_TRUE(strcmp("foo", ib_field_value_nulstr(f)) == 0) << "ib_tx_data_tfn_get() failed - source modified";
+
+    /* Transforming the fetched field shares the memo. */
+    rc = ib_tx_field_tfn_get(tx, f, &f, pl);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tx_field_tfn_get() failed - rc != IB_OK";
+    ASSERT_TRUE(f == f2) << "ib_tx_field_tfn_get() failed - not memoized";
+    ASSERT_TRUE(count_calls == 1) << "ib_tx_field_tfn_get() failed - pipeline ran more than once";
+
+    ib_engine_destroy(ib);
+}
+
+/// @test Test ironbee library - fused transformation pipelines
+TEST(TestIronBee, test_tfn_fuse)
+{
+    ib_engine_t *ib;
+    ib_tfn_pipeline_t *pl;
+    ib_tfn_pipeline_t *pl2;
+    ib_conn_t *conn;
+    ib_tx_t *tx;
+    ib_field_t *f;
+    ib_field_t *f2;
+    const char *names[] = { "lowercase", "compressWhitespace", "trim" };
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = ib_initialize();
+    ASSERT_TRUE(rc == IB_OK) << "ib_initialize() failed - rc != IB_OK";
+
+    rc = ib_engine_create(&ib, &ibplugin);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_create() failed - rc != IB_OK";
+
+    /* Fused into a single step. */
+    rc = ib_tfn_pipeline_create(ib, "lowercase,compressWhitespace,trim", &pl);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tfn_pipeline_create() failed - rc != IB_OK";
+    ASSERT_TRUE(pl->nstep == 1) << "ib_tfn_pipeline_create() failed - not fused";
+
+    /* Not fused (trim after trim must be a separate pass). */
+    rc = ib_tfn_pipeline_create(ib, "trimRight,compressWhitespace,lowercase,trim", &pl2);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tfn_pipeline_create() failed - rc != IB_OK";
+    ASSERT_TRUE(pl2->nstep == 2) << "ib_tfn_pipeline_create() failed - wrong steps";
+
+    rc = ib_conn_create(ib, &conn, NULL);
+    ASSERT_TRUE(rc == IB_OK) << "ib_conn_create() failed - rc != IB_OK";
+    rc = ib_tx_create(ib, &tx, conn, NULL);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tx_create() failed - rc != IB_OK";
+
+    rc = ib_data_add_nulstr_ex(tx->dpi, "target", 6,
+                               (char *)" \t Foo \r\n  BAR\t ", NULL);
+    ASSERT_TRUE(rc == IB_OK) << "ib_data_add_nulstr_ex() failed - rc != IB_OK";
+
+    rc = ib_tx_data_tfn_get(tx, "target", 6, &f, pl);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tx_data_tfn_get() failed - rc != IB_OK";
+    ASSERT_TRUE(strcmp("foo bar", ib_field_value_nulstr(f)) == 0) << "ib_tx_data_tfn_get() failed - wrong fused result";
+
+    rc = ib_tx_data_tfn_get(tx, "target", 6, &f2, pl2);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tx_data_tfn_get() failed - rc != IB_OK";
+    ASSERT_TRUE(strcmp(ib_field_value_nulstr(f), ib_field_value_nulstr(f2)) == 0) << "ib_tx_data_tfn_get() failed - fused and partially fused differ";
+
+    /* Same result as running each transformation in turn. */
+    rc = ib_data_get(tx->dpi, "target", &f2);
+    ASSERT_TRUE(rc == IB_OK) << "ib_data_get() failed - rc != IB_OK";
+    for (size_t i = 0; i < sizeof(names) / sizeof(*names); i++) {
+        ib_tfn_t *tfn;
+        ib_flags_t flags = 0;
+
+        rc = ib_tfn_lookup(ib, names[i], &tfn);
+        ASSERT_TRUE(rc == IB_OK) << "ib_tfn_lookup() failed - rc != IB_OK";
+        rc = ib_tfn_transform_field(tfn, f2, &flags);
+        ASSERT_TRUE(rc == IB_OK) << "ib_tfn_transform_field() failed - rc != IB_OK";
+    }
+    ASSERT_TRUE(strcmp(ib_field_value_nulstr(f), ib_field_value_nulstr(f2)) == 0) << "ib_tfn_transform_field() failed - fused and unfused differ";
+
+    ib_engine_destroy(ib);
+}
+
+/// @test Test ironbee library - fused URL decoding
+TEST(TestIronBee, test_tfn_fuse_decode)
+{
+    ib_engine_t *ib;
+    ib_tfn_pipeline_t *pl;
+    ib_tfn_t *tfn_url;
+    ib_tfn_t *tfn_lc;
+    const char *inputs[] = {
+        "/Path%2Fto+%41%u0042%uFF23",
+        "%4%41%zz%u12x%",
+        "%",
+        "%u004",
+        "plain",
+        ""
+    };
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = ib_initialize();
+    ASSERT_TRUE(rc == IB_OK) << "ib_initialize() failed - rc != IB_OK";
+
+    rc = ib_engine_create(&ib, &ibplugin);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_create() failed - rc != IB_OK";
+
+    rc = ib_tfn_pipeline_create(ib, "urlDecode,lowercase", &pl);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tfn_pipeline_create() failed - rc != IB_OK";
+    ASSERT_TRUE(pl->nstep == 1) << "ib_tfn_pipeline_create() failed - not fused";
+
+    rc = ib_tfn_lookup(ib, "urlDecode", &tfn_url);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tfn_lookup() failed - rc != IB_OK";
+    rc = ib_tfn_lookup(ib, "lowercase", &tfn_lc);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tfn_lookup() failed - rc != IB_OK";
+
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(*inputs); i++) {
+        ib_field_t *f;
+        ib_field_t *f2;
+        ib_flags_t flags;
+
+        rc = ib_field_create(&f, ib->mp, "f", IB_FTYPE_NULSTR, &inputs[i]);
+        ASSERT_TRUE(rc == IB_OK) << "ib_field_create() failed - rc != IB_OK";
+        rc = ib_field_create(&f2, ib->mp, "f2", IB_FTYPE_NULSTR, &inputs[i]);
+        ASSERT_TRUE(rc == IB_OK) << "ib_field_create() failed - rc != IB_OK";
+
+        rc = ib_tfn_pipeline_transform_field(pl, f, &flags);
+        ASSERT_TRUE(rc == IB_OK) << "ib_tfn_pipeline_transform_field() failed - rc != IB_OK";
+
+        rc = ib_tfn_transform_field(tfn_url, f2, &flags);
+        ASSERT_TRUE(rc == IB_OK) << "ib_tfn_transform_field() failed - rc != IB_OK";
+        rc = ib_tfn_transform_field(tfn_lc, f2, &flags);
+        ASSERT_TRUE(rc == IB_OK) << "ib_tfn_transform_field() failed - rc != IB_OK";
+
+        ASSERT_STREQ(ib_field_value_nulstr(f2), ib_field_value_nulstr(f)) << "fused and unfused differ for: " << inputs[i];
+        if (i == 0) {
+            ASSERT_STREQ("/path/to abc", ib_field_value_nulstr(f)) << "ib_tfn_pipeline_transform_field() failed - wrong result";
+        }
+    }
+
+    ib_engine_destroy(ib);
+}
+
+/// @test Test ironbee library - streaming transformations
+TEST(TestIronBee, test_tfn_stream)
+{
+    ib_engine_t *ib;
+    ib_tfn_pipeline_t *pl;
+    ib_tfn_stream_t *ts;
+    const char *specs[] = {
+        "urlDecode,lowercase",
+        "trimLeft,urlDecode,compressWhitespace",
+        "htmlEntityDecode",
+        "jsDecode,lowercase",
+        "cssDecode",
+        "hexDecode",
+        "base64Decode"
+    };
+    const char *inputs[] = {
+        "  /Path%2Fto+%41%u0042%uFF23  %4%41%zz%u12x%",
+        "a&lt;b&#x41;&#65&amp;&nbsp&#0000000000065;&bogus;&",
+        "\\x41\\u0042\\101\\n\\\\\\q\\41 \\0000041\\",
+        "414243zz4",
+        "aGVsbG8g d29y\nbGQ=junk"
+    };
+    const uint8_t *out;
+    size_t olen;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = ib_initialize();
+    ASSERT_TRUE(rc == IB_OK) << "ib_initialize() failed - rc != IB_OK";
+
+    rc = ib_engine_create(&ib, &ibplugin);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_create() failed - rc != IB_OK";
+
+    for (size_t s = 0; s < sizeof(specs) / sizeof(*specs); s++) {
+        rc = ib_tfn_pipeline_create(ib, specs[s], &pl);
+        ASSERT_TRUE(rc == IB_OK) << "ib_tfn_pipeline_create() failed - rc != IB_OK";
+
+        for (size_t i = 0; i < sizeof(inputs) / sizeof(*inputs); i++) {
+            size_t len = strlen(inputs[i]);
+            ib_bytestr_t *bs;
+            ib_field_t *f;
+            ib_flags_t flags;
+            std::string expected;
+
+            /* Expected result (all at once). */
+            rc = ib_bytestr_dup_mem(&bs, ib->mp,
+                                    (const uint8_t *)inputs[i], len);
+            ASSERT_TRUE(rc == IB_OK) << "ib_bytestr_dup_mem() failed - rc != IB_OK";
+            rc = ib_field_create(&f, ib->mp, "f", IB_FTYPE_BYTESTR, &bs);
+            ASSERT_TRUE(rc == IB_OK) << "ib_field_create() failed - rc != IB_OK";
+            rc = ib_tfn_pipeline_transform_field(pl, f, &flags);
+            ASSERT_TRUE(rc == IB_OK) << "ib_tfn_pipeline_transform_field() failed - rc != IB_OK";
+            bs = ib_field_value_bytestr(f);
+            expected.assign((const char *)ib_bytestr_ptr(bs),
+                            ib_bytestr_length(bs));
+
+            /* Every split into two chunks, then a byte at a time. */
+            for (size_t split = 0; split <= len + 1; split++) {
+                std::string result;
+
+                rc = ib_tfn_stream_create(pl, ib->mp, &ts);
+                ASSERT_TRUE(rc == IB_OK) << "ib_tfn_stream_create() failed - rc != IB_OK";
+
+                if (split <= len) {
+                    rc = ib_tfn_stream_update(ts, (const uint8_t *)inputs[i],
+                                              split, &out, &olen);
+                    ASSERT_TRUE(rc == IB_OK) << "ib_tfn_stream_update() failed - rc != IB_OK";
+                    result.append((const char *)out, olen);
+                    rc = ib_tfn_stream_update(ts,
+                                              (const uint8_t *)inputs[i] + split,
+                                              len - split, &out, &olen);
+                    ASSERT_TRUE(rc == IB_OK) << "ib_tfn_stream_update() failed - rc != IB_OK";
+                    result.append((const char *)out, olen);
+                }
+                else {
+                    for (size_t j = 0; j < len; j++) {
+                        rc = ib_tfn_stream_update(ts,
+                                                  (const uint8_t *)inputs[i] + j,
+                                                  1, &out, &olen);
+                        ASSERT_TRUE(rc == IB_OK) << "ib_tfn_stream_update() failed - rc != IB_OK";
+                        result.append((const char *)out, olen);
+                    }
+                }
+
+                rc = ib_tfn_stream_finish(ts, &out, &olen);
+                ASSERT_TRUE(rc == IB_OK) << "ib_tfn_stream_finish() failed - rc != IB_OK";
+                result.append((const char *)out, olen);
+
+                ASSERT_EQ(expected, result) << specs[s] << " differs for: "
+                                            << inputs[i] << " split at " << split;
+            }
+        }
+    }
+
+    /* Trimming the right side needs all of the data. */
+    rc = ib_tfn_pipeline_create(ib, "lowercase,trim", &pl);
+    ASSERT_TRUE(rc == IB_OK) << "ib_tfn_pipeline_create() failed - rc != IB_OK";
+    rc = ib_tfn_stream_create(pl, ib->mp, &ts);
+    ASSERT_TRUE(rc == IB_ENOTIMPL) << "ib_tfn_stream_create() failed - rc != IB_ENOTIMPL";
+
+    ib_engine_destroy(ib);
+}
+
+/// @test Test ironbee library - statistics counters
+TEST(TestIronBee, test_stats)
+{
+    ib_engine_t *ib;
+    ib_stat_id_t id;
+    ib_stat_id_t id2;
+    uint64_t val;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = ib_initialize();
+    ASSERT_TRUE(rc == IB_OK) << "ib_initialize() failed - rc != IB_OK";
+
+    rc = ib_engine_create(&ib, &ibplugin);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_create() failed - rc != IB_OK";
+    ASSERT_TRUE(ib != NULL) << "ib_engine_create() failed - NULL";
+
+    rc = ib_stat_lookup(ib, "tx.count", &id);
+    ASSERT_TRUE(rc == IB_OK) << "ib_stat_lookup() failed - built-in not registered";
+    ASSERT_TRUE(id == IB_STAT_TXS) << "ib_stat_lookup() failed - wrong built-in ID";
+
+    rc = ib_stat_register(ib, "test.count", &id);
+    ASSERT_TRUE(rc == IB_OK) << "ib_stat_register() failed - rc != IB_OK";
+    rc = ib_stat_register(ib, "test.count", &id2);
+    ASSERT_TRUE(rc == IB_OK) << "ib_stat_register() failed - rc != IB_OK";
+    ASSERT_TRUE(id == id2) << "ib_stat_register() failed - duplicate ID";
+
+    ib_stat_inc(ib, id);
+    ib_stat_add(ib, id, 41);
+    rc = ib_stat_get(ib, id, &val);
+    ASSERT_TRUE(rc == IB_OK) << "ib_stat_get() failed - rc != IB_OK";
+    ASSERT_TRUE(val == 42) << "ib_stat_get() failed - wrong value";
+
+    ib_engine_destroy(ib);
+}
+
+static int fini_order[2];
+static int fini_count;
+
+static ib_status_t test_fini_a(ib_engine_t *ib, ib_module_t *m)
+{
+    fini_order[fini_count++] = 1;
+    return IB_OK;
+}
+
+static ib_status_t test_fini_b(ib_engine_t *ib, ib_module_t *m)
+{
+    fini_order[fini_count++] = 2;
+    return IB_OK;
+}
+
+/// @test Test ironbee library - module finish on ib_engine_destroy()
+TEST(TestIronBee, test_module_fini)
+{
+    ib_engine_t *ib;
+    ib_module_t *m1;
+    ib_module_t *m2;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = ib_initialize();
+    ASSERT_TRUE(rc == IB_OK) << "ib_initialize() failed - rc != IB_OK";
+
+    rc = ib_engine_create(&ib, &ibplugin);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_create() failed - rc != IB_OK";
+    ASSERT_TRUE(ib != NULL) << "ib_engine_create() failed - NULL";
+
+    rc = ib_module_create(&m1, ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_module_create() failed - rc != IB_OK";
+    IB_MODULE_INIT_DYNAMIC(m1, __FILE__, NULL, ib, "test_fini_a",
+                           NULL, 0, NULL, NULL, NULL, test_fini_a, NULL);
+    rc = ib_module_init(m1, ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_module_init() failed - rc != IB_OK";
+
+    rc = ib_module_create(&m2, ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_module_create() failed - rc != IB_OK";
+    IB_MODULE_INIT_DYNAMIC(m2, __FILE__, NULL, ib, "test_fini_b",
+                           NULL, 0, NULL, NULL, NULL, test_fini_b, NULL);
+    rc = ib_module_init(m2, ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_module_init() failed - rc != IB_OK";
+
+    fini_count = 0;
+    ib_engine_destroy(ib);
+    ASSERT_TRUE(fini_count == 2) << "ib_engine_destroy() failed - modules not finished";
+    ASSERT_TRUE(fini_order[0] == 2) << "ib_engine_destroy() failed - wrong finish order";
+    ASSERT_TRUE(fini_order[1] == 1) << "ib_engine_destroy() failed - wrong finish order";
+}
+
+static int count_compiles = 0;
+
+static ib_status_t test_matcher_compile(ib_provider_t *mpr,
+                                        ib_mpool_t *pool,
+                                        void *pcpatt,
+                                        const char *patt,
+                                        const char **errptr,
+                                        int *erroffset)
+{
+    /* Patterns may be compiled on worker threads. */
+    __sync_fetch_and_add(&count_compiles, 1);
+
+    if (*patt == '\0') {
+        *(void **)pcpatt = NULL;
+        if (errptr != NULL) {
+            *errptr = "empty pattern";
+        }
+        return IB_EINVAL;
+    }
+    *(void **)pcpatt = ib_mpool_memdup(pool, patt, strlen(patt) + 1);
+
+    return IB_OK;
+}
+
+static ib_status_t test_matcher_match_compiled(ib_provider_t *mpr,
+                                               void *cpatt,
+                                               ib_flags_t flags,
+                                               const uint8_t *data,
+                                               size_t dlen)
+{
+    return IB_ENOENT;
+}
+
+static ib_status_t test_matcher_serialize(ib_provider_t *mpr,
+                                          void *cpatt,
+                                          ib_mpool_t *pool,
+                                          const uint8_t **pbuf,
+                                          size_t *plen)
+{
+    *pbuf = (const uint8_t *)cpatt;
+    *plen = strlen((const char *)cpatt);
+
+    return IB_OK;
+}
+
+static ib_status_t test_matcher_deserialize(ib_provider_t *mpr,
+                                            ib_mpool_t *pool,
+                                            void *pcpatt,
+                                            const uint8_t *buf,
+                                            size_t len)
+{
+    char *patt = (char *)ib_mpool_alloc(pool, len + 1);
+
+    memcpy(patt, buf, len);
+    patt[len] = '\0';
+    *(void **)pcpatt = patt;
+
+    return IB_OK;
+}
+
+static IB_PROVIDER_IFACE_TYPE(matcher) test_matcher_iface = {
+    IB_PROVIDER_IFACE_HEADER_DEFAULTS,
+    test_matcher_compile,
+    test_matcher_match_compiled,
+    NULL, NULL, NULL, NULL, NULL, NULL, NULL
+};
+
+static IB_PROVIDER_IFACE_TYPE(matcher) test_matcher_db_iface = {
+    IB_PROVIDER_IFACE_HEADER_DEFAULTS,
+    test_matcher_compile,
+    test_matcher_match_compiled,
+    NULL, NULL, NULL, NULL, NULL,
+    test_matcher_serialize,
+    test_matcher_deserialize
+};
+
+/// @test Test ironbee library - compiled pattern cache
+TEST(TestIronBee, test_matcher_cache)
+{
+    ib_engine_t *ib;
+    ib_provider_t *mpr;
+    ib_matcher_t *m;
+    ib_matcher_t *m2;
+    ib_matcher_t *tm;
+    void *cpatt;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = ib_initialize();
+    ASSERT_TRUE(rc == IB_OK) << "ib_initialize() failed - rc != IB_OK";
+
+    rc = ib_engine_create(&ib, &ibplugin);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_create() failed - rc != IB_OK";
+
+    rc = ib_provider_register(ib, IB_PROVIDER_TYPE_MATCHER, "test", &mpr,
+                              &test_matcher_iface, NULL);
+    ASSERT_TRUE(rc == IB_OK) << "ib_provider_register() failed - rc != IB_OK";
+
+    rc = ib_matcher_create(ib, ib_engine_pool_config_get(ib), "test", &m);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_create() failed - rc != IB_OK";
+    rc = ib_matcher_create(ib, ib_engine_pool_config_get(ib), "test", &m2);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_create() failed - rc != IB_OK";
+    rc = ib_matcher_create(ib, ib_engine_pool_temp_get(ib), "test", &tm);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_create() failed - rc != IB_OK";
+
+    count_compiles = 0;
+    cpatt = ib_matcher_compile(m, "foo", NULL, NULL);
+    ASSERT_TRUE(cpatt != NULL) << "ib_matcher_compile() failed - NULL";
+    ASSERT_TRUE(ib_matcher_compile(m2, "foo", NULL, NULL) == cpatt)
+        << "ib_matcher_compile() failed - identical pattern not shared";
+    ASSERT_TRUE(ib_matcher_compile(m, "bar", NULL, NULL) != cpatt)
+        << "ib_matcher_compile() failed - different pattern shared";
+    ASSERT_TRUE(count_compiles == 2) << "ib_matcher_compile() failed - "
+                                        "wrong number of compiles";
+    ASSERT_TRUE(ib->matcher_hits == 1) << "ib_matcher_compile() failed - "
+                                          "wrong number of hits";
+
+    /* Only patterns compiled into the configuration pool are shared. */
+    ASSERT_TRUE(ib_matcher_compile(tm, "foo", NULL, NULL) != cpatt)
+        << "ib_matcher_compile() failed - temporary pattern shared";
+    ASSERT_TRUE(count_compiles == 3) << "ib_matcher_compile() failed - "
+                                        "wrong number of compiles";
+
+    /* Nor once configuration is finished. */
+    ib_engine_pool_temp_destroy(ib);
+    ASSERT_TRUE(ib_matcher_compile(m, "foo", NULL, NULL) != cpatt)
+        << "ib_matcher_compile() failed - shared after configuration";
+    ASSERT_TRUE(count_compiles == 4) << "ib_matcher_compile() failed - "
+                                        "wrong number of compiles";
+
+    ib_engine_destroy(ib);
+}
+
+/// @test Test ironbee library - patterns compiled as configuration jobs
+TEST(TestIronBee, test_matcher_compile_async)
+{
+    ib_engine_t *ib;
+    ib_provider_t *mpr;
+    ib_matcher_t *m;
+    void *foo1 = NULL;
+    void *foo2 = NULL;
+    void *bar = NULL;
+    void *bad = NULL;
+    void *baz = NULL;
+    void *cpatt;
+    void *many[64];
+    char patt[64][16];
+    int i;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = ib_initialize();
+    ASSERT_TRUE(rc == IB_OK) << "ib_initialize() failed - rc != IB_OK";
+
+    rc = ib_engine_create(&ib, &ibplugin);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_create() failed - rc != IB_OK";
+
+    rc = ib_provider_register(ib, IB_PROVIDER_TYPE_MATCHER, "test", &mpr,
+                              &test_matcher_iface, NULL);
+    ASSERT_TRUE(rc == IB_OK) << "ib_provider_register() failed - rc != IB_OK";
+    rc = ib_matcher_create(ib, ib_engine_pool_config_get(ib), "test", &m);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_create() failed - rc != IB_OK";
+
+    /* Patterns are only compiled once jobs are run. */
+    count_compiles = 0;
+    rc = ib_matcher_compile_async(m, "foo", &foo1, "test.conf", 1);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_compile_async() failed - "
+                                "rc != IB_OK";
+    rc = ib_matcher_compile_async(m, "foo", &foo2, "test.conf", 2);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_compile_async() failed - "
+                                "rc != IB_OK";
+    rc = ib_matcher_compile_async(m, "bar", &bar, "test.conf", 3);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_compile_async() failed - "
+                                "rc != IB_OK";
+    rc = ib_matcher_compile_async(m, "", &bad, "test.conf", 4);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_compile_async() failed - "
+                                "rc != IB_OK";
+    for (i = 0; i < 64; i++) {
+        snprintf(patt[i], sizeof(patt[i]), "p%d", i);
+        many[i] = NULL;
+        rc = ib_matcher_compile_async(m, patt[i], &many[i], "test.conf",
+                                      5 + i);
+        ASSERT_TRUE(rc == IB_OK) << "ib_matcher_compile_async() failed - "
+                                    "rc != IB_OK";
+    }
+    ASSERT_TRUE(count_compiles == 0) << "ib_matcher_compile_async() failed - "
+                                        "compiled before jobs were run";
+    ASSERT_TRUE(foo1 == NULL) << "ib_matcher_compile_async() failed - "
+                                 "pattern written before jobs were run";
+
+    /* A queued pattern used now is compiled now. */
+    cpatt = ib_matcher_compile(m, "bar", NULL, NULL);
+    ASSERT_TRUE(cpatt != NULL) << "ib_matcher_compile() failed - NULL";
+    ASSERT_TRUE(bar == cpatt) << "ib_matcher_compile() failed - "
+                                 "queued pattern not written";
+    ASSERT_TRUE(count_compiles == 1) << "ib_matcher_compile() failed - "
+                                        "wrong number of compiles";
+
+    /* All jobs are run, but the failed one is reported. */
+    rc = ib_cfgjob_run(ib);
+    ASSERT_TRUE(rc == IB_EINVAL) << "ib_cfgjob_run() failed - "
+                                    "rc != IB_EINVAL";
+    ASSERT_TRUE(count_compiles == 67) << "ib_cfgjob_run() failed - "
+                                         "wrong number of compiles";
+    ASSERT_TRUE(foo1 != NULL) << "ib_cfgjob_run() failed - NULL";
+    ASSERT_TRUE(strcmp((const char *)foo1, "foo") == 0)
+        << "ib_cfgjob_run() failed - wrong pattern written";
+    ASSERT_TRUE(foo2 == foo1) << "ib_cfgjob_run() failed - "
+                                 "identical pattern not shared";
+    ASSERT_TRUE(bar == cpatt) << "ib_cfgjob_run() failed - "
+                                 "pattern compiled again";
+    ASSERT_TRUE(bad == NULL) << "ib_cfgjob_run() failed - "
+                                "invalid pattern written";
+    for (i = 0; i < 64; i++) {
+        ASSERT_TRUE(many[i] != NULL) << "ib_cfgjob_run() failed - NULL";
+        ASSERT_TRUE(strcmp((const char *)many[i], patt[i]) == 0)
+            << "ib_cfgjob_run() failed - wrong pattern written";
+    }
+
+    /* Jobs are run right away once run. */
+    rc = ib_matcher_compile_async(m, "baz", &baz, "test.conf", 100);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_compile_async() failed - "
+                                "rc != IB_OK";
+    ASSERT_TRUE(baz != NULL) << "ib_matcher_compile_async() failed - "
+                                "not compiled right away";
+
+    ib_engine_destroy(ib);
+}
+
+/// @test Test ironbee library - failed configuration jobs fail startup
+TEST(TestIronBee, test_cfgjob_failed)
+{
+    ib_engine_t *ib;
+    ib_provider_t *mpr;
+    ib_matcher_t *m;
+    void *foo = NULL;
+    void *bad = NULL;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = ib_initialize();
+    ASSERT_TRUE(rc == IB_OK) << "ib_initialize() failed - rc != IB_OK";
+
+    rc = ib_engine_create(&ib, &ibplugin);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_create() failed - rc != IB_OK";
+
+    rc = ib_engine_init(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_init() failed - rc != IB_OK";
+
+    rc = ib_state_notify_cfg_started(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_state_notify_cfg_started() failed - "
+                                "rc != IB_OK";
+
+    rc = ib_provider_register(ib, IB_PROVIDER_TYPE_MATCHER, "test", &mpr,
+                              &test_matcher_iface, NULL);
+    ASSERT_TRUE(rc == IB_OK) << "ib_provider_register() failed - rc != IB_OK";
+    rc = ib_matcher_create(ib, ib_engine_pool_config_get(ib), "test", &m);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_create() failed - rc != IB_OK";
+
+    rc = ib_matcher_compile_async(m, "", &bad, "test.conf", 1);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_compile_async() failed - "
+                                "rc != IB_OK";
+    rc = ib_matcher_compile_async(m, "foo", &foo, "test.conf", 2);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_compile_async() failed - "
+                                "rc != IB_OK";
+
+    rc = ib_state_notify_cfg_finished(ib);
+    ASSERT_TRUE(rc == IB_EINVAL) << "ib_state_notify_cfg_finished() failed - "
+                                    "job error not returned";
+    ASSERT_TRUE(foo != NULL) << "ib_state_notify_cfg_finished() failed - "
+                                "job not run";
+
+    ib_engine_destroy(ib);
+}
+
+static ib_engine_t *test_matcher_db_engine(const char *path,
+                                           ib_matcher_t **pm)
+{
+    ib_engine_t *ib;
+    ib_provider_t *mpr;
+
+    if (ib_engine_create(&ib, &ibplugin) != IB_OK) {
+        return NULL;
+    }
+    if ((ib_provider_register(ib, IB_PROVIDER_TYPE_MATCHER, "test", &mpr,
+                              &test_matcher_db_iface, NULL) != IB_OK)
+        || (ib_matcher_create(ib, ib_engine_pool_config_get(ib), "test",
+                              pm) != IB_OK)
+        || (ib_matcher_db_open(ib, path) != IB_OK))
+    {
+        ib_engine_destroy(ib);
+        return NULL;
+    }
+
+    return ib;
+}
+
+/// @test Test ironbee library - pattern database
+TEST(TestIronBee, test_matcher_db)
+{
+    char path[] = "/tmp/ib_test_patterns.XXXXXX";
+    ib_engine_t *ib;
+    ib_matcher_t *m;
+    struct stat st;
+    ino_t ino;
+    void *cpatt;
+    int fd;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = ib_initialize();
+    ASSERT_TRUE(rc == IB_OK) << "ib_initialize() failed - rc != IB_OK";
+
+    fd = mkstemp(path);
+    ASSERT_TRUE(fd >= 0) << "mkstemp() failed";
+    close(fd);
+
+    /* Nothing saved yet, so patterns are compiled and saved. */
+    ib = test_matcher_db_engine(path, &m);
+    ASSERT_TRUE(ib != NULL) << "Failed to create engine";
+    count_compiles = 0;
+    ASSERT_TRUE(ib_matcher_compile(m, "foo", NULL, NULL) != NULL);
+    ASSERT_TRUE(ib_matcher_compile(m, "bar", NULL, NULL) != NULL);
+    ASSERT_TRUE(count_compiles == 2) << "ib_matcher_compile() failed - "
+                                        "wrong number of compiles";
+    rc = ib_matcher_db_close(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_db_close() failed - rc != IB_OK";
+    ib_engine_destroy(ib);
+    ASSERT_TRUE(stat(path, &st) == 0);
+    ino = st.st_ino;
+
+    /* The same patterns are loaded and the file is not written again. */
+    ib = test_matcher_db_engine(path, &m);
+    ASSERT_TRUE(ib != NULL) << "Failed to create engine";
+    count_compiles = 0;
+    cpatt = ib_matcher_compile(m, "bar", NULL, NULL);
+    ASSERT_TRUE(cpatt != NULL);
+    ASSERT_TRUE(strcmp((const char *)cpatt, "bar") == 0)
+        << "ib_matcher_compile() failed - wrong pattern loaded";
+    ASSERT_TRUE(ib_matcher_compile(m, "foo", NULL, NULL) != NULL);
+    ASSERT_TRUE(count_compiles == 0) << "ib_matcher_compile() failed - "
+                                        "saved pattern compiled";
+    ASSERT_TRUE(ib->matcher_loaded == 2) << "ib_matcher_compile() failed - "
+                                            "wrong number loaded";
+    rc = ib_matcher_db_close(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_db_close() failed - rc != IB_OK";
+    ib_engine_destroy(ib);
+    ASSERT_TRUE(stat(path, &st) == 0);
+    ASSERT_TRUE(st.st_ino == ino) << "ib_matcher_db_close() failed - "
+                                     "unchanged database written";
+
+    /* A new pattern is compiled and the file written again. */
+    ib = test_matcher_db_engine(path, &m);
+    ASSERT_TRUE(ib != NULL) << "Failed to create engine";
+    count_compiles = 0;
+    ASSERT_TRUE(ib_matcher_compile(m, "foo", NULL, NULL) != NULL);
+    ASSERT_TRUE(ib_matcher_compile(m, "baz", NULL, NULL) != NULL);
+    ASSERT_TRUE(count_compiles == 1) << "ib_matcher_compile() failed - "
+                                        "wrong number of compiles";
+    rc = ib_matcher_db_close(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_matcher_db_close() failed - rc != IB_OK";
+    ib_engine_destroy(ib);
+    ASSERT_TRUE(stat(path, &st) == 0);
+    ASSERT_TRUE(st.st_ino != ino) << "ib_matcher_db_close() failed - "
+                                     "changed database not written";
+
+    /* An invalid file is ignored. */
+    fd = open(path, O_WRONLY | O_TRUNC);
+    ASSERT_TRUE(fd >= 0);
+    ASSERT_TRUE(write(fd, "IBPATDB\0garbage", 15) == 15);
+    close(fd);
+    ib = test_matcher_db_engine(path, &m);
+    ASSERT_TRUE(ib != NULL) << "Failed to create engine";
+    count_compiles = 0;
+    ASSERT_TRUE(ib_matcher_compile(m, "foo", NULL, NULL) != NULL);
+    ASSERT_TRUE(count_compiles == 1) << "ib_matcher_compile() failed - "
+                                        "invalid database used";
+    ib_engine_destroy(ib);
+
+    unlink(path);
+}
+
 int main(int argc, char **argv)
 {
     ::testing::InitGoogleTest(&argc, argv);
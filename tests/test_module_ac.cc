@@ -0,0 +1,159 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee - AC Module Test Functions
+/// 
+/// @author Brian Rectanus <brectanus@qualys.com>
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ironbee_config_auto.h"
+
+#include "gtest/gtest.h"
+#include "gtest/gtest-spi.h"
+
+#define TESTING
+
+#include "engine/engine.c"
+#include "engine/logger.c"
+#include "engine/provider.c"
+#include "engine/parser.c"
+#include "engine/config.c"
+#include "engine/config-parser.c"
+#include "engine/data.c"
+#include "engine/tfn.c"
+#include "engine/operator.c"
+#include "engine/matcher.c"
+#include "engine/filter.c"
+#include "engine/stats.c"
+#include "engine/core.c"
+#include "util/debug.c"
+
+/* The module is built as C (modules/ac.c). */
+extern "C" ib_module_t IB_MODULE_SYM;
+
+/* -- Helpers -- */
+
+static ib_plugin_t ibplugin = {
+    IB_PLUGIN_HEADER_DEFAULTS,
+    "unit_tests"
+};
+
+/**
+ * Match a single pattern added to a new "ac" matcher instance.
+ */
+static ib_status_t exec_match(ib_engine_t *ib,
+                              const char *patt,
+                              const char *data)
+{
+    ib_matcher_t *m;
+    ib_status_t rc;
+
+    rc = ib_matcher_create(ib, ib_engine_pool_main_get(ib), "ac", &m);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_matcher_add_pattern(m, patt, 1, NULL, NULL);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return ib_matcher_exec_buf(m, 0, (const uint8_t *)data, strlen(data),
+                               NULL, NULL);
+}
+
+/**
+ * Match a single pattern compiled with a new "ac" matcher.
+ */
+static ib_status_t compiled_match(ib_engine_t *ib,
+                                  const char *patt,
+                                  const char *data)
+{
+    ib_matcher_t *m;
+    void *cpatt;
+    ib_status_t rc;
+
+    rc = ib_matcher_create(ib, ib_engine_pool_main_get(ib), "ac", &m);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    cpatt = ib_matcher_compile(m, patt, NULL, NULL);
+    if (cpatt == NULL) {
+        return IB_EINVAL;
+    }
+
+    return ib_matcher_match_buf(m, cpatt, 0, (const uint8_t *)data,
+                                strlen(data));
+}
+
+
+/* -- Tests -- */
+
+/// @test Test ac module - settings are taken from the main context
+TEST(TestModuleAc, test_nocase)
+{
+    ib_engine_t *ib;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = ib_initialize();
+    ASSERT_TRUE(rc == IB_OK) << "ib_initialize() failed - rc != IB_OK";
+
+    rc = ib_engine_create(&ib, &ibplugin);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_create() failed - rc != IB_OK";
+    rc = ib_engine_init(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_init() failed - rc != IB_OK";
+    rc = ib_module_init(&IB_MODULE_SYM, ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_module_init() failed - rc != IB_OK";
+
+    /* Case sensitive by default. */
+    ASSERT_EQ(IB_OK, exec_match(ib, "select", "union select"));
+    ASSERT_EQ(IB_ENOENT, exec_match(ib, "select", "UNION SELECT"));
+
+    rc = ib_state_notify_cfg_started(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_state_notify_cfg_started() failed - "
+                                "rc != IB_OK";
+    ASSERT_EQ(IB_ENOENT, exec_match(ib, "select", "UNION SELECT"));
+
+    /* Set ac.nocase 1 */
+    rc = ib_context_set_num(ib_context_main(ib), "ac.nocase", 1);
+    ASSERT_TRUE(rc == IB_OK) << "ib_context_set_num() failed - rc != IB_OK";
+
+    /* Applies to matchers created while configuring. */
+    ASSERT_EQ(IB_OK, exec_match(ib, "select", "UNION SELECT"));
+    ASSERT_EQ(IB_OK, exec_match(ib, "SeLeCt", "union select"));
+    ASSERT_EQ(IB_OK, compiled_match(ib, "select", "UNION SELECT"));
+
+    rc = ib_state_notify_cfg_finished(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_state_notify_cfg_finished() failed - "
+                                "rc != IB_OK";
+
+    /* And to those created once configuration is finished. */
+    ASSERT_EQ(IB_OK, exec_match(ib, "select", "UNION SELECT"));
+    ASSERT_EQ(IB_OK, compiled_match(ib, "select", "UNION SELECT"));
+    ASSERT_EQ(IB_ENOENT, exec_match(ib, "select", "UNION SELEC"));
+
+    ib_engine_destroy(ib);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    ib_trace_init(NULL);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,335 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee - Metrics Module Test Functions
+///
+/// @author Brian Rectanus <brectanus@qualys.com>
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ironbee_config_auto.h"
+
+#include "gtest/gtest.h"
+#include "gtest/gtest-spi.h"
+
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <sys/un.h>
+
+#define TESTING
+
+#include "engine/engine.c"
+#include "engine/logger.c"
+#include "engine/provider.c"
+#include "engine/parser.c"
+#include "engine/config.c"
+#include "engine/config-parser.c"
+#include "engine/data.c"
+#include "engine/tfn.c"
+#include "engine/operator.c"
+#include "engine/matcher.c"
+#include "engine/filter.c"
+#include "engine/stats.c"
+#include "engine/core.c"
+#include "util/debug.c"
+
+/* The module is built as C (modules/metrics.c). */
+extern "C" ib_module_t IB_MODULE_SYM;
+
+/* -- Helpers -- */
+
+static ib_plugin_t ibplugin = {
+    IB_PLUGIN_HEADER_DEFAULTS,
+    "unit_tests"
+};
+
+/**
+ * Create an engine with the module loaded and configure it with a
+ * single directive.
+ */
+static ib_status_t engine_create(ib_engine_t **pib,
+                                 const char *name,
+                                 const char *p1)
+{
+    ib_cfgparser_t *cp;
+    ib_list_t *args;
+    ib_status_t rc;
+
+    rc = ib_initialize();
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_engine_create(pib, &ibplugin);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_engine_init(*pib);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_module_init(&IB_MODULE_SYM, *pib);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_state_notify_cfg_started(*pib);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_cfgparser_create(&cp, *pib);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    rc = ib_list_create(&args, ib_engine_pool_temp_get(*pib));
+    if (rc != IB_OK) {
+        return rc;
+    }
+    ib_list_push(args, (void *)p1);
+    rc = ib_config_directive_process(cp, name, args);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return ib_state_notify_cfg_finished(*pib);
+}
+
+/**
+ * Start connections, which starts the exporter with the first.
+ */
+static ib_status_t conns_start(ib_engine_t *ib,
+                               int n)
+{
+    ib_conn_t *conn;
+    ib_hook_t *hook;
+    ib_status_t rc;
+
+    while (n-- > 0) {
+        rc = ib_conn_create(ib, &conn, NULL);
+        if (rc != IB_OK) {
+            return rc;
+        }
+
+        /* There is no parser, so only the hooks of the module are run. */
+        for (hook = ib->ectx->hook[conn_started_event];
+             hook != NULL;
+             hook = hook->next)
+        {
+            if (hook->module != &IB_MODULE_SYM) {
+                continue;
+            }
+            rc = ((ib_state_hook_fn_t)hook->callback)(ib, conn, hook->cdata);
+            if (rc != IB_OK) {
+                return rc;
+            }
+        }
+    }
+
+    return IB_OK;
+}
+
+/**
+ * Get the metrics from a socket.
+ *
+ * @returns The data read from the socket (empty on error)
+ */
+static std::string sock_get(const char *path,
+                            const char *req)
+{
+    struct sockaddr_un sun;
+    std::string data;
+    char buf[4096];
+    ssize_t n;
+    int fd;
+
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    snprintf(sun.sun_path, sizeof(sun.sun_path), "%s", path);
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return data;
+    }
+    if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) != 0) {
+        close(fd);
+        return data;
+    }
+    if ((req != NULL) && (write(fd, req, strlen(req)) < 0)) {
+        close(fd);
+        return data;
+    }
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        data.append(buf, n);
+    }
+    close(fd);
+
+    return data;
+}
+
+/**
+ * Check the metrics exposition.
+ */
+static void check_metrics(const std::string &body)
+{
+    /* Counters have the "_total" suffix in both lines. */
+    ASSERT_NE(std::string::npos,
+              body.find("# TYPE ironbee_conn_count_total counter\n"
+                        "ironbee_conn_count_total 3\n")) << body;
+    ASSERT_NE(std::string::npos,
+              body.find("# TYPE ironbee_tx_count_total counter\n"
+                        "ironbee_tx_count_total 0\n")) << body;
+    ASSERT_EQ(std::string::npos, body.find("_total_total")) << body;
+
+    /* Hook timing is a summary. */
+    ASSERT_NE(std::string::npos,
+              body.find("# TYPE ironbee_hook_duration_seconds summary\n"))
+        << body;
+}
+
+
+/* -- Tests -- */
+
+/// @test Test metrics module - exposition served on a socket
+TEST(TestModuleMetrics, test_socket)
+{
+    char path[128];
+    ib_engine_t *ib;
+    std::string data;
+    std::string hdr;
+    std::string body;
+    size_t eoh;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = engine_create(&ib, "MetricsSocket", "/tmp/ib_metrics_test.%p.sock");
+    ASSERT_TRUE(rc == IB_OK) << "engine_create() failed - rc != IB_OK";
+    rc = conns_start(ib, 3);
+    ASSERT_TRUE(rc == IB_OK) << "conns_start() failed - rc != IB_OK";
+
+    snprintf(path, sizeof(path), "/tmp/ib_metrics_test.%ld.sock",
+             (long)getpid());
+
+    /* Only the metrics without a request. */
+    body = sock_get(path, NULL);
+    check_metrics(body);
+    ASSERT_EQ(0U, body.find("# TYPE ")) << body;
+
+    /* An HTTP response to an HTTP request. */
+    data = sock_get(path, "GET /metrics HTTP/1.0\r\n\r\n");
+    eoh = data.find("\r\n\r\n");
+    ASSERT_NE(std::string::npos, eoh) << data;
+    hdr = data.substr(0, eoh + 4);
+    body = data.substr(eoh + 4);
+    ASSERT_EQ(0U, hdr.find("HTTP/1.0 200 OK\r\n")) << hdr;
+    ASSERT_NE(std::string::npos,
+              hdr.find("Content-Type: text/plain; version=0.0.4\r\n")) << hdr;
+    std::ostringstream clen;
+    clen << "Content-Length: " << body.size() << "\r\n";
+    ASSERT_NE(std::string::npos, hdr.find(clen.str())) << hdr;
+    check_metrics(body);
+
+    /* The socket is removed once the engine is destroyed. */
+    ib_engine_destroy(ib);
+    ASSERT_NE(0, access(path, F_OK));
+}
+
+/// @test Test metrics module - exposition written to a file
+TEST(TestModuleMetrics, test_file)
+{
+    char path[128];
+    ib_engine_t *ib;
+    std::ostringstream body;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = engine_create(&ib, "MetricsFile", "/tmp/ib_metrics_test.%p.prom");
+    ASSERT_TRUE(rc == IB_OK) << "engine_create() failed - rc != IB_OK";
+    rc = conns_start(ib, 3);
+    ASSERT_TRUE(rc == IB_OK) << "conns_start() failed - rc != IB_OK";
+
+    /* A final copy is written as the engine is destroyed. */
+    ib_engine_destroy(ib);
+
+    snprintf(path, sizeof(path), "/tmp/ib_metrics_test.%ld.prom",
+             (long)getpid());
+    std::ifstream in(path);
+    ASSERT_TRUE(in.good()) << "No metrics file: " << path;
+    body << in.rdbuf();
+    unlink(path);
+    check_metrics(body.str());
+}
+
+/// @test Test metrics module - exporter started again after a fork
+TEST(TestModuleMetrics, test_fork)
+{
+    char path[128];
+    char cpath[128];
+    ib_engine_t *ib;
+    pid_t pid;
+    int status;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = engine_create(&ib, "MetricsSocket", "/tmp/ib_metrics_test.%p.sock");
+    ASSERT_TRUE(rc == IB_OK) << "engine_create() failed - rc != IB_OK";
+    rc = conns_start(ib, 3);
+    ASSERT_TRUE(rc == IB_OK) << "conns_start() failed - rc != IB_OK";
+
+    snprintf(path, sizeof(path), "/tmp/ib_metrics_test.%ld.sock",
+             (long)getpid());
+
+    pid = fork();
+    ASSERT_TRUE(pid >= 0) << "fork() failed";
+    if (pid == 0) {
+        /* The child has its own exporter, started by a connection. */
+        snprintf(cpath, sizeof(cpath), "/tmp/ib_metrics_test.%ld.sock",
+                 (long)getpid());
+        if (access(cpath, F_OK) == 0) {
+            _exit(1);
+        }
+        if (conns_start(ib, 1) != IB_OK) {
+            _exit(2);
+        }
+        if (sock_get(cpath, NULL).find("ironbee_conn_count_total 4\n")
+            == std::string::npos)
+        {
+            _exit(3);
+        }
+        ib_engine_destroy(ib);
+        _exit((access(cpath, F_OK) == 0) ? 4 : 0);
+    }
+    ASSERT_EQ(pid, waitpid(pid, &status, 0));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(0, WEXITSTATUS(status));
+
+    /* The child did not remove the socket of the parent. */
+    ASSERT_EQ(0, access(path, F_OK));
+    check_metrics(sock_get(path, NULL));
+
+    ib_engine_destroy(ib);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    ib_trace_init(NULL);
+    return RUN_ALL_TESTS();
+}
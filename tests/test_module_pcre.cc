@@ -0,0 +1,244 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee - PCRE Module Test Functions
+/// 
+/// @author Brian Rectanus <brectanus@qualys.com>
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ironbee_config_auto.h"
+
+#include "gtest/gtest.h"
+#include "gtest/gtest-spi.h"
+
+#define TESTING
+
+#include "engine/engine.c"
+#include "engine/logger.c"
+#include "engine/provider.c"
+#include "engine/parser.c"
+#include "engine/config.c"
+#include "engine/config-parser.c"
+#include "engine/data.c"
+#include "engine/tfn.c"
+#include "engine/operator.c"
+#include "engine/matcher.c"
+#include "engine/filter.c"
+#include "engine/stats.c"
+#include "engine/core.c"
+#include "util/debug.c"
+
+#include <string>
+
+/* The module is built as C (modules/pcre.c). */
+extern "C" ib_module_t IB_MODULE_SYM;
+
+/* -- Helpers -- */
+
+static ib_plugin_t ibplugin = {
+    IB_PLUGIN_HEADER_DEFAULTS,
+    "unit_tests"
+};
+
+/**
+ * Create an engine with the module loaded, ready to be configured.
+ */
+static ib_status_t engine_create(ib_engine_t **pib)
+{
+    ib_status_t rc;
+
+    rc = ib_initialize();
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_engine_create(pib, &ibplugin);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_engine_init(*pib);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_module_init(&IB_MODULE_SYM, *pib);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return ib_state_notify_cfg_started(*pib);
+}
+
+/**
+ * Get the number of matches which exceeded a limit.
+ */
+static uint64_t limit_count(ib_engine_t *ib)
+{
+    ib_stat_id_t id;
+    uint64_t val = 0;
+
+    if (ib_stat_lookup(ib, "pcre.limit_exceeded", &id) == IB_OK) {
+        ib_stat_get(ib, id, &val);
+    }
+
+    return val;
+}
+
+static ib_status_t count_match(void *cbdata, ib_num_t id, size_t end)
+{
+    (*(int *)cbdata)++;
+    return IB_OK;
+}
+
+/**
+ * Stream two chunks through a single pattern and count the matches,
+ * including any reported when the stream is finished.
+ */
+static int stream_matches(ib_engine_t *ib,
+                          const char *patt,
+                          const std::string &c1,
+                          const std::string &c2)
+{
+    ib_mpool_t *mp = ib_engine_pool_main_get(ib);
+    ib_matcher_t *m;
+    ib_matcher_stream_t *ms;
+    int n = 0;
+
+    if (   (ib_matcher_create(ib, mp, "pcre", &m) != IB_OK)
+        || (ib_matcher_add_pattern(m, patt, 1, NULL, NULL) != IB_OK)
+        || (ib_matcher_stream_create(m, mp, &ms) != IB_OK))
+    {
+        return -1;
+    }
+
+    ib_matcher_stream_feed(ms, 0, (const uint8_t *)c1.data(), c1.size(),
+                           count_match, &n);
+    if (!c2.empty()) {
+        ib_matcher_stream_feed(ms, 0, (const uint8_t *)c2.data(), c2.size(),
+                               count_match, &n);
+    }
+    ib_matcher_stream_finish(ms, count_match, &n);
+
+    return n;
+}
+
+
+/* -- Tests -- */
+
+/// @test Test pcre module - matches at the end of a chunk
+TEST(TestModulePcre, test_stream_split)
+{
+    ib_engine_t *ib;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = engine_create(&ib);
+    ASSERT_TRUE(rc == IB_OK) << "engine_create() failed - rc != IB_OK";
+    rc = ib_state_notify_cfg_finished(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_state_notify_cfg_finished() failed - "
+                                "rc != IB_OK";
+
+    /* A match which the next chunk rules out is not reported. */
+    ASSERT_EQ(0, stream_matches(ib, "foo$", "xfoo", "bar"));
+    ASSERT_EQ(0, stream_matches(ib, "select\\b", "union select", "ion"));
+    ASSERT_EQ(0, stream_matches(ib, "select(?!ion)", "union select", "ion"));
+
+    /* Nor is it lost if the next chunk (or the end) allows it. */
+    ASSERT_EQ(1, stream_matches(ib, "foo$", "xfoo", ""));
+    ASSERT_EQ(1, stream_matches(ib, "select\\b", "union select", " 1"));
+    ASSERT_EQ(1, stream_matches(ib, "select(?!ion)", "union select", " 1"));
+
+    /* Matches spanning chunks are found. */
+    ASSERT_EQ(1, stream_matches(ib, "union\\s+select", "x union ", "select"));
+    ASSERT_EQ(0, stream_matches(ib, "union\\s+select", "x union ", "x"));
+    ASSERT_EQ(1, stream_matches(ib, "^GET /a+b", "GET /aaa", "aab"));
+
+    ib_engine_destroy(ib);
+}
+
+/// @test Test pcre module - match limits
+TEST(TestModulePcre, test_limit)
+{
+    ib_engine_t *ib;
+    ib_mpool_t *mp;
+    ib_matcher_t *m;
+    ib_matcher_t *mi;
+    ib_matcher_stream_t *ms;
+    void *cpatt;
+    void *cok;
+    std::string data(8, 'a');
+    int n = 0;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = engine_create(&ib);
+    ASSERT_TRUE(rc == IB_OK) << "engine_create() failed - rc != IB_OK";
+    mp = ib_engine_pool_config_get(ib);
+
+    /* Backtracking needs more than 100 steps, but within the default. */
+    data += "!";
+
+    /* Compiled before the limit is configured. */
+    ASSERT_EQ(IB_OK, ib_matcher_create(ib, mp, "pcre", &m));
+    cpatt = ib_matcher_compile(m, "(a+)+$", NULL, NULL);
+    ASSERT_TRUE(cpatt != NULL);
+    cok = ib_matcher_compile(m, "a+!", NULL, NULL);
+    ASSERT_TRUE(cok != NULL);
+    ASSERT_EQ(IB_OK, ib_matcher_create(ib, mp, "pcre", &mi));
+    ASSERT_EQ(IB_OK, ib_matcher_add_pattern(mi, "(a+)+$", 1, NULL, NULL));
+
+    ASSERT_EQ(IB_OK, ib_context_set_num(ib_context_main(ib),
+                                        "pcre.match_limit", 100));
+    rc = ib_state_notify_cfg_finished(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_state_notify_cfg_finished() failed - "
+                                "rc != IB_OK";
+    ASSERT_EQ(0U, limit_count(ib));
+
+    /* Each match which exceeds the limit fails and is counted. */
+    ASSERT_EQ(IB_ELIMIT, ib_matcher_match_buf(m, cpatt, 0,
+                                              (const uint8_t *)data.data(),
+                                              data.size()));
+    ASSERT_EQ(1U, limit_count(ib));
+    ASSERT_EQ(IB_ELIMIT, ib_matcher_exec_buf(mi, 0,
+                                             (const uint8_t *)data.data(),
+                                             data.size(), count_match, &n));
+    ASSERT_EQ(2U, limit_count(ib));
+    ASSERT_EQ(IB_OK, ib_matcher_stream_create(mi, mp, &ms));
+    ASSERT_EQ(IB_ELIMIT, ib_matcher_stream_feed(ms, 0,
+                                                (const uint8_t *)data.data(),
+                                                data.size(),
+                                                count_match, &n));
+    ASSERT_EQ(3U, limit_count(ib));
+    ASSERT_EQ(0, n);
+
+    /* Others are not. */
+    ASSERT_EQ(IB_OK, ib_matcher_match_buf(m, cok, 0,
+                                          (const uint8_t *)data.data(),
+                                          data.size()));
+    ASSERT_EQ(IB_ENOENT, ib_matcher_match_buf(m, cpatt, 0,
+                                              (const uint8_t *)"b", 1));
+    ASSERT_EQ(3U, limit_count(ib));
+
+    ib_engine_destroy(ib);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    ib_trace_init(NULL);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,139 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee - PCRE2 Module Test Functions
+/// 
+/// @author Brian Rectanus <brectanus@qualys.com>
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ironbee_config_auto.h"
+
+#include "gtest/gtest.h"
+#include "gtest/gtest-spi.h"
+
+#define TESTING
+
+#include "engine/engine.c"
+#include "engine/logger.c"
+#include "engine/provider.c"
+#include "engine/parser.c"
+#include "engine/config.c"
+#include "engine/config-parser.c"
+#include "engine/data.c"
+#include "engine/tfn.c"
+#include "engine/operator.c"
+#include "engine/matcher.c"
+#include "engine/filter.c"
+#include "engine/stats.c"
+#include "engine/core.c"
+#include "util/debug.c"
+
+#include <string>
+
+/* The module is built as C (modules/pcre2.c). */
+extern "C" ib_module_t IB_MODULE_SYM;
+
+/* -- Helpers -- */
+
+static ib_plugin_t ibplugin = {
+    IB_PLUGIN_HEADER_DEFAULTS,
+    "unit_tests"
+};
+
+static ib_status_t count_match(void *cbdata, ib_num_t id, size_t end)
+{
+    (*(int *)cbdata)++;
+    return IB_OK;
+}
+
+/**
+ * Stream two chunks through a single pattern and count the matches,
+ * including any reported when the stream is finished.
+ */
+static int stream_matches(ib_engine_t *ib,
+                          const char *patt,
+                          const std::string &c1,
+                          const std::string &c2)
+{
+    ib_mpool_t *mp = ib_engine_pool_main_get(ib);
+    ib_matcher_t *m;
+    ib_matcher_stream_t *ms;
+    int n = 0;
+
+    if (   (ib_matcher_create(ib, mp, "pcre2", &m) != IB_OK)
+        || (ib_matcher_add_pattern(m, patt, 1, NULL, NULL) != IB_OK)
+        || (ib_matcher_stream_create(m, mp, &ms) != IB_OK))
+    {
+        return -1;
+    }
+
+    ib_matcher_stream_feed(ms, 0, (const uint8_t *)c1.data(), c1.size(),
+                           count_match, &n);
+    if (!c2.empty()) {
+        ib_matcher_stream_feed(ms, 0, (const uint8_t *)c2.data(), c2.size(),
+                               count_match, &n);
+    }
+    ib_matcher_stream_finish(ms, count_match, &n);
+
+    return n;
+}
+
+
+/* -- Tests -- */
+
+/// @test Test pcre2 module - matches at the end of a chunk
+TEST(TestModulePcre2, test_stream_split)
+{
+    ib_engine_t *ib;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = ib_initialize();
+    ASSERT_TRUE(rc == IB_OK) << "ib_initialize() failed - rc != IB_OK";
+
+    rc = ib_engine_create(&ib, &ibplugin);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_create() failed - rc != IB_OK";
+    rc = ib_engine_init(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_engine_init() failed - rc != IB_OK";
+    rc = ib_module_init(&IB_MODULE_SYM, ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_module_init() failed - rc != IB_OK";
+
+    /* A match which the next chunk rules out is not reported. */
+    ASSERT_EQ(0, stream_matches(ib, "foo$", "xfoo", "bar"));
+    ASSERT_EQ(0, stream_matches(ib, "select\\b", "union select", "ion"));
+    ASSERT_EQ(0, stream_matches(ib, "select(?!ion)", "union select", "ion"));
+
+    /* Nor is it lost if the next chunk (or the end) allows it. */
+    ASSERT_EQ(1, stream_matches(ib, "foo$", "xfoo", ""));
+    ASSERT_EQ(1, stream_matches(ib, "select\\b", "union select", " 1"));
+    ASSERT_EQ(1, stream_matches(ib, "select(?!ion)", "union select", " 1"));
+
+    /* Matches spanning chunks are found. */
+    ASSERT_EQ(1, stream_matches(ib, "union\\s+select", "x union ", "select"));
+    ASSERT_EQ(0, stream_matches(ib, "union\\s+select", "x union ", "x"));
+
+    ib_engine_destroy(ib);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    ib_trace_init(NULL);
+    return RUN_ALL_TESTS();
+}
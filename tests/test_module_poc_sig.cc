@@ -0,0 +1,749 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee - PocSig Module Test Functions
+///
+/// @author Brian Rectanus <brectanus@qualys.com>
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ironbee_config_auto.h"
+
+#include "gtest/gtest.h"
+#include "gtest/gtest-spi.h"
+
+#include <string>
+
+#define TESTING
+
+#include "engine/engine.c"
+#include "engine/logger.c"
+#include "engine/provider.c"
+#include "engine/parser.c"
+#include "engine/config.c"
+#include "engine/config-parser.c"
+#include "engine/data.c"
+#include "engine/tfn.c"
+#include "engine/operator.c"
+#include "engine/matcher.c"
+#include "engine/filter.c"
+#include "engine/stats.c"
+#include "engine/core.c"
+#include "util/debug.c"
+
+/* The module is built as C (modules/poc_sig.c), which is also built
+ * with POCSIG_VM_NO_COMPUTED_GOTO to test the switch dispatch.
+ */
+extern "C" ib_module_t IB_MODULE_SYM;
+
+/* -- Helpers -- */
+
+static ib_plugin_t ibplugin = {
+    IB_PLUGIN_HEADER_DEFAULTS,
+    "unit_tests"
+};
+
+/** Context selected for transactions (by select_ctx()). */
+static ib_context_t *selected_ctx;
+
+/**
+ * Select the context in selected_ctx.
+ *
+ * Signatures only run in a context other than the main context.
+ */
+static ib_status_t select_ctx(ib_context_t *ctx,
+                              ib_ctype_t type,
+                              void *ctxdata,
+                              void *cbdata)
+{
+    return (ctx == selected_ctx) ? IB_OK : IB_DECLINED;
+}
+
+/**
+ * Create an engine with the module loaded and start configuring it.
+ */
+static ib_status_t engine_create(ib_engine_t **pib,
+                                 ib_cfgparser_t **pcp)
+{
+    ib_status_t rc;
+
+    rc = ib_initialize();
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_engine_create(pib, &ibplugin);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_engine_init(*pib);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_module_init(&IB_MODULE_SYM, *pib);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_state_notify_cfg_started(*pib);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return ib_cfgparser_create(pcp, *pib);
+}
+
+/**
+ * Create a context (selected by select_ctx()) and make it current.
+ */
+static ib_status_t context_push(ib_cfgparser_t *cp,
+                                ib_context_t **pctx)
+{
+    ib_status_t rc;
+
+    rc = ib_context_create(pctx, cp->ib, cp->cur_ctx, select_ctx, NULL);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return ib_cfgparser_context_push(cp, *pctx);
+}
+
+/**
+ * Initialize the current context and make its parent current.
+ */
+static ib_status_t context_pop(ib_cfgparser_t *cp)
+{
+    ib_context_t *ctx;
+    ib_status_t rc;
+
+    rc = ib_cfgparser_context_pop(cp, &ctx);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    return ib_context_init(ctx);
+}
+
+/**
+ * Process a directive with a single parameter in the current context.
+ */
+static ib_status_t dir_param1(ib_cfgparser_t *cp,
+                              const char *name,
+                              const char *p1)
+{
+    ib_list_t *args;
+    ib_status_t rc;
+
+    rc = ib_list_create(&args, ib_engine_pool_temp_get(cp->ib));
+    if (rc != IB_OK) {
+        return rc;
+    }
+    ib_list_push(args, (void *)p1);
+
+    return ib_config_directive_process(cp, name, args);
+}
+
+/**
+ * Add a signature to the current context.
+ */
+static ib_status_t sig_add(ib_cfgparser_t *cp,
+                           const char *name,
+                           const char *target,
+                           const char *op,
+                           const char *action,
+                           const char *option = NULL)
+{
+    ib_list_t *args;
+    ib_status_t rc;
+
+    rc = ib_list_create(&args, ib_engine_pool_temp_get(cp->ib));
+    if (rc != IB_OK) {
+        return rc;
+    }
+    ib_list_push(args, (void *)target);
+    ib_list_push(args, (void *)op);
+    ib_list_push(args, (void *)action);
+    if (option != NULL) {
+        ib_list_push(args, (void *)option);
+    }
+
+    return ib_config_directive_process(cp, name, args);
+}
+
+/**
+ * Create a transaction (with fields a=foo, b=bar and num=5) and run
+ * its request header phases in a context.
+ */
+static ib_status_t tx_run(ib_engine_t *ib,
+                          ib_context_t *ctx,
+                          ib_tx_t **ptx)
+{
+    ib_conn_t *conn;
+    ib_tx_t *tx;
+    ib_status_t rc;
+
+    rc = ib_conn_create(ib, &conn, NULL);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    rc = ib_tx_create(ib, &tx, conn, NULL);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    ib_data_add_nulstr(tx->dpi, "a", (char *)"foo", NULL);
+    ib_data_add_nulstr(tx->dpi, "b", (char *)"bar", NULL);
+    ib_data_add_num(tx->dpi, "num", 5, NULL);
+
+    /* There is no parser, so only the phase hooks are notified. */
+    selected_ctx = ctx;
+    rc = _ib_context_get(ib, IB_CTYPE_TX, tx, &tx->ctx);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    if (tx->ctx != ctx) {
+        return IB_EUNKNOWN;
+    }
+    rc = ib_state_notify_tx(ib, handle_request_headers_event, tx);
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    *ptx = tx;
+    return IB_OK;
+}
+
+/**
+ * Run the post transaction phase of a transaction.
+ */
+static ib_status_t tx_finish(ib_tx_t *tx)
+{
+    return ib_state_notify_tx(tx->ib, handle_postprocess_event, tx);
+}
+
+/**
+ * Count the times a string was logged to a log file.
+ */
+static int log_count(FILE *fh,
+                     const char *str)
+{
+    char line[1024];
+    int n = 0;
+
+    rewind(fh);
+    while (fgets(line, sizeof(line), fh) != NULL) {
+        if (strstr(line, str) != NULL) {
+            n++;
+        }
+    }
+    fseek(fh, 0, SEEK_END);
+
+    return n;
+}
+
+/**
+ * Get the messages of the events logged for a transaction.
+ *
+ * @returns Messages in the order logged, separated by a comma
+ */
+static std::string tx_events(ib_tx_t *tx)
+{
+    std::string msgs;
+    ib_list_t *events;
+    ib_list_node_t *node;
+
+    if (ib_clog_events_get(tx->ctx, &events) != IB_OK) {
+        return "(none)";
+    }
+    IB_LIST_LOOP(events, node) {
+        ib_logevent_t *e = (ib_logevent_t *)ib_list_node_data(node);
+
+        /* The events of all transactions are in the same list. */
+        if (e->mp != tx->mp) {
+            continue;
+        }
+        if (!msgs.empty()) {
+            msgs += ",";
+        }
+        msgs += e->msg;
+    }
+
+    return msgs;
+}
+
+
+/* -- Stream Matcher -- */
+
+/** Longest stream kept by the "substr" matcher. */
+#define SUBSTR_STREAM_MAX 256
+
+/**
+ * Stream state of the "substr" matcher.
+ */
+typedef struct {
+    char                buf[SUBSTR_STREAM_MAX]; /**< Data fed so far */
+    size_t              len;      /**< Data length */
+    uint32_t            found;    /**< Patterns found (by index) */
+} substr_stream_t;
+
+/**
+ * Find a string in data.
+ */
+static int substr_find(const uint8_t *data,
+                       size_t dlen,
+                       const char *patt)
+{
+    return memmem(data, dlen, patt, strlen(patt)) != NULL;
+}
+
+static ib_status_t substr_compile(ib_provider_t *mpr,
+                                  ib_mpool_t *pool,
+                                  void *pcpatt,
+                                  const char *patt,
+                                  const char **errptr,
+                                  int *erroffset)
+{
+    *(const char **)pcpatt = (const char *)ib_mpool_memdup(pool, patt,
+                                                           strlen(patt) + 1);
+    return (*(const char **)pcpatt != NULL) ? IB_OK : IB_EALLOC;
+}
+
+static ib_status_t substr_match_compiled(ib_provider_t *mpr,
+                                         void *cpatt,
+                                         ib_flags_t flags,
+                                         const uint8_t *data,
+                                         size_t dlen)
+{
+    return substr_find(data, dlen, (const char *)cpatt) ? IB_OK : IB_ENOENT;
+}
+
+static ib_status_t substr_add(ib_provider_inst_t *mpi,
+                              const char *patt,
+                              ib_num_t id,
+                              const char **errptr,
+                              int *erroffset)
+{
+    ib_list_t *patts = (ib_list_t *)mpi->data;
+    char *p;
+
+    /* Keep the ID just before the pattern. */
+    p = (char *)ib_mpool_alloc(mpi->mp, sizeof(id) + strlen(patt) + 1);
+    if (p == NULL) {
+        return IB_EALLOC;
+    }
+    memcpy(p, &id, sizeof(id));
+    strcpy(p + sizeof(id), patt);
+
+    return ib_list_push(patts, p);
+}
+
+static ib_status_t substr_match(ib_provider_inst_t *mpi,
+                                ib_flags_t flags,
+                                const uint8_t *data,
+                                size_t dlen,
+                                ib_matcher_callback_fn_t fn,
+                                void *cbdata)
+{
+    ib_list_node_t *node;
+    ib_status_t rc = IB_ENOENT;
+
+    IB_LIST_LOOP((ib_list_t *)mpi->data, node) {
+        const char *p = (const char *)ib_list_node_data(node);
+        ib_num_t id;
+
+        memcpy(&id, p, sizeof(id));
+        if (substr_find(data, dlen, p + sizeof(id))) {
+            rc = IB_OK;
+            if (fn != NULL) {
+                fn(cbdata, id, dlen);
+            }
+        }
+    }
+
+    return rc;
+}
+
+static ib_status_t substr_stream_create(ib_provider_inst_t *mpi,
+                                        ib_mpool_t *pool,
+                                        void *pstate)
+{
+    *(void **)pstate = ib_mpool_calloc(pool, 1, sizeof(substr_stream_t));
+    return (*(void **)pstate != NULL) ? IB_OK : IB_EALLOC;
+}
+
+static ib_status_t substr_stream_feed(ib_provider_inst_t *mpi,
+                                      void *state,
+                                      ib_flags_t flags,
+                                      const uint8_t *data,
+                                      size_t dlen,
+                                      ib_matcher_callback_fn_t fn,
+                                      void *cbdata)
+{
+    substr_stream_t *st = (substr_stream_t *)state;
+    ib_list_node_t *node;
+    ib_status_t rc = IB_ENOENT;
+    int i = 0;
+
+    if (dlen > sizeof(st->buf) - st->len) {
+        return IB_EINVAL;
+    }
+    memcpy(st->buf + st->len, data, dlen);
+    st->len += dlen;
+
+    /* Patterns are found once, at the end of the data fed so far. */
+    IB_LIST_LOOP((ib_list_t *)mpi->data, node) {
+        const char *p = (const char *)ib_list_node_data(node);
+        ib_num_t id;
+
+        memcpy(&id, p, sizeof(id));
+        if (   ((st->found & (1U << i)) == 0)
+            && substr_find((const uint8_t *)st->buf, st->len, p + sizeof(id)))
+        {
+            st->found |= (1U << i);
+            rc = IB_OK;
+            fn(cbdata, id, st->len);
+        }
+        i++;
+    }
+
+    return rc;
+}
+
+static ib_status_t substr_stream_finish(ib_provider_inst_t *mpi,
+                                        void *state,
+                                        ib_matcher_callback_fn_t fn,
+                                        void *cbdata)
+{
+    return IB_ENOENT;
+}
+
+static ib_status_t substr_inst_init(ib_provider_inst_t *mpi,
+                                    void *data)
+{
+    return ib_list_create((ib_list_t **)&mpi->data, mpi->mp);
+}
+
+/** Streaming substring matcher (the body signatures need a stream). */
+static IB_PROVIDER_IFACE_TYPE(matcher) substr_iface = {
+    IB_PROVIDER_IFACE_HEADER_DEFAULTS,
+    substr_compile,
+    substr_match_compiled,
+    substr_add,
+    substr_match,
+    substr_stream_create,
+    substr_stream_feed,
+    substr_stream_finish,
+    NULL,
+    NULL
+};
+
+/**
+ * Get the first pattern added to the matcher of a stream.
+ */
+static const char *stream_patt(const ib_matcher_stream_t *ms)
+{
+    const char *p;
+
+    p = (const char *)ib_list_node_data(
+        ib_list_first((ib_list_t *)ms->m->mpi->data));
+    return p + sizeof(ib_num_t);
+}
+
+/**
+ * Feed a response body chunk to a transaction.
+ */
+static ib_status_t tx_body(ib_tx_t *tx,
+                           const char *chunk)
+{
+    ib_txdata_t txdata;
+
+    txdata.ib = tx->ib;
+    txdata.mp = tx->mp;
+    txdata.tx = tx;
+    txdata.dtype = IB_DTYPE_HTTP_BODY;
+    txdata.dalloc = strlen(chunk);
+    txdata.dlen = strlen(chunk);
+    txdata.data = (uint8_t *)chunk;
+
+    return ib_state_notify_tx_data(tx->ib, tx_data_out_event, &txdata);
+}
+
+
+/* -- Tests -- */
+
+/// @test Test pocsig module - failed FETCH, TFN and chain conditions
+TEST(TestModulePocSig, test_prog_skip)
+{
+    ib_engine_t *ib;
+    ib_cfgparser_t *cp;
+    ib_context_t *ctx;
+    ib_tx_t *tx;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = engine_create(&ib, &cp);
+    ASSERT_TRUE(rc == IB_OK) << "engine_create() failed - rc != IB_OK";
+    rc = context_push(cp, &ctx);
+    ASSERT_TRUE(rc == IB_OK) << "context_push() failed - rc != IB_OK";
+
+    /* No such field, so neither group of the target is run. */
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "missing",
+                             "@contains o", "fetch-plain"));
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "missing.t(lowercase)",
+                             "@contains o", "fetch-tfn"));
+
+    /* A number cannot be transformed, so only that group is skipped. */
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "num.t(lowercase)",
+                             "@eq 5", "tfn-fail"));
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "num.t(trim)",
+                             "@eq 5", "tfn-fail2"));
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "num",
+                             "@eq 5", "tfn-none"));
+
+    /* Targets after the one skipped are still run. */
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "a",
+                             "@streq foo", "after-fetch"));
+
+    /* Fails at the second condition (the third would pass). */
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "a",
+                             "@streq foo", "chain-fail", "chain"));
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "b",
+                             "@streq nope", "", "chain"));
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "a",
+                             "@streq foo", ""));
+
+    /* Fails at the second condition fetching a missing field. */
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "a",
+                             "@streq foo", "chain-missing", "chain"));
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "missing",
+                             "@contains o", ""));
+
+    /* All conditions pass. */
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "a",
+                             "@streq foo", "chain-pass", "chain"));
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "b.t(trim)",
+                             "@streq bar", ""));
+
+    rc = context_pop(cp);
+    ASSERT_TRUE(rc == IB_OK) << "context_pop() failed - rc != IB_OK";
+    rc = ib_state_notify_cfg_finished(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_state_notify_cfg_finished() failed - "
+                                "rc != IB_OK";
+
+    rc = tx_run(ib, ctx, &tx);
+    ASSERT_TRUE(rc == IB_OK) << "tx_run() failed - rc != IB_OK";
+    ASSERT_EQ("tfn-none,after-fetch,chain-pass", tx_events(tx));
+
+    ib_engine_destroy(ib);
+}
+
+/// @test Test pocsig module - inherited signatures run first
+TEST(TestModulePocSig, test_prog_layers)
+{
+    ib_engine_t *ib;
+    ib_cfgparser_t *cp;
+    ib_context_t *parent;
+    ib_context_t *child;
+    ib_tx_t *tx;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = engine_create(&ib, &cp);
+    ASSERT_TRUE(rc == IB_OK) << "engine_create() failed - rc != IB_OK";
+
+    rc = context_push(cp, &parent);
+    ASSERT_TRUE(rc == IB_OK) << "context_push() failed - rc != IB_OK";
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "b",
+                             "@streq bar", "parent-b"));
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "a",
+                             "@streq foo", "parent-chain", "chain"));
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "b",
+                             "@streq bar", ""));
+
+    /* The child has signatures on the same target as the parent. */
+    rc = context_push(cp, &child);
+    ASSERT_TRUE(rc == IB_OK) << "context_push() failed - rc != IB_OK";
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "a",
+                             "@streq foo", "child-a"));
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "b",
+                             "@streq bar", "child-b"));
+
+    rc = context_pop(cp);
+    ASSERT_TRUE(rc == IB_OK) << "context_pop() failed - rc != IB_OK";
+    rc = context_pop(cp);
+    ASSERT_TRUE(rc == IB_OK) << "context_pop() failed - rc != IB_OK";
+    rc = ib_state_notify_cfg_finished(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_state_notify_cfg_finished() failed - "
+                                "rc != IB_OK";
+
+    /* The whole parent layer (chains included) runs before the child. */
+    rc = tx_run(ib, child, &tx);
+    ASSERT_TRUE(rc == IB_OK) << "tx_run() failed - rc != IB_OK";
+    ASSERT_EQ("parent-b,parent-chain,child-a,child-b", tx_events(tx));
+
+    ib_engine_destroy(ib);
+}
+
+/// @test Test pocsig module - signatures of parent and child contexts
+TEST(TestModulePocSig, test_inherit)
+{
+    ib_engine_t *ib;
+    ib_cfgparser_t *cp;
+    ib_context_t *parent;
+    ib_context_t *child;
+    ib_matcher_stream_t **streams;
+    ib_tx_t *tx;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = engine_create(&ib, &cp);
+    ASSERT_TRUE(rc == IB_OK) << "engine_create() failed - rc != IB_OK";
+    rc = ib_provider_register(ib, IB_PROVIDER_TYPE_MATCHER, "substr", NULL,
+                              &substr_iface, substr_inst_init);
+    ASSERT_TRUE(rc == IB_OK) << "ib_provider_register() failed - "
+                                "rc != IB_OK";
+    rc = ib_context_set_string(ib_context_main(ib), "matcher", "substr");
+    ASSERT_TRUE(rc == IB_OK) << "ib_context_set_string() failed - "
+                                "rc != IB_OK";
+
+    /* The engine (depth 0) and main (depth 1) contexts have none. */
+    rc = context_push(cp, &parent);
+    ASSERT_TRUE(rc == IB_OK) << "context_push() failed - rc != IB_OK";
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "a",
+                             "@streq foo", "parent-a"));
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigResBody", "RESPONSE_BODY",
+                             "parentbody", "parent-body"));
+
+    rc = context_push(cp, &child);
+    ASSERT_TRUE(rc == IB_OK) << "context_push() failed - rc != IB_OK";
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "b",
+                             "@streq bar", "child-b"));
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigResBody", "RESPONSE_BODY",
+                             "childbody", "child-body"));
+
+    rc = context_pop(cp);
+    ASSERT_TRUE(rc == IB_OK) << "context_pop() failed - rc != IB_OK";
+    rc = context_pop(cp);
+    ASSERT_TRUE(rc == IB_OK) << "context_pop() failed - rc != IB_OK";
+    rc = ib_state_notify_cfg_finished(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_state_notify_cfg_finished() failed - "
+                                "rc != IB_OK";
+
+    /* The parent does not run the signatures of the child. */
+    rc = tx_run(ib, parent, &tx);
+    ASSERT_TRUE(rc == IB_OK) << "tx_run() failed - rc != IB_OK";
+    ASSERT_EQ(IB_OK, tx_body(tx, "parentbo"));
+    ASSERT_EQ(IB_OK, tx_body(tx, "dy childbody"));
+    ASSERT_EQ("parent-a,parent-body", tx_events(tx));
+
+    rc = ib_hash_get(tx->data, "pocsig.resbody", &streams);
+    ASSERT_TRUE(rc == IB_OK) << "ib_hash_get() failed - rc != IB_OK";
+    ASSERT_TRUE(streams[0] == NULL);
+    ASSERT_TRUE(streams[1] == NULL);
+    ASSERT_TRUE(streams[2] != NULL);
+    ASSERT_STREQ("parentbody", stream_patt(streams[2]));
+
+    /* The child runs those of the parent then its own. */
+    rc = tx_run(ib, child, &tx);
+    ASSERT_TRUE(rc == IB_OK) << "tx_run() failed - rc != IB_OK";
+    ASSERT_EQ(IB_OK, tx_body(tx, "childbo"));
+    ASSERT_EQ(IB_OK, tx_body(tx, "dy parentbody"));
+    ASSERT_EQ("parent-a,child-b,child-body,parent-body", tx_events(tx));
+
+    /* With a body stream for each layer, indexed by its depth. */
+    rc = ib_hash_get(tx->data, "pocsig.resbody", &streams);
+    ASSERT_TRUE(rc == IB_OK) << "ib_hash_get() failed - rc != IB_OK";
+    ASSERT_TRUE(streams[0] == NULL);
+    ASSERT_TRUE(streams[1] == NULL);
+    ASSERT_TRUE(streams[2] != NULL);
+    ASSERT_TRUE(streams[3] != NULL);
+    ASSERT_STREQ("parentbody", stream_patt(streams[2]));
+    ASSERT_STREQ("childbody", stream_patt(streams[3]));
+
+    ib_engine_destroy(ib);
+}
+
+/// @test Test pocsig module - profile dumped when signaled
+TEST(TestModulePocSig, test_prof_dump_signal)
+{
+    ib_engine_t *ib;
+    ib_cfgparser_t *cp;
+    ib_context_t *ctx;
+    ib_provider_inst_t *lpi;
+    struct sigaction sa;
+    FILE *log;
+    FILE *prev;
+    ib_tx_t *tx;
+    ib_status_t rc;
+
+    atexit(ib_shutdown);
+    rc = engine_create(&ib, &cp);
+    ASSERT_TRUE(rc == IB_OK) << "engine_create() failed - rc != IB_OK";
+
+    ASSERT_EQ(IB_EINVAL, dir_param1(cp, "PocSigProfileDumpSignal", "NOPE"));
+    ASSERT_EQ(IB_OK, dir_param1(cp, "PocSigProfileDumpSignal", "SIGUSR2"));
+
+    rc = context_push(cp, &ctx);
+    ASSERT_TRUE(rc == IB_OK) << "context_push() failed - rc != IB_OK";
+    ASSERT_EQ(IB_OK, dir_param1(cp, "PocSigProfile", "On"));
+    ASSERT_EQ(IB_OK, sig_add(cp, "PocSigReqHead", "a",
+                             "@streq foo", "profiled"));
+    rc = context_pop(cp);
+    ASSERT_TRUE(rc == IB_OK) << "context_pop() failed - rc != IB_OK";
+    rc = ib_state_notify_cfg_finished(ib);
+    ASSERT_TRUE(rc == IB_OK) << "ib_state_notify_cfg_finished() failed - "
+                                "rc != IB_OK";
+
+    /* Capture the log (written to the logger provider data). */
+    lpi = ib_log_provider_get_instance(ib_context_main(ib));
+    ASSERT_TRUE(lpi != NULL);
+    log = tmpfile();
+    ASSERT_TRUE(log != NULL);
+    prev = (FILE *)lpi->pr->data;
+    lpi->pr->data = log;
+
+    /* Not dumped until requested. */
+    ASSERT_EQ(IB_OK, tx_run(ib, ctx, &tx));
+    ASSERT_EQ(IB_OK, tx_finish(tx));
+    ASSERT_EQ(0, log_count(log, "PocSig PROFILE:"));
+
+    /* Dumped once by the next transaction to finish. */
+    ASSERT_EQ(0, raise(SIGUSR2));
+    ASSERT_EQ(0, log_count(log, "PocSig PROFILE:"));
+    ASSERT_EQ(IB_OK, tx_run(ib, ctx, &tx));
+    ASSERT_EQ(IB_OK, tx_finish(tx));
+    ASSERT_EQ(1, log_count(log, "PocSig PROFILE: 1 of 1 signatures"));
+    ASSERT_EQ(1, log_count(log, "evals=2 matches=2"));
+    ASSERT_EQ(IB_OK, tx_run(ib, ctx, &tx));
+    ASSERT_EQ(IB_OK, tx_finish(tx));
+    ASSERT_EQ(1, log_count(log, "PocSig PROFILE: 1 of 1 signatures"));
+
+    lpi->pr->data = prev;
+    fclose(log);
+
+    /* The previous handler is restored. */
+    ib_engine_destroy(ib);
+    ASSERT_EQ(0, sigaction(SIGUSR2, NULL, &sa));
+    ASSERT_TRUE(sa.sa_handler == SIG_DFL);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    ib_trace_init(NULL);
+    return RUN_ALL_TESTS();
+}
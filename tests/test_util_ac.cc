@@ -0,0 +1,334 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee - Aho-Corasick Test Functions
+///
+/// @author Brian Rectanus <brectanus@qualys.com>
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ironbee_config_auto.h"
+
+#include "gtest/gtest.h"
+#include "gtest/gtest-spi.h"
+
+#define TESTING
+
+#include "util/util.c"
+#include "util/mpool.c"
+#include "util/debug.c"
+#include "util/cpu.c"
+#include "util/strops.c"
+#include "util/ac.c"
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <utility>
+#include <algorithm>
+
+
+/* -- Helpers -- */
+
+typedef std::vector<std::pair<size_t, ib_num_t> > matches_t;
+
+/// Collect matches as (end, id) pairs.
+static ib_status_t collect(void *cbdata, ib_num_t id, size_t end)
+{
+    matches_t *m = (matches_t *)cbdata;
+
+    m->push_back(std::make_pair(end, id));
+
+    return IB_OK;
+}
+
+/// Stop after the first match.
+static ib_status_t stop(void *cbdata, ib_num_t id, size_t end)
+{
+    *(ib_num_t *)cbdata = id;
+
+    return IB_DECLINED;
+}
+
+/// Build an automaton from patterns (IDs are the index).
+static ib_ac_t *build(ib_mpool_t *mp,
+                      const std::vector<std::string> &patts,
+                      ib_flags_t flags)
+{
+    ib_ac_t *ac;
+    ib_status_t rc;
+
+    rc = ib_ac_create(&ac, mp, flags);
+    EXPECT_EQ(IB_OK, rc);
+    for (size_t i = 0; i < patts.size(); i++) {
+        rc = ib_ac_add_pattern(ac, (const uint8_t *)patts[i].data(),
+                               patts[i].size(), (ib_num_t)i);
+        EXPECT_EQ(IB_OK, rc);
+    }
+    rc = ib_ac_build(ac);
+    EXPECT_EQ(IB_OK, rc);
+
+    return ac;
+}
+
+/// Naive matching, in the same order as the automaton reports.
+static matches_t naive(const std::vector<std::string> &patts,
+                       const std::string &data,
+                       bool nocase)
+{
+    matches_t m;
+
+    for (size_t end = 1; end <= data.size(); end++) {
+        /* Longest first, as found along the failure chain. */
+        std::vector<std::pair<size_t, ib_num_t> > here;
+
+        for (size_t i = 0; i < patts.size(); i++) {
+            size_t len = patts[i].size();
+            size_t j;
+
+            if (len > end) {
+                continue;
+            }
+            for (j = 0; j < len; j++) {
+                int a = (unsigned char)data[end - len + j];
+                int b = (unsigned char)patts[i][j];
+                if (nocase ? (tolower(a) != tolower(b)) : (a != b)) {
+                    break;
+                }
+            }
+            if (j == len) {
+                here.push_back(std::make_pair(~len, (ib_num_t)i));
+            }
+        }
+        std::sort(here.begin(), here.end());
+        for (size_t i = 0; i < here.size(); i++) {
+            m.push_back(std::make_pair(end, here[i].second));
+        }
+    }
+
+    return m;
+}
+
+
+/* -- Tests -- */
+
+/// @test Test util ac library - ib_ac_match()
+TEST(TestIBUtilAC, test_ac_match)
+{
+    ib_mpool_t *mp;
+    ib_ac_t *ac;
+    matches_t m;
+    std::vector<std::string> patts;
+    const char *data = "ushers";
+    ib_status_t rc;
+
+    ASSERT_EQ(IB_OK, ib_mpool_create(&mp, NULL));
+
+    patts.push_back("he");
+    patts.push_back("she");
+    patts.push_back("his");
+    patts.push_back("hers");
+    ac = build(mp, patts, 0);
+    ASSERT_EQ(4UL, ib_ac_pattern_count(ac));
+    ASSERT_TRUE(ib_ac_memory(ac) > 0);
+
+    rc = ib_ac_match(ac, (const uint8_t *)data, strlen(data), collect, &m);
+    ASSERT_EQ(IB_OK, rc);
+    ASSERT_EQ(3UL, m.size());
+    ASSERT_EQ(std::make_pair((size_t)4, (ib_num_t)1), m[0]);
+    ASSERT_EQ(std::make_pair((size_t)4, (ib_num_t)0), m[1]);
+    ASSERT_EQ(std::make_pair((size_t)6, (ib_num_t)3), m[2]);
+
+    /* No callback and no match. */
+    rc = ib_ac_match(ac, (const uint8_t *)data, strlen(data), NULL, NULL);
+    ASSERT_EQ(IB_OK, rc);
+    rc = ib_ac_match(ac, (const uint8_t *)"xyz", 3, collect, &m);
+    ASSERT_EQ(IB_ENOENT, rc);
+
+    /* Stopping from the callback. */
+    ib_num_t id = -1;
+    rc = ib_ac_match(ac, (const uint8_t *)data, strlen(data), stop, &id);
+    ASSERT_EQ(IB_DECLINED, rc);
+    ASSERT_EQ(1, id);
+
+    /* Cannot add once built, nor add empty patterns. */
+    ASSERT_EQ(IB_EINVAL, ib_ac_add_pattern(ac, (const uint8_t *)"x", 1, 9));
+    ASSERT_EQ(IB_OK, ib_ac_create(&ac, mp, 0));
+    ASSERT_EQ(IB_EINVAL, ib_ac_add_pattern(ac, (const uint8_t *)"", 0, 9));
+    ASSERT_EQ(IB_EINVAL, ib_ac_match(ac, (const uint8_t *)"x", 1, NULL, NULL));
+
+    ib_mpool_destroy(mp);
+}
+
+/// @test Test util ac library - case insensitive and duplicates
+TEST(TestIBUtilAC, test_ac_nocase)
+{
+    ib_mpool_t *mp;
+    ib_ac_t *ac;
+    matches_t m;
+    std::vector<std::string> patts;
+    std::string data("xUnIoN SELECT union");
+    ib_status_t rc;
+
+    ASSERT_EQ(IB_OK, ib_mpool_create(&mp, NULL));
+
+    patts.push_back("union");
+    patts.push_back("Select");
+    patts.push_back("UNION");
+    ac = build(mp, patts, IB_AC_FNOCASE);
+
+    rc = ib_ac_match(ac, (const uint8_t *)data.data(), data.size(), collect, &m);
+    ASSERT_EQ(IB_OK, rc);
+    ASSERT_TRUE(naive(patts, data, true) == m);
+    ASSERT_EQ(5UL, m.size());
+
+    /* Case sensitive. */
+    m.clear();
+    ac = build(mp, patts, 0);
+    rc = ib_ac_match(ac, (const uint8_t *)data.data(), data.size(), collect, &m);
+    ASSERT_EQ(IB_OK, rc);
+    ASSERT_TRUE(naive(patts, data, false) == m);
+    ASSERT_EQ(1UL, m.size());
+
+    ib_mpool_destroy(mp);
+}
+
+/// @test Test util ac library - random patterns against a naive matcher
+TEST(TestIBUtilAC, test_ac_random)
+{
+    ib_mpool_t *mp;
+
+    ASSERT_EQ(IB_OK, ib_mpool_create(&mp, NULL));
+    srand(1);
+
+    for (int round = 0; round < 50; round++) {
+        std::vector<std::string> patts;
+        std::string data;
+        matches_t m;
+        ib_ac_t *ac;
+        bool nocase = (round & 1);
+        /* Small alphabets give lots of overlapping matches. */
+        int alpha = 2 + (round % 6);
+
+        for (int i = 0; i < 1 + rand() % 40; i++) {
+            std::string p;
+            for (int j = 0; j < 1 + rand() % 6; j++) {
+                p += (char)((rand() & 1 ? 'a' : 'A') + rand() % alpha);
+            }
+            patts.push_back(p);
+        }
+        for (int i = 0; i < 500; i++) {
+            data += (char)((rand() & 1 ? 'a' : 'A') + rand() % (alpha + 1));
+        }
+
+        ac = build(mp, patts, nocase ? IB_AC_FNOCASE : 0);
+        ib_ac_match(ac, (const uint8_t *)data.data(), data.size(), collect, &m);
+        ASSERT_TRUE(naive(patts, data, nocase) == m) << "round " << round;
+    }
+
+    ib_mpool_destroy(mp);
+}
+
+/// @test Test util ac library - large keyword lists
+TEST(TestIBUtilAC, test_ac_large)
+{
+    ib_mpool_t *mp;
+    ib_ac_t *ac;
+    std::vector<std::string> patts;
+    std::string data;
+    matches_t m;
+    char buf[32];
+
+    ASSERT_EQ(IB_OK, ib_mpool_create(&mp, NULL));
+
+    for (int i = 0; i < 50000; i++) {
+        snprintf(buf, sizeof(buf), "kw%dx", i * 7);
+        patts.push_back(buf);
+    }
+    ac = build(mp, patts, 0);
+    ASSERT_EQ(50000UL, ib_ac_pattern_count(ac));
+
+    data = "some kw0x and kw70x, but not kw1x or kw349993x";
+    ib_ac_match(ac, (const uint8_t *)data.data(), data.size(), collect, &m);
+    ASSERT_EQ(3UL, m.size());
+    ASSERT_EQ(0, m[0].second);
+    ASSERT_EQ(10, m[1].second);
+    ASSERT_EQ(49999, m[2].second);
+
+    ib_mpool_destroy(mp);
+}
+
+/// @test Test util ac library - ib_ac_match_stream()
+TEST(TestIBUtilAC, test_ac_stream)
+{
+    ib_mpool_t *mp;
+    ib_ac_t *ac;
+    std::vector<std::string> patts;
+    std::string data("hers and his ushers shed hishershe");
+    matches_t expected;
+    ib_ac_stream_t as;
+
+    ASSERT_EQ(IB_OK, ib_mpool_create(&mp, NULL));
+
+    patts.push_back("he");
+    patts.push_back("she");
+    patts.push_back("his");
+    patts.push_back("hers");
+    ac = build(mp, patts, 0);
+    ib_ac_match(ac, (const uint8_t *)data.data(), data.size(),
+                collect, &expected);
+    ASSERT_TRUE(naive(patts, data, false) == expected);
+
+    /* Every split point gives the same matches and offsets. */
+    for (size_t split = 0; split <= data.size(); split++) {
+        matches_t m;
+
+        ib_ac_stream_init(&as);
+        ib_ac_match_stream(ac, &as, (const uint8_t *)data.data(), split,
+                           collect, &m);
+        ib_ac_match_stream(ac, &as, (const uint8_t *)data.data() + split,
+                           data.size() - split, collect, &m);
+        ASSERT_TRUE(expected == m) << "split " << split;
+        ASSERT_EQ(data.size(), as.offset);
+    }
+
+    /* A byte at a time. */
+    matches_t m;
+    ib_ac_stream_init(&as);
+    for (size_t i = 0; i < data.size(); i++) {
+        ib_ac_match_stream(ac, &as, (const uint8_t *)data.data() + i, 1,
+                           collect, &m);
+    }
+    ASSERT_TRUE(expected == m);
+
+    /* A match spanning chunks without a callback. */
+    ib_ac_stream_init(&as);
+    ASSERT_EQ(IB_ENOENT, ib_ac_match_stream(ac, &as, (const uint8_t *)"xh",
+                                            2, NULL, NULL));
+    ASSERT_EQ(IB_OK, ib_ac_match_stream(ac, &as, (const uint8_t *)"is",
+                                        2, NULL, NULL));
+
+    ib_mpool_destroy(mp);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    ib_trace_init(NULL);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,187 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee - Decoding Test Functions
+/// 
+/// @author Brian Rectanus <brectanus@qualys.com>
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ironbee_config_auto.h"
+
+#include "gtest/gtest.h"
+#include "gtest/gtest-spi.h"
+
+#define TESTING
+
+#include "util/cpu.c"
+#include "util/strops.c"
+#include "util/decode.c"
+
+#include <string>
+
+
+/* -- Helpers -- */
+
+/// Decode function.
+typedef int (*decode_fn_t)(uint8_t *data, size_t dlen, size_t *pdlen);
+
+/// Run a decoder on a copy of the input, returning the output.
+static std::string decode(decode_fn_t fn, const std::string &in, int *pmod = NULL)
+{
+    std::string buf(in);
+    size_t dlen;
+    int modified;
+
+    modified = fn((uint8_t *)&buf[0], buf.size(), &dlen);
+    if (pmod != NULL) {
+        *pmod = modified;
+    }
+
+    return buf.substr(0, dlen);
+}
+
+static int decode_path(uint8_t *data, size_t dlen, size_t *pdlen)
+{
+    return ib_decode_path(data, dlen, pdlen, 0);
+}
+
+static int decode_path_win(uint8_t *data, size_t dlen, size_t *pdlen)
+{
+    return ib_decode_path(data, dlen, pdlen, 1);
+}
+
+
+/* -- Tests -- */
+
+/// @test Test util decode library - ib_decode_url()
+TEST(TestIBUtilDecode, test_decode_url)
+{
+    int modified;
+
+    ASSERT_EQ("a b<c>", decode(ib_decode_url, "a+b%3cc%3E"));
+    ASSERT_EQ("AB", decode(ib_decode_url, "%u0041%uff22"));
+    ASSERT_EQ("%4A%zz%u12x%", decode(ib_decode_url, "%4%41%zz%u12x%"));
+    ASSERT_EQ(std::string("a\0b", 3), decode(ib_decode_url, "a%00b"));
+
+    std::string plain(100, 'x');
+    ASSERT_EQ(plain, decode(ib_decode_url, plain, &modified));
+    ASSERT_TRUE(modified == 0) << "ib_decode_url() failed - unencoded data flagged";
+
+    /* Escapes spanning vector blocks. */
+    std::string in = std::string(31, 'x') + "%41" + std::string(40, 'y') + "+";
+    std::string out = std::string(31, 'x') + "A" + std::string(40, 'y') + " ";
+    ASSERT_EQ(out, decode(ib_decode_url, in));
+}
+
+/// @test Test util decode library - ib_decode_hex()
+TEST(TestIBUtilDecode, test_decode_hex)
+{
+    ASSERT_EQ("AB", decode(ib_decode_hex, "4142"));
+    ASSERT_EQ("Azz4", decode(ib_decode_hex, "41zz4"));
+}
+
+/// @test Test util decode library - ib_decode_base64()
+TEST(TestIBUtilDecode, test_decode_base64)
+{
+    ASSERT_EQ("hello world", decode(ib_decode_base64, "aGVsbG8gd29y\nbGQ="));
+    ASSERT_EQ("ab", decode(ib_decode_base64, "YWI="));
+    ASSERT_EQ("ab", decode(ib_decode_base64, "YWI*junk"));
+}
+
+/// @test Test util decode library - ib_decode_html_entity()
+TEST(TestIBUtilDecode, test_decode_html_entity)
+{
+    ASSERT_EQ("<a href=\"x\">&'", decode(ib_decode_html_entity, "&lt;a href=&quot;x&quot&gt;&amp;&apos;"));
+    ASSERT_EQ("AB\xa0", decode(ib_decode_html_entity, "&#65;&#x42&nbsp;"));
+    ASSERT_EQ("&foo; &#; &#x;&", decode(ib_decode_html_entity, "&foo; &#; &#x;&"));
+}
+
+/// @test Test util decode library - ib_decode_js()
+TEST(TestIBUtilDecode, test_decode_js)
+{
+    ASSERT_EQ("AB\n\"/", decode(ib_decode_js, "\\x41\\u0042\\n\\\"\\/"));
+    ASSERT_EQ("S\x01" "9", decode(ib_decode_js, "\\123\\19"));
+    ASSERT_EQ("x4", decode(ib_decode_js, "\\x4"));
+    ASSERT_EQ("trailing\\", decode(ib_decode_js, "trailing\\"));
+}
+
+/// @test Test util decode library - ib_decode_css()
+TEST(TestIBUtilDecode, test_decode_css)
+{
+    ASSERT_EQ("AB", decode(ib_decode_css, "\\41 \\000042"));
+    ASSERT_EQ("A x", decode(ib_decode_css, "\\41  x"));
+    ASSERT_EQ("xy", decode(ib_decode_css, "x\\\ny"));
+    ASSERT_EQ("zq", decode(ib_decode_css, "\\z\\q"));
+}
+
+/// @test Test util decode library - ib_decode_path()
+TEST(TestIBUtilDecode, test_decode_path)
+{
+    int modified;
+
+    ASSERT_EQ("/a/c", decode(decode_path, "/a/./b/../c"));
+    ASSERT_EQ("/a/", decode(decode_path, "//a//b/.."));
+    ASSERT_EQ("/etc/passwd", decode(decode_path, "/../../etc/passwd"));
+    ASSERT_EQ("../../b", decode(decode_path, "../../a/../b"));
+    ASSERT_EQ("a/", decode(decode_path, "a/."));
+    ASSERT_EQ("/a/b", decode(decode_path_win, "\\a\\.\\b"));
+    ASSERT_EQ("/a\\b", decode(decode_path, "/a\\b"));
+
+    ASSERT_EQ("/a.b/c", decode(decode_path, "/a.b/c", &modified));
+    ASSERT_TRUE(modified == 0) << "ib_decode_path() failed - normal path flagged";
+}
+
+/// @test Test util decode library - chunked decoding
+TEST(TestIBUtilDecode, test_decode_partial)
+{
+    std::string buf("ab%4");
+    size_t dlen;
+    size_t consumed;
+
+    /* A possibly incomplete escape is left unconsumed and untouched. */
+    ib_decode_url_ex((uint8_t *)&buf[0], buf.size(), &dlen, &consumed);
+    ASSERT_EQ(2UL, dlen);
+    ASSERT_EQ(2UL, consumed);
+    ASSERT_EQ("ab%4", buf);
+
+    buf = "%41" + std::string(20, 'x') + "\\x4";
+    ib_decode_js_ex((uint8_t *)&buf[0], buf.size(), &dlen, &consumed);
+    ASSERT_EQ(buf.size() - 3, consumed);
+    ASSERT_EQ(std::string("%41") + std::string(20, 'x'), buf.substr(0, dlen));
+
+    /* Base64 carries its state instead. */
+    ib_decode_base64_state_t state;
+    std::string out;
+
+    memset(&state, 0, sizeof(state));
+    buf = "aGVsb";
+    ib_decode_base64_ex((uint8_t *)&buf[0], buf.size(), &dlen, &state);
+    out += buf.substr(0, dlen);
+    buf = "G8=YQ";
+    ib_decode_base64_ex((uint8_t *)&buf[0], buf.size(), &dlen, &state);
+    out += buf.substr(0, dlen);
+    ASSERT_EQ("hello", out);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    ib_trace_init(NULL);
+    return RUN_ALL_TESTS();
+}
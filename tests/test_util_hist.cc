@@ -0,0 +1,128 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee - Histogram Test Functions
+/// 
+/// @author Brian Rectanus <brectanus@qualys.com>
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ironbee_config_auto.h"
+
+#include "gtest/gtest.h"
+#include "gtest/gtest-spi.h"
+
+#define TESTING
+
+#include "util/util.c"
+#include "util/hist.c"
+#include "util/mpool.c"
+#include "util/debug.c"
+
+
+/* -- Tests -- */
+
+/// @test Test util histogram library - ib_hist_create()
+TEST(TestIBUtilHist, test_hist_create)
+{
+    ib_mpool_t *mp;
+    ib_hist_t *h;
+    ib_status_t rc;
+    
+    atexit(ib_shutdown);
+    rc = ib_initialize();
+    ASSERT_TRUE(rc == IB_OK) << "ib_initialize() failed - rc != IB_OK";
+    rc = ib_mpool_create(&mp, NULL);
+    ASSERT_TRUE(rc == IB_OK) << "ib_mpool_create() failed - rc != IB_OK";
+    
+    rc = ib_hist_create(&h, mp);
+    ASSERT_TRUE(rc == IB_OK) << "ib_hist_create() failed - rc != IB_OK";
+    ASSERT_TRUE(h != NULL) << "ib_hist_create() failed - NULL value";
+    ASSERT_TRUE(h->count == 0) << "ib_hist_create() failed - not empty";
+    ASSERT_TRUE(ib_hist_percentile(h, 50.0) == 0) << "ib_hist_percentile() failed - empty histogram not zero";
+
+    ib_mpool_destroy(mp);
+}
+
+/// @test Test util histogram library - small values are exact
+TEST(TestIBUtilHist, test_hist_exact)
+{
+    ib_hist_t h;
+    uint64_t v;
+
+    for (v = 0; v < 64; v++) {
+        ib_hist_clear(&h);
+        ib_hist_record(&h, v);
+        ASSERT_TRUE(ib_hist_percentile(&h, 50.0) == v) << "ib_hist_percentile() failed - wrong value for " << v;
+    }
+
+    ib_hist_clear(&h);
+    ib_hist_record(&h, UINT64_MAX);
+    ASSERT_TRUE(ib_hist_percentile(&h, 99.0) == UINT64_MAX) << "ib_hist_percentile() failed - wrong max value";
+}
+
+/// @test Test util histogram library - ib_hist_record() and ib_hist_percentile()
+TEST(TestIBUtilHist, test_hist_percentile)
+{
+    ib_hist_t h;
+    uint64_t v;
+    uint64_t p50;
+    uint64_t p99;
+
+    ib_hist_clear(&h);
+    for (v = 1; v <= 1000; v++) {
+        ib_hist_record(&h, v * 1000);
+    }
+
+    ASSERT_TRUE(h.count == 1000) << "ib_hist_record() failed - wrong count";
+    ASSERT_TRUE(h.min == 1000) << "ib_hist_record() failed - wrong min";
+    ASSERT_TRUE(h.max == 1000000) << "ib_hist_record() failed - wrong max";
+    ASSERT_TRUE(ib_hist_mean(&h) == 500500) << "ib_hist_mean() failed - wrong mean";
+
+    /* Within the 12.5% bucket precision. */
+    p50 = ib_hist_percentile(&h, 50.0);
+    ASSERT_TRUE((p50 >= 500000) && (p50 <= 562500)) << "ib_hist_percentile() failed - wrong p50 " << p50;
+    p99 = ib_hist_percentile(&h, 99.0);
+    ASSERT_TRUE((p99 >= 990000) && (p99 <= 1000000)) << "ib_hist_percentile() failed - wrong p99 " << p99;
+}
+
+/// @test Test util histogram library - ib_hist_merge()
+TEST(TestIBUtilHist, test_hist_merge)
+{
+    ib_hist_t h1;
+    ib_hist_t h2;
+
+    ib_hist_clear(&h1);
+    ib_hist_clear(&h2);
+    ib_hist_record(&h1, 10);
+    ib_hist_record(&h2, 5);
+    ib_hist_record(&h2, 20);
+
+    ib_hist_merge(&h1, &h2);
+    ASSERT_TRUE(h1.count == 3) << "ib_hist_merge() failed - wrong count";
+    ASSERT_TRUE(h1.sum == 35) << "ib_hist_merge() failed - wrong sum";
+    ASSERT_TRUE(h1.min == 5) << "ib_hist_merge() failed - wrong min";
+    ASSERT_TRUE(h1.max == 20) << "ib_hist_merge() failed - wrong max";
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    ib_trace_init(NULL);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,549 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee - Regular Expression (DFA) Test Functions
+///
+/// @author Brian Rectanus <brectanus@qualys.com>
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ironbee_config_auto.h"
+
+#include "gtest/gtest.h"
+#include "gtest/gtest-spi.h"
+
+#define TESTING
+
+#include "util/util.c"
+#include "util/mpool.c"
+#include "util/debug.c"
+#include "util/list.c"
+#include "util/cpu.c"
+#include "util/strops.c"
+#include "util/re.c"
+
+#include <stdlib.h>
+#include <string>
+#include <vector>
+#include <utility>
+
+
+/* -- Helpers -- */
+
+typedef std::vector<std::pair<size_t, ib_num_t> > matches_t;
+
+/// Collect matches as (end, id) pairs.
+static ib_status_t collect(void *cbdata, ib_num_t id, size_t end)
+{
+    matches_t *m = (matches_t *)cbdata;
+
+    m->push_back(std::make_pair(end, id));
+
+    return IB_OK;
+}
+
+/// Build a regex from a single pattern.
+static ib_re_t *build1(ib_mpool_t *mp, const char *patt, ib_flags_t flags)
+{
+    ib_re_t *re;
+
+    EXPECT_EQ(IB_OK, ib_re_create(&re, mp, flags, 0));
+    EXPECT_EQ(IB_OK, ib_re_add_pattern(re, patt, 1, NULL, NULL)) << patt;
+    EXPECT_EQ(IB_OK, ib_re_build(re));
+
+    return re;
+}
+
+/// Match a single pattern, returning the end of the match or -1.
+static long match1(ib_mpool_t *mp, const char *patt, const std::string &data,
+                   ib_flags_t flags = 0)
+{
+    ib_re_t *re = build1(mp, patt, flags);
+    matches_t m;
+    ib_status_t rc;
+
+    rc = ib_re_match(re, (const uint8_t *)data.data(), data.size(),
+                     collect, &m);
+    if (rc == IB_ENOENT) {
+        EXPECT_EQ(0UL, m.size());
+        return -1;
+    }
+    EXPECT_EQ(IB_OK, rc);
+    EXPECT_EQ(1UL, m.size());
+
+    return (long)m[0].first;
+}
+
+
+/* -- Tests -- */
+
+/// @test Test util re library - syntax
+TEST(TestIBUtilRE, test_re_syntax)
+{
+    ib_mpool_t *mp;
+    struct {
+        const char *patt;
+        const char *data;
+        long end;
+    } tests[] = {
+        { "abc",            "xxabcxx",        5 },
+        { "abc",            "xxabxcx",       -1 },
+        { "a|b|c",          "xxc",            3 },
+        { "ab*c",           "xac",            3 },
+        { "ab*c",           "xabbbbc",        7 },
+        { "ab+c",           "xac",           -1 },
+        { "ab?c",           "abbc",          -1 },
+        { "a(bc)*d",        "abcbcd",         6 },
+        { "a(?:bc)+d",      "ad abcd",        7 },
+        { "a{3}",           "aab aaa",        7 },
+        { "xa{2,3}y",       "xay xaaaay xaaay", 16 },
+        { "xa{2,}y",        "xaaaaaay",       8 },
+        { "x(ab){0,2}y",    "xababy",         6 },
+        { "x(ab){0,2}y",    "xabababy",      -1 },
+        { "a{,2}",          "a{,2}",          5 },
+        { "^abc",           "abcd",           3 },
+        { "^abc",           "xabc",          -1 },
+        { "abc$",           "xabc",           4 },
+        { "abc$",           "abc\n",         -1 },
+        { "^$",             "",               0 },
+        { "\\Aab\\z",       "ab",             2 },
+        { "a.c",            "a\nc",           3 },
+        { "[a-c]+x",        "ddbcax",         6 },
+        { "[^a-c]x",        "ax bx dx",       8 },
+        { "[]a]",           "]",              1 },
+        { "[a-]",           "-",              1 },
+        { "[\\d.]+%",       "v 1.5%",         6 },
+        { "[[:digit:]]{3}", "a12b345",        7 },
+        { "[[:^alpha:]]",   "ab1",            3 },
+        { "\\d+\\s\\w",     "12 x",           4 },
+        { "\\D\\S\\W",      "a1b!",          -1 },
+        { "\\x41\\x{42}",   "zAB",            3 },
+        { "\\.\\*",         "a.*",            3 },
+        { "\\N",            "\n\nx",          3 },
+        { "(?i)select",     "SeLeCt",         6 },
+        { "a(?i)b",         "aB",             2 },
+        { "(?i:a)b",        "AB",            -1 },
+        { "(?<n>ab)c",      "abc",            3 },
+        { "a(?#comment)b",  "ab",             2 },
+        { "a*?b",           "aab",            3 },
+        { "",               "abc",            0 },
+        { "(a|)+b",         "aab",            3 },
+        { NULL,             NULL,             0 }
+    };
+
+    ASSERT_EQ(IB_OK, ib_mpool_create(&mp, NULL));
+
+    for (int i = 0; tests[i].patt != NULL; i++) {
+        std::string data(tests[i].data);
+
+        ASSERT_EQ(tests[i].end, match1(mp, tests[i].patt, data))
+            << "\"" << tests[i].patt << "\" on \"" << tests[i].data << "\"";
+    }
+
+    /* Case insensitive. */
+    ASSERT_EQ(6L, match1(mp, "union", "xUnIoN", IB_RE_FNOCASE));
+    ASSERT_EQ(2L, match1(mp, "[a-c]x", "BX", IB_RE_FNOCASE));
+    ASSERT_EQ(-1L, match1(mp, "[^a]", "A", IB_RE_FNOCASE));
+    ASSERT_EQ(-1L, match1(mp, "(?-i)a", "A", IB_RE_FNOCASE));
+
+    ib_mpool_destroy(mp);
+}
+
+/// @test Test util re library - invalid and unsupported patterns
+TEST(TestIBUtilRE, test_re_errors)
+{
+    ib_mpool_t *mp;
+    const char *patts[] = {
+        "(ab", "ab)", "*a", "a**", "[ab", "[b-a]", "a{3,2}", "\\",
+        "(a)\\1", "(?=a)", "(?!a)", "(?<=a)", "(?<!a)", "(?>a)", "a*+",
+        "\\bword\\b", "(?m)a", "\\x{100}", "[[:foo:]]", "\\q",
+        "(((a{100}){100}){100})",
+        NULL
+    };
+
+    ASSERT_EQ(IB_OK, ib_mpool_create(&mp, NULL));
+
+    for (int i = 0; patts[i] != NULL; i++) {
+        ib_re_t *re;
+        const char *errptr = NULL;
+        int erroffset = -1;
+
+        ASSERT_EQ(IB_OK, ib_re_create(&re, mp, 0, 0));
+        ASSERT_EQ(IB_EINVAL, ib_re_add_pattern(re, patts[i], 1,
+                                               &errptr, &erroffset))
+            << patts[i];
+        ASSERT_TRUE(errptr != NULL) << patts[i];
+        ASSERT_TRUE(erroffset >= 0) << patts[i];
+    }
+
+    /* Cannot add once built, nor match before. */
+    ib_re_t *re;
+    ASSERT_EQ(IB_OK, ib_re_create(&re, mp, 0, 0));
+    ASSERT_EQ(IB_EINVAL, ib_re_match(re, (const uint8_t *)"a", 1, NULL, NULL));
+    ASSERT_EQ(IB_OK, ib_re_add_pattern(re, "a", 1, NULL, NULL));
+    ASSERT_EQ(IB_OK, ib_re_build(re));
+    ASSERT_EQ(IB_EINVAL, ib_re_add_pattern(re, "b", 2, NULL, NULL));
+
+    ib_mpool_destroy(mp);
+}
+
+/// @test Test util re library - multiple patterns
+TEST(TestIBUtilRE, test_re_multi)
+{
+    ib_mpool_t *mp;
+    ib_re_t *re;
+    matches_t m;
+    std::string data("select * from users where id=1 or 1=1");
+    ib_status_t rc;
+
+    ASSERT_EQ(IB_OK, ib_mpool_create(&mp, NULL));
+
+    ASSERT_EQ(IB_OK, ib_re_create(&re, mp, IB_RE_FNOCASE, 0));
+    ASSERT_EQ(IB_EINVAL, ib_re_add_pattern(re, "\\bunion\\b", 0, NULL, NULL));
+    ASSERT_EQ(IB_OK, ib_re_add_pattern(re, "select\\s.*\\sfrom", 10, NULL, NULL));
+    ASSERT_EQ(IB_OK, ib_re_add_pattern(re, "(\\d)=\\d", 20, NULL, NULL));
+    ASSERT_EQ(IB_OK, ib_re_add_pattern(re, "drop\\s+table", 30, NULL, NULL));
+    ASSERT_EQ(IB_OK, ib_re_add_pattern(re, "=1$", 40, NULL, NULL));
+    ASSERT_EQ(IB_OK, ib_re_build(re));
+    ASSERT_EQ(4UL, ib_re_pattern_count(re));
+    ASSERT_TRUE(ib_re_memory(re) > 0);
+
+    rc = ib_re_match(re, (const uint8_t *)data.data(), data.size(),
+                     collect, &m);
+    ASSERT_EQ(IB_OK, rc);
+    ASSERT_EQ(3UL, m.size());
+    ASSERT_EQ(std::make_pair((size_t)13, (ib_num_t)10), m[0]);
+    ASSERT_EQ(std::make_pair((size_t)37, (ib_num_t)20), m[1]);
+    ASSERT_EQ(std::make_pair((size_t)37, (ib_num_t)40), m[2]);
+
+    /* Without a callback. */
+    rc = ib_re_match(re, (const uint8_t *)data.data(), data.size(),
+                     NULL, NULL);
+    ASSERT_EQ(IB_OK, rc);
+    rc = ib_re_match(re, (const uint8_t *)"nothing", 7, collect, &m);
+    ASSERT_EQ(IB_ENOENT, rc);
+
+    ib_mpool_destroy(mp);
+}
+
+/// @test Test util re library - linear time on backtracking patterns
+TEST(TestIBUtilRE, test_re_linear)
+{
+    ib_mpool_t *mp;
+    std::string data(100000, 'a');
+
+    ASSERT_EQ(IB_OK, ib_mpool_create(&mp, NULL));
+
+    /* Each of these takes exponential time with backtracking. */
+    ASSERT_EQ(-1L, match1(mp, "^(a+)+$", data + "!"));
+    ASSERT_EQ(-1L, match1(mp, "(a|aa)+b", data));
+    ASSERT_EQ(-1L, match1(mp, "(.*a){20}b", data));
+    ASSERT_EQ(100000L, match1(mp, "^(a|a?)+$", data));
+
+    ib_mpool_destroy(mp);
+}
+
+/// @test Test util re library - bounded cache
+TEST(TestIBUtilRE, test_re_cache)
+{
+    ib_mpool_t *mp;
+    ib_re_t *big;
+    ib_re_t *small;
+    const char *patt = "(a|b)*a(a|b){8}c";
+
+    ASSERT_EQ(IB_OK, ib_mpool_create(&mp, NULL));
+    srand(1);
+
+    /* This needs thousands of DFA states. */
+    ASSERT_EQ(IB_OK, ib_re_create(&big, mp, 0, 64 * 1024 * 1024));
+    ASSERT_EQ(IB_OK, ib_re_add_pattern(big, patt, 1, NULL, NULL));
+    ASSERT_EQ(IB_OK, ib_re_build(big));
+    ASSERT_EQ(IB_OK, ib_re_create(&small, mp, 0, 1));
+    ASSERT_EQ(IB_OK, ib_re_add_pattern(small, patt, 1, NULL, NULL));
+    ASSERT_EQ(IB_OK, ib_re_build(small));
+
+    for (int round = 0; round < 50; round++) {
+        std::string data;
+        matches_t m1;
+        matches_t m2;
+
+        for (int i = 0; i < 2000; i++) {
+            data += (char)('a' + rand() % 2);
+        }
+        if (round & 1) {
+            data += "abbbbbbbbc";
+        }
+
+        ib_re_match(big, (const uint8_t *)data.data(), data.size(),
+                    collect, &m1);
+        ib_re_match(small, (const uint8_t *)data.data(), data.size(),
+                    collect, &m2);
+        ASSERT_TRUE(m1 == m2) << "round " << round;
+
+        /* Without the cache (as if another thread were using it). */
+        m2.clear();
+        pthread_mutex_lock(&big->cache.lock);
+        ib_re_match(big, (const uint8_t *)data.data(), data.size(),
+                    collect, &m2);
+        pthread_mutex_unlock(&big->cache.lock);
+        ASSERT_TRUE(m1 == m2) << "round " << round;
+        ASSERT_EQ((round & 1) ? 1UL : 0UL, m1.size());
+    }
+
+    ASSERT_EQ(0UL, ib_re_cache_flushes(big));
+    ASSERT_TRUE(ib_re_cache_flushes(small) > 0);
+
+    ib_mpool_destroy(mp);
+}
+
+/// Regex matched again from a callback, and the matches of that.
+typedef struct {
+    ib_re_t *re;
+    std::string data;
+    matches_t inner;
+    matches_t outer;
+} nested_t;
+
+/// Collect matches, matching again (on the same thread) for each.
+static ib_status_t collect_nested(void *cbdata, ib_num_t id, size_t end)
+{
+    nested_t *n = (nested_t *)cbdata;
+
+    n->outer.push_back(std::make_pair(end, id));
+
+    return ib_re_match(n->re, (const uint8_t *)n->data.data(), n->data.size(),
+                       collect, &n->inner);
+}
+
+/// @test Test util re library - matching without the cache
+TEST(TestIBUtilRE, test_re_nocache)
+{
+    ib_mpool_t *mp;
+    ib_re_t *small;
+    ib_re_t *big;
+    nested_t n;
+    std::string data("xxabcxx");
+    std::string patt;
+
+    ASSERT_EQ(IB_OK, ib_mpool_create(&mp, NULL));
+    for (int i = 0; i < 100; i++) {
+        patt += "(a|b)";
+    }
+    small = build1(mp, "abc", 0);
+    big = build1(mp, patt.c_str(), 0);
+    n.re = small;
+    n.data = "abc";
+
+    /* Both regexes match with the (per-thread) scratch memory, which
+     * grows for the larger program.
+     */
+    pthread_mutex_lock(&small->cache.lock);
+    pthread_mutex_lock(&big->cache.lock);
+    for (int round = 0; round < 3; round++) {
+        matches_t m;
+
+        ASSERT_EQ(IB_OK, ib_re_match(small, (const uint8_t *)data.data(),
+                                     data.size(), collect, &m));
+        ASSERT_EQ(1UL, m.size());
+        ASSERT_EQ(5UL, m[0].first);
+
+        m.clear();
+        ASSERT_EQ(IB_ENOENT, ib_re_match(big, (const uint8_t *)data.data(),
+                                         data.size(), collect, &m));
+        ASSERT_EQ(0UL, m.size());
+    }
+
+    /* A callback matching while the scratch memory is in use. */
+    ASSERT_EQ(IB_OK, ib_re_match(small, (const uint8_t *)data.data(),
+                                 data.size(), collect_nested, &n));
+    pthread_mutex_unlock(&big->cache.lock);
+    pthread_mutex_unlock(&small->cache.lock);
+    ASSERT_EQ(1UL, n.outer.size());
+    ASSERT_EQ(5UL, n.outer[0].first);
+    ASSERT_EQ(1UL, n.inner.size());
+    ASSERT_EQ(3UL, n.inner[0].first);
+
+    ib_mpool_destroy(mp);
+}
+
+/// @test Test util re library - ib_re_match_stream()
+TEST(TestIBUtilRE, test_re_stream)
+{
+    ib_mpool_t *mp;
+    ib_re_t *re;
+    ib_re_stream_t *rs;
+    std::string data("GET /index.php?id=1%20union%20select HTTP/1.1");
+    matches_t expected;
+
+    ASSERT_EQ(IB_OK, ib_mpool_create(&mp, NULL));
+
+    ASSERT_EQ(IB_OK, ib_re_create(&re, mp, 0, 0));
+    ASSERT_EQ(IB_OK, ib_re_add_pattern(re, "union(%20|\\s)+select", 1,
+                                       NULL, NULL));
+    ASSERT_EQ(IB_OK, ib_re_add_pattern(re, "^GET", 2, NULL, NULL));
+    ASSERT_EQ(IB_OK, ib_re_add_pattern(re, "1\\.1$", 3, NULL, NULL));
+    ASSERT_EQ(IB_OK, ib_re_add_pattern(re, "^HTTP", 4, NULL, NULL));
+    ASSERT_EQ(IB_OK, ib_re_build(re));
+
+    ib_re_match(re, (const uint8_t *)data.data(), data.size(),
+                collect, &expected);
+    ASSERT_EQ(3UL, expected.size());
+
+    /* Every split point gives the same matches and offsets. */
+    for (size_t split = 0; split <= data.size(); split++) {
+        matches_t m;
+
+        ASSERT_EQ(IB_OK, ib_re_stream_create(re, mp, &rs));
+        ib_re_match_stream(re, rs, (const uint8_t *)data.data(), split,
+                           collect, &m);
+        ib_re_match_stream(re, rs, (const uint8_t *)data.data() + split,
+                           data.size() - split, collect, &m);
+        ASSERT_EQ(IB_OK, ib_re_match_finish(re, rs, collect, &m));
+        ASSERT_TRUE(expected == m) << "split " << split;
+
+        /* Each pattern is only reported once per stream. */
+        ASSERT_EQ(IB_ENOENT, ib_re_match_stream(re, rs,
+                                                (const uint8_t *)"GET", 3,
+                                                collect, &m));
+    }
+
+    /* A byte at a time. */
+    matches_t m;
+    ASSERT_EQ(IB_OK, ib_re_stream_create(re, mp, &rs));
+    for (size_t i = 0; i < data.size(); i++) {
+        ib_re_match_stream(re, rs, (const uint8_t *)data.data() + i, 1,
+                           collect, &m);
+    }
+    ib_re_match_finish(re, rs, collect, &m);
+    ASSERT_TRUE(expected == m);
+
+    ib_mpool_destroy(mp);
+}
+
+/// @test Test util re library - ib_re_analyze()
+TEST(TestIBUtilRE, test_re_analyze)
+{
+    struct {
+        const char *patt;
+        ib_status_t rc;
+        int offset;
+    } tests[] = {
+        /* Nested quantifiers. */
+        { "(a+)+$",                 IB_DECLINED,  0 },
+        { "x(a*)*y",                IB_DECLINED,  1 },
+        { "^(\\w+\\s?)*$",          IB_DECLINED,  1 },
+        { "(?:(?:a|b)+c?)+",        IB_DECLINED,  0 },
+        { "((a+)?){2,}",            IB_DECLINED,  0 },
+        { "(a{1,3})+",              IB_DECLINED,  0 },
+        { "(a+b)+",                 IB_OK,       -1 },
+        { "(a{2})+",                IB_OK,       -1 },
+        { "(a?)+",                  IB_OK,       -1 },
+        { "(a+)?",                  IB_OK,       -1 },
+        { "(\\d+,)*\\d+",           IB_OK,       -1 },
+        /* Overlapping alternation. */
+        { "(\\w|\\d)+$",            IB_DECLINED,  0 },
+        { "x(?:ab|a.)*",            IB_DECLINED,  1 },
+        { "(?:a|b|c|a)*",           IB_DECLINED,  0 },
+        { "(foo|fob)*",             IB_OK,       -1 },
+        { "(a|ab)*",                IB_OK,       -1 },
+        { "(.|\\n)*",               IB_DECLINED,  0 },
+        { "(?-s)(.|\\n)*",          IB_OK,       -1 },
+        { "(\\w|\\d)",              IB_OK,       -1 },
+        /* Constructs which are accepted, but not analyzed. */
+        { "\\bunion\\b.*select",    IB_OK,       -1 },
+        { "(a)\\1(?=b)(?<!c)(?>d+)", IB_OK,      -1 },
+        { "(?>a+)+b",               IB_OK,       -1 },
+        { "(a++)+",                 IB_OK,       -1 },
+        /* Parse errors. */
+        { "(ab",                    IB_EINVAL,   -1 },
+        { "\\q",                    IB_EINVAL,   -1 },
+        { NULL,                     IB_OK,       -1 }
+    };
+
+    for (int i = 0; tests[i].patt != NULL; i++) {
+        const char *reason = NULL;
+        int offset = -1;
+
+        ASSERT_EQ(tests[i].rc, ib_re_analyze(tests[i].patt, 0,
+                                             &reason, &offset))
+            << tests[i].patt;
+        if (tests[i].rc == IB_OK) {
+            ASSERT_TRUE(reason == NULL) << tests[i].patt;
+            continue;
+        }
+        ASSERT_TRUE(reason != NULL) << tests[i].patt;
+        if (tests[i].offset >= 0) {
+            ASSERT_EQ(tests[i].offset, offset) << tests[i].patt;
+        }
+    }
+}
+
+/// @test Test util re library - ib_re_literal()
+TEST(TestIBUtilRE, test_re_literal)
+{
+    ib_mpool_t *mp;
+    struct {
+        const char *patt;
+        ib_status_t rc;
+        const char *lit;
+    } tests[] = {
+        { "union\\s+select",         IB_OK,     "select" },
+        { "UNION",                   IB_OK,     "union" },
+        { "(?i)Union",               IB_OK,     "union" },
+        { "[Uu][Nn]ion",             IB_OK,     "union" },
+        { "^ab.*c(?=de)fgh$",        IB_OK,     "cfgh" },
+        { "x?abc+d",                 IB_OK,     "abc" },
+        { "(ab)+cd",                 IB_OK,     "abcd" },
+        { "a(?:bc|bc)d",             IB_OK,     "abcd" },
+        { "(?:foo|bar)bazz",         IB_OK,     "bazz" },
+        { "a(b)\\1c",                IB_OK,     "ab" },
+        { "a(?>bcd)e",               IB_OK,     "abcde" },
+        { "\\bselect\\b",            IB_OK,     "select" },
+        { "\\x41\\x42",              IB_OK,     "ab" },
+        { "foo|bar",                 IB_ENOENT, NULL },
+        { "a*",                      IB_ENOENT, NULL },
+        { "[ab]c?",                  IB_ENOENT, NULL },
+        { "(ab",                     IB_EINVAL, NULL },
+        { NULL,                      IB_OK,     NULL }
+    };
+
+    ASSERT_EQ(IB_OK, ib_mpool_create(&mp, NULL));
+
+    for (int i = 0; tests[i].patt != NULL; i++) {
+        const uint8_t *lit;
+        size_t len;
+
+        ASSERT_EQ(tests[i].rc, ib_re_literal(tests[i].patt, 0, mp,
+                                             &lit, &len))
+            << tests[i].patt;
+        if (tests[i].rc == IB_OK) {
+            ASSERT_EQ(std::string(tests[i].lit),
+                      std::string((const char *)lit, len))
+                << tests[i].patt;
+        }
+    }
+
+    ib_mpool_destroy(mp);
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    ib_trace_init(NULL);
+    return RUN_ALL_TESTS();
+}
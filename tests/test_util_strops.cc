@@ -0,0 +1,264 @@
+//////////////////////////////////////////////////////////////////////////////
+// Licensed to Qualys, Inc. (QUALYS) under one or more
+// contributor license agreements.  See the NOTICE file distributed with
+// this work for additional information regarding copyright ownership.
+// QUALYS licenses this file to You under the Apache License, Version 2.0
+// (the "License"); you may not use this file except in compliance with
+// the License.  You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//////////////////////////////////////////////////////////////////////////////
+
+//////////////////////////////////////////////////////////////////////////////
+/// @file
+/// @brief IronBee - String Operation Test Functions
+/// 
+/// @author Brian Rectanus <brectanus@qualys.com>
+//////////////////////////////////////////////////////////////////////////////
+
+#include "ironbee_config_auto.h"
+
+#include "gtest/gtest.h"
+#include "gtest/gtest-spi.h"
+
+#define TESTING
+
+#include "util/util.c"
+#include "util/mpool.c"
+#include "util/debug.c"
+#include "util/cpu.c"
+#include "util/strops.c"
+
+#include <ctype.h>
+
+
+/* -- Helpers -- */
+
+/// Fill a buffer with a mix of letters, whitespace and high bytes.
+static void fill(uint8_t *buf, size_t len, unsigned int seed)
+{
+    static const char chars[] = "AZaz@[`{ \t\n\v\f\r\x08\x0e\x80\xc1\xff" "0";
+
+    srand(seed);
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t)chars[rand() % (sizeof(chars) - 1)];
+    }
+}
+
+
+/* -- Tests -- */
+
+/// @test Test util string ops library - ib_strops_lower()
+TEST(TestIBUtilStrOps, test_strops_lower)
+{
+    uint8_t buf[128];
+    uint8_t ref[128];
+
+    for (size_t len = 0; len < 100; len++) {
+        fill(buf, len, (unsigned int)len);
+        memcpy(ref, buf, len);
+
+        int modified = ib_strops_lower(buf, len);
+
+        int ref_modified = 0;
+        for (size_t i = 0; i < len; i++) {
+            if ((ref[i] >= 'A') && (ref[i] <= 'Z')) {
+                ref[i] = (uint8_t)(ref[i] + ('a' - 'A'));
+                ref_modified = 1;
+            }
+        }
+        ASSERT_TRUE(memcmp(buf, ref, len) == 0) << "ib_strops_lower() failed - wrong data at length " << len;
+        ASSERT_TRUE(modified == ref_modified) << "ib_strops_lower() failed - wrong modified flag at length " << len;
+    }
+
+    ASSERT_TRUE(ib_strops_lower((uint8_t *)"already lower 0123456789 !@#$%^&*()", 35) == 0) << "ib_strops_lower() failed - unmodified data flagged";
+}
+
+/// @test Test util string ops library - ib_strops_wsleft()/ib_strops_wsright()
+TEST(TestIBUtilStrOps, test_strops_trim)
+{
+    uint8_t buf[160];
+
+    for (size_t len = 0; len < 150; len++) {
+        for (size_t ws = 0; ws <= len; ws += 7) {
+            fill(buf, len, (unsigned int)(len * 131 + ws));
+
+            /* Whitespace around a random middle. */
+            for (size_t i = 0; i < ws; i++) {
+                buf[i] = ' ';
+                buf[len - 1 - i] = '\t';
+            }
+
+            size_t left = 0;
+            while ((left < len) && isspace(buf[left])) {
+                left++;
+            }
+            size_t right = len;
+            while ((right > 0) && isspace(buf[right - 1])) {
+                right--;
+            }
+
+            ASSERT_TRUE(ib_strops_wsleft(buf, len) == left) << "ib_strops_wsleft() failed - length " << len << " ws " << ws;
+            ASSERT_TRUE(ib_strops_wsright(buf, len) == right) << "ib_strops_wsright() failed - length " << len << " ws " << ws;
+        }
+    }
+}
+
+/// @test Test util string ops library - ib_strops_find_any()
+TEST(TestIBUtilStrOps, test_strops_find_any)
+{
+    uint8_t buf[128];
+
+    memset(buf, 'x', sizeof(buf));
+    for (size_t pos = 0; pos <= 100; pos++) {
+        if (pos < 100) {
+            buf[pos] = '%';
+        }
+        ASSERT_TRUE(ib_strops_find_any(buf, 100, "%+", 2) == pos) << "ib_strops_find_any() failed - position " << pos;
+        ASSERT_TRUE(ib_strops_find_any(buf, 100, "+&<>=", 5) == 100) << "ib_strops_find_any() failed - large set";
+        if (pos < 100) {
+            buf[pos] = 'x';
+        }
+    }
+    ASSERT_TRUE(ib_strops_find_any(buf, 100, "", 0) == 100) << "ib_strops_find_any() failed - empty set";
+}
+
+/// @test Test util string ops library - ib_strops_find()
+TEST(TestIBUtilStrOps, test_strops_find)
+{
+    uint8_t buf[100];
+
+    memset(buf, 'a', sizeof(buf));
+    memcpy(buf + 90, "abc", 3);
+    ASSERT_TRUE(ib_strops_find(buf, 100, "abc", 3) == 90) << "ib_strops_find() failed - wrong position";
+    ASSERT_TRUE(ib_strops_find(buf, 100, "abd", 3) == 100) << "ib_strops_find() failed - found";
+    ASSERT_TRUE(ib_strops_find(buf, 100, "aaaaaaaac", 9) == 100) << "ib_strops_find() failed - found";
+    ASSERT_TRUE(ib_strops_find(buf, 100, "c", 1) == 92) << "ib_strops_find() failed - single byte";
+    ASSERT_TRUE(ib_strops_find(buf, 2, "aaa", 3) == 2) << "ib_strops_find() failed - needle too long";
+    ASSERT_TRUE(ib_strops_find(buf, 100, "", 0) == 0) << "ib_strops_find() failed - empty needle";
+}
+
+#ifdef IB_STROPS_X86
+/// @test Test util string ops library - vector kernels match scalar kernels
+TEST(TestIBUtilStrOps, test_strops_kernels)
+{
+    uint8_t buf[4][300];
+    ib_flags_t features;
+    bool avx2;
+    bool avx512;
+
+    atexit(ib_shutdown);
+    ib_initialize();
+    features = ib_cpu_features();
+    avx2 = (features & IB_CPU_AVX2) != 0;
+    avx512 = (features & IB_CPU_AVX512BW) != 0;
+
+    for (size_t len = 0; len < 260; len++) {
+        for (size_t off = 0; off < 3; off++) {
+            uint8_t *d[4];
+
+            for (size_t k = 0; k < 4; k++) {
+                d[k] = buf[k] + off;
+                fill(d[k], len, (unsigned int)(len * 3 + off));
+            }
+
+            ASSERT_TRUE(ib_strops_wsleft_sse2(d[0], len) == ib_strops_wsleft_scalar(d[0], len)) << "SSE2 wsleft failed - length " << len;
+            ASSERT_TRUE(ib_strops_wsright_sse2(d[0], len) == ib_strops_wsright_scalar(d[0], len)) << "SSE2 wsright failed - length " << len;
+            if (avx2) {
+                ASSERT_TRUE(ib_strops_wsleft_avx2(d[0], len) == ib_strops_wsleft_scalar(d[0], len)) << "AVX2 wsleft failed - length " << len;
+                ASSERT_TRUE(ib_strops_wsright_avx2(d[0], len) == ib_strops_wsright_scalar(d[0], len)) << "AVX2 wsright failed - length " << len;
+            }
+
+            int m0 = ib_strops_lower_scalar(d[0], len);
+            int m1 = ib_strops_lower_sse2(d[1], len);
+            ASSERT_TRUE((m0 == m1) && (memcmp(d[0], d[1], len) == 0)) << "SSE2 lower failed - length " << len;
+            if (avx2) {
+                int m2 = ib_strops_lower_avx2(d[2], len);
+                ASSERT_TRUE((m0 == m2) && (memcmp(d[0], d[2], len) == 0)) << "AVX2 lower failed - length " << len;
+            }
+            if (avx512) {
+                int m3 = ib_strops_lower_avx512(d[3], len);
+                ASSERT_TRUE((m0 == m3) && (memcmp(d[0], d[3], len) == 0)) << "AVX-512 lower failed - length " << len;
+            }
+
+            /* Lowercased (d[0]) vs original (d[1] was lowercased too,
+             * so refill it).
+             */
+            fill(d[1], len, (unsigned int)(len * 3 + off));
+            ASSERT_TRUE(ib_strops_caseeq_sse2(d[0], d[1], len)) << "SSE2 caseeq failed - length " << len;
+            if (avx2) {
+                ASSERT_TRUE(ib_strops_caseeq_avx2(d[0], d[1], len)) << "AVX2 caseeq failed - length " << len;
+            }
+            if (len > 0) {
+                d[1][len - 1] ^= 0x01;
+                ASSERT_TRUE(!ib_strops_caseeq_sse2(d[0], d[1], len)) << "SSE2 caseeq failed - length " << len;
+                ASSERT_TRUE(!ib_strops_caseeq_scalar(d[0], d[1], len)) << "scalar caseeq failed - length " << len;
+                if (avx2) {
+                    ASSERT_TRUE(!ib_strops_caseeq_avx2(d[0], d[1], len)) << "AVX2 caseeq failed - length " << len;
+                }
+            }
+
+            for (size_t pos = 0; pos < len; pos += 13) {
+                uint8_t save = d[2][pos];
+                size_t exp;
+
+                d[2][pos] = '%';
+                exp = ib_strops_find_any_scalar(d[2], len, (const uint8_t *)"%&", 2);
+                ASSERT_TRUE(ib_strops_find_any_sse2(d[2], len, (const uint8_t *)"%&", 2) == exp) << "SSE2 find_any failed - length " << len;
+                if (avx2) {
+                    ASSERT_TRUE(ib_strops_find_any_avx2(d[2], len, (const uint8_t *)"%&", 2) == exp) << "AVX2 find_any failed - length " << len;
+                }
+                if (avx512) {
+                    ASSERT_TRUE(ib_strops_find_any_avx512(d[2], len, (const uint8_t *)"%&", 2) == exp) << "AVX-512 find_any failed - length " << len;
+                }
+                d[2][pos] = save;
+            }
+
+            for (size_t nlen = 1; nlen < 6; nlen++) {
+                for (size_t pos = 0; pos + nlen <= len; pos += 17) {
+                    size_t exp = ib_strops_find_scalar(d[0], len, d[0] + pos, nlen);
+                    ASSERT_TRUE(exp <= pos) << "scalar find failed - length " << len;
+                    ASSERT_TRUE(ib_strops_find_sse2(d[0], len, d[0] + pos, nlen) == exp) << "SSE2 find failed - length " << len;
+                    if (avx2) {
+                        ASSERT_TRUE(ib_strops_find_avx2(d[0], len, d[0] + pos, nlen) == exp) << "AVX2 find failed - length " << len;
+                    }
+                }
+            }
+        }
+    }
+}
+#endif
+
+/// @test Test util string ops library - kernel selection by CPU features
+TEST(TestIBUtilStrOps, test_strops_select)
+{
+    char buf[64];
+    ib_flags_t features;
+
+    atexit(ib_shutdown);
+    ib_initialize();
+
+    features = ib_cpu_features();
+    ASSERT_TRUE(ib_cpu_features_str(features, buf, sizeof(buf)) != NULL) << "ib_cpu_features_str() failed - NULL";
+
+    /* Limit to the baseline and back. */
+    ASSERT_TRUE(ib_cpu_features_limit(IB_CPU_SSE2) == (features & IB_CPU_SSE2)) << "ib_cpu_features_limit() failed - wrong features";
+    ASSERT_TRUE(ib_strops_caseeq((const uint8_t *)"Content-Type", (const uint8_t *)"content-type", 12)) << "ib_strops_caseeq() failed - not equal";
+    ASSERT_TRUE(ib_cpu_features_limit(~0) == features) << "ib_cpu_features_limit() failed - not restored";
+    ASSERT_TRUE(ib_strops_caseeq((const uint8_t *)"Content-Type", (const uint8_t *)"content-type", 12)) << "ib_strops_caseeq() failed - not equal";
+    ASSERT_TRUE(!ib_strops_caseeq((const uint8_t *)"Content-Type", (const uint8_t *)"content-typf", 12)) << "ib_strops_caseeq() failed - equal";
+    ASSERT_STREQ("none", ib_cpu_features_str(0, buf, sizeof(buf)));
+}
+
+int main(int argc, char **argv)
+{
+    ::testing::InitGoogleTest(&argc, argv);
+    ib_trace_init(NULL);
+    return RUN_ALL_TESTS();
+}
@@ -0,0 +1,738 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee - Utility Aho-Corasick Functions
+ * @author Brian Rectanus <brectanus@qualys.com>
+ */
+
+/**
+ * @internal
+ *
+ * Patterns are first added to a simple linked trie. Building then
+ * lays the trie out as a double-array: the children of a state s on
+ * byte class c are at cell base[s] + c, which is valid if check of
+ * that cell is s. The base/check pairs are interleaved so that a
+ * transition touches a single cache line, while the failure and
+ * output data, which are needed far less often, are kept separately.
+ *
+ * Bytes are first mapped to classes, with every byte which is not in
+ * any pattern in class 0. This keeps the double-array dense and lets
+ * the scan loop reset to the root on such bytes without any lookup.
+ * The root has a full 256 entry table, as most failures end there.
+ */
+
+#include "ironbee_config_auto.h"
+
+#include <string.h>
+
+#include <ironbee/util.h>
+
+/** @internal No node/cell. */
+#define IB_AC_NONE     (-1)
+
+/**
+ * @internal
+ * Trie node (only used until built).
+ */
+typedef struct {
+    int32_t             child;            /**< First child node */
+    int32_t             sibling;          /**< Next sibling node */
+    int32_t             out;              /**< First output entry */
+    int32_t             cell;             /**< Double-array cell */
+    uint8_t             byte;             /**< Label (folded if nocase) */
+} ib_ac_node_t;
+
+/**
+ * @internal
+ * Trie output entry (only used until built).
+ */
+typedef struct {
+    ib_num_t            id;               /**< Pattern ID */
+    int32_t             next;             /**< Next output entry */
+} ib_ac_outent_t;
+
+/**
+ * @internal
+ * Double-array transition cell.
+ */
+typedef struct {
+    int32_t             base;             /**< Base of child cells */
+    int32_t             check;            /**< Parent cell (or IB_AC_NONE) */
+} ib_ac_cell_t;
+
+/**
+ * @internal
+ * Per-state failure and output data.
+ */
+typedef struct {
+    int32_t             fail;             /**< Failure state */
+    int32_t             match;            /**< First state with outputs on
+                                               the failure chain (including
+                                               this one) or IB_AC_NONE */
+    uint32_t            out;              /**< First output ID */
+    uint32_t            nout;             /**< Number of output IDs */
+} ib_ac_state_t;
+
+struct ib_ac_t {
+    ib_mpool_t         *mp;               /**< Memory pool */
+    ib_flags_t          flags;            /**< Flags */
+    size_t              npatt;            /**< Number of patterns */
+
+    /* Trie (until built). */
+    ib_mpool_t         *bmp;              /**< Build memory pool */
+    ib_ac_node_t       *node;             /**< Nodes (0 is the root) */
+    size_t              nnode;            /**< Number of nodes */
+    size_t              anode;            /**< Allocated nodes */
+    ib_ac_outent_t     *outent;           /**< Output entries */
+    size_t              noutent;          /**< Number of output entries */
+    size_t              aoutent;          /**< Allocated output entries */
+
+    /* Automaton (once built). */
+    uint8_t             cls[256];         /**< Byte classes */
+    int32_t             root[256];        /**< Root transitions by class */
+    ib_ac_cell_t       *cell;             /**< Transition cells */
+    ib_ac_state_t      *state;            /**< State data (by cell) */
+    uint32_t            ncell;            /**< Number of cells */
+    ib_num_t           *ids;              /**< Output IDs */
+};
+
+/**
+ * @internal
+ * Grow a build array allocated from a pool.
+ *
+ * @param mp Memory pool
+ * @param parr Address of array
+ * @param palloc Address of allocated element count
+ * @param n Number of elements needed
+ * @param esize Element size
+ *
+ * @returns Status code
+ */
+static ib_status_t ib_ac_grow(ib_mpool_t *mp,
+                              void *parr,
+                              size_t *palloc,
+                              size_t n,
+                              size_t esize)
+{
+    size_t alloc = *palloc;
+    void *arr;
+
+    if (n <= alloc) {
+        return IB_OK;
+    }
+
+    /* The old array is left in the build pool until it is destroyed. */
+    alloc = (alloc == 0) ? 64 : alloc;
+    while (alloc < n) {
+        alloc *= 2;
+    }
+    arr = ib_mpool_alloc(mp, alloc * esize);
+    if (arr == NULL) {
+        return IB_EALLOC;
+    }
+    if (*palloc > 0) {
+        memcpy(arr, *(void **)parr, *palloc * esize);
+    }
+    *(void **)parr = arr;
+    *palloc = alloc;
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Fold a byte for a nocase automaton.
+ */
+#define IB_AC_FOLD(ac, c) \
+    ((((ac)->flags & IB_AC_FNOCASE) && ((c) >= 'A') && ((c) <= 'Z')) \
+     ? (uint8_t)((c) + ('a' - 'A')) : (uint8_t)(c))
+
+ib_status_t ib_ac_create(ib_ac_t **pac,
+                         ib_mpool_t *pool,
+                         ib_flags_t flags)
+{
+    IB_FTRACE_INIT(ib_ac_create);
+    ib_ac_t *ac;
+    ib_status_t rc;
+
+    ac = (ib_ac_t *)ib_mpool_calloc(pool, 1, sizeof(*ac));
+    if (ac == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    ac->mp = pool;
+    ac->flags = flags;
+
+    rc = ib_mpool_create(&ac->bmp, pool);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    /* Root node. */
+    rc = ib_ac_grow(ac->bmp, &ac->node, &ac->anode, 1, sizeof(*ac->node));
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    ac->node[0].child = IB_AC_NONE;
+    ac->node[0].sibling = IB_AC_NONE;
+    ac->node[0].out = IB_AC_NONE;
+    ac->nnode = 1;
+
+    *pac = ac;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+ib_status_t ib_ac_add_pattern(ib_ac_t *ac,
+                              const uint8_t *patt,
+                              size_t plen,
+                              ib_num_t id)
+{
+    IB_FTRACE_INIT(ib_ac_add_pattern);
+    int32_t n = 0;
+    size_t i;
+    ib_status_t rc;
+
+    if ((ac->bmp == NULL) || (plen == 0)) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    for (i = 0; i < plen; i++) {
+        uint8_t b = IB_AC_FOLD(ac, patt[i]);
+        int32_t c;
+
+        for (c = ac->node[n].child; c != IB_AC_NONE; c = ac->node[c].sibling) {
+            if (ac->node[c].byte == b) {
+                break;
+            }
+        }
+
+        if (c == IB_AC_NONE) {
+            rc = ib_ac_grow(ac->bmp, &ac->node, &ac->anode,
+                            ac->nnode + 1, sizeof(*ac->node));
+            if (rc != IB_OK) {
+                IB_FTRACE_RET_STATUS(rc);
+            }
+            c = (int32_t)ac->nnode++;
+            ac->node[c].child = IB_AC_NONE;
+            ac->node[c].sibling = ac->node[n].child;
+            ac->node[c].out = IB_AC_NONE;
+            ac->node[c].byte = b;
+            ac->node[n].child = c;
+        }
+
+        n = c;
+    }
+
+    rc = ib_ac_grow(ac->bmp, &ac->outent, &ac->aoutent,
+                    ac->noutent + 1, sizeof(*ac->outent));
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    ac->outent[ac->noutent].id = id;
+    ac->outent[ac->noutent].next = ac->node[n].out;
+    ac->node[n].out = (int32_t)ac->noutent++;
+    ac->npatt++;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Assign byte classes to the bytes used in patterns.
+ *
+ * @param ac Automaton
+ *
+ * @returns Number of classes (including class 0)
+ */
+static size_t ib_ac_build_classes(ib_ac_t *ac)
+{
+    uint8_t used[256];
+    size_t ncls = 1;
+    size_t i;
+
+    memset(used, 0, sizeof(used));
+    for (i = 1; i < ac->nnode; i++) {
+        used[ac->node[i].byte] = 1;
+    }
+
+    memset(ac->cls, 0, sizeof(ac->cls));
+    for (i = 0; i < 256; i++) {
+        if (used[i]) {
+            ac->cls[i] = (uint8_t)ncls++;
+        }
+    }
+
+    /* Upper case bytes share the class of the (folded) lower case. */
+    if (ac->flags & IB_AC_FNOCASE) {
+        for (i = 'A'; i <= 'Z'; i++) {
+            ac->cls[i] = ac->cls[i + ('a' - 'A')];
+        }
+    }
+
+    return ncls;
+}
+
+/**
+ * @internal
+ * Maximum number of free cells tried when placing the children of a
+ * state before placing them at the end instead. This bounds the build
+ * time at the cost of leaving some cells unused.
+ */
+#define IB_AC_MAX_PROBES    64
+
+/**
+ * @internal
+ * Double-array layout state (only used while building).
+ *
+ * Free cells are kept in a doubly linked list so that placing the
+ * children of a state only looks at cells which may be used.
+ */
+typedef struct {
+    ib_ac_cell_t       *cell;             /**< Cells */
+    int32_t            *nextf;            /**< Next free cell */
+    int32_t            *prevf;            /**< Previous free cell */
+    size_t              ncell;            /**< Number of cells */
+    size_t              acell;            /**< Allocated cells */
+    size_t              anextf;           /**< Allocated next links */
+    size_t              aprevf;           /**< Allocated previous links */
+    int32_t             headf;            /**< First free cell */
+    int32_t             tailf;            /**< Last free cell */
+} ib_ac_layout_t;
+
+/**
+ * @internal
+ * Add free cells to the end of a layout.
+ *
+ * @param ac Automaton
+ * @param lo Layout
+ * @param n Number of cells needed
+ *
+ * @returns Status code
+ */
+static ib_status_t ib_ac_layout_extend(ib_ac_t *ac,
+                                       ib_ac_layout_t *lo,
+                                       size_t n)
+{
+    ib_status_t rc;
+
+    if (n <= lo->ncell) {
+        return IB_OK;
+    }
+
+    rc = ib_ac_grow(ac->bmp, &lo->cell, &lo->acell, n, sizeof(*lo->cell));
+    if (rc == IB_OK) {
+        rc = ib_ac_grow(ac->bmp, &lo->nextf, &lo->anextf, n, sizeof(int32_t));
+    }
+    if (rc == IB_OK) {
+        rc = ib_ac_grow(ac->bmp, &lo->prevf, &lo->aprevf, n, sizeof(int32_t));
+    }
+    if (rc != IB_OK) {
+        return rc;
+    }
+
+    while (lo->ncell < n) {
+        int32_t t = (int32_t)lo->ncell++;
+
+        lo->cell[t].base = 0;
+        lo->cell[t].check = IB_AC_NONE;
+        lo->nextf[t] = IB_AC_NONE;
+        lo->prevf[t] = lo->tailf;
+        if (lo->tailf != IB_AC_NONE) {
+            lo->nextf[lo->tailf] = t;
+        }
+        else {
+            lo->headf = t;
+        }
+        lo->tailf = t;
+    }
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Mark a cell as used by a state.
+ *
+ * @param lo Layout
+ * @param t Cell
+ * @param parent Parent cell
+ */
+static void ib_ac_layout_use(ib_ac_layout_t *lo,
+                             int32_t t,
+                             int32_t parent)
+{
+    int32_t next = lo->nextf[t];
+    int32_t prev = lo->prevf[t];
+
+    if (prev != IB_AC_NONE) {
+        lo->nextf[prev] = next;
+    }
+    else {
+        lo->headf = next;
+    }
+    if (next != IB_AC_NONE) {
+        lo->prevf[next] = prev;
+    }
+    else {
+        lo->tailf = prev;
+    }
+
+    lo->cell[t].check = parent;
+}
+
+/**
+ * @internal
+ * Lay out the trie as a double-array.
+ *
+ * @param ac Automaton
+ * @param order Address which nodes are written in breadth first order
+ * @param lo Layout
+ *
+ * @returns Status code
+ */
+static ib_status_t ib_ac_build_cells(ib_ac_t *ac,
+                                     int32_t *order,
+                                     ib_ac_layout_t *lo)
+{
+    uint8_t label[256];
+    size_t head = 0;
+    size_t tail = 0;
+    ib_status_t rc;
+
+    memset(lo, 0, sizeof(*lo));
+    lo->headf = IB_AC_NONE;
+    lo->tailf = IB_AC_NONE;
+
+    /* The root is cell 0. */
+    rc = ib_ac_layout_extend(ac, lo, 1);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    ib_ac_layout_use(lo, 0, IB_AC_NONE);
+    ac->node[0].cell = 0;
+    order[tail++] = 0;
+
+    while (head < tail) {
+        int32_t n = order[head++];
+        size_t nlabel = 0;
+        size_t minl = 256;
+        size_t maxl = 0;
+        size_t base = 0;
+        size_t probes = 0;
+        int32_t e;
+        int32_t c;
+
+        for (c = ac->node[n].child; c != IB_AC_NONE; c = ac->node[c].sibling) {
+            size_t l = ac->cls[ac->node[c].byte];
+
+            label[nlabel++] = (uint8_t)l;
+            minl = (l < minl) ? l : minl;
+            maxl = (l > maxl) ? l : maxl;
+        }
+        if (nlabel == 0) {
+            continue;
+        }
+
+        /* Try free cells for the smallest label, else use the end. */
+        for (e = lo->headf;
+             (e != IB_AC_NONE) && (probes < IB_AC_MAX_PROBES);
+             e = lo->nextf[e], probes++)
+        {
+            size_t i;
+
+            if ((size_t)e <= minl) {
+                continue;
+            }
+            base = (size_t)e - minl;
+            for (i = 0; i < nlabel; i++) {
+                size_t t = base + label[i];
+
+                if ((t < lo->ncell) && (lo->cell[t].check != IB_AC_NONE)) {
+                    break;
+                }
+            }
+            if (i == nlabel) {
+                break;
+            }
+            base = 0;
+        }
+        if (base == 0) {
+            base = (lo->ncell > minl) ? lo->ncell - minl : 1;
+        }
+
+        rc = ib_ac_layout_extend(ac, lo, base + maxl + 1);
+        if (rc != IB_OK) {
+            return rc;
+        }
+
+        lo->cell[ac->node[n].cell].base = (int32_t)base;
+        for (c = ac->node[n].child; c != IB_AC_NONE; c = ac->node[c].sibling) {
+            int32_t t = (int32_t)(base + ac->cls[ac->node[c].byte]);
+
+            ib_ac_layout_use(lo, t, ac->node[n].cell);
+            ac->node[c].cell = t;
+            order[tail++] = c;
+        }
+    }
+
+    ac->ncell = (uint32_t)lo->ncell;
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Follow the goto function of a state.
+ *
+ * @param ac Automaton
+ * @param s State
+ * @param c Byte class (non-zero)
+ *
+ * @returns Next state or IB_AC_NONE
+ */
+static inline int32_t ib_ac_goto(const ib_ac_t *ac,
+                                 int32_t s,
+                                 uint32_t c)
+{
+    uint32_t t;
+
+    if (s == 0) {
+        return ac->root[c];
+    }
+    t = (uint32_t)ac->cell[s].base + c;
+    if ((t < ac->ncell) && (ac->cell[t].check == s)) {
+        return (int32_t)t;
+    }
+
+    return IB_AC_NONE;
+}
+
+ib_status_t ib_ac_build(ib_ac_t *ac)
+{
+    IB_FTRACE_INIT(ib_ac_build);
+    ib_ac_layout_t lo;
+    int32_t *order;
+    size_t nids = 0;
+    size_t i;
+    ib_status_t rc;
+
+    if (ac->bmp == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    ib_ac_build_classes(ac);
+
+    order = (int32_t *)ib_mpool_alloc(ac->bmp, ac->nnode * sizeof(*order));
+    if (order == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    rc = ib_ac_build_cells(ac, order, &lo);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    /* Copy the cells out of the build pool. */
+    ac->cell = (ib_ac_cell_t *)ib_mpool_alloc(ac->mp,
+                                              ac->ncell * sizeof(*ac->cell));
+    ac->state = (ib_ac_state_t *)ib_mpool_calloc(ac->mp, ac->ncell,
+                                                 sizeof(*ac->state));
+    ac->ids = (ib_num_t *)ib_mpool_alloc(ac->mp,
+                                         (ac->noutent + 1) * sizeof(*ac->ids));
+    if ((ac->cell == NULL) || (ac->state == NULL) || (ac->ids == NULL)) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    memcpy(ac->cell, lo.cell, ac->ncell * sizeof(*ac->cell));
+
+    for (i = 0; i < 256; i++) {
+        ac->root[i] = 0;
+    }
+    for (i = 0; i < ac->ncell; i++) {
+        if ((i > 0) && (ac->cell[i].check == 0)) {
+            ac->root[i - (size_t)ac->cell[0].base] = (int32_t)i;
+        }
+        ac->state[i].match = IB_AC_NONE;
+    }
+
+    /* In breadth first order, so failure states are always done
+     * before the states failing to them.
+     */
+    for (i = 0; i < ac->nnode; i++) {
+        const ib_ac_node_t *n = &ac->node[order[i]];
+        ib_ac_state_t *st = &ac->state[n->cell];
+        int32_t c;
+        int32_t o;
+
+        /* Outputs, in the order added. */
+        for (o = n->out; o != IB_AC_NONE; o = ac->outent[o].next) {
+            st->nout++;
+        }
+        st->out = (uint32_t)nids;
+        nids += st->nout;
+        for (c = 0, o = n->out; o != IB_AC_NONE; o = ac->outent[o].next) {
+            ac->ids[nids - (size_t)++c] = ac->outent[o].id;
+        }
+        if (st->nout > 0) {
+            st->match = n->cell;
+        }
+        else if (n->cell != 0) {
+            st->match = ac->state[st->fail].match;
+        }
+
+        /* Children fail to the longest proper suffix in the trie. */
+        for (c = n->child; c != IB_AC_NONE; c = ac->node[c].sibling) {
+            uint32_t l = ac->cls[ac->node[c].byte];
+            int32_t f = IB_AC_NONE;
+            int32_t s;
+
+            if (n->cell != 0) {
+                for (s = st->fail; ; s = ac->state[s].fail) {
+                    f = ib_ac_goto(ac, s, l);
+                    if ((f > 0) || (s == 0)) {
+                        break;
+                    }
+                }
+            }
+            ac->state[ac->node[c].cell].fail = (f > 0) ? f : 0;
+        }
+    }
+
+    ib_mpool_destroy(ac->bmp);
+    ac->bmp = NULL;
+    ac->node = NULL;
+    ac->outent = NULL;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+int ib_ac_is_built(const ib_ac_t *ac)
+{
+    return (ac->bmp == NULL);
+}
+
+size_t ib_ac_pattern_count(const ib_ac_t *ac)
+{
+    return ac->npatt;
+}
+
+size_t ib_ac_memory(const ib_ac_t *ac)
+{
+    if (ac->bmp != NULL) {
+        return 0;
+    }
+
+    return sizeof(*ac)
+        + (ac->ncell * (sizeof(*ac->cell) + sizeof(*ac->state)))
+        + (ac->npatt * sizeof(*ac->ids));
+}
+
+void ib_ac_stream_init(ib_ac_stream_t *as)
+{
+    as->state = 0;
+    as->offset = 0;
+}
+
+ib_status_t ib_ac_match_stream(const ib_ac_t *ac,
+                               ib_ac_stream_t *as,
+                               const uint8_t *data,
+                               size_t dlen,
+                               ib_ac_callback_fn_t fn,
+                               void *cbdata)
+{
+    IB_FTRACE_INIT(ib_ac_match_stream);
+    const ib_ac_cell_t *cell = ac->cell;
+    const ib_ac_state_t *state = ac->state;
+    const uint32_t ncell = ac->ncell;
+    ib_status_t rc = IB_ENOENT;
+    int32_t s = as->state;
+    size_t i;
+
+    if (ac->bmp != NULL) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    for (i = 0; i < dlen; i++) {
+        uint32_t c = ac->cls[data[i]];
+        int32_t m;
+
+        /* No pattern contains this byte. */
+        if (c == 0) {
+            s = 0;
+            continue;
+        }
+
+        for (;;) {
+            uint32_t t;
+
+            if (s == 0) {
+                s = ac->root[c];
+                break;
+            }
+            t = (uint32_t)cell[s].base + c;
+            if ((t < ncell) && (cell[t].check == s)) {
+                s = (int32_t)t;
+                break;
+            }
+            s = state[s].fail;
+        }
+
+        /* Report all patterns ending here. */
+        for (m = state[s].match; m != IB_AC_NONE; m = state[state[m].fail].match) {
+            uint32_t j;
+
+            if (fn == NULL) {
+                rc = IB_OK;
+                goto stop;
+            }
+            for (j = 0; j < state[m].nout; j++) {
+                rc = fn(cbdata, ac->ids[state[m].out + j], as->offset + i + 1);
+                if (rc != IB_OK) {
+                    goto stop;
+                }
+            }
+        }
+    }
+
+    as->state = s;
+    as->offset += dlen;
+
+    IB_FTRACE_RET_STATUS(rc);
+
+stop:
+    /* Stopped early, so the rest of the data was not seen. */
+    as->state = s;
+    as->offset += i + 1;
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+ib_status_t ib_ac_match(const ib_ac_t *ac,
+                        const uint8_t *data,
+                        size_t dlen,
+                        ib_ac_callback_fn_t fn,
+                        void *cbdata)
+{
+    IB_FTRACE_INIT(ib_ac_match);
+    ib_ac_stream_t as;
+    ib_status_t rc;
+
+    ib_ac_stream_init(&as);
+    rc = ib_ac_match_stream(ac, &as, data, dlen, fn, cbdata);
+
+    IB_FTRACE_RET_STATUS(rc);
+}
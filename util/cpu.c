@@ -0,0 +1,180 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee - Utility CPU Feature Functions
+ * @author Brian Rectanus <brectanus@qualys.com>
+ */
+
+/**
+ * @internal
+ *
+ * Features are detected once, on first use. Each module with vector
+ * kernels checks ib_cpu_features() and selects the kernels it calls
+ * through its function pointers when the features change, so this
+ * module does not depend on any of them. This allows a single build
+ * for a baseline CPU to use wider vectors where available.
+ */
+
+#include "ironbee_config_auto.h"
+
+#include <ironbee/util.h>
+
+#include "ironbee_util_private.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define IB_CPU_X86
+#include <cpuid.h>
+#endif
+
+/** Detected features. */
+static ib_flags_t ib_cpu_detected = 0;
+
+/** Active (detected and not masked) features. */
+static ib_flags_t ib_cpu_active = 0;
+
+/** Set once features have been detected. */
+static int ib_cpu_initialized = 0;
+
+
+#ifdef IB_CPU_X86
+
+/* Not defined by all versions of cpuid.h */
+#define IB_CPUID1_ECX_SSE42     (1 << 20)
+#define IB_CPUID1_ECX_OSXSAVE   (1 << 27)
+#define IB_CPUID1_ECX_AVX       (1 << 28)
+#define IB_CPUID1_EDX_SSE2      (1 << 26)
+#define IB_CPUID7_EBX_AVX2      (1 << 5)
+#define IB_CPUID7_EBX_AVX512F   (1 << 16)
+#define IB_CPUID7_EBX_AVX512BW  (1 << 30)
+
+/* XCR0 state components the OS must save for AVX and AVX-512. */
+#define IB_XCR0_YMM             0x06
+#define IB_XCR0_ZMM             0xe6
+
+/**
+ * @internal
+ * Read the XCR0 register.
+ */
+static uint64_t ib_cpu_xgetbv(void)
+{
+    uint32_t lo;
+    uint32_t hi;
+
+    __asm__ __volatile__ ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/**
+ * @internal
+ * Detect x86 features.
+ *
+ * Wide vector features are only reported if the OS also saves the
+ * wider register state.
+ */
+static ib_flags_t ib_cpu_detect(void)
+{
+    ib_flags_t flags = 0;
+    unsigned int eax, ebx, ecx, edx;
+    uint64_t xcr0 = 0;
+
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return 0;
+    }
+
+    if (edx & IB_CPUID1_EDX_SSE2) {
+        flags |= IB_CPU_SSE2;
+    }
+    if (ecx & IB_CPUID1_ECX_SSE42) {
+        flags |= IB_CPU_SSE42;
+    }
+    if ((ecx & IB_CPUID1_ECX_OSXSAVE) && (ecx & IB_CPUID1_ECX_AVX)) {
+        xcr0 = ib_cpu_xgetbv();
+    }
+
+    if (__get_cpuid_max(0, NULL) >= 7) {
+        __cpuid_count(7, 0, eax, ebx, ecx, edx);
+
+        if (   ((xcr0 & IB_XCR0_YMM) == IB_XCR0_YMM)
+            && (ebx & IB_CPUID7_EBX_AVX2))
+        {
+            flags |= IB_CPU_AVX2;
+        }
+        if (   ((xcr0 & IB_XCR0_ZMM) == IB_XCR0_ZMM)
+            && (ebx & IB_CPUID7_EBX_AVX512F)
+            && (ebx & IB_CPUID7_EBX_AVX512BW))
+        {
+            flags |= IB_CPU_AVX512BW;
+        }
+    }
+
+    return flags;
+}
+
+#else
+
+static ib_flags_t ib_cpu_detect(void)
+{
+    return 0;
+}
+
+#endif /* IB_CPU_X86 */
+
+void ib_cpu_init(void)
+{
+    if (ib_cpu_initialized) {
+        return;
+    }
+
+    ib_cpu_detected = ib_cpu_detect();
+    ib_cpu_active = ib_cpu_detected;
+    ib_cpu_initialized = 1;
+}
+
+ib_flags_t ib_cpu_features(void)
+{
+    if (!ib_cpu_initialized) {
+        ib_cpu_init();
+    }
+
+    return ib_cpu_active;
+}
+
+ib_flags_t ib_cpu_features_limit(ib_flags_t mask)
+{
+    ib_cpu_init();
+
+    ib_cpu_active = ib_cpu_detected & mask;
+
+    return ib_cpu_active;
+}
+
+const char *ib_cpu_features_str(ib_flags_t flags,
+                                char *buf,
+                                size_t blen)
+{
+    snprintf(buf, blen, "%s%s%s%s",
+             (flags & IB_CPU_SSE2) ? " sse2" : "",
+             (flags & IB_CPU_SSE42) ? " sse4.2" : "",
+             (flags & IB_CPU_AVX2) ? " avx2" : "",
+             (flags & IB_CPU_AVX512BW) ? " avx512bw" : "");
+
+    /* Skip the leading space. */
+    return (*buf != '\0') ? buf + 1 : "none";
+}
@@ -0,0 +1,691 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee - Utility Decoding Functions
+ * @author Brian Rectanus <brectanus@qualys.com>
+ */
+
+/**
+ * @internal
+ *
+ * All decoders work in-place, as decoded data is never longer than
+ * the encoded data. Decoders with an escape character use
+ * ib_strops_find_any() to skip (and leave untouched) runs of data
+ * without escapes, so the common case of unencoded data is a vector
+ * scan with no writes.
+ *
+ * The _ex variants may be given data in chunks. Escape based decoders
+ * then stop before an escape which may continue in the following
+ * chunk, leaving it unconsumed (and untouched) to be passed again
+ * with the following data. As no escape is longer than
+ * IB_DECODE_PARTIAL_MAX, an escape starting closer than that to the
+ * end of a chunk is always left unconsumed, whether complete or not.
+ */
+
+#include "ironbee_config_auto.h"
+
+#include <string.h>
+
+#include <ironbee/util.h>
+
+/**
+ * @internal
+ * Check for whitespace (as isspace() in the "C" locale).
+ */
+#define IB_DECODE_ISSPACE(c) \
+    (((c) == ' ') || (((c) >= '\t') && ((c) <= '\r')))
+
+int ib_decode_hexval(uint8_t c)
+{
+    if ((uint8_t)(c - '0') < 10) {
+        return c - '0';
+    }
+    c |= 0x20;
+    if ((uint8_t)(c - 'a') < 6) {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+uint8_t ib_decode_ucs2(uint32_t cp)
+{
+    /* Full width ASCII forms are common evasions. */
+    if ((cp >= 0xff01) && (cp <= 0xff5e)) {
+        return (uint8_t)(cp - 0xfee0);
+    }
+    return (uint8_t)(cp & 0xff);
+}
+
+/**
+ * @internal
+ * Parse a fixed number of hex digits.
+ *
+ * @param data Data
+ * @param n Number of digits
+ * @param pval Address which the value is written
+ *
+ * @returns Non-zero if all digits were hex
+ */
+static int ib_decode_hexn(const uint8_t *data,
+                          size_t n,
+                          uint32_t *pval)
+{
+    uint32_t val = 0;
+    size_t i;
+
+    for (i = 0; i < n; i++) {
+        int h = ib_decode_hexval(data[i]);
+        if (h < 0) {
+            return 0;
+        }
+        val = (val << 4) | (uint32_t)h;
+    }
+    *pval = val;
+
+    return 1;
+}
+
+/** @internal Longest escape for each decoder. */
+#define IB_DECODE_URL_MAX       6       /* %uHHHH */
+#define IB_DECODE_HEX_MAX       2       /* HH */
+#define IB_DECODE_HTML_MAX      16      /* &#xHHHHHHHHHHHH; */
+#define IB_DECODE_HTML_DIGITS   12
+#define IB_DECODE_JS_MAX        6       /* \uHHHH */
+#define IB_DECODE_CSS_MAX       8       /* \HHHHHH followed by whitespace */
+
+int ib_decode_url(uint8_t *data,
+                  size_t dlen,
+                  size_t *pdlen)
+{
+    return ib_decode_url_ex(data, dlen, pdlen, NULL);
+}
+
+int ib_decode_url_ex(uint8_t *data,
+                     size_t dlen,
+                     size_t *pdlen,
+                     size_t *pconsumed)
+{
+    size_t i = ib_strops_find_any(data, dlen, "%+", 2);
+    size_t o = i;
+    int modified = 0;
+
+    while (i < dlen) {
+        uint8_t c = data[i];
+        uint32_t val;
+
+        if (c == '+') {
+            data[o++] = ' ';
+            i++;
+            modified = 1;
+        }
+        else if (c != '%') {
+            data[o++] = c;
+            i++;
+        }
+        else if ((pconsumed != NULL) && (dlen - i < IB_DECODE_URL_MAX)) {
+            break;
+        }
+        else if (   (i + 5 < dlen)
+                 && ((data[i + 1] | 0x20) == 'u')
+                 && ib_decode_hexn(data + i + 2, 4, &val))
+        {
+            data[o++] = ib_decode_ucs2(val);
+            i += 6;
+            modified = 1;
+        }
+        else if ((i + 2 < dlen) && ib_decode_hexn(data + i + 1, 2, &val)) {
+            data[o++] = (uint8_t)val;
+            i += 3;
+            modified = 1;
+        }
+        else {
+            /* Invalid escapes are left as-is. */
+            data[o++] = c;
+            i++;
+        }
+
+        /* Skip (move) any unescaped run. */
+        if ((i < dlen) && (data[i] != '%') && (data[i] != '+')) {
+            size_t n = ib_strops_find_any(data + i, dlen - i, "%+", 2);
+            memmove(data + o, data + i, n);
+            o += n;
+            i += n;
+        }
+    }
+
+    if (pconsumed != NULL) {
+        *pconsumed = i;
+    }
+    *pdlen = o;
+    return modified;
+}
+
+int ib_decode_hex(uint8_t *data,
+                  size_t dlen,
+                  size_t *pdlen)
+{
+    return ib_decode_hex_ex(data, dlen, pdlen, NULL);
+}
+
+int ib_decode_hex_ex(uint8_t *data,
+                     size_t dlen,
+                     size_t *pdlen,
+                     size_t *pconsumed)
+{
+    size_t i = 0;
+    size_t o = 0;
+    int modified = 0;
+
+    /* Every byte is part of the encoding, so there are no runs
+     * to skip. Invalid pairs are left as-is.
+     */
+    while (i < dlen) {
+        uint32_t val;
+
+        if ((pconsumed != NULL) && (dlen - i < IB_DECODE_HEX_MAX)) {
+            break;
+        }
+        if ((i + 1 < dlen) && ib_decode_hexn(data + i, 2, &val)) {
+            data[o++] = (uint8_t)val;
+            i += 2;
+            modified = 1;
+        }
+        else {
+            data[o++] = data[i++];
+        }
+    }
+
+    if (pconsumed != NULL) {
+        *pconsumed = i;
+    }
+    *pdlen = o;
+    return modified;
+}
+
+/**
+ * @internal
+ * Base64 value of a byte.
+ *
+ * @param c Byte
+ *
+ * @returns Value (0-63) or -1 if not a base64 byte
+ */
+static int ib_decode_b64val(uint8_t c)
+{
+    if ((uint8_t)(c - 'A') < 26) {
+        return c - 'A';
+    }
+    if ((uint8_t)(c - 'a') < 26) {
+        return c - 'a' + 26;
+    }
+    if ((uint8_t)(c - '0') < 10) {
+        return c - '0' + 52;
+    }
+    if (c == '+') {
+        return 62;
+    }
+    if (c == '/') {
+        return 63;
+    }
+    return -1;
+}
+
+int ib_decode_base64(uint8_t *data,
+                     size_t dlen,
+                     size_t *pdlen)
+{
+    ib_decode_base64_state_t state;
+
+    memset(&state, 0, sizeof(state));
+
+    return ib_decode_base64_ex(data, dlen, pdlen, &state);
+}
+
+int ib_decode_base64_ex(uint8_t *data,
+                        size_t dlen,
+                        size_t *pdlen,
+                        ib_decode_base64_state_t *state)
+{
+    uint32_t acc = state->acc;
+    int bits = state->bits;
+    size_t i;
+    size_t o = 0;
+
+    /* Whitespace is ignored and decoding stops at padding or at
+     * the first invalid byte.
+     */
+    for (i = 0; (i < dlen) && !state->done; i++) {
+        uint8_t c = data[i];
+        int val;
+
+        if (IB_DECODE_ISSPACE(c)) {
+            continue;
+        }
+        val = ib_decode_b64val(c);
+        if (val < 0) {
+            state->done = 1;
+            break;
+        }
+        acc = (acc << 6) | (uint32_t)val;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            data[o++] = (uint8_t)(acc >> bits);
+        }
+    }
+
+    /* Only the undecoded bits need to be kept. */
+    state->acc = acc & ((1U << bits) - 1);
+    state->bits = bits;
+
+    *pdlen = o;
+    return 1;
+}
+
+/**
+ * @internal
+ * Named HTML entities.
+ */
+static const struct {
+    const char *name;
+    size_t      nlen;
+    uint8_t     val;
+} ib_decode_html_entities[] = {
+    { "quot", 4, '"' },
+    { "amp",  3, '&' },
+    { "lt",   2, '<' },
+    { "gt",   2, '>' },
+    { "apos", 4, '\'' },
+    { "nbsp", 4, 0xa0 },
+    { NULL,   0, 0 }
+};
+
+/**
+ * @internal
+ * Decode a single HTML entity.
+ *
+ * @param data Data starting after the '&'
+ * @param dlen Data length
+ * @param pval Address which decoded byte is written
+ *
+ * @returns Encoded length consumed (after the '&') or 0 if invalid
+ */
+static size_t ib_decode_html_entity_one(const uint8_t *data,
+                                        size_t dlen,
+                                        uint8_t *pval)
+{
+    size_t i = 0;
+    size_t j;
+
+    if ((dlen > 1) && (data[0] == '#')) {
+        uint32_t val = 0;
+        int hex = ((data[1] | 0x20) == 'x');
+        size_t start;
+
+        i = start = hex ? 2 : 1;
+        while ((i < dlen) && (i - start < IB_DECODE_HTML_DIGITS)) {
+            int h = hex ? ib_decode_hexval(data[i])
+                        : (((uint8_t)(data[i] - '0') < 10) ? data[i] - '0' : -1);
+            if (h < 0) {
+                break;
+            }
+            /* Only the low byte is kept, so overflow is harmless. */
+            val = (val * (hex ? 16 : 10)) + (uint32_t)h;
+            i++;
+        }
+        if (i == start) {
+            return 0;
+        }
+        *pval = (uint8_t)(val & 0xff);
+    }
+    else {
+        for (j = 0; ib_decode_html_entities[j].name != NULL; j++) {
+            size_t nlen = ib_decode_html_entities[j].nlen;
+
+            if (   (nlen <= dlen)
+                && (memcmp(data, ib_decode_html_entities[j].name, nlen) == 0))
+            {
+                break;
+            }
+        }
+        if (ib_decode_html_entities[j].name == NULL) {
+            return 0;
+        }
+        *pval = ib_decode_html_entities[j].val;
+        i = ib_decode_html_entities[j].nlen;
+    }
+
+    /* The terminating ';' is optional (as browsers allow). */
+    if ((i < dlen) && (data[i] == ';')) {
+        i++;
+    }
+
+    return i;
+}
+
+int ib_decode_html_entity(uint8_t *data,
+                          size_t dlen,
+                          size_t *pdlen)
+{
+    return ib_decode_html_entity_ex(data, dlen, pdlen, NULL);
+}
+
+int ib_decode_html_entity_ex(uint8_t *data,
+                             size_t dlen,
+                             size_t *pdlen,
+                             size_t *pconsumed)
+{
+    size_t i = ib_strops_find_any(data, dlen, "&", 1);
+    size_t o = i;
+    int modified = 0;
+
+    while (i < dlen) {
+        size_t n;
+
+        /* Always at a '&' here. */
+        if ((pconsumed != NULL) && (dlen - i < IB_DECODE_HTML_MAX)) {
+            break;
+        }
+        n = ib_decode_html_entity_one(data + i + 1, dlen - i - 1, &data[o]);
+        if (n > 0) {
+            o++;
+            i += n + 1;
+            modified = 1;
+        }
+        else {
+            data[o++] = data[i++];
+        }
+
+        n = ib_strops_find_any(data + i, dlen - i, "&", 1);
+        memmove(data + o, data + i, n);
+        o += n;
+        i += n;
+    }
+
+    if (pconsumed != NULL) {
+        *pconsumed = i;
+    }
+    *pdlen = o;
+    return modified;
+}
+
+int ib_decode_js(uint8_t *data,
+                 size_t dlen,
+                 size_t *pdlen)
+{
+    return ib_decode_js_ex(data, dlen, pdlen, NULL);
+}
+
+int ib_decode_js_ex(uint8_t *data,
+                    size_t dlen,
+                    size_t *pdlen,
+                    size_t *pconsumed)
+{
+    size_t i = ib_strops_find_any(data, dlen, "\\", 1);
+    size_t o = i;
+    int modified = 0;
+
+    while (i < dlen) {
+        uint32_t val;
+        uint8_t c;
+        size_t n;
+
+        /* Always at a '\' here; a trailing '\' is left as-is. */
+        if ((pconsumed != NULL) && (dlen - i < IB_DECODE_JS_MAX)) {
+            break;
+        }
+        if (i + 1 >= dlen) {
+            data[o++] = data[i++];
+            break;
+        }
+        c = data[i + 1];
+        modified = 1;
+
+        if (   ((c == 'u') || (c == 'U'))
+            && (i + 5 < dlen)
+            && ib_decode_hexn(data + i + 2, 4, &val))
+        {
+            data[o++] = ib_decode_ucs2(val);
+            i += 6;
+        }
+        else if (   ((c == 'x') || (c == 'X'))
+                 && (i + 3 < dlen)
+                 && ib_decode_hexn(data + i + 2, 2, &val))
+        {
+            data[o++] = (uint8_t)val;
+            i += 4;
+        }
+        else if ((uint8_t)(c - '0') < 8) {
+            /* Up to three octal digits, limited to a byte value. */
+            size_t max = (c <= '3') ? 3 : 2;
+
+            val = 0;
+            for (n = 0;
+                 (n < max) && (i + 1 + n < dlen)
+                     && ((uint8_t)(data[i + 1 + n] - '0') < 8);
+                 n++)
+            {
+                val = (val << 3) | (uint32_t)(data[i + 1 + n] - '0');
+            }
+            data[o++] = (uint8_t)val;
+            i += 1 + n;
+        }
+        else {
+            switch (c) {
+                case 'a': c = '\a'; break;
+                case 'b': c = '\b'; break;
+                case 'f': c = '\f'; break;
+                case 'n': c = '\n'; break;
+                case 'r': c = '\r'; break;
+                case 't': c = '\t'; break;
+                case 'v': c = '\v'; break;
+                default:
+                    /* Any other escaped character is itself. */
+                    break;
+            }
+            data[o++] = c;
+            i += 2;
+        }
+
+        n = ib_strops_find_any(data + i, dlen - i, "\\", 1);
+        memmove(data + o, data + i, n);
+        o += n;
+        i += n;
+    }
+
+    if (pconsumed != NULL) {
+        *pconsumed = i;
+    }
+    *pdlen = o;
+    return modified;
+}
+
+int ib_decode_css(uint8_t *data,
+                  size_t dlen,
+                  size_t *pdlen)
+{
+    return ib_decode_css_ex(data, dlen, pdlen, NULL);
+}
+
+int ib_decode_css_ex(uint8_t *data,
+                     size_t dlen,
+                     size_t *pdlen,
+                     size_t *pconsumed)
+{
+    size_t i = ib_strops_find_any(data, dlen, "\\", 1);
+    size_t o = i;
+    int modified = 0;
+
+    while (i < dlen) {
+        uint32_t val = 0;
+        size_t n;
+
+        /* Always at a '\' here; a trailing '\' is left as-is. */
+        if ((pconsumed != NULL) && (dlen - i < IB_DECODE_CSS_MAX)) {
+            break;
+        }
+        if (i + 1 >= dlen) {
+            data[o++] = data[i++];
+            break;
+        }
+        modified = 1;
+
+        /* Up to six hex digits, optionally followed by a single
+         * whitespace character.
+         */
+        for (n = 0;
+             (n < 6) && (i + 1 + n < dlen)
+                 && (ib_decode_hexval(data[i + 1 + n]) >= 0);
+             n++)
+        {
+            val = (val << 4) | (uint32_t)ib_decode_hexval(data[i + 1 + n]);
+        }
+
+        if (n > 0) {
+            data[o++] = ib_decode_ucs2(val);
+            i += 1 + n;
+            if ((i < dlen) && IB_DECODE_ISSPACE(data[i])) {
+                i++;
+            }
+        }
+        else if (data[i + 1] == '\n') {
+            /* Line continuation. */
+            i += 2;
+        }
+        else {
+            /* Any other escaped character is itself. */
+            data[o++] = data[i + 1];
+            i += 2;
+        }
+
+        n = ib_strops_find_any(data + i, dlen - i, "\\", 1);
+        memmove(data + o, data + i, n);
+        o += n;
+        i += n;
+    }
+
+    if (pconsumed != NULL) {
+        *pconsumed = i;
+    }
+    *pdlen = o;
+    return modified;
+}
+
+int ib_decode_path(uint8_t *data,
+                   size_t dlen,
+                   size_t *pdlen,
+                   int win)
+{
+    size_t base;
+    size_t i;
+    size_t o;
+    int modified = 0;
+
+    /* Convert windows separators. */
+    if (win) {
+        for (i = ib_strops_find_any(data, dlen, "\\", 1);
+             i < dlen;
+             i += ib_strops_find_any(data + i, dlen - i, "\\", 1))
+        {
+            data[i++] = '/';
+            modified = 1;
+        }
+    }
+
+    /* Without a '.' segment or an empty segment there is
+     * nothing to do.
+     */
+    if (ib_strops_find_any(data, dlen, ".", 1) == dlen) {
+        const uint8_t *p = data;
+        const uint8_t *end = data + dlen;
+
+        while ((p = (const uint8_t *)memchr(p, '/', end - p)) != NULL) {
+            if ((++p < end) && (*p == '/')) {
+                break;
+            }
+        }
+        if (p == NULL) {
+            *pdlen = dlen;
+            return modified;
+        }
+    }
+
+    base = ((dlen > 0) && (data[0] == '/')) ? 1 : 0;
+    i = o = base;
+
+    while (i < dlen) {
+        const uint8_t *sep = (const uint8_t *)memchr(data + i, '/', dlen - i);
+        size_t j = (sep != NULL) ? (size_t)(sep - data) : dlen;
+        size_t seglen = j - i;
+
+        if ((seglen == 0) || ((seglen == 1) && (data[i] == '.'))) {
+            /* Empty or "." segment. */
+            modified = 1;
+        }
+        else if ((seglen == 2) && (data[i] == '.') && (data[i + 1] == '.')) {
+            size_t prev = o;
+
+            /* Find the previous output segment (which always
+             * ends with a '/').
+             */
+            if (prev > base) {
+                prev--;
+                while ((prev > base) && (data[prev - 1] != '/')) {
+                    prev--;
+                }
+            }
+
+            if ((o > base) && !((o - prev == 3) && (data[prev] == '.')
+                                && (data[prev + 1] == '.')))
+            {
+                /* Drop the previous segment. */
+                o = prev;
+                modified = 1;
+            }
+            else if (base > 0) {
+                /* Cannot go above the root. */
+                modified = 1;
+            }
+            else {
+                /* Leading ".." of a relative path is kept. */
+                memmove(data + o, data + i, 2);
+                o += 2;
+                if (j < dlen) {
+                    data[o++] = '/';
+                }
+            }
+        }
+        else {
+            memmove(data + o, data + i, seglen);
+            o += seglen;
+            if (j < dlen) {
+                data[o++] = '/';
+            }
+        }
+
+        i = j + 1;
+    }
+
+    if (o != dlen) {
+        modified = 1;
+    }
+
+    *pdlen = o;
+    return modified;
+}
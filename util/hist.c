@@ -0,0 +1,197 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee - Utility Histogram Functions
+ * @author Brian Rectanus <brectanus@qualys.com>
+ */
+
+/**
+ * @internal
+ *
+ * This is a log-linear histogram. Values less than IB_HIST_SUB_COUNT
+ * each get their own bucket. Larger values are bucketed by the
+ * position of their most significant bit (the magnitude) and then
+ * linearly by the next IB_HIST_SUB_BITS bits.
+ */
+
+#include "ironbee_config_auto.h"
+
+#include <string.h>
+
+#include <ironbee/util.h>
+
+/**
+ * @internal
+ * Calculate the bucket index for a value.
+ *
+ * @param val Value
+ *
+ * @returns Bucket index
+ */
+static size_t ib_hist_index(uint64_t val)
+{
+    int msb;
+    int shift;
+
+    if (val < IB_HIST_SUB_COUNT) {
+        return (size_t)val;
+    }
+
+    msb = 63 - __builtin_clzll(val);
+    shift = msb - IB_HIST_SUB_BITS;
+
+    return (size_t)(((shift + 1) << IB_HIST_SUB_BITS)
+                    + ((val >> shift) - IB_HIST_SUB_COUNT));
+}
+
+/**
+ * @internal
+ * Calculate the highest value that is recorded in a bucket.
+ *
+ * @param idx Bucket index
+ *
+ * @returns Highest value in the bucket
+ */
+static uint64_t ib_hist_bucket_max(size_t idx)
+{
+    size_t mag = idx >> IB_HIST_SUB_BITS;
+    uint64_t sub = idx & (IB_HIST_SUB_COUNT - 1);
+    uint64_t lo;
+
+    if (mag == 0) {
+        return (uint64_t)idx;
+    }
+
+    lo = (sub + IB_HIST_SUB_COUNT) << (mag - 1);
+
+    return lo + ((uint64_t)1 << (mag - 1)) - 1;
+}
+
+ib_status_t ib_hist_create(ib_hist_t **ph,
+                           ib_mpool_t *pool)
+{
+    IB_FTRACE_INIT(ib_hist_create);
+
+    *ph = (ib_hist_t *)ib_mpool_alloc(pool, sizeof(**ph));
+    if (*ph == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    ib_hist_clear(*ph);
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+void ib_hist_clear(ib_hist_t *h)
+{
+    IB_FTRACE_INIT(ib_hist_clear);
+    memset(h, 0, sizeof(*h));
+    h->min = UINT64_MAX;
+    IB_FTRACE_RET_VOID();
+}
+
+void ib_hist_record(ib_hist_t *h,
+                    uint64_t val)
+{
+    IB_FTRACE_INIT(ib_hist_record);
+
+    h->bucket[ib_hist_index(val)]++;
+    h->count++;
+    h->sum += val;
+    if (val < h->min) {
+        h->min = val;
+    }
+    if (val > h->max) {
+        h->max = val;
+    }
+
+    IB_FTRACE_RET_VOID();
+}
+
+void ib_hist_merge(ib_hist_t *dst,
+                   const ib_hist_t *src)
+{
+    IB_FTRACE_INIT(ib_hist_merge);
+    size_t i;
+
+    if (src->count == 0) {
+        IB_FTRACE_RET_VOID();
+    }
+
+    for (i = 0; i < IB_HIST_BUCKETS; i++) {
+        dst->bucket[i] += src->bucket[i];
+    }
+    dst->count += src->count;
+    dst->sum += src->sum;
+    if (src->min < dst->min) {
+        dst->min = src->min;
+    }
+    if (src->max > dst->max) {
+        dst->max = src->max;
+    }
+
+    IB_FTRACE_RET_VOID();
+}
+
+uint64_t ib_hist_percentile(const ib_hist_t *h,
+                            double pct)
+{
+    IB_FTRACE_INIT(ib_hist_percentile);
+    uint64_t target;
+    uint64_t seen = 0;
+    uint64_t val;
+    size_t i;
+
+    if (h->count == 0) {
+        IB_FTRACE_RET_UINT(0);
+    }
+
+    if (pct <= 0.0) {
+        IB_FTRACE_RET_UINT(h->min);
+    }
+    if (pct >= 100.0) {
+        IB_FTRACE_RET_UINT(h->max);
+    }
+
+    /* Rank of the value (rounded up), at least the first value. */
+    target = (uint64_t)((pct / 100.0) * (double)h->count + 0.5);
+    if (target == 0) {
+        target = 1;
+    }
+
+    for (i = 0; i < IB_HIST_BUCKETS; i++) {
+        seen += h->bucket[i];
+        if (seen >= target) {
+            val = ib_hist_bucket_max(i);
+            IB_FTRACE_RET_UINT((val > h->max) ? h->max : val);
+        }
+    }
+
+    IB_FTRACE_RET_UINT(h->max);
+}
+
+uint64_t ib_hist_mean(const ib_hist_t *h)
+{
+    IB_FTRACE_INIT(ib_hist_mean);
+
+    if (h->count == 0) {
+        IB_FTRACE_RET_UINT(0);
+    }
+
+    IB_FTRACE_RET_UINT(h->sum / h->count);
+}
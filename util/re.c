@@ -0,0 +1,3001 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee - Utility Regular Expression (DFA) Functions
+ * @author Brian Rectanus <brectanus@qualys.com>
+ */
+
+/**
+ * @internal
+ *
+ * Patterns are parsed to a syntax tree, and building compiles all of
+ * them into a single Thompson NFA program, each ending in a MATCH
+ * instruction for that pattern.
+ *
+ * Matching simulates the NFA with a DFA which is built lazily: a DFA
+ * state is the set of NFA instructions which can be reached, and its
+ * transitions are only computed when first taken. The unanchored
+ * search is done by adding the pattern starts to every set. States
+ * are kept in a cache of bounded size, which is flushed (and then
+ * refilled as needed) when full, so the cost of a byte is bounded by
+ * the size of the program whatever the data and pattern.
+ *
+ * As in the AC automaton, bytes are mapped to classes which no
+ * pattern tells apart, to keep the transition tables small.
+ *
+ * The cache is only used by one thread at a time. A thread which
+ * finds it in use simulates the NFA directly instead, which is slower
+ * but still linear.
+ */
+
+#include "ironbee_config_auto.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <pthread.h>
+
+#include <ironbee/util.h>
+
+/** @internal Maximum instructions in a program. */
+#define IB_RE_MAX_INSTS      100000
+
+/** @internal Maximum group nesting. */
+#define IB_RE_MAX_DEPTH      250
+
+/** @internal Maximum repeat count. */
+#define IB_RE_MAX_REPEAT     65535
+
+/** @internal Minimum cache block size. */
+#define IB_RE_BLOCK_SIZE     (16 * 1024)
+
+/** @internal Default cache size. */
+#define IB_RE_CACHE_DEFAULT  (256 * 1024)
+
+/** @internal Initial number of cache hash buckets. */
+#define IB_RE_BUCKETS        64
+
+/** @internal Add a byte to a set. */
+#define IB_RE_SET_ADD(s, c)  ((s)[(c) >> 5] |= (1U << ((c) & 31)))
+
+/** @internal Check if a byte is in a set. */
+#define IB_RE_SET_HAS(s, c)  ((s)[(c) >> 5] & (1U << ((c) & 31)))
+
+/** @internal Empty byte set. */
+static const uint32_t ib_re_none[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+/** @internal Syntax tree node types. */
+enum {
+    IB_RE_N_EMPTY,                        /**< Matches the empty string */
+    IB_RE_N_BYTES,                        /**< Any byte in a set */
+    IB_RE_N_CAT,                          /**< Concatenation */
+    IB_RE_N_ALT,                          /**< Alternation */
+    IB_RE_N_REPEAT,                       /**< Repetition */
+    IB_RE_N_BOL,                          /**< Start of subject */
+    IB_RE_N_EOL,                          /**< End of subject */
+
+    /* Only when analyzing. */
+    IB_RE_N_ATOMIC,                       /**< Atomic group or possessive */
+    IB_RE_N_BACKREF                       /**< Back reference */
+};
+
+/** @internal Instruction op codes. */
+enum {
+    IB_RE_OP_BYTES,                       /**< Consume a byte in the set */
+    IB_RE_OP_SPLIT,                       /**< Continue at out and out1 */
+    IB_RE_OP_BOL,                         /**< Assert start of subject */
+    IB_RE_OP_EOL,                         /**< Assert end of subject */
+    IB_RE_OP_MATCH                        /**< Pattern matched */
+};
+
+/**
+ * @internal
+ * Syntax tree node.
+ */
+typedef struct ib_re_node_t ib_re_node_t;
+struct ib_re_node_t {
+    int                 type;             /**< Type (IB_RE_N_*) */
+    ib_re_node_t       *left;             /**< Left (or repeated) node */
+    ib_re_node_t       *right;            /**< Right node */
+    int                 min;              /**< Minimum repeat */
+    int                 max;              /**< Maximum repeat (-1 if none) */
+    size_t              off;              /**< Pattern offset */
+    uint32_t            set[8];           /**< Byte set */
+};
+
+/**
+ * @internal
+ * Parsed pattern (only used until built).
+ */
+typedef struct {
+    ib_re_node_t       *root;             /**< Syntax tree */
+    ib_num_t            id;               /**< Pattern ID */
+    size_t              ninst;            /**< Instructions needed */
+} ib_re_patt_t;
+
+/**
+ * @internal
+ * NFA instruction.
+ */
+typedef struct {
+    uint32_t            set[8];           /**< Byte set (BYTES) */
+    int32_t             out;              /**< Next instruction */
+    int32_t             out1;             /**< Alternate instruction (SPLIT) */
+    int32_t             arg;              /**< Pattern index (MATCH) */
+    uint8_t             op;               /**< Op code (IB_RE_OP_*) */
+} ib_re_inst_t;
+
+/**
+ * @internal
+ * DFA state.
+ */
+typedef struct ib_re_dstate_t ib_re_dstate_t;
+struct ib_re_dstate_t {
+    ib_re_dstate_t    **next;             /**< Transitions by byte class
+                                               (NULL if not yet known) */
+    ib_re_dstate_t     *hnext;            /**< Next state in hash bucket */
+    int32_t            *set;              /**< NFA instructions (sorted) */
+    int32_t            *match;            /**< Patterns matched on entry */
+    int32_t             nset;             /**< Number of instructions */
+    int32_t             nmatch;           /**< Number of patterns matched */
+    uint32_t            hash;             /**< Hash of instructions */
+};
+
+/**
+ * @internal
+ * Cache memory block.
+ */
+typedef struct ib_re_block_t ib_re_block_t;
+struct ib_re_block_t {
+    ib_re_block_t      *next;             /**< Next (older) block */
+    size_t              size;             /**< Usable size */
+    size_t              used;             /**< Used size */
+};
+
+/**
+ * @internal
+ * Sparse set of instructions, which can be cleared in constant time.
+ */
+typedef struct {
+    int32_t            *dense;            /**< Members */
+    int32_t            *sparse;           /**< Index in dense by member */
+    int32_t             n;                /**< Number of members */
+} ib_re_sset_t;
+
+/**
+ * @internal
+ * Scratch memory for computing instruction sets.
+ */
+typedef struct {
+    ib_re_sset_t        q;                /**< Instructions reached */
+    int32_t            *stack;            /**< Closure stack */
+    int32_t            *key;              /**< Resulting set */
+    int32_t            *save;             /**< Set kept across a flush */
+} ib_re_work_t;
+
+/**
+ * @internal
+ * DFA state cache.
+ */
+typedef struct {
+    pthread_mutex_t     lock;             /**< Held while in use */
+    ib_re_block_t      *blocks;           /**< Memory blocks */
+    size_t              size;             /**< Memory allocated to blocks */
+    ib_re_dstate_t    **buckets;          /**< Hash buckets */
+    size_t              nbuckets;         /**< Number of hash buckets */
+    size_t              nstates;          /**< Number of states */
+    size_t              flushes;          /**< Number of flushes */
+    ib_re_dstate_t     *start;            /**< Start state */
+    ib_re_work_t        work;             /**< Scratch memory */
+} ib_re_cache_t;
+
+struct ib_re_t {
+    ib_mpool_t         *mp;               /**< Memory pool */
+    ib_flags_t          flags;            /**< Flags */
+    size_t              cache_max;        /**< Maximum cache memory */
+    size_t              block_size;       /**< Cache block size */
+    size_t              npatt;            /**< Number of patterns */
+
+    /* Parsed patterns (until built). */
+    ib_mpool_t         *bmp;              /**< Build memory pool */
+    ib_list_t          *patts;            /**< Parsed patterns */
+    size_t              ninst;            /**< Instructions needed */
+
+    /* Program (once built). */
+    ib_re_inst_t       *prog;             /**< Instructions */
+    int32_t             nprog;            /**< Number of instructions */
+    int32_t            *starts;           /**< Start by pattern index */
+    ib_num_t           *ids;              /**< ID by pattern index */
+    uint8_t             cls[256];         /**< Byte classes */
+    uint8_t             rep[256];         /**< Byte by class */
+    int                 ncls;             /**< Number of byte classes */
+    ib_re_cache_t       cache;            /**< DFA state cache */
+};
+
+struct ib_re_stream_t {
+    int32_t            *set;              /**< NFA instructions */
+    int32_t             nset;             /**< Number of instructions */
+    size_t              offset;           /**< Bytes matched so far */
+    uint8_t            *done;             /**< Patterns reported */
+    size_t              ndone;            /**< Number of patterns reported */
+    int                 started;          /**< Start state entered */
+};
+
+
+/* -- Parser -- */
+
+/**
+ * @internal
+ * Parser state.
+ */
+typedef struct {
+    ib_mpool_t         *mp;               /**< Memory pool for nodes */
+    const char         *patt;             /**< Pattern */
+    const char         *p;                /**< Current position */
+    int                 nocase;           /**< Case insensitive */
+    int                 dotall;           /**< Dot matches newlines */
+    int                 analyze;          /**< Parsing only for analysis */
+    int                 depth;            /**< Group nesting */
+    const char         *err;              /**< Error message */
+} ib_re_parser_t;
+
+static ib_re_node_t *ib_re_parse_alt(ib_re_parser_t *ps);
+
+/**
+ * @internal
+ * Create a syntax tree node.
+ */
+static ib_re_node_t *ib_re_node(ib_re_parser_t *ps,
+                                int type,
+                                ib_re_node_t *left,
+                                ib_re_node_t *right)
+{
+    ib_re_node_t *n;
+
+    n = (ib_re_node_t *)ib_mpool_calloc(ps->mp, 1, sizeof(*n));
+    if (n == NULL) {
+        ps->err = "out of memory";
+        return NULL;
+    }
+    n->type = type;
+    n->left = left;
+    n->right = right;
+    n->off = (left != NULL) ? left->off : (size_t)(ps->p - ps->patt);
+
+    return n;
+}
+
+/**
+ * @internal
+ * Set a parse error, returning NULL.
+ */
+static ib_re_node_t *ib_re_error(ib_re_parser_t *ps, const char *err)
+{
+    ps->err = err;
+    return NULL;
+}
+
+/**
+ * @internal
+ * Add both cases of the letters in a set.
+ */
+static void ib_re_fold(uint32_t *set)
+{
+    int c;
+
+    for (c = 'a'; c <= 'z'; c++) {
+        int u = c - ('a' - 'A');
+
+        if (IB_RE_SET_HAS(set, c) || IB_RE_SET_HAS(set, u)) {
+            IB_RE_SET_ADD(set, c);
+            IB_RE_SET_ADD(set, u);
+        }
+    }
+}
+
+/**
+ * @internal
+ * Add a byte range to a set.
+ */
+static void ib_re_set_range(uint32_t *set, int lo, int hi)
+{
+    int c;
+
+    for (c = lo; c <= hi; c++) {
+        IB_RE_SET_ADD(set, c);
+    }
+}
+
+/**
+ * @internal
+ * Invert a set.
+ */
+static void ib_re_set_invert(uint32_t *set)
+{
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        set[i] = ~set[i];
+    }
+}
+
+/**
+ * @internal
+ * Add the bytes of a class escape (\\d, \\w, ...) to a set.
+ *
+ * @param e Escape character
+ * @param set Set
+ *
+ * @returns Non-zero if a class escape
+ */
+static int ib_re_class_escape(int e, uint32_t *set)
+{
+    uint32_t cs[8];
+    int i;
+
+    memset(cs, 0, sizeof(cs));
+
+    switch (e) {
+        case 'd': case 'D':
+            ib_re_set_range(cs, '0', '9');
+            break;
+        case 'w': case 'W':
+            ib_re_set_range(cs, '0', '9');
+            ib_re_set_range(cs, 'A', 'Z');
+            ib_re_set_range(cs, 'a', 'z');
+            IB_RE_SET_ADD(cs, '_');
+            break;
+        case 's': case 'S':
+            ib_re_set_range(cs, '\t', '\r');
+            IB_RE_SET_ADD(cs, ' ');
+            break;
+        case 'h': case 'H':
+            IB_RE_SET_ADD(cs, '\t');
+            IB_RE_SET_ADD(cs, ' ');
+            IB_RE_SET_ADD(cs, 0xa0);
+            break;
+        case 'v': case 'V':
+            ib_re_set_range(cs, '\n', '\r');
+            IB_RE_SET_ADD(cs, 0x85);
+            break;
+        default:
+            return 0;
+    }
+
+    /* Upper case escapes are the negated classes. */
+    if ((e >= 'A') && (e <= 'Z')) {
+        ib_re_set_invert(cs);
+    }
+    for (i = 0; i < 8; i++) {
+        set[i] |= cs[i];
+    }
+
+    return 1;
+}
+
+/**
+ * @internal
+ * Parse a character escape (after the backslash).
+ *
+ * @param ps Parser
+ *
+ * @returns Byte value, or -1 on error
+ */
+static int ib_re_char_escape(ib_re_parser_t *ps)
+{
+    int e = (unsigned char)*ps->p;
+    int c = 0;
+    int n;
+
+    if (e == '\0') {
+        ps->err = "\\ at end of pattern";
+        return -1;
+    }
+    ps->p++;
+
+    switch (e) {
+        case 't': return '\t';
+        case 'n': return '\n';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'e': return 0x1b;
+        case 'a': return 0x07;
+        case '0':
+            /* Up to two more octal digits. */
+            for (n = 0; (n < 2) && (*ps->p >= '0') && (*ps->p <= '7'); n++) {
+                c = (c * 8) + (*ps->p++ - '0');
+            }
+            return c;
+        case 'x':
+            if (*ps->p == '{') {
+                ps->p++;
+                for (n = 0; isxdigit((unsigned char)*ps->p); n++) {
+                    c = (c * 16) + (isdigit((unsigned char)*ps->p)
+                                    ? (*ps->p - '0')
+                                    : (tolower((unsigned char)*ps->p) - 'a' + 10));
+                    ps->p++;
+                    if (c > 0xff) {
+                        ps->err = "character value in \\x{} is too large";
+                        return -1;
+                    }
+                }
+                if ((n == 0) || (*ps->p != '}')) {
+                    ps->err = "malformed \\x{} escape";
+                    return -1;
+                }
+                ps->p++;
+                return c;
+            }
+            for (n = 0; (n < 2) && isxdigit((unsigned char)*ps->p); n++) {
+                c = (c * 16) + (isdigit((unsigned char)*ps->p)
+                                ? (*ps->p - '0')
+                                : (tolower((unsigned char)*ps->p) - 'a' + 10));
+                ps->p++;
+            }
+            return c;
+        default:
+            break;
+    }
+
+    if ((e >= '1') && (e <= '9')) {
+        ps->err = "back references are not supported";
+        return -1;
+    }
+    if (isalnum(e)) {
+        ps->err = "unsupported escape sequence";
+        return -1;
+    }
+
+    return e;
+}
+
+/**
+ * @internal
+ * Parse a POSIX class name ([:alpha:]) in a character class.
+ *
+ * @param ps Parser (at the '[')
+ * @param set Set
+ *
+ * @returns Non-zero on success
+ */
+static int ib_re_parse_posix(ib_re_parser_t *ps, uint32_t *set)
+{
+    static const char *names[] = {
+        "alpha", "digit", "alnum", "space", "upper", "lower",
+        "punct", "xdigit", "word", "blank", "cntrl", "print", "graph",
+        NULL
+    };
+    uint32_t cs[8];
+    const char *p = ps->p + 2;
+    const char *end;
+    int neg = 0;
+    int i;
+    int c;
+
+    if (*p == '^') {
+        neg = 1;
+        p++;
+    }
+    end = strstr(p, ":]");
+    if (end == NULL) {
+        ps->err = "missing terminating ] for character class";
+        return 0;
+    }
+
+    for (i = 0; names[i] != NULL; i++) {
+        if ((strlen(names[i]) == (size_t)(end - p))
+            && (strncmp(names[i], p, end - p) == 0))
+        {
+            break;
+        }
+    }
+    if (names[i] == NULL) {
+        ps->err = "unknown POSIX class name";
+        return 0;
+    }
+
+    memset(cs, 0, sizeof(cs));
+    for (c = 0; c < 128; c++) {
+        int in;
+
+        switch (i) {
+            case 0:  in = isalpha(c); break;
+            case 1:  in = isdigit(c); break;
+            case 2:  in = isalnum(c); break;
+            case 3:  in = isspace(c); break;
+            case 4:  in = isupper(c); break;
+            case 5:  in = islower(c); break;
+            case 6:  in = ispunct(c); break;
+            case 7:  in = isxdigit(c); break;
+            case 8:  in = isalnum(c) || (c == '_'); break;
+            case 9:  in = (c == ' ') || (c == '\t'); break;
+            case 10: in = iscntrl(c); break;
+            case 11: in = isprint(c); break;
+            default: in = isgraph(c); break;
+        }
+        if (in) {
+            IB_RE_SET_ADD(cs, c);
+        }
+    }
+    if (neg) {
+        ib_re_set_invert(cs);
+    }
+    for (i = 0; i < 8; i++) {
+        set[i] |= cs[i];
+    }
+
+    ps->p = end + 2;
+
+    return 1;
+}
+
+/**
+ * @internal
+ * Parse a character class ([...]).
+ */
+static ib_re_node_t *ib_re_parse_class(ib_re_parser_t *ps)
+{
+    ib_re_node_t *n = ib_re_node(ps, IB_RE_N_BYTES, NULL, NULL);
+    int first = 1;
+    int neg = 0;
+
+    if (n == NULL) {
+        return NULL;
+    }
+
+    ps->p++;
+    if (*ps->p == '^') {
+        neg = 1;
+        ps->p++;
+    }
+
+    for (;;) {
+        int lo;
+        int hi;
+
+        if (*ps->p == '\0') {
+            return ib_re_error(ps, "missing terminating ] for character class");
+        }
+        if ((*ps->p == ']') && !first) {
+            ps->p++;
+            break;
+        }
+        first = 0;
+
+        if ((ps->p[0] == '[') && (ps->p[1] == ':')) {
+            if (!ib_re_parse_posix(ps, n->set)) {
+                return NULL;
+            }
+            continue;
+        }
+
+        /* Start of a range (or single byte). */
+        if (*ps->p == '\\') {
+            ps->p++;
+            if (ib_re_class_escape((unsigned char)*ps->p, n->set)) {
+                ps->p++;
+                continue;
+            }
+            if (*ps->p == 'b') {
+                ps->p++;
+                lo = '\b';
+            }
+            else if ((lo = ib_re_char_escape(ps)) < 0) {
+                return NULL;
+            }
+        }
+        else {
+            lo = (unsigned char)*ps->p++;
+        }
+
+        /* A '-' before the end or a class is a literal. */
+        if ((ps->p[0] != '-') || (ps->p[1] == ']') || (ps->p[1] == '\0')
+            || ((ps->p[1] == '[') && (ps->p[2] == ':')))
+        {
+            IB_RE_SET_ADD(n->set, lo);
+            continue;
+        }
+        ps->p++;
+
+        if (*ps->p == '\\') {
+            ps->p++;
+            if (ib_re_class_escape((unsigned char)*ps->p, n->set)) {
+                /* As in PCRE, [a-\d] is a, - or a digit. */
+                ps->p++;
+                IB_RE_SET_ADD(n->set, lo);
+                IB_RE_SET_ADD(n->set, '-');
+                continue;
+            }
+            if (*ps->p == 'b') {
+                ps->p++;
+                hi = '\b';
+            }
+            else if ((hi = ib_re_char_escape(ps)) < 0) {
+                return NULL;
+            }
+        }
+        else {
+            hi = (unsigned char)*ps->p++;
+        }
+
+        if (hi < lo) {
+            return ib_re_error(ps, "range out of order in character class");
+        }
+        ib_re_set_range(n->set, lo, hi);
+    }
+
+    if (ps->nocase) {
+        ib_re_fold(n->set);
+    }
+    if (neg) {
+        ib_re_set_invert(n->set);
+    }
+
+    return n;
+}
+
+/**
+ * @internal
+ * Parse a group ((...), (?:...) or inline options).
+ */
+static ib_re_node_t *ib_re_parse_group(ib_re_parser_t *ps)
+{
+    int nocase = ps->nocase;
+    int saved = ps->nocase;
+    int dotall = ps->dotall;
+    int saved_dotall = ps->dotall;
+    int assertion = 0;
+    int atomic = 0;
+    size_t start = (size_t)(ps->p - ps->patt);
+    ib_re_node_t *n;
+
+    if (++ps->depth > IB_RE_MAX_DEPTH) {
+        return ib_re_error(ps, "parentheses are too deeply nested");
+    }
+
+    ps->p++;
+    if (*ps->p == '?') {
+        ps->p++;
+        switch (*ps->p) {
+            case ':':
+                ps->p++;
+                break;
+            case '=':
+            case '!':
+                if (!ps->analyze) {
+                    return ib_re_error(ps,
+                                       "lookahead assertions are not supported");
+                }
+                ps->p++;
+                assertion = 1;
+                break;
+            case '>':
+                if (!ps->analyze) {
+                    return ib_re_error(ps, "atomic groups are not supported");
+                }
+                ps->p++;
+                atomic = 1;
+                break;
+            case '#':
+                /* Comment. */
+                while ((*ps->p != '\0') && (*ps->p != ')')) {
+                    ps->p++;
+                }
+                if (*ps->p != ')') {
+                    return ib_re_error(ps, "missing ) after comment");
+                }
+                ps->p++;
+                ps->depth--;
+                return ib_re_node(ps, IB_RE_N_EMPTY, NULL, NULL);
+            case '<':
+            case 'P':
+            case '\'':
+                /* Named groups are plain groups (names are not used). */
+                if ((ps->p[0] == '<')
+                    && ((ps->p[1] == '=') || (ps->p[1] == '!')))
+                {
+                    if (!ps->analyze) {
+                        return ib_re_error(ps,
+                                           "lookbehind assertions are not supported");
+                    }
+                    ps->p += 2;
+                    assertion = 1;
+                    break;
+                }
+                if ((ps->p[0] == 'P') && (ps->p[1] != '<')) {
+                    return ib_re_error(ps, "unsupported group");
+                }
+                ps->p += (*ps->p == 'P') ? 2 : 1;
+                while (isalnum((unsigned char)*ps->p) || (*ps->p == '_')) {
+                    ps->p++;
+                }
+                if ((*ps->p != '>') && (*ps->p != '\'')) {
+                    return ib_re_error(ps, "malformed group name");
+                }
+                ps->p++;
+                break;
+            default:
+            {
+                int on = 1;
+
+                /* Options: (?i), (?-i), (?i:...); s is always on when
+                 * matching.
+                 */
+                for (;; ps->p++) {
+                    if (*ps->p == '-') {
+                        on = 0;
+                    }
+                    else if (*ps->p == 'i') {
+                        nocase = on;
+                    }
+                    else if (*ps->p == 's') {
+                        dotall = ps->analyze ? on : 1;
+                    }
+                    else {
+                        break;
+                    }
+                }
+                if (*ps->p == ')') {
+                    /* Applies to the rest of the enclosing group. */
+                    ps->p++;
+                    ps->nocase = nocase;
+                    ps->dotall = dotall;
+                    ps->depth--;
+                    return ib_re_node(ps, IB_RE_N_EMPTY, NULL, NULL);
+                }
+                if (*ps->p != ':') {
+                    return ib_re_error(ps, "unsupported option or group");
+                }
+                ps->p++;
+                break;
+            }
+        }
+    }
+
+    ps->nocase = nocase;
+    ps->dotall = dotall;
+    n = ib_re_parse_alt(ps);
+    if (n == NULL) {
+        return NULL;
+    }
+    if (*ps->p != ')') {
+        return ib_re_error(ps, "missing )");
+    }
+    ps->p++;
+    ps->nocase = saved;
+    ps->dotall = saved_dotall;
+    ps->depth--;
+
+    /* When analyzing, assertions match no text and atomic groups are
+     * not backtracked into.
+     */
+    if (assertion) {
+        return ib_re_node(ps, IB_RE_N_EMPTY, NULL, NULL);
+    }
+    else if (atomic) {
+        n = ib_re_node(ps, IB_RE_N_ATOMIC, n, NULL);
+        if (n == NULL) {
+            return NULL;
+        }
+    }
+    n->off = start;
+
+    return n;
+}
+
+/**
+ * @internal
+ * Parse a counted repeat ({n}, {n,} or {n,m}).
+ *
+ * @param ps Parser (at the '{')
+ * @param pmin Address which the minimum is written
+ * @param pmax Address which the maximum is written (-1 if none)
+ *
+ * @returns Non-zero if a valid repeat (and the parser is moved past
+ *          it), else it is a literal '{'
+ */
+static int ib_re_parse_count(ib_re_parser_t *ps, int *pmin, int *pmax)
+{
+    const char *p = ps->p + 1;
+    long min = 0;
+    long max;
+
+    if (!isdigit((unsigned char)*p)) {
+        return 0;
+    }
+    while (isdigit((unsigned char)*p)) {
+        min = (min * 10) + (*p++ - '0');
+        if (min > IB_RE_MAX_REPEAT) {
+            min = IB_RE_MAX_REPEAT + 1;
+        }
+    }
+
+    if (*p == '}') {
+        max = min;
+    }
+    else if (*p != ',') {
+        return 0;
+    }
+    else if (*++p == '}') {
+        max = -1;
+    }
+    else {
+        if (!isdigit((unsigned char)*p)) {
+            return 0;
+        }
+        max = 0;
+        while (isdigit((unsigned char)*p)) {
+            max = (max * 10) + (*p++ - '0');
+            if (max > IB_RE_MAX_REPEAT) {
+                max = IB_RE_MAX_REPEAT + 1;
+            }
+        }
+        if (*p != '}') {
+            return 0;
+        }
+    }
+
+    ps->p = p + 1;
+    *pmin = (int)min;
+    *pmax = (int)max;
+
+    return 1;
+}
+
+/**
+ * @internal
+ * Parse an atom (a single byte, class, group or assertion).
+ */
+static ib_re_node_t *ib_re_parse_atom(ib_re_parser_t *ps)
+{
+    ib_re_node_t *n;
+    int min;
+    int max;
+    int c;
+
+    switch (*ps->p) {
+        case '(':
+            return ib_re_parse_group(ps);
+        case '[':
+            return ib_re_parse_class(ps);
+        case '.':
+            /* Matches newlines (PCRE_DOTALL) unless turned off by (?-s)
+             * when analyzing.
+             */
+            n = ib_re_node(ps, IB_RE_N_BYTES, NULL, NULL);
+            if (n != NULL) {
+                memset(n->set, 0xff, sizeof(n->set));
+                if (!ps->dotall) {
+                    n->set['\n' >> 5] &= ~(1U << ('\n' & 31));
+                }
+                ps->p++;
+            }
+            return n;
+        case '^':
+            n = ib_re_node(ps, IB_RE_N_BOL, NULL, NULL);
+            ps->p++;
+            return n;
+        case '$':
+            /* Only matches at the very end (PCRE_DOLLAR_ENDONLY). */
+            n = ib_re_node(ps, IB_RE_N_EOL, NULL, NULL);
+            ps->p++;
+            return n;
+        case '*':
+        case '+':
+        case '?':
+            return ib_re_error(ps, "nothing to repeat");
+        case '{':
+            if (ib_re_parse_count(ps, &min, &max)) {
+                return ib_re_error(ps, "nothing to repeat");
+            }
+            break;
+        case '\\':
+            ps->p++;
+            switch (*ps->p) {
+                case 'A':
+                    ps->p++;
+                    return ib_re_node(ps, IB_RE_N_BOL, NULL, NULL);
+                case 'z':
+                    ps->p++;
+                    return ib_re_node(ps, IB_RE_N_EOL, NULL, NULL);
+                case 'b':
+                case 'B':
+                    if (!ps->analyze) {
+                        return ib_re_error(ps,
+                                           "word boundaries are not supported");
+                    }
+                    ps->p++;
+                    return ib_re_node(ps, IB_RE_N_EMPTY, NULL, NULL);
+                case '1': case '2': case '3': case '4': case '5':
+                case '6': case '7': case '8': case '9':
+                    if (!ps->analyze) {
+                        break;
+                    }
+                    /* A back reference, which matches unknown text. */
+                    n = ib_re_node(ps, IB_RE_N_BACKREF, NULL, NULL);
+                    while (isdigit((unsigned char)*ps->p)) {
+                        ps->p++;
+                    }
+                    return n;
+                case 'N':
+                    n = ib_re_node(ps, IB_RE_N_BYTES, NULL, NULL);
+                    if (n != NULL) {
+                        memset(n->set, 0xff, sizeof(n->set));
+                        n->set['\n' >> 5] &= ~(1U << ('\n' & 31));
+                        ps->p++;
+                    }
+                    return n;
+                default:
+                    break;
+            }
+            n = ib_re_node(ps, IB_RE_N_BYTES, NULL, NULL);
+            if (n == NULL) {
+                return NULL;
+            }
+            if (ib_re_class_escape((unsigned char)*ps->p, n->set)) {
+                ps->p++;
+                return n;
+            }
+            if ((c = ib_re_char_escape(ps)) < 0) {
+                return NULL;
+            }
+            IB_RE_SET_ADD(n->set, c);
+            if (ps->nocase) {
+                ib_re_fold(n->set);
+            }
+            return n;
+        default:
+            break;
+    }
+
+    /* Literal byte. */
+    n = ib_re_node(ps, IB_RE_N_BYTES, NULL, NULL);
+    if (n == NULL) {
+        return NULL;
+    }
+    c = (unsigned char)*ps->p++;
+    IB_RE_SET_ADD(n->set, c);
+    if (ps->nocase) {
+        ib_re_fold(n->set);
+    }
+
+    return n;
+}
+
+/**
+ * @internal
+ * Parse an atom with any quantifier.
+ */
+static ib_re_node_t *ib_re_parse_repeat(ib_re_parser_t *ps)
+{
+    ib_re_node_t *atom;
+    ib_re_node_t *n;
+    int possessive = 0;
+    int min;
+    int max;
+
+    atom = ib_re_parse_atom(ps);
+    if (atom == NULL) {
+        return NULL;
+    }
+
+    switch (*ps->p) {
+        case '*':
+            min = 0;
+            max = -1;
+            ps->p++;
+            break;
+        case '+':
+            min = 1;
+            max = -1;
+            ps->p++;
+            break;
+        case '?':
+            min = 0;
+            max = 1;
+            ps->p++;
+            break;
+        case '{':
+            if (!ib_re_parse_count(ps, &min, &max)) {
+                return atom;
+            }
+            if ((min > IB_RE_MAX_REPEAT) || (max > IB_RE_MAX_REPEAT)) {
+                return ib_re_error(ps, "number too big in {} quantifier");
+            }
+            if ((max >= 0) && (max < min)) {
+                return ib_re_error(ps, "numbers out of order in {} quantifier");
+            }
+            break;
+        default:
+            return atom;
+    }
+
+    /* Lazy quantifiers match the same strings. */
+    if (*ps->p == '?') {
+        ps->p++;
+    }
+    else if (*ps->p == '+') {
+        if (!ps->analyze) {
+            return ib_re_error(ps, "possessive quantifiers are not supported");
+        }
+        possessive = 1;
+        ps->p++;
+    }
+    if ((*ps->p == '*') || (*ps->p == '+') || (*ps->p == '?')) {
+        return ib_re_error(ps, "nothing to repeat");
+    }
+
+    n = ib_re_node(ps, IB_RE_N_REPEAT, atom, NULL);
+    if (n == NULL) {
+        return NULL;
+    }
+    n->min = min;
+    n->max = max;
+    n->off = atom->off;
+
+    /* Possessive quantifiers are never backtracked into. */
+    if (possessive) {
+        n = ib_re_node(ps, IB_RE_N_ATOMIC, n, NULL);
+    }
+
+    return n;
+}
+
+/**
+ * @internal
+ * Parse a concatenation.
+ */
+static ib_re_node_t *ib_re_parse_cat(ib_re_parser_t *ps)
+{
+    ib_re_node_t *n = NULL;
+
+    while ((*ps->p != '\0') && (*ps->p != '|') && (*ps->p != ')')) {
+        ib_re_node_t *r = ib_re_parse_repeat(ps);
+
+        if (r == NULL) {
+            return NULL;
+        }
+        n = (n == NULL) ? r : ib_re_node(ps, IB_RE_N_CAT, n, r);
+        if (n == NULL) {
+            return NULL;
+        }
+    }
+
+    return (n != NULL) ? n : ib_re_node(ps, IB_RE_N_EMPTY, NULL, NULL);
+}
+
+/**
+ * @internal
+ * Parse an alternation.
+ */
+static ib_re_node_t *ib_re_parse_alt(ib_re_parser_t *ps)
+{
+    ib_re_node_t *n = ib_re_parse_cat(ps);
+
+    while ((n != NULL) && (*ps->p == '|')) {
+        ib_re_node_t *r;
+
+        ps->p++;
+        r = ib_re_parse_cat(ps);
+        if (r == NULL) {
+            return NULL;
+        }
+        n = ib_re_node(ps, IB_RE_N_ALT, n, r);
+    }
+
+    return n;
+}
+
+/**
+ * @internal
+ * Parse a pattern.
+ *
+ * @param mp Memory pool for the syntax tree
+ * @param patt Pattern
+ * @param flags Flags (IB_RE_F*)
+ * @param analyze Parse backtracking constructs for analysis only
+ * @param proot Address which the syntax tree is written
+ * @param errptr Address which an error message is written (or NULL)
+ * @param erroffset Address which the error offset is written (or NULL)
+ *
+ * @returns Status code
+ */
+static ib_status_t ib_re_parse(ib_mpool_t *mp,
+                               const char *patt,
+                               ib_flags_t flags,
+                               int analyze,
+                               ib_re_node_t **proot,
+                               const char **errptr,
+                               int *erroffset)
+{
+    ib_re_parser_t ps;
+    ib_re_node_t *root;
+
+    memset(&ps, 0, sizeof(ps));
+    ps.mp = mp;
+    ps.patt = patt;
+    ps.p = patt;
+    ps.nocase = (flags & IB_RE_FNOCASE) ? 1 : 0;
+    ps.dotall = 1;
+    ps.analyze = analyze;
+
+    root = ib_re_parse_alt(&ps);
+    if ((root != NULL) && (*ps.p != '\0')) {
+        root = ib_re_error(&ps, "unmatched )");
+    }
+    if (root == NULL) {
+        if (errptr != NULL) {
+            *errptr = ps.err;
+        }
+        if (erroffset != NULL) {
+            *erroffset = (int)(ps.p - patt);
+        }
+        return IB_EINVAL;
+    }
+
+    *proot = root;
+
+    return IB_OK;
+}
+
+
+/* -- Analysis -- */
+
+/**
+ * @internal
+ * Risky construct found by analysis.
+ */
+typedef struct {
+    const char         *reason;           /**< Description */
+    size_t              off;              /**< Pattern offset */
+} ib_re_risk_t;
+
+/**
+ * @internal
+ * Whether a node can match the empty string.
+ */
+static int ib_re_nullable(const ib_re_node_t *n)
+{
+    switch (n->type) {
+        case IB_RE_N_BYTES:
+            return 0;
+        case IB_RE_N_CAT:
+            return ib_re_nullable(n->left) && ib_re_nullable(n->right);
+        case IB_RE_N_ALT:
+            return ib_re_nullable(n->left) || ib_re_nullable(n->right);
+        case IB_RE_N_REPEAT:
+            return (n->min == 0) || ib_re_nullable(n->left);
+        case IB_RE_N_ATOMIC:
+            return ib_re_nullable(n->left);
+        default:
+            return 1;
+    }
+}
+
+/**
+ * @internal
+ * Add the bytes which can start (or end) a match of a node to a set.
+ *
+ * @param n Node
+ * @param last Use the bytes which can end a match
+ * @param set Set
+ */
+static void ib_re_edge(const ib_re_node_t *n, int last, uint32_t *set)
+{
+    const ib_re_node_t *a;
+    const ib_re_node_t *b;
+    int i;
+
+    switch (n->type) {
+        case IB_RE_N_BYTES:
+            for (i = 0; i < 8; i++) {
+                set[i] |= n->set[i];
+            }
+            break;
+        case IB_RE_N_CAT:
+            a = last ? n->right : n->left;
+            b = last ? n->left : n->right;
+            ib_re_edge(a, last, set);
+            if (ib_re_nullable(a)) {
+                ib_re_edge(b, last, set);
+            }
+            break;
+        case IB_RE_N_ALT:
+            ib_re_edge(n->left, last, set);
+            ib_re_edge(n->right, last, set);
+            break;
+        case IB_RE_N_REPEAT:
+            if (n->max != 0) {
+                ib_re_edge(n->left, last, set);
+            }
+            break;
+        case IB_RE_N_ATOMIC:
+            ib_re_edge(n->left, last, set);
+            break;
+        default:
+            break;
+    }
+}
+
+/**
+ * @internal
+ * Whether a node can match a string using only node x, with all else
+ * matching the empty string.
+ */
+static int ib_re_only(const ib_re_node_t *n, const ib_re_node_t *x)
+{
+    if (n == x) {
+        return 1;
+    }
+
+    switch (n->type) {
+        case IB_RE_N_CAT:
+            return (ib_re_only(n->left, x) && ib_re_nullable(n->right))
+                || (ib_re_nullable(n->left) && ib_re_only(n->right, x));
+        case IB_RE_N_ALT:
+            return ib_re_only(n->left, x) || ib_re_only(n->right, x);
+        case IB_RE_N_REPEAT:
+            return (n->max != 0) && ib_re_only(n->left, x);
+        default:
+            return 0;
+    }
+}
+
+/**
+ * @internal
+ * Look for a quantifier in a repeated body which can match a whole
+ * iteration by itself.
+ *
+ * Such a body matches the same text as one iteration or as several,
+ * as with (a+)+ or (\w+\s?)*, so the ways to match grow exponentially.
+ *
+ * @param body Body of the outer repeat
+ * @param n Node within the body
+ * @param risk Risk found
+ *
+ * @returns Non-zero if found
+ */
+static int ib_re_nested(const ib_re_node_t *body,
+                        const ib_re_node_t *n,
+                        ib_re_risk_t *risk)
+{
+    if (n->type == IB_RE_N_ATOMIC) {
+        return 0;
+    }
+    if (n->type == IB_RE_N_REPEAT) {
+        uint32_t first[8];
+
+        memset(first, 0, sizeof(first));
+        ib_re_edge(n->left, 0, first);
+
+        /* Matches runs of differing length of something non-empty. */
+        if (((n->max < 0) || (n->max > 1)) && (n->max != n->min)
+            && (memcmp(first, ib_re_none, sizeof(first)) != 0)
+            && ib_re_only(body, n))
+        {
+            risk->reason = "nested quantifiers";
+            return 1;
+        }
+    }
+
+    return ((n->left != NULL) && ib_re_nested(body, n->left, risk))
+        || ((n->right != NULL) && ib_re_nested(body, n->right, risk));
+}
+
+/**
+ * @internal
+ * Whether any branch of one alternation can match the same text as
+ * any branch of another.
+ *
+ * Branches overlap if both the bytes which start them and those which
+ * end them intersect, so (\w|\d) overlaps but (foo|fob) does not.
+ */
+static int ib_re_alt_overlap(const ib_re_node_t *a, const ib_re_node_t *b)
+{
+    uint32_t fa[8];
+    uint32_t fb[8];
+    int first;
+    int i;
+
+    if (a->type == IB_RE_N_ALT) {
+        return ib_re_alt_overlap(a->left, b) || ib_re_alt_overlap(a->right, b);
+    }
+    if (b->type == IB_RE_N_ALT) {
+        return ib_re_alt_overlap(a, b->left) || ib_re_alt_overlap(a, b->right);
+    }
+
+    for (first = 0; first < 2; first++) {
+        int overlap = 0;
+
+        memset(fa, 0, sizeof(fa));
+        memset(fb, 0, sizeof(fb));
+        ib_re_edge(a, !first, fa);
+        ib_re_edge(b, !first, fb);
+        for (i = 0; i < 8; i++) {
+            overlap |= ((fa[i] & fb[i]) != 0);
+        }
+        if (!overlap) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/**
+ * @internal
+ * Analyze a syntax tree for constructs which backtrack exponentially.
+ *
+ * @param n Node
+ * @param inloop Node is within a repeated group
+ * @param risk Risk found
+ *
+ * @returns Non-zero if found
+ */
+static int ib_re_risky(const ib_re_node_t *n,
+                       int inloop,
+                       ib_re_risk_t *risk)
+{
+    if ((n->type == IB_RE_N_REPEAT) && ((n->max < 0) || (n->max > 1))) {
+        if (ib_re_nested(n->left, n->left, risk)) {
+            /* Report the outer repeat. */
+            risk->off = n->off;
+            return 1;
+        }
+        inloop = 1;
+    }
+    else if ((n->type == IB_RE_N_ALT) && inloop
+             && ib_re_alt_overlap(n->left, n->right))
+    {
+        risk->reason = "overlapping alternation in a repeated group";
+        risk->off = n->off;
+        return 1;
+    }
+
+    return ((n->left != NULL) && ib_re_risky(n->left, inloop, risk))
+        || ((n->right != NULL) && ib_re_risky(n->right, inloop, risk));
+}
+
+
+/* -- Required Literals -- */
+
+/**
+ * @internal
+ * A literal string (case folded to lower).
+ */
+typedef struct {
+    const uint8_t      *s;                /**< Bytes (NULL if unknown) */
+    size_t              len;              /**< Length */
+} ib_re_str_t;
+
+/**
+ * @internal
+ * Literals of the text matched by a node.
+ *
+ * If exact is known, every match is exactly that text, and then
+ * prefix, suffix and req are the same.
+ */
+typedef struct {
+    ib_re_str_t         exact;            /**< All of every match */
+    ib_re_str_t         prefix;           /**< Start of every match */
+    ib_re_str_t         suffix;           /**< End of every match */
+    ib_re_str_t         req;              /**< Within every match */
+} ib_re_lit_t;
+
+/**
+ * @internal
+ * Get the byte a set matches ignoring case.
+ *
+ * @returns Lower case byte, or -1 if the set is not a single byte
+ */
+static int ib_re_lit_byte(const uint32_t *set)
+{
+    uint32_t folded[8];
+    int c = -1;
+    int i;
+
+    for (i = 0; i < 256; i++) {
+        if (IB_RE_SET_HAS(set, i)) {
+            if ((c >= 0) && (c != tolower(i))) {
+                return -1;
+            }
+            c = tolower(i);
+        }
+    }
+    if (c < 0) {
+        return -1;
+    }
+
+    /* Only the byte or both its cases. */
+    memset(folded, 0, sizeof(folded));
+    IB_RE_SET_ADD(folded, c);
+    IB_RE_SET_ADD(folded, toupper(c));
+    for (i = 0; i < 8; i++) {
+        if ((set[i] & ~folded[i]) != 0) {
+            return -1;
+        }
+    }
+
+    return c;
+}
+
+/**
+ * @internal
+ * Concatenate two literals.
+ */
+static ib_re_str_t ib_re_str_cat(ib_mpool_t *mp,
+                                 ib_re_str_t a,
+                                 ib_re_str_t b)
+{
+    ib_re_str_t r;
+    uint8_t *s;
+
+    if (b.len == 0) {
+        return a;
+    }
+    if (a.len == 0) {
+        return b;
+    }
+
+    r.s = NULL;
+    r.len = 0;
+    s = (uint8_t *)ib_mpool_alloc(mp, a.len + b.len);
+    if (s != NULL) {
+        memcpy(s, a.s, a.len);
+        memcpy(s + a.len, b.s, b.len);
+        r.s = s;
+        r.len = a.len + b.len;
+    }
+
+    return r;
+}
+
+/**
+ * @internal
+ * Set the literals of a node which matches exactly one string.
+ */
+static void ib_re_lit_exact(ib_re_lit_t *li, ib_re_str_t exact)
+{
+    li->exact = exact;
+    li->prefix = exact;
+    li->suffix = exact;
+    li->req = exact;
+}
+
+/**
+ * @internal
+ * Find the literals of the text matched by a node.
+ *
+ * @param mp Memory pool for the literals
+ * @param n Node
+ * @param li Literals
+ */
+static void ib_re_lit(ib_mpool_t *mp,
+                      const ib_re_node_t *n,
+                      ib_re_lit_t *li)
+{
+    static const uint8_t none[1] = { 0 };
+    ib_re_lit_t l;
+    ib_re_lit_t r;
+    ib_re_str_t cross;
+    uint8_t *s;
+    int c;
+
+    memset(li, 0, sizeof(*li));
+    li->prefix.s = none;
+    li->suffix.s = none;
+    li->req.s = none;
+
+    switch (n->type) {
+        case IB_RE_N_EMPTY:
+        case IB_RE_N_BOL:
+        case IB_RE_N_EOL:
+            ib_re_lit_exact(li, li->req);
+            break;
+        case IB_RE_N_BYTES:
+            c = ib_re_lit_byte(n->set);
+            if (c < 0) {
+                break;
+            }
+            s = (uint8_t *)ib_mpool_alloc(mp, 1);
+            if (s != NULL) {
+                ib_re_str_t exact;
+
+                *s = (uint8_t)c;
+                exact.s = s;
+                exact.len = 1;
+                ib_re_lit_exact(li, exact);
+            }
+            break;
+        case IB_RE_N_CAT:
+            ib_re_lit(mp, n->left, &l);
+            ib_re_lit(mp, n->right, &r);
+            if ((l.exact.s != NULL) && (r.exact.s != NULL)) {
+                ib_re_lit_exact(li, ib_re_str_cat(mp, l.exact, r.exact));
+                break;
+            }
+            li->prefix = (l.exact.s != NULL)
+                ? ib_re_str_cat(mp, l.exact, r.prefix) : l.prefix;
+            li->suffix = (r.exact.s != NULL)
+                ? ib_re_str_cat(mp, l.suffix, r.exact) : r.suffix;
+
+            /* The longest required literal wins. */
+            cross = ib_re_str_cat(mp, l.suffix, r.prefix);
+            li->req = l.req;
+            if (r.req.len > li->req.len) {
+                li->req = r.req;
+            }
+            if (cross.len > li->req.len) {
+                li->req = cross;
+            }
+            if (li->prefix.len > li->req.len) {
+                li->req = li->prefix;
+            }
+            if (li->suffix.len > li->req.len) {
+                li->req = li->suffix;
+            }
+            break;
+        case IB_RE_N_ALT:
+            ib_re_lit(mp, n->left, &l);
+            ib_re_lit(mp, n->right, &r);
+            if ((l.exact.s != NULL) && (r.exact.s != NULL)
+                && (l.exact.len == r.exact.len)
+                && (memcmp(l.exact.s, r.exact.s, l.exact.len) == 0))
+            {
+                *li = l;
+            }
+            break;
+        case IB_RE_N_REPEAT:
+            if (n->min == 0) {
+                break;
+            }
+            ib_re_lit(mp, n->left, &l);
+            if (n->max == 1) {
+                *li = l;
+                break;
+            }
+            li->prefix = l.prefix;
+            li->suffix = l.suffix;
+            li->req = l.req;
+            break;
+        case IB_RE_N_ATOMIC:
+            ib_re_lit(mp, n->left, li);
+            break;
+        default:
+            break;
+    }
+}
+
+
+/* -- Compiler -- */
+
+/**
+ * @internal
+ * Multiply sizes, saturating past the instruction limit.
+ */
+static size_t ib_re_size_mul(size_t a, size_t b)
+{
+    if ((a != 0) && (b > (IB_RE_MAX_INSTS + 1) / a)) {
+        return IB_RE_MAX_INSTS + 1;
+    }
+    return a * b;
+}
+
+/**
+ * @internal
+ * Count the instructions needed for a syntax tree.
+ *
+ * @returns Number of instructions (more than IB_RE_MAX_INSTS if too
+ *          many)
+ */
+static size_t ib_re_size(const ib_re_node_t *n)
+{
+    size_t l;
+    size_t r;
+
+    switch (n->type) {
+        case IB_RE_N_EMPTY:
+            return 0;
+        case IB_RE_N_CAT:
+        case IB_RE_N_ALT:
+            l = ib_re_size(n->left);
+            r = ib_re_size(n->right);
+            if (l + r > IB_RE_MAX_INSTS) {
+                return IB_RE_MAX_INSTS + 1;
+            }
+            return l + r + ((n->type == IB_RE_N_ALT) ? 1 : 0);
+        case IB_RE_N_REPEAT:
+            l = ib_re_size(n->left);
+            if (n->max < 0) {
+                r = ib_re_size_mul(l, (n->min > 0) ? n->min : 1) + 1;
+            }
+            else {
+                r = ib_re_size_mul(l, n->min)
+                    + ib_re_size_mul(l + 1, n->max - n->min);
+            }
+            return (r > IB_RE_MAX_INSTS) ? IB_RE_MAX_INSTS + 1 : r;
+        default:
+            return 1;
+    }
+}
+
+/**
+ * @internal
+ * Add an instruction to the program.
+ */
+static int32_t ib_re_inst(ib_re_t *re, int op, int32_t out)
+{
+    int32_t i = re->nprog++;
+
+    re->prog[i].op = (uint8_t)op;
+    re->prog[i].out = out;
+    re->prog[i].out1 = -1;
+    re->prog[i].arg = -1;
+
+    return i;
+}
+
+/**
+ * @internal
+ * Compile a syntax tree, with the program continuing at next.
+ *
+ * @returns Start instruction
+ */
+static int32_t ib_re_emit(ib_re_t *re, const ib_re_node_t *n, int32_t next)
+{
+    int32_t cur = next;
+    int32_t s;
+    int k;
+
+    switch (n->type) {
+        case IB_RE_N_EMPTY:
+            return next;
+        case IB_RE_N_BYTES:
+            s = ib_re_inst(re, IB_RE_OP_BYTES, next);
+            memcpy(re->prog[s].set, n->set, sizeof(n->set));
+            return s;
+        case IB_RE_N_BOL:
+            return ib_re_inst(re, IB_RE_OP_BOL, next);
+        case IB_RE_N_EOL:
+            return ib_re_inst(re, IB_RE_OP_EOL, next);
+        case IB_RE_N_CAT:
+            return ib_re_emit(re, n->left, ib_re_emit(re, n->right, next));
+        case IB_RE_N_ALT:
+            s = ib_re_inst(re, IB_RE_OP_SPLIT, -1);
+            re->prog[s].out = ib_re_emit(re, n->left, next);
+            re->prog[s].out1 = ib_re_emit(re, n->right, next);
+            return s;
+        default:
+            break;
+    }
+
+    /* Repeat: x{n,} is n-1 copies then x+, x{n,m} is n copies then
+     * m-n nested optional copies. */
+    if (n->max < 0) {
+        s = ib_re_inst(re, IB_RE_OP_SPLIT, -1);
+        re->prog[s].out1 = next;
+        cur = ib_re_emit(re, n->left, s);
+        re->prog[s].out = cur;
+        if (n->min == 0) {
+            return s;
+        }
+        k = n->min - 1;
+    }
+    else {
+        for (k = n->min; k < n->max; k++) {
+            s = ib_re_inst(re, IB_RE_OP_SPLIT, -1);
+            re->prog[s].out1 = next;
+            re->prog[s].out = ib_re_emit(re, n->left, cur);
+            cur = s;
+        }
+        k = n->min;
+    }
+    while (k-- > 0) {
+        cur = ib_re_emit(re, n->left, cur);
+    }
+
+    return cur;
+}
+
+/**
+ * @internal
+ * Assign byte classes, so that bytes which every BYTES instruction
+ * treats the same have the same class.
+ */
+static void ib_re_classes(ib_re_t *re)
+{
+    int16_t map[512];
+    int32_t i;
+    int c;
+
+    memset(re->cls, 0, sizeof(re->cls));
+    re->ncls = 1;
+
+    for (i = 0; i < re->nprog; i++) {
+        const ib_re_inst_t *inst = &re->prog[i];
+        int ncls = 0;
+
+        if (inst->op != IB_RE_OP_BYTES) {
+            continue;
+        }
+
+        /* Split each class by membership in the set. */
+        memset(map, 0xff, sizeof(map));
+        for (c = 0; c < 256; c++) {
+            int k = (re->cls[c] * 2) + (IB_RE_SET_HAS(inst->set, c) ? 1 : 0);
+
+            if (map[k] < 0) {
+                map[k] = (int16_t)ncls++;
+            }
+            re->cls[c] = (uint8_t)map[k];
+        }
+        re->ncls = ncls;
+    }
+
+    for (c = 255; c >= 0; c--) {
+        re->rep[re->cls[c]] = (uint8_t)c;
+    }
+}
+
+
+/* -- Instruction Sets -- */
+
+/**
+ * @internal
+ * Allocate scratch memory.
+ */
+static ib_status_t ib_re_work_init(ib_re_work_t *w,
+                                   int32_t ninst,
+                                   void *(*alloc)(void *, size_t),
+                                   void *adata)
+{
+    size_t n = (size_t)ninst;
+
+    w->q.dense = (int32_t *)alloc(adata, n * sizeof(int32_t));
+    w->q.sparse = (int32_t *)alloc(adata, n * sizeof(int32_t));
+    w->stack = (int32_t *)alloc(adata, ((2 * n) + 1) * sizeof(int32_t));
+    w->key = (int32_t *)alloc(adata, n * sizeof(int32_t));
+    w->save = (int32_t *)alloc(adata, n * sizeof(int32_t));
+    if ((w->q.dense == NULL) || (w->q.sparse == NULL) || (w->stack == NULL)
+        || (w->key == NULL) || (w->save == NULL))
+    {
+        return IB_EALLOC;
+    }
+    w->q.n = 0;
+
+    return IB_OK;
+}
+
+/** @internal Pool allocator for ib_re_work_init(). */
+static void *ib_re_pool_alloc(void *mp, size_t size)
+{
+    return ib_mpool_calloc((ib_mpool_t *)mp, 1, size);
+}
+
+/**
+ * @internal
+ * Heap allocator for ib_re_work_init().
+ *
+ * @param data Unused
+ * @param size Size to allocate
+ *
+ * @returns Zeroed memory (or NULL on failure)
+ */
+static void *ib_re_heap_alloc(void *data, size_t size)
+{
+    return calloc(1, size);
+}
+
+/**
+ * @internal
+ * Free scratch memory allocated with ib_re_heap_alloc().
+ */
+static void ib_re_work_free(ib_re_work_t *w)
+{
+    free(w->q.dense);
+    free(w->q.sparse);
+    free(w->stack);
+    free(w->key);
+    free(w->save);
+}
+
+/**
+ * @internal
+ * Scratch memory kept by each thread for matching without the cache.
+ */
+typedef struct {
+    ib_re_work_t        work;             /**< Scratch memory */
+    int32_t             ninst;            /**< Instructions it is sized for */
+    int                 busy;             /**< In use (by an outer match) */
+} ib_re_thread_t;
+
+static pthread_key_t ib_re_thread_key;
+static pthread_once_t ib_re_thread_once = PTHREAD_ONCE_INIT;
+static int ib_re_thread_key_ok;
+
+/**
+ * @internal
+ * Free the scratch memory of a thread as it exits.
+ *
+ * @param data Thread scratch memory
+ */
+static void ib_re_thread_free(void *data)
+{
+    ib_re_thread_t *t = (ib_re_thread_t *)data;
+
+    ib_re_work_free(&t->work);
+    free(t);
+}
+
+/** @internal Create the key for per-thread scratch memory (once). */
+static void ib_re_thread_key_create(void)
+{
+    ib_re_thread_key_ok =
+        (pthread_key_create(&ib_re_thread_key, ib_re_thread_free) == 0);
+}
+
+/**
+ * @internal
+ * Get the scratch memory of the calling thread.
+ *
+ * @param ninst Minimum number of instructions
+ *
+ * @returns Thread scratch memory, or NULL if it is already in use or
+ *          cannot be allocated
+ */
+static ib_re_thread_t *ib_re_thread_get(int32_t ninst)
+{
+    ib_re_thread_t *t;
+
+    pthread_once(&ib_re_thread_once, ib_re_thread_key_create);
+    if (!ib_re_thread_key_ok) {
+        return NULL;
+    }
+
+    t = (ib_re_thread_t *)pthread_getspecific(ib_re_thread_key);
+    if (t == NULL) {
+        t = (ib_re_thread_t *)calloc(1, sizeof(*t));
+        if (t == NULL) {
+            return NULL;
+        }
+        if (pthread_setspecific(ib_re_thread_key, t) != 0) {
+            free(t);
+            return NULL;
+        }
+    }
+    if (t->busy) {
+        return NULL;
+    }
+
+    if (t->ninst < ninst) {
+        ib_re_work_free(&t->work);
+        t->ninst = 0;
+        if (ib_re_work_init(&t->work, ninst,
+                            ib_re_heap_alloc, NULL) != IB_OK)
+        {
+            ib_re_work_free(&t->work);
+            memset(&t->work, 0, sizeof(t->work));
+            return NULL;
+        }
+        t->ninst = ninst;
+    }
+
+    return t;
+}
+
+/**
+ * @internal
+ * Add the instructions reachable from an instruction without
+ * consuming a byte.
+ *
+ * @param re Regex
+ * @param w Scratch memory (w->q is added to)
+ * @param i Instruction
+ * @param bol At the start of the subject
+ * @param eol At the end of the subject
+ */
+static void ib_re_closure(const ib_re_t *re,
+                          ib_re_work_t *w,
+                          int32_t i,
+                          int bol,
+                          int eol)
+{
+    ib_re_sset_t *q = &w->q;
+    int32_t sp = 0;
+
+    w->stack[sp++] = i;
+    while (sp > 0) {
+        const ib_re_inst_t *inst;
+
+        i = w->stack[--sp];
+        if ((q->sparse[i] < q->n) && (q->dense[q->sparse[i]] == i)) {
+            continue;
+        }
+        q->sparse[i] = q->n;
+        q->dense[q->n++] = i;
+
+        inst = &re->prog[i];
+        switch (inst->op) {
+            case IB_RE_OP_SPLIT:
+                w->stack[sp++] = inst->out1;
+                w->stack[sp++] = inst->out;
+                break;
+            case IB_RE_OP_BOL:
+                if (bol) {
+                    w->stack[sp++] = inst->out;
+                }
+                break;
+            case IB_RE_OP_EOL:
+                if (eol) {
+                    w->stack[sp++] = inst->out;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/**
+ * @internal
+ * Compute the next instruction set after a byte.
+ *
+ * The pattern starts are always added, which makes the search
+ * unanchored. Only the instructions which matter to later steps
+ * (BYTES, MATCH and EOL) are kept.
+ *
+ * @param re Regex
+ * @param w Scratch memory
+ * @param set Instruction set (or NULL for the start)
+ * @param nset Number of instructions
+ * @param byte Byte
+ * @param bol At the start of the subject
+ * @param key Address which the next set is written
+ *
+ * @returns Number of instructions in the next set
+ */
+static int32_t ib_re_step(const ib_re_t *re,
+                          ib_re_work_t *w,
+                          const int32_t *set,
+                          int32_t nset,
+                          int byte,
+                          int bol,
+                          int32_t *key)
+{
+    int32_t nkey = 0;
+    int32_t i;
+    size_t k;
+
+    w->q.n = 0;
+    for (i = 0; i < nset; i++) {
+        const ib_re_inst_t *inst = &re->prog[set[i]];
+
+        if ((inst->op == IB_RE_OP_BYTES) && IB_RE_SET_HAS(inst->set, byte)) {
+            ib_re_closure(re, w, inst->out, 0, 0);
+        }
+    }
+    for (k = 0; k < re->npatt; k++) {
+        ib_re_closure(re, w, re->starts[k], bol, 0);
+    }
+
+    for (i = 0; i < w->q.n; i++) {
+        int op = re->prog[w->q.dense[i]].op;
+
+        if ((op == IB_RE_OP_BYTES) || (op == IB_RE_OP_MATCH)
+            || (op == IB_RE_OP_EOL))
+        {
+            key[nkey++] = w->q.dense[i];
+        }
+    }
+
+    return nkey;
+}
+
+
+/* -- Match Reporting -- */
+
+/**
+ * @internal
+ * Match reporting state.
+ */
+typedef struct {
+    uint8_t            *done;             /**< Patterns reported */
+    size_t             *ndone;            /**< Number of patterns reported */
+    ib_re_callback_fn_t fn;               /**< Callback */
+    void               *cbdata;           /**< Callback data */
+    int                 matched;          /**< Something was reported */
+    ib_status_t         rc;               /**< Status to stop with */
+} ib_re_report_t;
+
+/**
+ * @internal
+ * Report a pattern match (once per pattern).
+ *
+ * @returns Non-zero to stop matching (with r->rc)
+ */
+static int ib_re_report(const ib_re_t *re,
+                        ib_re_report_t *r,
+                        int32_t patt,
+                        size_t end)
+{
+    ib_status_t rc;
+
+    if (r->done[patt]) {
+        return 0;
+    }
+    r->done[patt] = 1;
+    (*r->ndone)++;
+    r->matched = 1;
+
+    if (r->fn == NULL) {
+        r->rc = IB_OK;
+        return 1;
+    }
+    rc = r->fn(r->cbdata, re->ids[patt], end);
+    if (rc != IB_OK) {
+        r->rc = rc;
+        return 1;
+    }
+
+    /* Nothing left to find. */
+    if (*r->ndone == re->npatt) {
+        r->rc = IB_OK;
+        return 1;
+    }
+
+    return 0;
+}
+
+/**
+ * @internal
+ * Report the MATCH instructions in a set.
+ *
+ * @returns Non-zero to stop matching
+ */
+static int ib_re_report_set(const ib_re_t *re,
+                            ib_re_report_t *r,
+                            const int32_t *set,
+                            int32_t nset,
+                            size_t end)
+{
+    int32_t i;
+
+    for (i = 0; i < nset; i++) {
+        const ib_re_inst_t *inst = &re->prog[set[i]];
+
+        if ((inst->op == IB_RE_OP_MATCH) && ib_re_report(re, r, inst->arg, end)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ * @internal
+ * Report the patterns which match at the end of the subject.
+ *
+ * @returns Non-zero to stop matching
+ */
+static int ib_re_report_end(const ib_re_t *re,
+                            ib_re_work_t *w,
+                            ib_re_report_t *r,
+                            const int32_t *set,
+                            int32_t nset,
+                            int bol,
+                            size_t end)
+{
+    int32_t i;
+
+    w->q.n = 0;
+    for (i = 0; i < nset; i++) {
+        if (re->prog[set[i]].op == IB_RE_OP_EOL) {
+            ib_re_closure(re, w, set[i], bol, 1);
+        }
+    }
+
+    return ib_re_report_set(re, r, w->q.dense, w->q.n, end);
+}
+
+
+/* -- DFA State Cache -- */
+
+/** @internal Compare instructions for qsort(). */
+static int ib_re_cmp(const void *a, const void *b)
+{
+    return *(const int32_t *)a - *(const int32_t *)b;
+}
+
+/** @internal Hash an instruction set. */
+static uint32_t ib_re_hash(const int32_t *set, int32_t nset)
+{
+    uint32_t h = 2166136261U;
+    int32_t i;
+
+    for (i = 0; i < nset; i++) {
+        h = (h ^ (uint32_t)set[i]) * 16777619U;
+    }
+
+    return h;
+}
+
+/**
+ * @internal
+ * Size of a DFA state in the cache.
+ */
+static size_t ib_re_dstate_size(const ib_re_t *re, int32_t nset, int32_t nmatch)
+{
+    size_t size = sizeof(ib_re_dstate_t)
+        + (re->ncls * sizeof(ib_re_dstate_t *))
+        + ((nset + nmatch) * sizeof(int32_t));
+
+    return (size + 7) & ~(size_t)7;
+}
+
+/**
+ * @internal
+ * Flush the cache.
+ */
+static void ib_re_cache_flush(ib_re_cache_t *c)
+{
+    while (c->blocks != NULL) {
+        ib_re_block_t *b = c->blocks;
+
+        c->blocks = b->next;
+        free(b);
+    }
+    c->size = 0;
+    if (c->buckets != NULL) {
+        memset(c->buckets, 0, c->nbuckets * sizeof(*c->buckets));
+    }
+    c->nstates = 0;
+    c->start = NULL;
+    c->flushes++;
+}
+
+/**
+ * @internal
+ * Free the cache when the regex pool is destroyed.
+ */
+static ib_status_t ib_re_cache_cleanup(void *data)
+{
+    ib_re_cache_t *c = (ib_re_cache_t *)data;
+
+    ib_re_cache_flush(c);
+    free(c->buckets);
+    c->buckets = NULL;
+    pthread_mutex_destroy(&c->lock);
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Allocate cache memory.
+ *
+ * @returns Memory, or NULL if full (*prc is IB_ELIMIT) or on
+ *          allocation failure (*prc is IB_EALLOC)
+ */
+static void *ib_re_cache_alloc(ib_re_t *re, size_t size, ib_status_t *prc)
+{
+    ib_re_cache_t *c = &re->cache;
+    ib_re_block_t *b = c->blocks;
+    size_t bsize;
+    void *mem;
+
+    if ((b == NULL) || (b->used + size > b->size)) {
+        bsize = (size > re->block_size) ? size : re->block_size;
+        if ((c->size > 0) && (c->size + bsize > re->cache_max)) {
+            *prc = IB_ELIMIT;
+            return NULL;
+        }
+        b = (ib_re_block_t *)malloc(sizeof(*b) + bsize);
+        if (b == NULL) {
+            *prc = IB_EALLOC;
+            return NULL;
+        }
+        b->size = bsize;
+        b->used = 0;
+        b->next = c->blocks;
+        c->blocks = b;
+        c->size += bsize;
+    }
+
+    mem = (uint8_t *)(b + 1) + b->used;
+    b->used += size;
+
+    return mem;
+}
+
+/**
+ * @internal
+ * Find a DFA state.
+ */
+static ib_re_dstate_t *ib_re_cache_find(const ib_re_cache_t *c,
+                                        const int32_t *set,
+                                        int32_t nset,
+                                        uint32_t hash)
+{
+    ib_re_dstate_t *s;
+
+    if (c->buckets == NULL) {
+        return NULL;
+    }
+    for (s = c->buckets[hash & (c->nbuckets - 1)]; s != NULL; s = s->hnext) {
+        if ((s->hash == hash) && (s->nset == nset)
+            && (memcmp(s->set, set, nset * sizeof(*set)) == 0))
+        {
+            return s;
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * @internal
+ * Add a DFA state.
+ *
+ * @returns Status code (IB_ELIMIT if the cache is full)
+ */
+static ib_status_t ib_re_cache_add(ib_re_t *re,
+                                   const int32_t *set,
+                                   int32_t nset,
+                                   uint32_t hash,
+                                   ib_re_dstate_t **ps)
+{
+    ib_re_cache_t *c = &re->cache;
+    ib_re_dstate_t *s;
+    int32_t nmatch = 0;
+    int32_t i;
+    ib_status_t rc = IB_OK;
+
+    /* Grow the hash table as states are added. */
+    if (c->nstates >= 2 * c->nbuckets) {
+        size_t nbuckets = (c->nbuckets == 0) ? IB_RE_BUCKETS : 2 * c->nbuckets;
+        ib_re_dstate_t **buckets;
+        size_t k;
+
+        buckets = (ib_re_dstate_t **)calloc(nbuckets, sizeof(*buckets));
+        if (buckets == NULL) {
+            return IB_EALLOC;
+        }
+        for (k = 0; k < c->nbuckets; k++) {
+            while (c->buckets[k] != NULL) {
+                ib_re_dstate_t *m = c->buckets[k];
+
+                c->buckets[k] = m->hnext;
+                m->hnext = buckets[m->hash & (nbuckets - 1)];
+                buckets[m->hash & (nbuckets - 1)] = m;
+            }
+        }
+        free(c->buckets);
+        c->buckets = buckets;
+        c->nbuckets = nbuckets;
+    }
+
+    for (i = 0; i < nset; i++) {
+        if (re->prog[set[i]].op == IB_RE_OP_MATCH) {
+            nmatch++;
+        }
+    }
+
+    s = (ib_re_dstate_t *)ib_re_cache_alloc(re,
+                                            ib_re_dstate_size(re, nset, nmatch),
+                                            &rc);
+    if (s == NULL) {
+        return rc;
+    }
+    s->next = (ib_re_dstate_t **)(s + 1);
+    s->set = (int32_t *)(s->next + re->ncls);
+    s->match = s->set + nset;
+    s->nset = nset;
+    s->nmatch = 0;
+    s->hash = hash;
+    memset(s->next, 0, re->ncls * sizeof(*s->next));
+    memcpy(s->set, set, nset * sizeof(*set));
+    for (i = 0; i < nset; i++) {
+        const ib_re_inst_t *inst = &re->prog[set[i]];
+
+        if (inst->op == IB_RE_OP_MATCH) {
+            s->match[s->nmatch++] = inst->arg;
+        }
+    }
+
+    s->hnext = c->buckets[hash & (c->nbuckets - 1)];
+    c->buckets[hash & (c->nbuckets - 1)] = s;
+    c->nstates++;
+
+    *ps = s;
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Find or add the DFA state for a set in w->key.
+ *
+ * If the cache is full, it is flushed first. As this frees all
+ * states, the state in *pkeep (if any) is added back and *pkeep
+ * updated.
+ */
+static ib_status_t ib_re_dfa_state(ib_re_t *re,
+                                   int32_t nkey,
+                                   ib_re_dstate_t **pkeep,
+                                   ib_re_dstate_t **ps)
+{
+    ib_re_cache_t *c = &re->cache;
+    ib_re_work_t *w = &c->work;
+    uint32_t hash;
+    ib_status_t rc;
+
+    qsort(w->key, nkey, sizeof(*w->key), ib_re_cmp);
+    hash = ib_re_hash(w->key, nkey);
+
+    *ps = ib_re_cache_find(c, w->key, nkey, hash);
+    if (*ps != NULL) {
+        return IB_OK;
+    }
+
+    rc = ib_re_cache_add(re, w->key, nkey, hash, ps);
+    if (rc != IB_ELIMIT) {
+        return rc;
+    }
+
+    /* Full, so start again (the block size leaves room for both). */
+    if ((pkeep != NULL) && (*pkeep != NULL)) {
+        ib_re_dstate_t *keep = *pkeep;
+        int32_t nsave = keep->nset;
+
+        memcpy(w->save, keep->set, nsave * sizeof(*w->save));
+        ib_re_cache_flush(c);
+        rc = ib_re_cache_add(re, w->save, nsave,
+                             ib_re_hash(w->save, nsave), pkeep);
+        if (rc != IB_OK) {
+            return rc;
+        }
+        *ps = ib_re_cache_find(c, w->key, nkey, hash);
+        if (*ps != NULL) {
+            return IB_OK;
+        }
+    }
+    else {
+        ib_re_cache_flush(c);
+    }
+
+    return ib_re_cache_add(re, w->key, nkey, hash, ps);
+}
+
+/**
+ * @internal
+ * Compute a transition not yet in the cache.
+ *
+ * @param re Regex
+ * @param ps Address of the current state, which is updated if the
+ *           cache is flushed
+ * @param byte Byte
+ * @param pnext Address which the next state is written
+ *
+ * @returns Status code
+ */
+static ib_status_t ib_re_dfa_next(ib_re_t *re,
+                                  ib_re_dstate_t **ps,
+                                  uint8_t byte,
+                                  ib_re_dstate_t **pnext)
+{
+    ib_re_work_t *w = &re->cache.work;
+    int32_t nkey;
+    ib_status_t rc;
+
+    nkey = ib_re_step(re, w, (*ps)->set, (*ps)->nset, byte, 0, w->key);
+    rc = ib_re_dfa_state(re, nkey, ps, pnext);
+    if (rc != IB_OK) {
+        return rc;
+    }
+    (*ps)->next[re->cls[byte]] = *pnext;
+
+    return IB_OK;
+}
+
+
+/* -- Matching -- */
+
+/**
+ * @internal
+ * Match data with the DFA (cache lock held).
+ *
+ * @param re Regex
+ * @param set Initial set (NULL for the start), which is written back
+ *            if psetout is not NULL
+ * @param pnset Address of the number of instructions in set
+ * @param data Data
+ * @param dlen Data length
+ * @param offset Offset of data in the subject
+ * @param end Data is the end of the subject
+ * @param r Match reporting state
+ *
+ * @returns Status code
+ */
+static ib_status_t ib_re_run_dfa(ib_re_t *re,
+                                 int32_t *set,
+                                 int32_t *pnset,
+                                 const uint8_t *data,
+                                 size_t dlen,
+                                 size_t offset,
+                                 int end,
+                                 ib_re_report_t *r)
+{
+    ib_re_cache_t *c = &re->cache;
+    ib_re_dstate_t *s;
+    size_t i = 0;
+    int stop = 0;
+    ib_status_t rc;
+
+    if ((set == NULL) || (*pnset < 0)) {
+        if (c->start == NULL) {
+            int32_t nkey = ib_re_step(re, &c->work, NULL, 0, 0, 1,
+                                      c->work.key);
+
+            rc = ib_re_dfa_state(re, nkey, NULL, &c->start);
+            if (rc != IB_OK) {
+                return rc;
+            }
+        }
+        s = c->start;
+        for (i = 0; !stop && (i < (size_t)s->nmatch); i++) {
+            stop = ib_re_report(re, r, s->match[i], offset);
+        }
+    }
+    else {
+        memcpy(c->work.key, set, *pnset * sizeof(*set));
+        rc = ib_re_dfa_state(re, *pnset, NULL, &s);
+        if (rc != IB_OK) {
+            return rc;
+        }
+    }
+
+    for (i = 0; !stop && (i < dlen) && (s->nset > 0); i++) {
+        ib_re_dstate_t *t = s->next[re->cls[data[i]]];
+
+        if (t == NULL) {
+            rc = ib_re_dfa_next(re, &s, data[i], &t);
+            if (rc != IB_OK) {
+                return rc;
+            }
+        }
+        s = t;
+
+        if (s->nmatch > 0) {
+            int32_t k;
+
+            for (k = 0; !stop && (k < s->nmatch); k++) {
+                stop = ib_re_report(re, r, s->match[k], offset + i + 1);
+            }
+        }
+    }
+
+    if (!stop && end) {
+        ib_re_report_end(re, &c->work, r, s->set, s->nset,
+                         (offset + dlen) == 0, offset + dlen);
+    }
+
+    if (set != NULL) {
+        memcpy(set, s->set, s->nset * sizeof(*set));
+        *pnset = s->nset;
+    }
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Match data by simulating the NFA (used when the cache is busy).
+ *
+ * Scratch memory is kept per thread; it is only allocated for the match
+ * when a callback matches again on the same thread.
+ *
+ * Parameters are as for ib_re_run_dfa().
+ */
+static ib_status_t ib_re_run_nfa(const ib_re_t *re,
+                                 int32_t *set,
+                                 int32_t *pnset,
+                                 const uint8_t *data,
+                                 size_t dlen,
+                                 size_t offset,
+                                 int end,
+                                 ib_re_report_t *r)
+{
+    ib_re_thread_t *t;
+    ib_re_work_t tw;
+    ib_re_work_t *w;
+    int32_t *cur;
+    int32_t *nxt;
+    int32_t ncur;
+    size_t i;
+    int stop = 0;
+    ib_status_t rc;
+
+    t = ib_re_thread_get(re->nprog + 1);
+    if (t != NULL) {
+        t->busy = 1;
+        w = &t->work;
+    }
+    else {
+        w = &tw;
+        rc = ib_re_work_init(w, re->nprog + 1, ib_re_heap_alloc, NULL);
+        if (rc != IB_OK) {
+            ib_re_work_free(w);
+            return rc;
+        }
+    }
+    cur = w->key;
+    nxt = w->save;
+
+    if ((set == NULL) || (*pnset < 0)) {
+        ncur = ib_re_step(re, w, NULL, 0, 0, 1, cur);
+        stop = ib_re_report_set(re, r, cur, ncur, offset);
+    }
+    else {
+        ncur = *pnset;
+        memcpy(cur, set, ncur * sizeof(*set));
+    }
+
+    for (i = 0; !stop && (i < dlen) && (ncur > 0); i++) {
+        int32_t *tmp;
+
+        ncur = ib_re_step(re, w, cur, ncur, data[i], 0, nxt);
+        tmp = cur;
+        cur = nxt;
+        nxt = tmp;
+
+        stop = ib_re_report_set(re, r, cur, ncur, offset + i + 1);
+    }
+
+    if (!stop && end) {
+        ib_re_report_end(re, w, r, cur, ncur,
+                         (offset + dlen) == 0, offset + dlen);
+    }
+
+    if (set != NULL) {
+        memcpy(set, cur, ncur * sizeof(*set));
+        *pnset = ncur;
+    }
+
+    if (t != NULL) {
+        t->busy = 0;
+    }
+    else {
+        ib_re_work_free(w);
+    }
+
+    return IB_OK;
+}
+
+/**
+ * @internal
+ * Match data, with the DFA if the cache is free.
+ */
+static ib_status_t ib_re_run(const ib_re_t *cre,
+                             int32_t *set,
+                             int32_t *pnset,
+                             const uint8_t *data,
+                             size_t dlen,
+                             size_t offset,
+                             int end,
+                             ib_re_report_t *r)
+{
+    /* Only the cache is modified, under its lock. */
+    ib_re_t *re = (ib_re_t *)cre;
+    ib_status_t rc;
+
+    if (pthread_mutex_trylock(&re->cache.lock) != 0) {
+        return ib_re_run_nfa(re, set, pnset, data, dlen, offset, end, r);
+    }
+    rc = ib_re_run_dfa(re, set, pnset, data, dlen, offset, end, r);
+    pthread_mutex_unlock(&re->cache.lock);
+
+    return rc;
+}
+
+
+/* -- Public API -- */
+
+ib_status_t ib_re_create(ib_re_t **pre,
+                         ib_mpool_t *pool,
+                         ib_flags_t flags,
+                         size_t cache_max)
+{
+    IB_FTRACE_INIT(ib_re_create);
+    ib_re_t *re;
+    ib_status_t rc;
+
+    re = (ib_re_t *)ib_mpool_calloc(pool, 1, sizeof(*re));
+    if (re == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    re->mp = pool;
+    re->flags = flags;
+    re->cache_max = (cache_max > 0) ? cache_max : IB_RE_CACHE_DEFAULT;
+
+    rc = ib_mpool_create(&re->bmp, pool);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    rc = ib_list_create(&re->patts, re->bmp);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    *pre = re;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+ib_status_t ib_re_add_pattern(ib_re_t *re,
+                              const char *patt,
+                              ib_num_t id,
+                              const char **errptr,
+                              int *erroffset)
+{
+    IB_FTRACE_INIT(ib_re_add_pattern);
+    ib_re_patt_t *p;
+    ib_status_t rc;
+
+    if (re->bmp == NULL) {
+        if (errptr != NULL) {
+            *errptr = "already built";
+        }
+        if (erroffset != NULL) {
+            *erroffset = 0;
+        }
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    p = (ib_re_patt_t *)ib_mpool_calloc(re->bmp, 1, sizeof(*p));
+    if (p == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    rc = ib_re_parse(re->bmp, patt, re->flags, 0, &p->root, errptr, erroffset);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    /* One more for the MATCH instruction. */
+    p->ninst = ib_re_size(p->root) + 1;
+    if (re->ninst + p->ninst > IB_RE_MAX_INSTS) {
+        if (errptr != NULL) {
+            *errptr = "regular expression is too large";
+        }
+        if (erroffset != NULL) {
+            *erroffset = 0;
+        }
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+    p->id = id;
+
+    rc = ib_list_push(re->patts, p);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    re->ninst += p->ninst;
+    re->npatt++;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+ib_status_t ib_re_build(ib_re_t *re)
+{
+    IB_FTRACE_INIT(ib_re_build);
+    ib_list_node_t *node;
+    size_t maxstate;
+    size_t k = 0;
+    ib_status_t rc;
+
+    if (re->bmp == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    re->prog = (ib_re_inst_t *)ib_mpool_alloc(re->mp,
+                                              (re->ninst + 1) * sizeof(*re->prog));
+    re->starts = (int32_t *)ib_mpool_alloc(re->mp,
+                                           (re->npatt + 1) * sizeof(*re->starts));
+    re->ids = (ib_num_t *)ib_mpool_alloc(re->mp,
+                                         (re->npatt + 1) * sizeof(*re->ids));
+    if ((re->prog == NULL) || (re->starts == NULL) || (re->ids == NULL)) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+
+    IB_LIST_LOOP(re->patts, node) {
+        ib_re_patt_t *p = (ib_re_patt_t *)ib_list_node_data(node);
+        int32_t m = ib_re_inst(re, IB_RE_OP_MATCH, -1);
+
+        re->prog[m].arg = (int32_t)k;
+        re->starts[k] = ib_re_emit(re, p->root, m);
+        re->ids[k] = p->id;
+        k++;
+    }
+
+    ib_re_classes(re);
+
+    /* The cache must hold at least two of the largest states. */
+    maxstate = ib_re_dstate_size(re, re->nprog, re->nprog);
+    re->block_size = (2 * maxstate > IB_RE_BLOCK_SIZE)
+        ? 2 * maxstate : IB_RE_BLOCK_SIZE;
+    if (re->cache_max < 2 * re->block_size) {
+        re->cache_max = 2 * re->block_size;
+    }
+
+    rc = ib_re_work_init(&re->cache.work, re->nprog + 1,
+                         ib_re_pool_alloc, re->mp);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    if (pthread_mutex_init(&re->cache.lock, NULL) != 0) {
+        IB_FTRACE_RET_STATUS(IB_EUNKNOWN);
+    }
+    ib_mpool_cleanup_register(re->mp, &re->cache, ib_re_cache_cleanup);
+
+    /* The syntax trees are no longer needed. */
+    ib_mpool_destroy(re->bmp);
+    re->bmp = NULL;
+    re->patts = NULL;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+int ib_re_is_built(const ib_re_t *re)
+{
+    return (re->bmp == NULL) ? 1 : 0;
+}
+
+size_t ib_re_pattern_count(const ib_re_t *re)
+{
+    return re->npatt;
+}
+
+size_t ib_re_memory(const ib_re_t *re)
+{
+    if (re->bmp != NULL) {
+        return 0;
+    }
+
+    return (re->nprog * sizeof(*re->prog)) + re->cache.size
+        + (re->cache.nbuckets * sizeof(*re->cache.buckets));
+}
+
+size_t ib_re_cache_flushes(const ib_re_t *re)
+{
+    return re->cache.flushes;
+}
+
+ib_status_t ib_re_match(const ib_re_t *re,
+                        const uint8_t *data,
+                        size_t dlen,
+                        ib_re_callback_fn_t fn,
+                        void *cbdata)
+{
+    IB_FTRACE_INIT(ib_re_match);
+    uint8_t done_buf[256];
+    ib_re_report_t r;
+    size_t ndone = 0;
+    ib_status_t rc;
+
+    if (re->bmp != NULL) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    memset(&r, 0, sizeof(r));
+    r.fn = fn;
+    r.cbdata = cbdata;
+    r.ndone = &ndone;
+    r.rc = IB_OK;
+    if (re->npatt <= sizeof(done_buf)) {
+        memset(done_buf, 0, sizeof(done_buf));
+        r.done = done_buf;
+    }
+    else {
+        r.done = (uint8_t *)calloc(re->npatt, 1);
+        if (r.done == NULL) {
+            IB_FTRACE_RET_STATUS(IB_EALLOC);
+        }
+    }
+
+    rc = ib_re_run(re, NULL, NULL, data, dlen, 0, 1, &r);
+
+    if (r.done != done_buf) {
+        free(r.done);
+    }
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+    if (r.rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(r.rc);
+    }
+
+    IB_FTRACE_RET_STATUS(r.matched ? IB_OK : IB_ENOENT);
+}
+
+ib_status_t ib_re_stream_create(const ib_re_t *re,
+                                ib_mpool_t *pool,
+                                ib_re_stream_t **prs)
+{
+    IB_FTRACE_INIT(ib_re_stream_create);
+    ib_re_stream_t *rs;
+
+    if (re->bmp != NULL) {
+        IB_FTRACE_RET_STATUS(IB_EINVAL);
+    }
+
+    rs = (ib_re_stream_t *)ib_mpool_calloc(pool, 1, sizeof(*rs));
+    if (rs == NULL) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    rs->set = (int32_t *)ib_mpool_alloc(pool, (re->nprog + 1) * sizeof(*rs->set));
+    rs->done = (uint8_t *)ib_mpool_calloc(pool, re->npatt + 1, 1);
+    if ((rs->set == NULL) || (rs->done == NULL)) {
+        IB_FTRACE_RET_STATUS(IB_EALLOC);
+    }
+    rs->nset = -1;
+
+    *prs = rs;
+
+    IB_FTRACE_RET_STATUS(IB_OK);
+}
+
+/**
+ * @internal
+ * Match the next chunk of a stream, or finish it.
+ */
+static ib_status_t ib_re_stream_run(const ib_re_t *re,
+                                    ib_re_stream_t *rs,
+                                    const uint8_t *data,
+                                    size_t dlen,
+                                    int end,
+                                    ib_re_callback_fn_t fn,
+                                    void *cbdata)
+{
+    ib_re_report_t r;
+    ib_status_t rc;
+
+    memset(&r, 0, sizeof(r));
+    r.fn = fn;
+    r.cbdata = cbdata;
+    r.done = rs->done;
+    r.ndone = &rs->ndone;
+    r.rc = IB_OK;
+
+    /* Everything has been reported already. */
+    if (rs->ndone == re->npatt) {
+        rs->offset += dlen;
+        return IB_ENOENT;
+    }
+
+    rc = ib_re_run(re, rs->set, &rs->nset, data, dlen, rs->offset, end, &r);
+    rs->offset += dlen;
+    if (rc != IB_OK) {
+        return rc;
+    }
+    if (r.rc != IB_OK) {
+        return r.rc;
+    }
+
+    return r.matched ? IB_OK : IB_ENOENT;
+}
+
+ib_status_t ib_re_match_stream(const ib_re_t *re,
+                               ib_re_stream_t *rs,
+                               const uint8_t *data,
+                               size_t dlen,
+                               ib_re_callback_fn_t fn,
+                               void *cbdata)
+{
+    IB_FTRACE_INIT(ib_re_match_stream);
+    ib_status_t rc;
+
+    rc = ib_re_stream_run(re, rs, data, dlen, 0, fn, cbdata);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+ib_status_t ib_re_match_finish(const ib_re_t *re,
+                               ib_re_stream_t *rs,
+                               ib_re_callback_fn_t fn,
+                               void *cbdata)
+{
+    IB_FTRACE_INIT(ib_re_match_finish);
+    ib_status_t rc;
+
+    rc = ib_re_stream_run(re, rs, NULL, 0, 1, fn, cbdata);
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+ib_status_t ib_re_analyze(const char *patt,
+                          ib_flags_t flags,
+                          const char **preason,
+                          int *poffset)
+{
+    IB_FTRACE_INIT(ib_re_analyze);
+    ib_mpool_t *mp;
+    ib_re_node_t *root;
+    ib_re_risk_t risk;
+    ib_status_t rc;
+
+    *preason = NULL;
+    *poffset = 0;
+
+    rc = ib_mpool_create(&mp, NULL);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    rc = ib_re_parse(mp, patt, flags, 1, &root, preason, poffset);
+    if (rc == IB_OK) {
+        memset(&risk, 0, sizeof(risk));
+        if (ib_re_risky(root, 0, &risk)) {
+            *preason = risk.reason;
+            *poffset = (int)risk.off;
+            rc = IB_DECLINED;
+        }
+    }
+
+    ib_mpool_destroy(mp);
+
+    IB_FTRACE_RET_STATUS(rc);
+}
+
+ib_status_t ib_re_literal(const char *patt,
+                          ib_flags_t flags,
+                          ib_mpool_t *pool,
+                          const uint8_t **plit,
+                          size_t *plen)
+{
+    IB_FTRACE_INIT(ib_re_literal);
+    ib_mpool_t *mp;
+    ib_re_node_t *root;
+    ib_re_lit_t li;
+    ib_status_t rc;
+
+    *plit = NULL;
+    *plen = 0;
+
+    rc = ib_mpool_create(&mp, NULL);
+    if (rc != IB_OK) {
+        IB_FTRACE_RET_STATUS(rc);
+    }
+
+    rc = ib_re_parse(mp, patt, flags, 1, &root, NULL, NULL);
+    if (rc == IB_OK) {
+        ib_re_lit(mp, root, &li);
+        if (li.req.len == 0) {
+            rc = IB_ENOENT;
+        }
+        else {
+            *plit = (const uint8_t *)ib_mpool_memdup(pool, li.req.s,
+                                                     li.req.len);
+            *plen = li.req.len;
+            if (*plit == NULL) {
+                rc = IB_EALLOC;
+            }
+        }
+    }
+
+    ib_mpool_destroy(mp);
+
+    IB_FTRACE_RET_STATUS(rc);
+}
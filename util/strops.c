@@ -0,0 +1,820 @@
+/*****************************************************************************
+ * Licensed to Qualys, Inc. (QUALYS) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * QUALYS licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *****************************************************************************/
+
+/**
+ * @file
+ * @brief IronBee - Utility String Operations
+ * @author Brian Rectanus <brectanus@qualys.com>
+ */
+
+/**
+ * @internal
+ *
+ * Each operation has a scalar kernel and, on x86, SSE2 and AVX2
+ * kernels which work on 16 or 32 bytes at a time (and AVX-512 kernels
+ * for the hottest scans). The kernels are selected at runtime by
+ * ib_strops_select() from ib_cpu_features(), checked on each call so
+ * that a change made by ib_cpu_features_limit() is picked up. The
+ * vector kernels hand any remaining tail bytes to the next narrower
+ * kernel (AVX2 kernels clear the upper vector state first to avoid
+ * the AVX to SSE transition penalty). All kernels use ASCII ("C"
+ * locale) rules regardless of the process locale.
+ */
+
+#include "ironbee_config_auto.h"
+
+#include <ironbee/util.h>
+
+#include "ironbee_util_private.h"
+
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__SSE2__)
+#define IB_STROPS_X86
+#include <emmintrin.h>
+#include <immintrin.h>
+#endif
+
+/**
+ * @internal
+ * Check for whitespace (as isspace() in the "C" locale).
+ */
+#define IB_STROPS_ISSPACE(c) \
+    (((c) == ' ') || (((c) >= '\t') && ((c) <= '\r')))
+
+
+/* -- Scalar Kernels -- */
+
+/**
+ * @internal
+ * Lowercase ASCII letters (scalar).
+ */
+static int ib_strops_lower_scalar(uint8_t *data,
+                                  size_t dlen)
+{
+    int modified = 0;
+    size_t i;
+
+    for (i = 0; i < dlen; i++) {
+        uint8_t c = data[i];
+
+        if ((uint8_t)(c - 'A') < 26) {
+            data[i] = c | 0x20;
+            modified = 1;
+        }
+    }
+
+    return modified;
+}
+
+/**
+ * @internal
+ * Count leading whitespace (scalar).
+ */
+static size_t ib_strops_wsleft_scalar(const uint8_t *data,
+                                      size_t dlen)
+{
+    size_t i = 0;
+
+    while ((i < dlen) && IB_STROPS_ISSPACE(data[i])) {
+        i++;
+    }
+
+    return i;
+}
+
+/**
+ * @internal
+ * Length without trailing whitespace (scalar).
+ */
+static size_t ib_strops_wsright_scalar(const uint8_t *data,
+                                       size_t dlen)
+{
+    size_t i = dlen;
+
+    while ((i > 0) && IB_STROPS_ISSPACE(data[i - 1])) {
+        i--;
+    }
+
+    return i;
+}
+
+/**
+ * @internal
+ * Find the first byte in a set (scalar).
+ */
+static size_t ib_strops_find_any_scalar(const uint8_t *data,
+                                        size_t dlen,
+                                        const uint8_t *set,
+                                        size_t nset)
+{
+    size_t i;
+    size_t j;
+
+    for (i = 0; i < dlen; i++) {
+        for (j = 0; j < nset; j++) {
+            if (data[i] == set[j]) {
+                return i;
+            }
+        }
+    }
+
+    return dlen;
+}
+
+/**
+ * @internal
+ * Find the first occurrence of a substring (scalar).
+ */
+static size_t ib_strops_find_scalar(const uint8_t *data,
+                                    size_t dlen,
+                                    const uint8_t *needle,
+                                    size_t nlen)
+{
+    size_t i;
+
+    for (i = 0; i + nlen <= dlen; i++) {
+        if (   (data[i] == needle[0])
+            && (memcmp(data + i + 1, needle + 1, nlen - 1) == 0))
+        {
+            return i;
+        }
+    }
+
+    return dlen;
+}
+
+/**
+ * @internal
+ * Compare ignoring ASCII case (scalar).
+ */
+static int ib_strops_caseeq_scalar(const uint8_t *a,
+                                   const uint8_t *b,
+                                   size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        uint8_t ca = a[i];
+        uint8_t cb = b[i];
+
+        if (ca != cb) {
+            if ((uint8_t)(ca - 'A') < 26) {
+                ca |= 0x20;
+            }
+            if ((uint8_t)(cb - 'A') < 26) {
+                cb |= 0x20;
+            }
+            if (ca != cb) {
+                return 0;
+            }
+        }
+    }
+
+    return 1;
+}
+
+#ifdef IB_STROPS_X86
+
+/* -- SSE2 Kernels -- */
+
+/**
+ * @internal
+ * Whitespace mask of a 16 byte vector (SSE2).
+ *
+ * Bytes >= 0x80 are negative as signed bytes and so never
+ * fall within the signed range comparisons.
+ */
+static inline __m128i ib_strops_ws_sse2(__m128i v)
+{
+    __m128i ctl = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('\t' - 1)),
+                                _mm_cmplt_epi8(v, _mm_set1_epi8('\r' + 1)));
+
+    return _mm_or_si128(ctl, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+}
+
+/**
+ * @internal
+ * Lowercase ASCII letters (SSE2).
+ */
+static int ib_strops_lower_sse2(uint8_t *data,
+                                size_t dlen)
+{
+    const __m128i lo = _mm_set1_epi8('A' - 1);
+    const __m128i hi = _mm_set1_epi8('Z' + 1);
+    const __m128i bit = _mm_set1_epi8(0x20);
+    int modified = 0;
+    size_t i = 0;
+
+    for (; i + 16 <= dlen; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i m = _mm_and_si128(_mm_cmpgt_epi8(v, lo),
+                                  _mm_cmplt_epi8(v, hi));
+
+        /* Only write back blocks which change. */
+        if (_mm_movemask_epi8(m) != 0) {
+            v = _mm_or_si128(v, _mm_and_si128(m, bit));
+            _mm_storeu_si128((__m128i *)(data + i), v);
+            modified = 1;
+        }
+    }
+
+    return ib_strops_lower_scalar(data + i, dlen - i) | modified;
+}
+
+/**
+ * @internal
+ * Count leading whitespace (SSE2).
+ */
+static size_t ib_strops_wsleft_sse2(const uint8_t *data,
+                                    size_t dlen)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= dlen; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        unsigned int m = ~_mm_movemask_epi8(ib_strops_ws_sse2(v)) & 0xffff;
+
+        if (m != 0) {
+            return i + __builtin_ctz(m);
+        }
+    }
+
+    return i + ib_strops_wsleft_scalar(data + i, dlen - i);
+}
+
+/**
+ * @internal
+ * Length without trailing whitespace (SSE2).
+ */
+static size_t ib_strops_wsright_sse2(const uint8_t *data,
+                                     size_t dlen)
+{
+    size_t i = dlen;
+
+    for (; i >= 16; i -= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i - 16));
+        unsigned int m = ~_mm_movemask_epi8(ib_strops_ws_sse2(v)) & 0xffff;
+
+        if (m != 0) {
+            return i - 16 + (32 - __builtin_clz(m));
+        }
+    }
+
+    return ib_strops_wsright_scalar(data, i);
+}
+
+
+/**
+ * @internal
+ * Find the first byte in a set (SSE2).
+ */
+static size_t ib_strops_find_any_sse2(const uint8_t *data,
+                                      size_t dlen,
+                                      const uint8_t *set,
+                                      size_t nset)
+{
+    __m128i vset[IB_STROPS_SET_MAX];
+    size_t i = 0;
+    size_t j;
+
+    for (j = 0; j < nset; j++) {
+        vset[j] = _mm_set1_epi8((char)set[j]);
+    }
+
+    for (; i + 16 <= dlen; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i m = _mm_cmpeq_epi8(v, vset[0]);
+        unsigned int bits;
+
+        for (j = 1; j < nset; j++) {
+            m = _mm_or_si128(m, _mm_cmpeq_epi8(v, vset[j]));
+        }
+        bits = _mm_movemask_epi8(m);
+        if (bits != 0) {
+            return i + __builtin_ctz(bits);
+        }
+    }
+
+    return i + ib_strops_find_any_scalar(data + i, dlen - i, set, nset);
+}
+
+/**
+ * @internal
+ * Find the first occurrence of a substring (SSE2).
+ *
+ * Candidate positions are those where both the first and the last
+ * byte of the needle match; only those are compared in full.
+ */
+static size_t ib_strops_find_sse2(const uint8_t *data,
+                                  size_t dlen,
+                                  const uint8_t *needle,
+                                  size_t nlen)
+{
+    const __m128i first = _mm_set1_epi8((char)needle[0]);
+    const __m128i last = _mm_set1_epi8((char)needle[nlen - 1]);
+    size_t i = 0;
+
+    for (; i + nlen - 1 + 16 <= dlen; i += 16) {
+        __m128i vf = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i vl = _mm_loadu_si128((const __m128i *)(data + i + nlen - 1));
+        unsigned int bits = _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(vf, first),
+                          _mm_cmpeq_epi8(vl, last)));
+
+        while (bits != 0) {
+            size_t pos = i + __builtin_ctz(bits);
+
+            if (memcmp(data + pos + 1, needle + 1, nlen - 1) == 0) {
+                return pos;
+            }
+            bits &= bits - 1;
+        }
+    }
+
+    return i + ib_strops_find_scalar(data + i, dlen - i, needle, nlen);
+}
+
+/**
+ * @internal
+ * Lowercase a 16 byte vector (SSE2).
+ */
+static inline __m128i ib_strops_tolower_sse2(__m128i v)
+{
+    __m128i m = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                              _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+
+    return _mm_or_si128(v, _mm_and_si128(m, _mm_set1_epi8(0x20)));
+}
+
+/**
+ * @internal
+ * Compare ignoring ASCII case (SSE2).
+ */
+static int ib_strops_caseeq_sse2(const uint8_t *a,
+                                 const uint8_t *b,
+                                 size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 16 <= len; i += 16) {
+        __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+        __m128i eq = _mm_cmpeq_epi8(ib_strops_tolower_sse2(va),
+                                    ib_strops_tolower_sse2(vb));
+
+        if (_mm_movemask_epi8(eq) != 0xffff) {
+            return 0;
+        }
+    }
+
+    return ib_strops_caseeq_scalar(a + i, b + i, len - i);
+}
+
+/* -- AVX2 Kernels -- */
+
+/**
+ * @internal
+ * Whitespace mask of a 32 byte vector (AVX2).
+ */
+__attribute__((target("avx2")))
+static inline __m256i ib_strops_ws_avx2(__m256i v)
+{
+    __m256i ctl = _mm256_and_si256(
+        _mm256_cmpgt_epi8(v, _mm256_set1_epi8('\t' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('\r' + 1), v));
+
+    return _mm256_or_si256(ctl, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+}
+
+/**
+ * @internal
+ * Lowercase ASCII letters (AVX2).
+ */
+__attribute__((target("avx2")))
+static int ib_strops_lower_avx2(uint8_t *data,
+                                size_t dlen)
+{
+    const __m256i lo = _mm256_set1_epi8('A' - 1);
+    const __m256i hi = _mm256_set1_epi8('Z' + 1);
+    const __m256i bit = _mm256_set1_epi8(0x20);
+    int modified = 0;
+    size_t i = 0;
+
+    for (; i + 32 <= dlen; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i m = _mm256_and_si256(_mm256_cmpgt_epi8(v, lo),
+                                     _mm256_cmpgt_epi8(hi, v));
+
+        if (!_mm256_testz_si256(m, m)) {
+            v = _mm256_or_si256(v, _mm256_and_si256(m, bit));
+            _mm256_storeu_si256((__m256i *)(data + i), v);
+            modified = 1;
+        }
+    }
+
+    _mm256_zeroupper();
+    return ib_strops_lower_sse2(data + i, dlen - i) | modified;
+}
+
+/**
+ * @internal
+ * Count leading whitespace (AVX2).
+ */
+__attribute__((target("avx2")))
+static size_t ib_strops_wsleft_avx2(const uint8_t *data,
+                                    size_t dlen)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= dlen; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        uint32_t m = ~(uint32_t)_mm256_movemask_epi8(ib_strops_ws_avx2(v));
+
+        if (m != 0) {
+            return i + __builtin_ctz(m);
+        }
+    }
+
+    _mm256_zeroupper();
+    return i + ib_strops_wsleft_sse2(data + i, dlen - i);
+}
+
+/**
+ * @internal
+ * Length without trailing whitespace (AVX2).
+ */
+__attribute__((target("avx2")))
+static size_t ib_strops_wsright_avx2(const uint8_t *data,
+                                     size_t dlen)
+{
+    size_t i = dlen;
+
+    for (; i >= 32; i -= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i - 32));
+        uint32_t m = ~(uint32_t)_mm256_movemask_epi8(ib_strops_ws_avx2(v));
+
+        if (m != 0) {
+            return i - 32 + (32 - __builtin_clz(m));
+        }
+    }
+
+    _mm256_zeroupper();
+    return ib_strops_wsright_sse2(data, i);
+}
+
+/**
+ * @internal
+ * Find the first byte in a set (AVX2).
+ */
+__attribute__((target("avx2")))
+static size_t ib_strops_find_any_avx2(const uint8_t *data,
+                                      size_t dlen,
+                                      const uint8_t *set,
+                                      size_t nset)
+{
+    __m256i vset[IB_STROPS_SET_MAX];
+    size_t i = 0;
+    size_t j;
+
+    for (j = 0; j < nset; j++) {
+        vset[j] = _mm256_set1_epi8((char)set[j]);
+    }
+
+    for (; i + 32 <= dlen; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i m = _mm256_cmpeq_epi8(v, vset[0]);
+        uint32_t bits;
+
+        for (j = 1; j < nset; j++) {
+            m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, vset[j]));
+        }
+        bits = (uint32_t)_mm256_movemask_epi8(m);
+        if (bits != 0) {
+            _mm256_zeroupper();
+            return i + __builtin_ctz(bits);
+        }
+    }
+
+    _mm256_zeroupper();
+    return i + ib_strops_find_any_sse2(data + i, dlen - i, set, nset);
+}
+
+/**
+ * @internal
+ * Find the first occurrence of a substring (AVX2).
+ */
+__attribute__((target("avx2")))
+static size_t ib_strops_find_avx2(const uint8_t *data,
+                                  size_t dlen,
+                                  const uint8_t *needle,
+                                  size_t nlen)
+{
+    const __m256i first = _mm256_set1_epi8((char)needle[0]);
+    const __m256i last = _mm256_set1_epi8((char)needle[nlen - 1]);
+    size_t i = 0;
+
+    for (; i + nlen - 1 + 32 <= dlen; i += 32) {
+        __m256i vf = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i vl = _mm256_loadu_si256(
+            (const __m256i *)(data + i + nlen - 1));
+        uint32_t bits = (uint32_t)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(vf, first),
+                             _mm256_cmpeq_epi8(vl, last)));
+
+        while (bits != 0) {
+            size_t pos = i + __builtin_ctz(bits);
+
+            if (memcmp(data + pos + 1, needle + 1, nlen - 1) == 0) {
+                _mm256_zeroupper();
+                return pos;
+            }
+            bits &= bits - 1;
+        }
+    }
+
+    _mm256_zeroupper();
+    return i + ib_strops_find_sse2(data + i, dlen - i, needle, nlen);
+}
+
+/**
+ * @internal
+ * Lowercase a 32 byte vector (AVX2).
+ */
+__attribute__((target("avx2")))
+static inline __m256i ib_strops_tolower_avx2(__m256i v)
+{
+    __m256i m = _mm256_and_si256(
+        _mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)),
+        _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+
+    return _mm256_or_si256(v, _mm256_and_si256(m, _mm256_set1_epi8(0x20)));
+}
+
+/**
+ * @internal
+ * Compare ignoring ASCII case (AVX2).
+ */
+__attribute__((target("avx2")))
+static int ib_strops_caseeq_avx2(const uint8_t *a,
+                                 const uint8_t *b,
+                                 size_t len)
+{
+    size_t i = 0;
+
+    for (; i + 32 <= len; i += 32) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+        __m256i vb = _mm256_loadu_si256((const __m256i *)(b + i));
+        __m256i eq = _mm256_cmpeq_epi8(ib_strops_tolower_avx2(va),
+                                       ib_strops_tolower_avx2(vb));
+
+        if ((uint32_t)_mm256_movemask_epi8(eq) != 0xffffffff) {
+            _mm256_zeroupper();
+            return 0;
+        }
+    }
+
+    _mm256_zeroupper();
+    return ib_strops_caseeq_sse2(a + i, b + i, len - i);
+}
+
+
+/* -- AVX-512 Kernels -- */
+
+/**
+ * @internal
+ * Lowercase ASCII letters (AVX-512BW).
+ */
+__attribute__((target("avx512f,avx512bw")))
+static int ib_strops_lower_avx512(uint8_t *data,
+                                  size_t dlen)
+{
+    const __m512i lo = _mm512_set1_epi8('A');
+    const __m512i range = _mm512_set1_epi8(26);
+    const __m512i bit = _mm512_set1_epi8(0x20);
+    int modified = 0;
+    size_t i = 0;
+
+    for (; i + 64 <= dlen; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(data + i));
+        __mmask64 m = _mm512_cmplt_epu8_mask(_mm512_sub_epi8(v, lo), range);
+
+        if (m != 0) {
+            v = _mm512_mask_add_epi8(v, m, v, bit);
+            _mm512_storeu_si512((void *)(data + i), v);
+            modified = 1;
+        }
+    }
+
+    _mm256_zeroupper();
+    return ib_strops_lower_sse2(data + i, dlen - i) | modified;
+}
+
+/**
+ * @internal
+ * Find the first byte in a set (AVX-512BW).
+ */
+__attribute__((target("avx512f,avx512bw")))
+static size_t ib_strops_find_any_avx512(const uint8_t *data,
+                                        size_t dlen,
+                                        const uint8_t *set,
+                                        size_t nset)
+{
+    __m512i vset[IB_STROPS_SET_MAX];
+    size_t i = 0;
+    size_t j;
+
+    for (j = 0; j < nset; j++) {
+        vset[j] = _mm512_set1_epi8((char)set[j]);
+    }
+
+    for (; i + 64 <= dlen; i += 64) {
+        __m512i v = _mm512_loadu_si512((const void *)(data + i));
+        __mmask64 m = _mm512_cmpeq_epi8_mask(v, vset[0]);
+
+        for (j = 1; j < nset; j++) {
+            m |= _mm512_cmpeq_epi8_mask(v, vset[j]);
+        }
+        if (m != 0) {
+            _mm256_zeroupper();
+            return i + __builtin_ctzll(m);
+        }
+    }
+
+    _mm256_zeroupper();
+    return i + ib_strops_find_any_sse2(data + i, dlen - i, set, nset);
+}
+
+#endif /* IB_STROPS_X86 */
+
+
+/* -- Kernel Selection -- */
+
+/**
+ * @internal
+ * Selected kernels.
+ */
+static struct {
+    int    (*lower)(uint8_t *, size_t);
+    size_t (*wsleft)(const uint8_t *, size_t);
+    size_t (*wsright)(const uint8_t *, size_t);
+    size_t (*find_any)(const uint8_t *, size_t, const uint8_t *, size_t);
+    size_t (*find)(const uint8_t *, size_t, const uint8_t *, size_t);
+    int    (*caseeq)(const uint8_t *, const uint8_t *, size_t);
+}
+#ifdef IB_STROPS_X86
+/* Baseline until ib_strops_select() is first called. */
+ib_strops_kernel = {
+    ib_strops_lower_sse2,
+    ib_strops_wsleft_sse2,
+    ib_strops_wsright_sse2,
+    ib_strops_find_any_sse2,
+    ib_strops_find_sse2,
+    ib_strops_caseeq_sse2
+};
+#else
+ib_strops_kernel = {
+    ib_strops_lower_scalar,
+    ib_strops_wsleft_scalar,
+    ib_strops_wsright_scalar,
+    ib_strops_find_any_scalar,
+    ib_strops_find_scalar,
+    ib_strops_caseeq_scalar
+};
+#endif
+
+/**
+ * @internal
+ * CPU features the kernels were selected for (none selected yet).
+ */
+static ib_flags_t ib_strops_features = ~(ib_flags_t)0;
+
+/**
+ * @internal
+ * Select the kernels for a set of CPU features.
+ *
+ * @param features CPU features (IB_CPU_*)
+ */
+static void ib_strops_select(ib_flags_t features)
+{
+#ifdef IB_STROPS_X86
+    if (features & IB_CPU_AVX2) {
+        ib_strops_kernel.lower = ib_strops_lower_avx2;
+        ib_strops_kernel.wsleft = ib_strops_wsleft_avx2;
+        ib_strops_kernel.wsright = ib_strops_wsright_avx2;
+        ib_strops_kernel.find_any = ib_strops_find_any_avx2;
+        ib_strops_kernel.find = ib_strops_find_avx2;
+        ib_strops_kernel.caseeq = ib_strops_caseeq_avx2;
+    }
+    else {
+        ib_strops_kernel.lower = ib_strops_lower_sse2;
+        ib_strops_kernel.wsleft = ib_strops_wsleft_sse2;
+        ib_strops_kernel.wsright = ib_strops_wsright_sse2;
+        ib_strops_kernel.find_any = ib_strops_find_any_sse2;
+        ib_strops_kernel.find = ib_strops_find_sse2;
+        ib_strops_kernel.caseeq = ib_strops_caseeq_sse2;
+    }
+    if (features & IB_CPU_AVX512BW) {
+        ib_strops_kernel.lower = ib_strops_lower_avx512;
+        ib_strops_kernel.find_any = ib_strops_find_any_avx512;
+    }
+#endif
+    ib_strops_features = features;
+}
+
+/**
+ * @internal
+ * Select the kernels if the active CPU features have changed.
+ */
+#define IB_STROPS_SELECT() \
+    do { \
+        ib_flags_t ib_strops_f = ib_cpu_features(); \
+        if (ib_strops_f != ib_strops_features) { \
+            ib_strops_select(ib_strops_f); \
+        } \
+    } while (0)
+
+
+/* -- Public API -- */
+
+int ib_strops_lower(uint8_t *data,
+                    size_t dlen)
+{
+    IB_STROPS_SELECT();
+
+    return ib_strops_kernel.lower(data, dlen);
+}
+
+size_t ib_strops_wsleft(const uint8_t *data,
+                        size_t dlen)
+{
+    IB_STROPS_SELECT();
+
+    return ib_strops_kernel.wsleft(data, dlen);
+}
+
+size_t ib_strops_wsright(const uint8_t *data,
+                         size_t dlen)
+{
+    IB_STROPS_SELECT();
+
+    return ib_strops_kernel.wsright(data, dlen);
+}
+
+size_t ib_strops_find_any(const uint8_t *data,
+                          size_t dlen,
+                          const char *set,
+                          size_t nset)
+{
+    if (nset == 0) {
+        return dlen;
+    }
+    if (nset > IB_STROPS_SET_MAX) {
+        return ib_strops_find_any_scalar(data, dlen,
+                                         (const uint8_t *)set, nset);
+    }
+
+    IB_STROPS_SELECT();
+
+    return ib_strops_kernel.find_any(data, dlen, (const uint8_t *)set, nset);
+}
+
+size_t ib_strops_find(const uint8_t *data,
+                      size_t dlen,
+                      const char *needle,
+                      size_t nlen)
+{
+    if (nlen == 0) {
+        return 0;
+    }
+    if (nlen > dlen) {
+        return dlen;
+    }
+
+    IB_STROPS_SELECT();
+
+    return ib_strops_kernel.find(data, dlen, (const uint8_t *)needle, nlen);
+}
+
+int ib_strops_caseeq(const uint8_t *a,
+                     const uint8_t *b,
+                     size_t len)
+{
+    IB_STROPS_SELECT();
+
+    return ib_strops_kernel.caseeq(a, b, len);
+}